@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+// DictValue microbenchmark against the std::unordered_map it replaced, reports ms per phase.
+//
+//   g++ -O2 -std=c++20 bench_dict.cpp vm_dict.cpp vm_value.cpp vm_list.cpp -o bench_dict
+//
+// Usage: bench_dict [entries]
+
+#include "vm_value.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace steve::VM;
+
+namespace {
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Insert every key, look each one up twice, then sum over an iteration. The checksum keeps
+// the work observable and must match between the two containers.
+template <typename Insert, typename Lookup, typename Iterate>
+void run(const char* name, Insert insert, Lookup lookup, Iterate iterate, size_t count) {
+    auto start = std::chrono::steady_clock::now();
+    insert();
+    double insertMs = elapsedMs(start);
+    start = std::chrono::steady_clock::now();
+    int64_t sum = lookup() + lookup();
+    double lookupMs = elapsedMs(start);
+    start = std::chrono::steady_clock::now();
+    sum += iterate();
+    double iterateMs = elapsedMs(start);
+    std::printf("%-24s insert %8.2f ms  lookup %8.2f ms  iterate %7.2f ms  (%zu entries, checksum %lld)\n",
+        name, insertMs, lookupMs, iterateMs, count, static_cast<long long>(sum));
+}
+
+template <typename Key>
+void compare(const char* keyName, const std::vector<Key>& keys, const std::vector<Value>& keyValues) {
+    size_t count = keys.size();
+    std::string label = std::string(keyName) + " DictValue";
+    {
+        DictValue dict;
+        run(label.c_str(),
+            [&] { for (size_t i = 0; i < count; i++) dict.set(keyValues[i], Value(static_cast<int>(i))); },
+            [&] { int64_t s = 0; for (const Value& key : keyValues) s += dict.find(key)->get<int>(); return s; },
+            [&] { int64_t s = 0; dict.forEach([&](const Value&, const Value& v) { s += v.get<int>(); }); return s; },
+            count);
+    }
+    label = std::string(keyName) + " unordered_map";
+    {
+        std::unordered_map<Key, Value> map;
+        run(label.c_str(),
+            [&] { for (size_t i = 0; i < count; i++) map[keys[i]] = Value(static_cast<int>(i)); },
+            [&] { int64_t s = 0; for (const Key& key : keys) s += map.find(key)->second.template get<int>(); return s; },
+            [&] { int64_t s = 0; for (const auto& pair : map) s += pair.second.template get<int>(); return s; },
+            count);
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+
+    // Scattered ints, as dictionary keys usually are ids rather than 0..n
+    std::vector<int64_t> ints;
+    std::vector<Value> intValues;
+    for (size_t i = 0; i < count; i++) {
+        ints.push_back(static_cast<int64_t>(i * 2654435761u % 1000000007u));
+        intValues.push_back(Value(ints.back()));
+    }
+    compare("int", ints, intValues);
+
+    std::vector<std::string> strings;
+    std::vector<Value> stringValues;
+    for (size_t i = 0; i < count; i++) {
+        strings.push_back("key_" + std::to_string(i * 7919));
+        stringValues.push_back(Value(strings.back()));
+    }
+    compare("string", strings, stringValues);
+    return 0;
+}
@@ -0,0 +1,2052 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+// Interpreter dispatch, call, string, list and exception microbenchmark, reports instructions/second.
+//
+// The dispatch strategy is chosen at build time, so build this twice and compare:
+//   g++ -O2 -std=c++20 bench_dispatch.cpp vm.cpp vm_value.cpp vm_dict.cpp vm_list.cpp vm_intern.cpp vm_register.cpp vm_bytecode.cpp vm_gc.cpp vm_jit.cpp vm_jit_ir.cpp vm_codeheap.cpp language.cpp gc.cpp mem.cpp -o bench_threaded
+//   g++ -O2 -std=c++20 -DSTEVE_THREADED_DISPATCH=0 <same sources> -o bench_switch
+//
+// Usage: bench_dispatch [--no-fuse] [--register] [--jit] [--osr] [--baseline] [--verify] [--profile] [program.sir|program.stb ...]
+// Without programs the built-in ones below are measured.
+//   --no-fuse  load without superinstructions (instruction counts then match the IR)
+//   --register run on the register tier, instruction counts are register instructions
+//   --jit      run on the JIT, instruction counts are those of the interpreter, then print the
+//              tier-ups, deoptimizations and machine code size
+//   --osr      like --jit, but interpret and only move hot WHILE loops to the JIT (on-stack
+//              replacement), then print the loops compiled and the entries into them
+//   --baseline with --jit, --osr or --verify, keep the JIT on its baseline tier
+//   --verify   run every program (the built-in ones plus VERIFY_PROGRAMS) once on the interpreter
+//              and once on the JIT and compare output, errors, result, globals and stack, and
+//              the output a program expects; with --osr the second run uses on-stack replacement
+//   --profile  print the most frequent opcode sequences as SUPERINSTRUCTION_PATTERNS rows,
+//              needs a build with -DSTEVE_PROFILE_OPCODES=1
+
+#include "vm.h"
+#include "vm_jit.h"
+#include "vm_superinstructions.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchProgram {
+    const char* name;
+    const char* ir;
+    const char* expected = nullptr;  // Output --verify also requires, nullptr to only compare the two runs
+};
+
+// Nested WHILE loops with arithmetic, comparisons and IF/ELSE
+const char* const LOOP_IR = R"(# IR BEGIN
+DEFVAR i
+DEFVAR j
+DEFVAR n
+LOAD 0
+STORE i
+LOAD i
+LOAD 1000
+BINARY_OP <
+WHILE
+  LOAD 0
+  STORE j
+  LOAD j
+  LOAD 1000
+  BINARY_OP <
+  WHILE
+    LOAD j
+    LOAD 2
+    BINARY_OP %
+    LOAD 0
+    BINARY_OP ==
+    IF
+      LOAD n
+      LOAD 1
+      BINARY_OP +
+      STORE n
+    ELSE
+      LOAD n
+      LOAD 2
+      BINARY_OP -
+      STORE n
+    END
+    LOAD j
+    LOAD 1
+    BINARY_OP +
+    STORE j
+  END
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+# IR END
+)";
+
+// LABEL/GOTO counting loop
+const char* const GOTO_IR = R"(# IR BEGIN
+DEFVAR k
+LOAD 0
+STORE k
+LABEL top
+LOAD k
+LOAD 1
+BINARY_OP +
+STORE k
+LOAD k
+LOAD 2000000
+BINARY_OP <
+IF
+  GOTO top
+END
+# IR END
+)";
+
+// Running sum of two variables
+const char* const SUM_IR = R"(# IR BEGIN
+DEFVAR s
+DEFVAR i
+LOAD 0
+STORE s
+LOAD 0
+STORE i
+LOAD i
+LOAD 2000000
+BINARY_OP <
+WHILE
+  LOAD s
+  LOAD i
+  BINARY_OP +
+  STORE s
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+# IR END
+)";
+
+// Doubly recursive fib(25), one frame push/pop per call
+const char* const FIB_IR = R"(# IR BEGIN
+FUNC fib n
+LOAD n
+LOAD 2
+BINARY_OP <
+IF
+  LOAD n
+  RETURN
+END
+LOAD n
+LOAD 1
+BINARY_OP -
+CALL fib
+LOAD n
+LOAD 2
+BINARY_OP -
+CALL fib
+BINARY_OP +
+RETURN
+END
+LOAD 25
+CALL fib
+POP
+# IR END
+)";
+
+// Ackermann(2, 500), deep and uneven recursion with two arguments
+const char* const ACK_IR = R"(# IR BEGIN
+FUNC ack m n
+LOAD m
+LOAD 0
+BINARY_OP ==
+IF
+  LOAD n
+  LOAD 1
+  BINARY_OP +
+  RETURN
+END
+LOAD n
+LOAD 0
+BINARY_OP ==
+IF
+  LOAD m
+  LOAD 1
+  BINARY_OP -
+  LOAD 1
+  CALL ack
+  RETURN
+END
+LOAD m
+LOAD 1
+BINARY_OP -
+LOAD m
+LOAD n
+LOAD 1
+BINARY_OP -
+CALL ack
+CALL ack
+RETURN
+END
+LOAD 2
+LOAD 500
+CALL ack
+POP
+# IR END
+)";
+
+// Appends a 10-byte piece 1048576 times to build a 10 MB string, then hashes it (one flatten)
+const char* const STRING_IR = R"(# IR BEGIN
+DEFVAR s
+DEFVAR i
+LOAD ""
+STORE s
+LOAD 0
+STORE i
+LOAD i
+LOAD 1048576
+BINARY_OP <
+WHILE
+  LOAD s
+  LOAD "0123456789"
+  BINARY_OP +
+  STORE s
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD s
+CALL hash 1
+POP
+# IR END
+)";
+
+// Appends 1000000 items to a list with x = append(x, i), then takes its length
+const char* const LIST_IR = R"(# IR BEGIN
+DEFVAR xs
+DEFVAR i
+CALL list 0
+STORE xs
+LOAD 0
+STORE i
+LOAD i
+LOAD 1000000
+BINARY_OP <
+WHILE
+  LOAD xs
+  LOAD i
+  CALL append 2
+  STORE xs
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD xs
+CALL len 1
+POP
+# IR END
+)";
+
+// Builds a 100000 int list, then runs list_sum, list_dot and list_mul over it 1000 times
+const char* const LIST_BULK_IR = R"(# IR BEGIN
+DEFVAR xs
+DEFVAR i
+DEFVAR total
+CALL list 0
+STORE xs
+LOAD 0
+STORE i
+LOAD i
+LOAD 100000
+BINARY_OP <
+WHILE
+  LOAD xs
+  LOAD i
+  CALL append 2
+  STORE xs
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD 0
+STORE i
+LOAD 0
+STORE total
+LOAD i
+LOAD 1000
+BINARY_OP <
+WHILE
+  LOAD xs
+  CALL list_sum 1
+  LOAD xs
+  LOAD xs
+  CALL list_dot 2
+  BINARY_OP +
+  LOAD xs
+  LOAD 3
+  CALL list_mul 2
+  CALL list_sum 1
+  BINARY_OP +
+  STORE total
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+# IR END
+)";
+
+// Triangular nested loop over 2000 rows: CONTINUE skips every third column, BREAK leaves a row at the diagonal
+const char* const LOOP_CONTROL_IR = R"(# IR BEGIN
+DEFVAR i
+DEFVAR j
+DEFVAR n
+LOAD 0
+STORE i
+LOAD i
+LOAD 2000
+BINARY_OP <
+WHILE
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD 0
+  STORE j
+  LOAD 1
+  WHILE
+    LOAD j
+    LOAD 1
+    BINARY_OP +
+    STORE j
+    LOAD j
+    LOAD i
+    BINARY_OP >
+    IF
+      BREAK
+    END
+    LOAD j
+    LOAD 3
+    BINARY_OP %
+    LOAD 0
+    BINARY_OP ==
+    IF
+      CONTINUE
+    END
+    LOAD n
+    LOAD j
+    BINARY_OP +
+    STORE n
+  END
+END
+# IR END
+)";
+
+// 1000000 TRY blocks, every other one throws from a function two frames down and catches the value
+const char* const THROW_IR = R"(# IR BEGIN
+DEFVAR i
+DEFVAR caught
+FUNC check n
+  LOAD n
+  LOAD 2
+  BINARY_OP %
+  IF
+    LOAD n
+    THROW
+  END
+  LOAD n
+  RETURN
+END
+FUNC work n
+  LOAD n
+  CALL check 1
+  RETURN
+END
+LOAD 0
+STORE i
+LOAD i
+LOAD 1000000
+BINARY_OP <
+WHILE
+  TRY
+    LOAD i
+    CALL work 1
+    POP
+  CATCH e
+    LOAD caught
+    LOAD 1
+    BINARY_OP +
+    STORE caught
+  END
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+# IR END
+)";
+
+// Differential coverage for --verify: GOTO, nested IF/ELSE, BREAK/CONTINUE, strings, unary operators, top-level RETURN
+const char* const VERIFY_CONTROL_IR = R"(# IR BEGIN
+DEFVAR i
+DEFVAR s
+LOAD 0
+STORE i
+LOAD ""
+STORE s
+LABEL again
+LOAD i
+LOAD 3
+BINARY_OP %
+LOAD 0
+BINARY_OP ==
+IF
+  LOAD s
+  LOAD "f"
+  BINARY_OP +
+  STORE s
+ELSE
+  LOAD i
+  LOAD 2
+  BINARY_OP %
+  IF
+    LOAD s
+    LOAD i
+    BINARY_OP +
+    STORE s
+  END
+END
+LOAD i
+LOAD 1
+BINARY_OP +
+STORE i
+LOAD i
+LOAD 20
+BINARY_OP <
+IF
+  GOTO again
+END
+LOAD s
+PRINT
+LOAD 0
+STORE i
+LOAD 1
+WHILE
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD i
+  LOAD 4
+  BINARY_OP ==
+  IF
+    CONTINUE
+  END
+  LOAD i
+  PRINT
+  LOAD i
+  LOAD 6
+  BINARY_OP >=
+  IF
+    BREAK
+  END
+END
+LOAD i
+UNARY_OP -
+PRINT
+LOAD 0
+UNARY_OP not
+PRINT
+LOAD 1
+RETURN
+LOAD "unreachable"
+PRINT
+# IR END
+)";
+
+// Differential coverage for --verify: recursion deeper than the JIT's native call limit, built-ins,
+// VM errors and THROW caught across frames, and an uncaught error at the end
+const char* const VERIFY_CALLS_IR = R"(# IR BEGIN
+FUNC down n
+  LOAD n
+  LOAD 0
+  BINARY_OP ==
+  IF
+    LOAD 0
+    RETURN
+  END
+  LOAD n
+  LOAD 1
+  BINARY_OP -
+  CALL down 1
+  LOAD 1
+  BINARY_OP +
+  RETURN
+END
+FUNC divide a b
+  LOAD a
+  LOAD b
+  BINARY_OP /
+  RETURN
+END
+FUNC nothrow
+  TRY
+    LOAD "inner"
+    THROW
+  CATCH e
+    LOAD e
+    PRINT
+  END
+  LOAD "after"
+  RETURN
+END
+LOAD 3000
+CALL down 1
+PRINT
+TRY
+  LOAD 1
+  LOAD 0
+  CALL divide 2
+  PRINT
+CATCH e
+  LOAD e
+  PRINT
+END
+TRY
+  LOAD "thrown"
+  THROW
+CATCH
+  LOAD "caught"
+  PRINT
+END
+CALL nothrow 0
+PRINT
+CALL list 0
+LOAD 7
+CALL append 2
+LOAD 8
+CALL append 2
+CALL len 1
+PRINT
+LOAD 1
+LOAD 0
+CALL divide 2
+PRINT
+# IR END
+)";
+
+// Differential coverage for the optimizing tier: hot loops whose guards fail part way through (a
+// variable turning into a double and then a string, division by zero caught in the loop, products
+// too wide to store inline), booleans stored and branched on, and a hot function given a double
+const char* const VERIFY_SPECULATION_IR = R"(# IR BEGIN
+FUNC half n
+  LOAD n
+  LOAD 2
+  BINARY_OP /
+  RETURN
+END
+DEFVAR i
+DEFVAR x
+DEFVAR w
+DEFVAR r
+DEFVAR y
+DEFVAR z
+DEFVAR s
+DEFVAR q
+DEFVAR p
+DEFVAR even
+DEFVAR count
+LOAD 1
+STORE w
+LOAD 1
+STORE s
+LOAD i
+LOAD 5000
+BINARY_OP <
+WHILE
+  LOAD x
+  LOAD i
+  BINARY_OP +
+  STORE x
+  LOAD y
+  STORE z
+  LOAD i
+  LOAD 700
+  BINARY_OP %
+  LOAD 699
+  BINARY_OP ==
+  IF
+    LOAD w
+    STORE x
+    LOAD w
+    LOAD 0.5
+    BINARY_OP *
+    STORE w
+    LOAD s
+    STORE y
+    LOAD "str"
+    STORE s
+  END
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD x
+PRINT
+LOAD z
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE q
+LOAD i
+LOAD 3000
+BINARY_OP <
+WHILE
+  TRY
+    LOAD 100
+    LOAD i
+    LOAD 7
+    BINARY_OP %
+    BINARY_OP /
+    LOAD q
+    BINARY_OP +
+    STORE q
+  CATCH
+    LOAD q
+    LOAD 1
+    BINARY_OP -
+    STORE q
+  END
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD q
+PRINT
+LOAD 0
+STORE i
+LOAD 1
+STORE p
+LOAD i
+LOAD 3000
+BINARY_OP <
+WHILE
+  LOAD p
+  LOAD 100003
+  BINARY_OP *
+  LOAD 2000000011
+  BINARY_OP %
+  STORE p
+  LOAD p
+  LOAD p
+  BINARY_OP *
+  STORE r
+  LOAD i
+  LOAD 2
+  BINARY_OP %
+  LOAD 0
+  BINARY_OP ==
+  STORE even
+  LOAD even
+  IF
+    LOAD i
+    LOAD 3
+    BINARY_OP %
+    LOAD i
+    LOAD 5
+    BINARY_OP %
+    BINARY_OP and
+    IF
+      LOAD count
+      LOAD 1
+      BINARY_OP +
+      STORE count
+    END
+  END
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD p
+PRINT
+LOAD r
+PRINT
+LOAD even
+PRINT
+LOAD count
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE q
+LOAD i
+LOAD 2000
+BINARY_OP <
+WHILE
+  LOAD q
+  LOAD i
+  LOAD 0
+  LOAD 7
+  BINARY_OP -
+  BINARY_OP -
+  CALL half 1
+  BINARY_OP +
+  STORE q
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD q
+PRINT
+LOAD 7.5
+CALL half 1
+PRINT
+LOAD q
+LOAD 0
+BINARY_OP /
+PRINT
+# IR END
+)";
+
+// Differential coverage for loop variables kept in registers: a hot function loop entered once with a
+// double, a sum growing too wide to store inline, a variable overwritten while its old value is on the
+// stack, a branch first taken after optimization, BREAK and GOTO out of loops, enough variables to
+// spill, and division by zero part way through
+const char* const VERIFY_REGISTERS_IR = R"(# IR BEGIN
+FUNC sum n start
+  DEFVAR s
+  DEFVAR k
+  LOAD start
+  STORE s
+  LOAD 0
+  STORE k
+  LOAD k
+  LOAD n
+  BINARY_OP <
+  WHILE
+    LOAD s
+    LOAD k
+    BINARY_OP +
+    STORE s
+    LOAD k
+    LOAD 1
+    BINARY_OP +
+    STORE k
+  END
+  LOAD s
+  RETURN
+END
+DEFVAR i
+DEFVAR t
+DEFVAR p
+DEFVAR a
+DEFVAR b
+DEFVAR c
+DEFVAR d
+DEFVAR e
+DEFVAR f
+DEFVAR g
+DEFVAR h
+DEFVAR q
+LOAD 0
+STORE i
+LOAD 0
+STORE t
+LOAD i
+LOAD 300
+BINARY_OP <
+WHILE
+  LOAD t
+  LOAD 20
+  LOAD i
+  CALL sum 2
+  BINARY_OP +
+  STORE t
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD t
+PRINT
+LOAD 20
+LOAD 0.5
+CALL sum 2
+PRINT
+LOAD 0
+STORE i
+LOAD 1
+STORE p
+LOAD i
+LOAD 2000
+BINARY_OP <
+WHILE
+  LOAD p
+  LOAD 100000
+  LOAD 1000000
+  BINARY_OP *
+  BINARY_OP +
+  STORE p
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD p
+PRINT
+LOAD i
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE a
+LOAD 0
+STORE b
+LOAD i
+LOAD 3000
+BINARY_OP <
+WHILE
+  LOAD a
+  LOAD a
+  LOAD 1
+  BINARY_OP +
+  STORE a
+  LOAD b
+  BINARY_OP +
+  STORE b
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD a
+PRINT
+LOAD b
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE c
+LOAD 1
+WHILE
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD c
+  LOAD i
+  LOAD 3
+  BINARY_OP %
+  BINARY_OP +
+  STORE c
+  LOAD i
+  LOAD 2500
+  BINARY_OP ==
+  IF
+    LOAD c
+    LOAD 1000000
+    BINARY_OP +
+    STORE c
+  END
+  LOAD i
+  LOAD 4000
+  BINARY_OP >=
+  IF
+    BREAK
+  END
+END
+LOAD i
+PRINT
+LOAD c
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE d
+LOAD i
+LOAD 100000
+BINARY_OP <
+WHILE
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD d
+  LOAD 2
+  BINARY_OP +
+  STORE d
+  LOAD d
+  LOAD 5000
+  BINARY_OP >
+  IF
+    GOTO out
+  END
+END
+LABEL out
+LOAD i
+PRINT
+LOAD d
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE a
+LOAD 0
+STORE b
+LOAD 0
+STORE c
+LOAD 0
+STORE d
+LOAD 0
+STORE e
+LOAD 0
+STORE f
+LOAD 0
+STORE g
+LOAD 0
+STORE h
+LOAD i
+LOAD 3000
+BINARY_OP <
+WHILE
+  LOAD a
+  LOAD 1
+  BINARY_OP +
+  STORE a
+  LOAD b
+  LOAD a
+  BINARY_OP +
+  STORE b
+  LOAD c
+  LOAD b
+  LOAD 7
+  BINARY_OP %
+  BINARY_OP +
+  STORE c
+  LOAD d
+  LOAD c
+  BINARY_OP +
+  STORE d
+  LOAD e
+  LOAD d
+  LOAD 11
+  BINARY_OP %
+  BINARY_OP +
+  STORE e
+  LOAD f
+  LOAD e
+  BINARY_OP +
+  STORE f
+  LOAD g
+  LOAD f
+  LOAD 13
+  BINARY_OP %
+  BINARY_OP +
+  STORE g
+  LOAD h
+  LOAD g
+  LOAD 5
+  BINARY_OP %
+  BINARY_OP +
+  LOAD a
+  LOAD b
+  LOAD c
+  BINARY_OP -
+  BINARY_OP *
+  LOAD 1000
+  BINARY_OP %
+  BINARY_OP -
+  STORE h
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD a
+PRINT
+LOAD b
+PRINT
+LOAD c
+PRINT
+LOAD d
+PRINT
+LOAD e
+PRINT
+LOAD f
+PRINT
+LOAD g
+PRINT
+LOAD h
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE q
+LOAD i
+LOAD 3000
+BINARY_OP <
+WHILE
+  LOAD q
+  LOAD 1000
+  LOAD 2999
+  LOAD i
+  BINARY_OP -
+  BINARY_OP /
+  BINARY_OP +
+  STORE q
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD q
+PRINT
+# IR END
+)";
+
+const BenchProgram BUILTIN_PROGRAMS[] = {
+    { "nested-loop", LOOP_IR },
+    { "goto-loop", GOTO_IR },
+    { "loop-control", LOOP_CONTROL_IR },
+    { "sum-loop", SUM_IR },
+    { "fib", FIB_IR },
+    { "ackermann", ACK_IR },
+    { "string-build", STRING_IR },
+    { "list-append", LIST_IR },
+    { "list-bulk", LIST_BULK_IR },
+    { "throw-catch", THROW_IR },
+};
+
+// Differential coverage for on-stack replacement (--verify --osr): a hot loop calling a function on
+// every iteration with a value left on the operand stack below it, a hot loop in a function called
+// again once compiled, a RETURN out of a compiled loop, an inner loop compiled before its outer loop,
+// a THROW and a BREAK leaving compiled loops, and a variable turning into a double
+const char* const VERIFY_OSR_IR = R"(# IR BEGIN
+FUNC step n
+  LOAD n
+  LOAD 3
+  BINARY_OP %
+  RETURN
+END
+FUNC countdown n
+  DEFVAR total
+  LOAD 0
+  STORE total
+  LOAD n
+  LOAD 0
+  BINARY_OP >
+  WHILE
+    LOAD total
+    LOAD n
+    BINARY_OP +
+    STORE total
+    LOAD n
+    LOAD 1
+    BINARY_OP -
+    STORE n
+  END
+  LOAD total
+  RETURN
+END
+FUNC find limit
+  DEFVAR k
+  LOAD 0
+  STORE k
+  LOAD 1
+  WHILE
+    LOAD k
+    LOAD k
+    BINARY_OP *
+    LOAD limit
+    BINARY_OP >
+    IF
+      LOAD k
+      RETURN
+    END
+    LOAD k
+    LOAD 1
+    BINARY_OP +
+    STORE k
+  END
+  LOAD -1
+  RETURN
+END
+DEFVAR i
+DEFVAR j
+DEFVAR sum
+DEFVAR inner
+LOAD "kept"
+LOAD 0
+STORE i
+LOAD i
+LOAD 3000
+BINARY_OP <
+WHILE
+  LOAD sum
+  LOAD i
+  CALL step 1
+  BINARY_OP +
+  STORE sum
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD sum
+PRINT
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE sum
+LOAD i
+LOAD 5
+BINARY_OP <
+WHILE
+  LOAD 1500
+  CALL countdown 1
+  LOAD sum
+  BINARY_OP +
+  STORE sum
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD sum
+PRINT
+LOAD 3000000
+CALL find 1
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE sum
+LOAD i
+LOAD 40
+BINARY_OP <
+WHILE
+  LOAD 0
+  STORE j
+  LOAD j
+  LOAD 100
+  BINARY_OP <
+  WHILE
+    LOAD inner
+    LOAD 1
+    BINARY_OP +
+    STORE inner
+    LOAD j
+    LOAD 1
+    BINARY_OP +
+    STORE j
+  END
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+END
+LOAD inner
+PRINT
+LOAD 0
+STORE i
+TRY
+  LOAD 1
+  WHILE
+    LOAD i
+    LOAD 1
+    BINARY_OP +
+    STORE i
+    LOAD i
+    LOAD 2500
+    BINARY_OP ==
+    IF
+      LOAD "stop"
+      THROW
+    END
+  END
+CATCH e
+  LOAD e
+  PRINT
+END
+LOAD i
+PRINT
+LOAD 0
+STORE i
+LOAD 1
+WHILE
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD i
+  LOAD 1800
+  BINARY_OP >=
+  IF
+    BREAK
+  END
+END
+LOAD i
+PRINT
+LOAD 0
+STORE i
+LOAD i
+LOAD 1200
+BINARY_OP <
+WHILE
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD i
+  LOAD 1100
+  BINARY_OP ==
+  IF
+    LOAD 1.5
+    STORE sum
+  END
+  LOAD sum
+  LOAD 2
+  BINARY_OP *
+  STORE sum
+END
+LOAD sum
+PRINT
+LOAD i
+LOAD 0
+BINARY_OP /
+PRINT
+# IR END
+)";
+
+// Regression for in-place built-ins (xs = list_fill(xs) and the like): the variable is released
+// before the call, an error caught around it must leave the variable holding its list
+const char* const VERIFY_IN_PLACE_IR = R"(# IR BEGIN
+DEFVAR xs
+CALL list 0
+STORE xs
+LOAD xs
+LOAD 1
+CALL append 2
+STORE xs
+LOAD xs
+LOAD 2
+CALL append 2
+STORE xs
+TRY
+  LOAD xs
+  CALL list_fill 1
+  STORE xs
+CATCH e
+  LOAD e
+  PRINT
+END
+LOAD xs
+CALL len 1
+PRINT
+LOAD xs
+LOAD 0
+CALL list_fill 2
+STORE xs
+LOAD xs
+CALL list_sum 1
+PRINT
+LOAD xs
+CALL len 1
+PRINT
+# IR END
+)";
+
+// BREAK and CONTINUE checked against known results: three nested loops leaving and restarting
+// each level (the outer one also by its condition), then the triangle of loop-control over 200
+// rows. A wrong jump target changes the iteration counts printed.
+const char* const VERIFY_LOOP_CONTROL_IR = R"(# IR BEGIN
+DEFVAR i
+DEFVAR j
+DEFVAR k
+DEFVAR outer
+DEFVAR inner
+DEFVAR deepest
+DEFVAR sum
+DEFVAR n
+LOAD 0
+STORE i
+LOAD i
+LOAD 30
+BINARY_OP <
+WHILE
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD i
+  LOAD 4
+  BINARY_OP %
+  LOAD 0
+  BINARY_OP ==
+  IF
+    CONTINUE
+  END
+  LOAD i
+  LOAD 25
+  BINARY_OP >
+  IF
+    BREAK
+  END
+  LOAD outer
+  LOAD 1
+  BINARY_OP +
+  STORE outer
+  LOAD 0
+  STORE j
+  LOAD j
+  LOAD 20
+  BINARY_OP <
+  WHILE
+    LOAD j
+    LOAD 1
+    BINARY_OP +
+    STORE j
+    LOAD j
+    LOAD 2
+    BINARY_OP %
+    IF
+      CONTINUE
+    END
+    LOAD j
+    LOAD i
+    BINARY_OP >
+    IF
+      BREAK
+    END
+    LOAD inner
+    LOAD 1
+    BINARY_OP +
+    STORE inner
+    LOAD 0
+    STORE k
+    LOAD 1
+    WHILE
+      LOAD k
+      LOAD 1
+      BINARY_OP +
+      STORE k
+      LOAD k
+      LOAD j
+      BINARY_OP >
+      IF
+        BREAK
+      END
+      LOAD k
+      LOAD 3
+      BINARY_OP ==
+      IF
+        CONTINUE
+      END
+      LOAD deepest
+      LOAD 1
+      BINARY_OP +
+      STORE deepest
+      LOAD sum
+      LOAD i
+      LOAD j
+      BINARY_OP *
+      LOAD k
+      BINARY_OP +
+      BINARY_OP +
+      STORE sum
+    END
+  END
+END
+LOAD i
+PRINT
+LOAD outer
+PRINT
+LOAD inner
+PRINT
+LOAD deepest
+PRINT
+LOAD sum
+PRINT
+LOAD 0
+STORE i
+LOAD i
+LOAD 200
+BINARY_OP <
+WHILE
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD 0
+  STORE j
+  LOAD 1
+  WHILE
+    LOAD j
+    LOAD 1
+    BINARY_OP +
+    STORE j
+    LOAD j
+    LOAD i
+    BINARY_OP >
+    IF
+      BREAK
+    END
+    LOAD j
+    LOAD 3
+    BINARY_OP %
+    LOAD 0
+    BINARY_OP ==
+    IF
+      CONTINUE
+    END
+    LOAD n
+    LOAD j
+    BINARY_OP +
+    STORE n
+  END
+END
+LOAD n
+PRINT
+# IR END
+)";
+
+// Integer edge cases checked against known results: INT64_MIN divided by -1 wraps and its
+// remainder is 0 instead of trapping, a hot loop overflows the multiply, add and divide, a
+// function loop optimized with a divisor of 3 deopts when it is called with -1, and list_div
+// wraps it alike in the typed kernel and the element-by-element fallback
+const char* const VERIFY_INT_EDGES_IR = R"(# IR BEGIN
+FUNC quot x d n
+  DEFVAR s
+  DEFVAR k
+  LOAD 0
+  STORE s
+  LOAD 0
+  STORE k
+  LOAD k
+  LOAD n
+  BINARY_OP <
+  WHILE
+    LOAD s
+    LOAD x
+    LOAD d
+    BINARY_OP /
+    BINARY_OP +
+    LOAD x
+    LOAD d
+    BINARY_OP %
+    BINARY_OP +
+    STORE s
+    LOAD k
+    LOAD 1
+    BINARY_OP +
+    STORE k
+  END
+  LOAD s
+  RETURN
+END
+DEFVAR m
+DEFVAR x
+DEFVAR s
+DEFVAR d
+DEFVAR i
+LOAD -2147483648
+LOAD -2147483648
+BINARY_OP *
+LOAD -2
+BINARY_OP *
+STORE m
+LOAD m
+LOAD -1
+BINARY_OP /
+PRINT
+LOAD m
+LOAD -1
+BINARY_OP %
+PRINT
+LOAD m
+UNARY_OP -
+PRINT
+LOAD m
+LOAD 1
+BINARY_OP -
+PRINT
+LOAD 1
+STORE x
+LOAD 0
+STORE s
+LOAD -1
+STORE d
+LOAD 0
+STORE i
+LOAD i
+LOAD 2000
+BINARY_OP <
+WHILE
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD x
+  LOAD 7
+  BINARY_OP *
+  LOAD i
+  BINARY_OP +
+  LOAD d
+  BINARY_OP /
+  STORE x
+  LOAD s
+  LOAD m
+  LOAD d
+  BINARY_OP /
+  BINARY_OP +
+  LOAD m
+  LOAD d
+  BINARY_OP %
+  BINARY_OP +
+  LOAD i
+  BINARY_OP +
+  STORE s
+  LOAD i
+  LOAD 2000
+  BINARY_OP <
+END
+LOAD x
+PRINT
+LOAD s
+PRINT
+LOAD 0
+STORE i
+LOAD 0
+STORE s
+LOAD i
+LOAD 300
+BINARY_OP <
+WHILE
+  LOAD s
+  LOAD i
+  LOAD 3
+  LOAD 20
+  CALL quot 3
+  BINARY_OP +
+  STORE s
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD i
+  LOAD 300
+  BINARY_OP <
+END
+LOAD s
+PRINT
+LOAD 7
+LOAD -1
+LOAD 5
+CALL quot 3
+PRINT
+LOAD m
+LOAD -1
+LOAD 3
+CALL quot 3
+PRINT
+LOAD m
+LOAD 6
+CALL list 2
+LOAD -1
+CALL list_div 2
+LOAD m
+CALL list_find 2
+PRINT
+LOAD m
+LOAD 6
+CALL list 2
+LOAD -1
+LOAD 1.5
+CALL list 2
+CALL list_div 2
+LOAD m
+CALL list_find 2
+PRINT
+LOAD m
+LOAD 1.5
+CALL list 2
+LOAD -1
+CALL list_div 2
+LOAD m
+CALL list_find 2
+PRINT
+LOAD m
+LOAD 6
+CALL list 2
+LOAD -1
+CALL list_div 2
+LOAD -6
+CALL list_find 2
+PRINT
+# IR END
+)";
+
+// Globals holding lists with strings in them, which the two VMs intern separately: a string
+// alone, strings after numbers, a rope, lists nested in a list, and strings appended in a hot loop
+const char* const VERIFY_STRING_LISTS_IR = R"(# IR BEGIN
+DEFVAR a
+DEFVAR b
+DEFVAR c
+DEFVAR d
+DEFVAR i
+LOAD "x"
+CALL list 1
+STORE a
+LOAD 1.5
+LOAD 2
+CALL list 2
+STORE b
+LOAD b
+LOAD "y"
+CALL append 2
+STORE b
+LOAD "ab"
+LOAD "cd"
+BINARY_OP +
+LOAD a
+LOAD b
+CALL list 3
+STORE c
+CALL list 0
+STORE d
+LOAD 0
+STORE i
+LOAD i
+LOAD 2000
+BINARY_OP <
+WHILE
+  LOAD d
+  LOAD "s"
+  CALL append 2
+  STORE d
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD i
+  LOAD 2000
+  BINARY_OP <
+END
+LOAD b
+CALL len 1
+PRINT
+LOAD c
+CALL len 1
+PRINT
+LOAD d
+LOAD "s"
+CALL list_find 2
+PRINT
+LOAD d
+CALL len 1
+PRINT
+# IR END
+)";
+
+// Integer literals beyond int decode as int64_t, also as constants of a hot loop, and only
+// beyond int64_t as double. Hex and inf are names, never set here, so they load as 0.
+const char* const VERIFY_LITERALS_IR = R"(# IR BEGIN
+DEFVAR s
+DEFVAR i
+LOAD 3000000000
+LOAD 1
+BINARY_OP +
+PRINT
+LOAD 9007199254740993
+PRINT
+LOAD -9223372036854775808
+PRINT
+LOAD 99999999999999999999
+PRINT
+LOAD 0x10
+PRINT
+LOAD -inf
+PRINT
+LOAD 0
+STORE s
+LOAD 0
+STORE i
+LOAD i
+LOAD 2000
+BINARY_OP <
+WHILE
+  LOAD s
+  LOAD 3000000000
+  BINARY_OP +
+  STORE s
+  LOAD i
+  LOAD 1
+  BINARY_OP +
+  STORE i
+  LOAD i
+  LOAD 2000
+  BINARY_OP <
+END
+LOAD s
+PRINT
+# IR END
+)";
+
+const BenchProgram VERIFY_PROGRAMS[] = {
+    { "verify-control", VERIFY_CONTROL_IR },
+    { "verify-loop-control", VERIFY_LOOP_CONTROL_IR, "26\n19\n110\n868\n212376\n902356\n" },
+    { "verify-calls", VERIFY_CALLS_IR },
+    { "verify-speculate", VERIFY_SPECULATION_IR },
+    { "verify-registers", VERIFY_REGISTERS_IR },
+    { "verify-osr", VERIFY_OSR_IR },
+    { "verify-in-place", VERIFY_IN_PLACE_IR, "Type Error: list_fill expects a list and a value\n2\n0\n2\n" },
+    { "verify-literals", VERIFY_LITERALS_IR, "3000000001\n9007199254740993\n-9223372036854775808\n1e+20\n0\n0\n6000000000000\n" },
+    { "verify-string-lists", VERIFY_STRING_LISTS_IR, "3\n3\n0\n2000\n" },
+    { "verify-int-edges", VERIFY_INT_EDGES_IR,
+        "-9223372036854775808\n0\n-9223372036854775808\n9223372036854775807\n8173942548501868633\n2001000\n303000\n"
+        "-35\n-9223372036854775808\n0\n0\n0\n1\n" },
+};
+
+const int RUNS = 5;
+const size_t PROFILE_ROWS = 12;
+
+bool fuse = true;
+bool registerTier = false;
+bool jit = false;
+bool osr = false;
+bool optimizing = true;
+
+// Expected output of the program being verified, nullptr for none
+const char* expectedOutput = nullptr;
+
+// Opcode sequence counts summed over every measured program (last run of each)
+std::map<uint64_t, uint64_t> sequenceCounts;
+
+// Run a program RUNS times and report the best instructions/second
+bool measure(const std::string& name, const std::string& filename) {
+    double bestSeconds = 0.0;
+    uint64_t instructions = 0;
+    uint64_t interpreted = 0;
+    steve::VM::JITStats stats;
+    if (jit || osr) {
+        // Compiled code does not count instructions, rate it by the interpreter's count
+        steve::VM::VirtualMachine vm;
+        vm.setSuperinstructions(fuse);
+        if (!vm.loadProgram(filename) || !vm.execute()) {
+            std::cerr << name << ": execution failed" << std::endl;
+            return false;
+        }
+        interpreted = vm.getInstructionCount();
+    }
+    for (int run = 0; run < RUNS; run++) {
+        steve::VM::VirtualMachine vm;
+        vm.setSuperinstructions(fuse);
+        vm.setRegisterTier(registerTier);
+        vm.setJIT(jit);
+        vm.setOSR(osr);
+        vm.getJITCompiler().setOptimizing(optimizing);
+        if (!vm.loadProgram(filename)) {
+            std::cerr << name << ": failed to load " << filename << std::endl;
+            return false;
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool ok = vm.execute();
+        auto stop = std::chrono::steady_clock::now();
+        if (!ok) {
+            std::cerr << name << ": execution failed" << std::endl;
+            return false;
+        }
+        double seconds = std::chrono::duration<double>(stop - start).count();
+        if (run == 0 || seconds < bestSeconds) {
+            bestSeconds = seconds;
+        }
+        instructions = jit || osr ? interpreted : vm.getInstructionCount();
+        stats = vm.getJITCompiler().getStats();
+        if (run == RUNS - 1) {
+            for (const auto& entry : vm.getOpcodeProfile().counts) {
+                sequenceCounts[entry.first] += entry.second;
+            }
+        }
+    }
+
+    double perSecond = bestSeconds > 0.0 ? instructions / bestSeconds : 0.0;
+    std::printf("%-16s %-9s %12llu instr %9.3f ms %10.2f Minstr/s\n", name.c_str(),
+        jit ? "jit" : osr ? "osr" : registerTier ? "register" : steve::VM::VirtualMachine::dispatchMode(), static_cast<unsigned long long>(instructions),
+        bestSeconds * 1000.0, perSecond / 1e6);
+    if (jit) {
+        std::printf("%-16s %llu tier-ups, %llu deopts, %zu + %zu bytes of baseline + optimized code, %llu loops in registers, %llu spills\n", "",
+            static_cast<unsigned long long>(stats.tierUps), static_cast<unsigned long long>(stats.deopts),
+            stats.baselineCodeSize, stats.optimizedCodeSize, static_cast<unsigned long long>(stats.registerLoops),
+            static_cast<unsigned long long>(stats.spilledValues));
+    }
+    if (osr) {
+        std::printf("%-16s %llu loops compiled, %llu entries from the interpreter, %llu tier-ups, %llu deopts, %zu + %zu bytes of code\n", "",
+            static_cast<unsigned long long>(stats.osrLoops), static_cast<unsigned long long>(stats.osrEntries),
+            static_cast<unsigned long long>(stats.tierUps), static_cast<unsigned long long>(stats.deopts),
+            stats.baselineCodeSize, stats.optimizedCodeSize);
+    }
+    return true;
+}
+
+// Program output and end state of one execution
+struct Outcome {
+    bool ok = false;
+    std::string out;
+    std::string err;
+};
+
+Outcome runCaptured(steve::VM::VirtualMachine& vm, const std::string& filename) {
+    Outcome outcome;
+    std::ostringstream out;
+    std::ostringstream err;
+    std::streambuf* savedOut = std::cout.rdbuf(out.rdbuf());
+    std::streambuf* savedErr = std::cerr.rdbuf(err.rdbuf());
+    outcome.ok = vm.loadProgram(filename) && vm.execute();
+    std::cout.rdbuf(savedOut);
+    std::cerr.rdbuf(savedErr);
+    outcome.out = out.str();
+    outcome.err = err.str();
+    return outcome;
+}
+
+// Equal values of two VMs. Interned strings only compare by payload within one VM, so strings compare by text,
+// also inside lists and dictionaries.
+bool sameValue(const steve::VM::Value& left, const steve::VM::Value& right) {
+    if (left.is<std::string>() && right.is<std::string>()) {
+        return left.get<std::string>() == right.get<std::string>();
+    }
+    if (left.is<steve::VM::ListValue>() && right.is<steve::VM::ListValue>()) {
+        const steve::VM::ListValue& a = left.get<steve::VM::ListValue>();
+        const steve::VM::ListValue& b = right.get<steve::VM::ListValue>();
+        if (a.size() != b.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < a.size(); i++) {
+            if (!sameValue(a.at(i), b.at(i))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (left.is<steve::VM::DictValue>() && right.is<steve::VM::DictValue>()) {
+        const steve::VM::DictValue& a = left.get<steve::VM::DictValue>();
+        const steve::VM::DictValue& b = right.get<steve::VM::DictValue>();
+        if (a.size() != b.size()) {
+            return false;
+        }
+        // Keys are looked up by text too, find() would compare the other VM's payloads
+        bool same = true;
+        a.forEach([&](const steve::VM::Value& key, const steve::VM::Value& value) {
+            bool found = false;
+            b.forEach([&](const steve::VM::Value& otherKey, const steve::VM::Value& otherValue) {
+                if (!found && sameValue(key, otherKey)) {
+                    found = true;
+                    same = same && sameValue(value, otherValue);
+                }
+            });
+            same = same && found;
+        });
+        return same;
+    }
+    return left == right;
+}
+
+bool sameValues(const std::vector<steve::VM::Value>& left, const std::vector<steve::VM::Value>& right) {
+    return std::equal(left.begin(), left.end(), right.begin(), right.end(), sameValue);
+}
+
+// Run a program on the interpreter and on the JIT (or with on-stack replacement), report the first difference
+bool verify(const std::string& name, const std::string& filename) {
+    steve::VM::VirtualMachine interpreter;
+    steve::VM::VirtualMachine compiled;
+    interpreter.setSuperinstructions(fuse);
+    compiled.setSuperinstructions(fuse);
+    compiled.setJIT(!osr);
+    compiled.setOSR(osr);
+    compiled.getJITCompiler().setOptimizing(optimizing);
+    Outcome expected = runCaptured(interpreter, filename);
+    Outcome actual = runCaptured(compiled, filename);
+
+    const steve::VM::MachineState& left = interpreter.getState();
+    const steve::VM::MachineState& right = compiled.getState();
+    const char* difference = nullptr;
+    if (expected.ok != actual.ok) {
+        difference = "result";
+    }
+    else if (expected.out != actual.out) {
+        difference = "output";
+    }
+    else if (expected.err != actual.err) {
+        difference = "errors";
+    }
+    else if (!sameValues(left.globals, right.globals)) {
+        difference = "globals";
+    }
+    else if (!sameValues(left.stack, right.stack)) {
+        difference = "stack";
+    }
+    else if (left.pc != right.pc) {
+        difference = "pc";
+    }
+    else if (expectedOutput && expected.out != expectedOutput) {
+        difference = "expected output";
+    }
+
+    const steve::VM::JITStats& stats = compiled.getJITCompiler().getStats();
+    std::printf("%-16s %s%s (%llu tier-ups, %llu deopts, %llu loops in registers, %llu OSR loops)\n", name.c_str(),
+        difference ? "MISMATCH in " : "ok", difference ? difference : "", static_cast<unsigned long long>(stats.tierUps),
+        static_cast<unsigned long long>(stats.deopts), static_cast<unsigned long long>(stats.registerLoops),
+        static_cast<unsigned long long>(stats.osrLoops));
+    if (difference) {
+        std::printf("  interpreter: %s\n%s%s  jit: %s\n%s%s", expected.ok ? "ok" : "failed", expected.out.c_str(),
+            expected.err.c_str(), actual.ok ? "ok" : "failed", actual.out.c_str(), actual.err.c_str());
+        if (expectedOutput) {
+            std::printf("  expected:\n%s", expectedOutput);
+        }
+    }
+    return !difference;
+}
+
+uint64_t sequenceKey(const steve::VM::InstructionType* sequence, size_t length) {
+    uint64_t opcodes = 0;
+    for (size_t i = 0; i < length; i++) {
+        opcodes = (opcodes << 8) | static_cast<uint8_t>(sequence[i]);
+    }
+    return (static_cast<uint64_t>(length) << 32) | opcodes;
+}
+
+void printRow(const char* fused, uint64_t key, uint64_t weight) {
+    uint32_t length = static_cast<uint32_t>(key >> 32);
+    uint32_t opcodes = static_cast<uint32_t>(key);
+    std::printf("{ InstructionType::%s, %u,\n  {", fused, length);
+    for (uint32_t i = 0; i < length; i++) {
+        auto type = static_cast<steve::VM::InstructionType>((opcodes >> (8 * (length - 1 - i))) & 0xFF);
+        std::printf("%s InstructionType::%s", i ? "," : "", steve::VM::instructionTypeName(type));
+    }
+    std::printf(" }, %llu },\n", static_cast<unsigned long long>(weight));
+}
+
+// Print the weights of the current patterns, then the heaviest sequences without a superinstruction
+void printProfile() {
+    using steve::VM::SUPERINSTRUCTION_PATTERNS;
+    std::map<uint64_t, bool> known;
+    std::printf("\n// SUPERINSTRUCTION_PATTERNS, weight = executions * (length - 1)\n");
+    for (const auto& pattern : SUPERINSTRUCTION_PATTERNS) {
+        uint64_t key = sequenceKey(pattern.sequence, pattern.length);
+        known[key] = true;
+        auto it = sequenceCounts.find(key);
+        uint64_t count = it != sequenceCounts.end() ? it->second : 0;
+        printRow(steve::VM::instructionTypeName(pattern.fused), key, count * (pattern.length - 1));
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> rows;
+    for (const auto& entry : sequenceCounts) {
+        if (!known.count(entry.first)) {
+            rows.emplace_back(entry.second * ((entry.first >> 32) - 1), entry.first);
+        }
+    }
+    std::sort(rows.rbegin(), rows.rend());
+    if (rows.size() > PROFILE_ROWS) {
+        rows.resize(PROFILE_ROWS);
+    }
+    std::printf("\n// Other frequent sequences\n");
+    for (const auto& row : rows) {
+        printRow("NEW", row.second, row.first);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    bool ok = true;
+    bool profile = false;
+    bool check = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--no-fuse") {
+            fuse = false;
+        }
+        else if (arg == "--register") {
+            registerTier = true;
+        }
+        else if (arg == "--jit") {
+            jit = true;
+        }
+        else if (arg == "--osr") {
+            osr = true;
+        }
+        else if (arg == "--baseline") {
+            optimizing = false;
+        }
+        else if (arg == "--verify") {
+            check = true;
+        }
+        else if (arg == "--profile") {
+            profile = true;
+        }
+        else {
+            files.push_back(arg);
+        }
+    }
+#if !defined(STEVE_PROFILE_OPCODES) || !STEVE_PROFILE_OPCODES
+    if (profile) {
+        std::cerr << "--profile needs a build with -DSTEVE_PROFILE_OPCODES=1" << std::endl;
+        return 1;
+    }
+#endif
+    if ((jit || osr || check) && !steve::VM::JITCompiler::supported()) {
+        std::cerr << "The JIT does not support this host" << std::endl;
+        return 1;
+    }
+    auto run = check ? verify : measure;
+
+    if (!files.empty()) {
+        for (const std::string& file : files) {
+            ok = run(file, file) && ok;
+        }
+        if (profile) {
+            printProfile();
+        }
+        return ok ? 0 : 1;
+    }
+
+    std::vector<BenchProgram> programs(std::begin(BUILTIN_PROGRAMS), std::end(BUILTIN_PROGRAMS));
+    if (check) {
+        programs.insert(programs.end(), std::begin(VERIFY_PROGRAMS), std::end(VERIFY_PROGRAMS));
+    }
+    for (const BenchProgram& program : programs) {
+        std::filesystem::path path = std::filesystem::temp_directory_path() /
+            (std::string("steve_bench_") + program.name + ".sir");
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << program.ir;
+        }
+        expectedOutput = program.expected;
+        ok = run(program.name, path.string()) && ok;
+        std::filesystem::remove(path);
+    }
+    if (profile) {
+        printProfile();
+    }
+    return ok ? 0 : 1;
+}
@@ -10,14 +10,24 @@
 #include "vm_gc.h"
 #include "vm_exception.h"
 #include "vm_jit.h"
+#include "vm_bytecode.h"
+#include "vm_superinstructions.h"
+#include "vm_register.h"
+#include "vm_list.h"
 #include "mem.h"
 #include "gc.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
+#include <array>
 #include <regex>
 #include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <set>
 #include <variant>
 #include <memory>
@@ -26,10 +36,26 @@
 #include <vector>
 #include <stack>
 
+// Interpreter dispatch: direct threading through computed goto on GCC/Clang,
+// a portable switch elsewhere. Build with -DSTEVE_THREADED_DISPATCH=0 to force the switch.
+#ifndef STEVE_THREADED_DISPATCH
+#if defined(__GNUC__) || defined(__clang__)
+#define STEVE_THREADED_DISPATCH 1
+#else
+#define STEVE_THREADED_DISPATCH 0
+#endif
+#endif
+
+// Build with -DSTEVE_PROFILE_OPCODES=1 to count executed opcode sequences (see vm_superinstructions.h).
+// Superinstruction fusion is disabled in such builds so the profile sees the original sequences.
+#ifndef STEVE_PROFILE_OPCODES
+#define STEVE_PROFILE_OPCODES 0
+#endif
+
 namespace steve {
     namespace VM {
 
-        VirtualMachine::VirtualMachine() {
+        VirtualMachine::VirtualMachine() : builtInFunctions(state.symbols) {
 
             // Initialize state
 
@@ -47,11 +73,6 @@ namespace steve {
 
 
 
-            // Initialize scope
-
-            state.scopes.push_back({});
-
-
             // Initialize debug state
             debugState.debugging = false;
             debugState.pendingCommand = DebugCommand::NONE;
@@ -70,6 +91,16 @@ namespace steve {
             jitCompiler = std::make_unique<JITCompiler>();
 
             useJIT = false; // Default is not to use JIT
+
+            useOSR = false;
+
+            osrPending = false;
+
+            osrLoop = NO_IMMEDIATE;
+
+            useSuperinstructions = true;
+
+            useRegisterTier = false;
             
 
             // Initialize file operation support
@@ -106,41 +137,66 @@ namespace steve {
 
         }
 
+        // Argument i of a list_* built-in, which must be a list
+        static const ListValue& listArgument(BuiltInArgs args, size_t i, const char* name) {
+            if (args.size() <= i || !args[i].is<ListValue>()) {
+                throw TypeError(std::string(name) + " expects a list as argument " + std::to_string(i + 1));
+            }
+            return args[i].get<ListValue>();
+        }
+
+        // Element equality of list_find: numbers by value as with ==, anything else by Value equality
+        static bool listElementEquals(const Value& element, const Value& needle) {
+            bool elementNumeric = element.is<int>() || element.is<int64_t>() || element.is<double>();
+            bool needleNumeric = needle.is<int>() || needle.is<int64_t>() || needle.is<double>();
+            if (elementNumeric && needleNumeric) {
+                if (element.is<double>() || needle.is<double>()) {
+                    auto asDouble = [](const Value& v) {
+                        return v.is<double>() ? v.get<double>() : static_cast<double>(v.is<int>() ? v.get<int>() : v.get<int64_t>());
+                    };
+                    return asDouble(element) == asDouble(needle);
+                }
+                return (element.is<int>() ? element.get<int>() : element.get<int64_t>()) ==
+                    (needle.is<int>() ? needle.get<int>() : needle.get<int64_t>());
+            }
+            return element == needle;
+        }
+
         void VirtualMachine::registerBuiltInFunctions() {
 
             // Register print function
 
-            builtInFunctions["print"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["print"] = [this](BuiltInArgs args) -> Value {
 
                 if (!args.empty()) {
 
-                    if (std::holds_alternative<std::string>(args[0])) {
+                    if (args[0].is<std::string>()) {
 
-                        std::cout << std::get<std::string>(args[0]);
+                        std::cout << args[0].get<std::string>();
 
                     }
 
-                    else if (std::holds_alternative<int>(args[0])) {
+                    else if (args[0].is<int>()) {
 
-                        std::cout << std::get<int>(args[0]);
+                        std::cout << args[0].get<int>();
 
                     }
 
-                    else if (std::holds_alternative<double>(args[0])) {
+                    else if (args[0].is<double>()) {
 
-                        std::cout << std::get<double>(args[0]);
+                        std::cout << args[0].get<double>();
 
                     }
 
-                    else if (std::holds_alternative<bool>(args[0])) {
+                    else if (args[0].is<bool>()) {
 
-                        std::string boolStr = std::get<bool>(args[0]) ? "true" : "false";
+                        std::string boolStr = args[0].get<bool>() ? "true" : "false";
 
                         std::cout << boolStr;
 
                     }
 
-                    else if (std::holds_alternative<std::nullptr_t>(args[0])) {
+                    else if (args[0].is<std::nullptr_t>()) {
 
                         std::cout << "null";
 
@@ -158,7 +214,7 @@ namespace steve {
 
             // Register input function
 
-            builtInFunctions["input"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["input"] = [this](BuiltInArgs args) -> Value {
 
                 std::string input;
 
@@ -172,15 +228,15 @@ namespace steve {
 
             // Type conversion function - int
 
-            builtInFunctions["int"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["int"] = [this](BuiltInArgs args) -> Value {
 
                 if (!args.empty()) {
 
-                    if (std::holds_alternative<std::string>(args[0])) {
+                    if (args[0].is<std::string>()) {
 
                         try {
 
-                            return Value(std::stoi(std::get<std::string>(args[0])));
+                            return Value(std::stoi(args[0].get<std::string>()));
 
                         }
 
@@ -192,25 +248,25 @@ namespace steve {
 
                     }
 
-                    else if (std::holds_alternative<double>(args[0])) {
+                    else if (args[0].is<double>()) {
 
-                        return Value(static_cast<int>(std::get<double>(args[0])));
+                        return Value(static_cast<int>(args[0].get<double>()));
 
                     }
 
-                    else if (std::holds_alternative<int64_t>(args[0])) {
+                    else if (args[0].is<int64_t>()) {
 
-                        return Value(static_cast<int>(std::get<int64_t>(args[0])));
+                        return Value(static_cast<int>(args[0].get<int64_t>()));
 
                     }
 
-                    else if (std::holds_alternative<bool>(args[0])) {
+                    else if (args[0].is<bool>()) {
 
-                        return Value(static_cast<int>(std::get<bool>(args[0])));
+                        return Value(static_cast<int>(args[0].get<bool>()));
 
                     }
 
-                    else if (std::holds_alternative<int>(args[0])) {
+                    else if (args[0].is<int>()) {
 
                         return args[0];
 
@@ -226,15 +282,15 @@ namespace steve {
 
             // Type conversion function - float
 
-            builtInFunctions["float"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["float"] = [this](BuiltInArgs args) -> Value {
 
                 if (!args.empty()) {
 
-                    if (std::holds_alternative<std::string>(args[0])) {
+                    if (args[0].is<std::string>()) {
 
                         try {
 
-                            return Value(std::stod(std::get<std::string>(args[0])));
+                            return Value(std::stod(args[0].get<std::string>()));
 
                         }
 
@@ -246,25 +302,25 @@ namespace steve {
 
                     }
 
-                    else if (std::holds_alternative<int>(args[0])) {
+                    else if (args[0].is<int>()) {
 
-                        return Value(static_cast<double>(std::get<int>(args[0])));
+                        return Value(static_cast<double>(args[0].get<int>()));
 
                     }
 
-                    else if (std::holds_alternative<int64_t>(args[0])) {
+                    else if (args[0].is<int64_t>()) {
 
-                        return Value(static_cast<double>(std::get<int64_t>(args[0])));
+                        return Value(static_cast<double>(args[0].get<int64_t>()));
 
                     }
 
-                    else if (std::holds_alternative<bool>(args[0])) {
+                    else if (args[0].is<bool>()) {
 
-                        return Value(static_cast<double>(std::get<bool>(args[0])));
+                        return Value(static_cast<double>(args[0].get<bool>()));
 
                     }
 
-                    else if (std::holds_alternative<double>(args[0])) {
+                    else if (args[0].is<double>()) {
 
                         return args[0];
 
@@ -280,41 +336,41 @@ namespace steve {
 
             // Type conversion function - string
 
-            builtInFunctions["string"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["string"] = [this](BuiltInArgs args) -> Value {
 
                 if (!args.empty()) {
 
-                    if (std::holds_alternative<int>(args[0])) {
+                    if (args[0].is<int>()) {
 
-                        return Value(std::to_string(std::get<int>(args[0])));
+                        return Value(std::to_string(args[0].get<int>()));
 
                     }
 
-                    else if (std::holds_alternative<int64_t>(args[0])) {
+                    else if (args[0].is<int64_t>()) {
 
-                        return Value(std::to_string(std::get<int64_t>(args[0])));
+                        return Value(std::to_string(args[0].get<int64_t>()));
 
                     }
 
-                    else if (std::holds_alternative<double>(args[0])) {
+                    else if (args[0].is<double>()) {
 
-                        return Value(std::to_string(std::get<double>(args[0])));
+                        return Value(std::to_string(args[0].get<double>()));
 
                     }
 
-                    else if (std::holds_alternative<bool>(args[0])) {
+                    else if (args[0].is<bool>()) {
 
-                        return Value(std::get<bool>(args[0]) ? "true" : "false");
+                        return Value(args[0].get<bool>() ? "true" : "false");
 
                     }
 
-                    else if (std::holds_alternative<std::string>(args[0])) {
+                    else if (args[0].is<std::string>()) {
 
                         return args[0];
 
                     }
 
-                    else if (std::holds_alternative<std::nullptr_t>(args[0])) {
+                    else if (args[0].is<std::nullptr_t>()) {
 
                         return Value("null");
 
@@ -330,31 +386,31 @@ namespace steve {
 
             // Type conversion function - bool
 
-            builtInFunctions["bool"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["bool"] = [this](BuiltInArgs args) -> Value {
 
                 if (!args.empty()) {
 
-                    if (std::holds_alternative<int>(args[0])) {
+                    if (args[0].is<int>()) {
 
-                        return Value(std::get<int>(args[0]) != 0);
+                        return Value(args[0].get<int>() != 0);
 
                     }
 
-                    else if (std::holds_alternative<int64_t>(args[0])) {
+                    else if (args[0].is<int64_t>()) {
 
-                        return Value(std::get<int64_t>(args[0]) != 0);
+                        return Value(args[0].get<int64_t>() != 0);
 
                     }
 
-                    else if (std::holds_alternative<double>(args[0])) {
+                    else if (args[0].is<double>()) {
 
-                        return Value(std::get<double>(args[0]) != 0.0);
+                        return Value(args[0].get<double>() != 0.0);
 
                     }
 
-                    else if (std::holds_alternative<std::string>(args[0])) {
+                    else if (args[0].is<std::string>()) {
 
-                        std::string s = std::get<std::string>(args[0]);
+                        std::string s = args[0].get<std::string>();
 
                         std::transform(s.begin(), s.end(), s.begin(), ::tolower);
 
@@ -362,13 +418,13 @@ namespace steve {
 
                     }
 
-                    else if (std::holds_alternative<bool>(args[0])) {
+                    else if (args[0].is<bool>()) {
 
                         return args[0];
 
                     }
 
-                    else if (std::holds_alternative<std::nullptr_t>(args[0])) {
+                    else if (args[0].is<std::nullptr_t>()) {
 
                         return Value(false);
 
@@ -383,12 +439,13 @@ namespace steve {
             // Pointer related functions
 
             // new function - creates a new object in memory and returns a pointer
-            builtInFunctions["new"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["new"] = [this](BuiltInArgs args) -> Value {
                 if (!args.empty()) {
                     // For simplicity, we'll create a mock pointer value
                     // In a real implementation, this would allocate memory for the specific type
-                    ManagedObject* obj = new ManagedObject(nullptr, "object", sizeof(int)); // Create a managed object
-                    PointerValue ptr(obj, "object", false); // Placeholder for now
+                    SymbolId objectType = state.symbols.intern("object");
+                    ManagedObject* obj = new ManagedObject(nullptr, objectType, sizeof(int)); // Create a managed object
+                    PointerValue ptr(obj, objectType, false); // Placeholder for now
                     // Add to managed objects for GC
                     int64_t objId = nextObjectId++;
                     managedObjects[objId] = obj;
@@ -398,22 +455,22 @@ namespace steve {
             };
 
             // type function - returns the type of a variable
-            builtInFunctions["type"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["type"] = [this](BuiltInArgs args) -> Value {
                 if (!args.empty()) {
-                    if (std::holds_alternative<int>(args[0])) {
+                    if (args[0].is<int>()) {
                         return Value(std::string("int"));
-                    } else if (std::holds_alternative<double>(args[0])) {
+                    } else if (args[0].is<double>()) {
                         return Value(std::string("float")); // Or double
-                    } else if (std::holds_alternative<std::string>(args[0])) {
+                    } else if (args[0].is<std::string>()) {
                         return Value(std::string("string"));
-                    } else if (std::holds_alternative<bool>(args[0])) {
+                    } else if (args[0].is<bool>()) {
                         return Value(std::string("bool"));
-                    } else if (std::holds_alternative<std::nullptr_t>(args[0])) {
+                    } else if (args[0].is<std::nullptr_t>()) {
                         return Value(std::string("null"));
-                    } else if (std::holds_alternative<int64_t>(args[0])) {
+                    } else if (args[0].is<int64_t>()) {
                         return Value(std::string("long"));
-                    } else if (std::holds_alternative<PointerValue>(args[0])) {
-                        PointerValue ptr = std::get<PointerValue>(args[0]);
+                    } else if (args[0].is<PointerValue>()) {
+                        PointerValue ptr = args[0].get<PointerValue>();
                         return Value(ptr.type);
                     }
                 }
@@ -421,15 +478,15 @@ namespace steve {
             };
 
             // hash function
-            builtInFunctions["hash"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["hash"] = [this](BuiltInArgs args) -> Value {
                 if (!args.empty()) {
-                    if (std::holds_alternative<std::string>(args[0])) {
-                        std::string str = std::get<std::string>(args[0]);
+                    if (args[0].is<std::string>()) {
+                        const std::string& str = args[0].get<std::string>();
                         return Value(static_cast<int64_t>(std::hash<std::string>{}(str)));
-                    } else if (std::holds_alternative<int>(args[0])) {
-                        return Value(static_cast<int64_t>(std::hash<int>{}(std::get<int>(args[0]))));
-                    } else if (std::holds_alternative<double>(args[0])) {
-                        return Value(static_cast<int64_t>(std::hash<double>{}(std::get<double>(args[0]))));
+                    } else if (args[0].is<int>()) {
+                        return Value(static_cast<int64_t>(std::hash<int>{}(args[0].get<int>())));
+                    } else if (args[0].is<double>()) {
+                        return Value(static_cast<int64_t>(std::hash<double>{}(args[0].get<double>())));
                     } else {
                         // For other types, convert to string and hash
                         std::ostringstream ss;
@@ -441,13 +498,13 @@ namespace steve {
             };
 
             // bs function (binary string conversion)
-            builtInFunctions["bs"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["bs"] = [this](BuiltInArgs args) -> Value {
                 if (!args.empty()) {
-                    if (std::holds_alternative<int>(args[0])) {
-                        int val = std::get<int>(args[0]);
+                    if (args[0].is<int>()) {
+                        int val = args[0].get<int>();
                         return Value(static_cast<long long>(val));
-                    } else if (std::holds_alternative<int64_t>(args[0])) {
-                        int64_t val = std::get<int64_t>(args[0]);
+                    } else if (args[0].is<int64_t>()) {
+                        int64_t val = args[0].get<int64_t>();
                         return Value(val);
                     } else {
                         return Value(std::string("0"));
@@ -457,7 +514,7 @@ namespace steve {
             };
 
             // run function (for executing external files)
-            builtInFunctions["run"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["run"] = [this](BuiltInArgs args) -> Value {
                 // For now, this is a placeholder implementation
                 // In a real implementation, this would execute external files
                 std::cout << "Run function called (not fully implemented)" << std::endl;
@@ -465,19 +522,20 @@ namespace steve {
             };
 
             // open function for file operations
-            builtInFunctions["open"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["open"] = [this](BuiltInArgs args) -> Value {
                 if (args.size() >= 2) {
-                    if (std::holds_alternative<std::string>(args[0]) && std::holds_alternative<std::string>(args[1])) {
-                        std::string filename = std::get<std::string>(args[0]);
-                        std::string mode = std::get<std::string>(args[1]);
+                    if (args[0].is<std::string>() && args[1].is<std::string>()) {
+                        std::string filename = args[0].get<std::string>();
+                        std::string mode = args[1].get<std::string>();
                         
                         FileHandle* handle = new FileHandle(filename, mode);
                         if (handle->isOpen) {
                             int64_t handleId = nextFileHandleId++;
                             fileHandles[handleId] = handle;
                             // Return a pointer-like value representing the file handle
-                            ManagedObject* obj = new ManagedObject(reinterpret_cast<void*>(handleId), "file", sizeof(int64_t));
-                            PointerValue ptr(obj, "file", false);
+                            SymbolId fileType = state.symbols.intern("file");
+                            ManagedObject* obj = new ManagedObject(reinterpret_cast<void*>(handleId), fileType, sizeof(int64_t));
+                            PointerValue ptr(obj, fileType, false);
                             // Add to managed objects for GC
                             managedObjects[handleId] = obj;
                             return Value(ptr);
@@ -487,16 +545,17 @@ namespace steve {
                             return Value(PointerValue());
                         }
                     }
-                } else if (!args.empty() && std::holds_alternative<std::string>(args[0])) {
-                    std::string filename = std::get<std::string>(args[0]);
+                } else if (!args.empty() && args[0].is<std::string>()) {
+                    std::string filename = args[0].get<std::string>();
                     std::string defaultMode = "r"; // Default read mode
                     
                     FileHandle* handle = new FileHandle(filename, defaultMode);
                     if (handle->isOpen) {
                         int64_t handleId = nextFileHandleId++;
                         fileHandles[handleId] = handle;
-                        ManagedObject* obj = new ManagedObject(reinterpret_cast<void*>(handleId), "file", sizeof(int64_t));
-                        PointerValue ptr(obj, "file", false);
+                        SymbolId fileType = state.symbols.intern("file");
+                        ManagedObject* obj = new ManagedObject(reinterpret_cast<void*>(handleId), fileType, sizeof(int64_t));
+                        PointerValue ptr(obj, fileType, false);
                         // Add to managed objects for GC
                         managedObjects[handleId] = obj;
                         return Value(ptr);
@@ -510,9 +569,9 @@ namespace steve {
             };
 
             // close function for file operations
-            builtInFunctions["close"] = [this](std::vector<Value> args) -> Value {
-                if (!args.empty() && std::holds_alternative<PointerValue>(args[0])) {
-                    PointerValue ptrVal = std::get<PointerValue>(args[0]);
+            builtInFunctions["close"] = [this](BuiltInArgs args) -> Value {
+                if (!args.empty() && args[0].is<PointerValue>()) {
+                    PointerValue ptrVal = args[0].get<PointerValue>();
                     if (!ptrVal.isNull) {
                         int64_t handleId = reinterpret_cast<int64_t>(ptrVal.ptr);
                         auto it = fileHandles.find(handleId);
@@ -545,9 +604,9 @@ namespace steve {
 
             // Additional file operations
             // write function for file operations
-            builtInFunctions["write"] = [this](std::vector<Value> args) -> Value {
-                if (args.size() >= 2 && std::holds_alternative<PointerValue>(args[0])) {
-                    PointerValue ptrVal = std::get<PointerValue>(args[0]);
+            builtInFunctions["write"] = [this](BuiltInArgs args) -> Value {
+                if (args.size() >= 2 && args[0].is<PointerValue>()) {
+                    PointerValue ptrVal = args[0].get<PointerValue>();
                     if (!ptrVal.isNull) {
                         int64_t handleId = reinterpret_cast<int64_t>(ptrVal.ptr);
                         auto it = fileHandles.find(handleId);
@@ -555,8 +614,8 @@ namespace steve {
                             FileHandle* handle = it->second;
                             if (handle->stream && handle->isOpen) {
                                 std::string content;
-                                if (std::holds_alternative<std::string>(args[1])) {
-                                    content = std::get<std::string>(args[1]);
+                                if (args[1].is<std::string>()) {
+                                    content = args[1].get<std::string>();
                                 } else {
                                     // Convert other types to string
                                     std::ostringstream ss;
@@ -579,9 +638,9 @@ namespace steve {
             };
 
             // read function for file operations
-            builtInFunctions["read"] = [this](std::vector<Value> args) -> Value {
-                if (!args.empty() && std::holds_alternative<PointerValue>(args[0])) {
-                    PointerValue ptrVal = std::get<PointerValue>(args[0]);
+            builtInFunctions["read"] = [this](BuiltInArgs args) -> Value {
+                if (!args.empty() && args[0].is<PointerValue>()) {
+                    PointerValue ptrVal = args[0].get<PointerValue>();
                     if (!ptrVal.isNull) {
                         int64_t handleId = reinterpret_cast<int64_t>(ptrVal.ptr);
                         auto it = fileHandles.find(handleId);
@@ -604,11 +663,11 @@ namespace steve {
             };
 
             // throw function for exception handling
-            builtInFunctions["throw"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["throw"] = [this](BuiltInArgs args) -> Value {
                 if (!args.empty()) {
                     std::string exceptionMsg;
-                    if (std::holds_alternative<std::string>(args[0])) {
-                        exceptionMsg = std::get<std::string>(args[0]);
+                    if (args[0].is<std::string>()) {
+                        exceptionMsg = args[0].get<std::string>();
                     } else {
                         // Convert other types to string
                         std::ostringstream ss;
@@ -628,25 +687,25 @@ namespace steve {
 
             // Math function - abs
 
-            builtInFunctions["abs"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["abs"] = [this](BuiltInArgs args) -> Value {
 
                 if (!args.empty()) {
 
-                    if (std::holds_alternative<int>(args[0])) {
+                    if (args[0].is<int>()) {
 
-                        return Value(std::abs(std::get<int>(args[0])));
+                        return Value(std::abs(args[0].get<int>()));
 
                     }
 
-                    else if (std::holds_alternative<double>(args[0])) {
+                    else if (args[0].is<double>()) {
 
-                        return Value(std::abs(std::get<double>(args[0])));
+                        return Value(std::abs(args[0].get<double>()));
 
                     }
 
-                    else if (std::holds_alternative<int64_t>(args[0])) {
+                    else if (args[0].is<int64_t>()) {
 
-                        return Value(std::llabs(std::get<int64_t>(args[0])));
+                        return Value(std::llabs(args[0].get<int64_t>()));
 
                     }
 
@@ -660,7 +719,7 @@ namespace steve {
 
             // Math function - pow
 
-            builtInFunctions["pow"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["pow"] = [this](BuiltInArgs args) -> Value {
 
                 if (args.size() >= 2) {
 
@@ -670,21 +729,21 @@ namespace steve {
 
                     // Get base
 
-                    if (std::holds_alternative<int>(args[0])) {
+                    if (args[0].is<int>()) {
 
-                        base = std::get<int>(args[0]);
+                        base = args[0].get<int>();
 
                     }
 
-                    else if (std::holds_alternative<double>(args[0])) {
+                    else if (args[0].is<double>()) {
 
-                        base = std::get<double>(args[0]);
+                        base = args[0].get<double>();
 
                     }
 
-                    else if (std::holds_alternative<int64_t>(args[0])) {
+                    else if (args[0].is<int64_t>()) {
 
-                        base = std::get<int64_t>(args[0]);
+                        base = args[0].get<int64_t>();
 
                     }
 
@@ -692,21 +751,21 @@ namespace steve {
 
                     // Get exponent
 
-                    if (std::holds_alternative<int>(args[1])) {
+                    if (args[1].is<int>()) {
 
-                        exponent = std::get<int>(args[1]);
+                        exponent = args[1].get<int>();
 
                     }
 
-                    else if (std::holds_alternative<double>(args[1])) {
+                    else if (args[1].is<double>()) {
 
-                        exponent = std::get<double>(args[1]);
+                        exponent = args[1].get<double>();
 
                     }
 
-                    else if (std::holds_alternative<int64_t>(args[1])) {
+                    else if (args[1].is<int64_t>()) {
 
-                        exponent = std::get<int64_t>(args[1]);
+                        exponent = args[1].get<int64_t>();
 
                     }
 
@@ -724,11 +783,11 @@ namespace steve {
 
             // String function - len
 
-            builtInFunctions["len"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["len"] = [this](BuiltInArgs args) -> Value {
 
-                if (!args.empty() && std::holds_alternative<std::string>(args[0])) {
+                if (!args.empty() && args[0].is<std::string>()) {
 
-                    return Value(static_cast<int>(std::get<std::string>(args[0]).length()));
+                    return Value(static_cast<int>(args[0].get<std::string>().length()));
 
                 }
 
@@ -740,27 +799,27 @@ namespace steve {
 
             // String function - substr
 
-            builtInFunctions["substr"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["substr"] = [this](BuiltInArgs args) -> Value {
 
-                if (args.size() >= 2 && std::holds_alternative<std::string>(args[0])) {
+                if (args.size() >= 2 && args[0].is<std::string>()) {
 
-                    std::string str = std::get<std::string>(args[0]);
+                    const std::string& str = args[0].get<std::string>();
 
                     int start = 0, length = static_cast<int>(str.length());
 
 
 
-                    if (std::holds_alternative<int>(args[1])) {
+                    if (args[1].is<int>()) {
 
-                        start = std::get<int>(args[1]);
+                        start = args[1].get<int>();
 
                     }
 
 
 
-                    if (args.size() >= 3 && std::holds_alternative<int>(args[2])) {
+                    if (args.size() >= 3 && args[2].is<int>()) {
 
-                        length = std::get<int>(args[2]);
+                        length = args[2].get<int>();
 
                     }
 
@@ -789,7 +848,7 @@ namespace steve {
                 };
 
             // List/Array function - append
-            builtInFunctions["append"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["append"] = [this](BuiltInArgs args) -> Value {
                 // This would typically be called as list.append(item) in actual implementation
                 // For now, this is a placeholder - the actual implementation would need
                 // the VM to support list objects directly
@@ -797,18 +856,18 @@ namespace steve {
             };
 
             // Dictionary function - append (add key-value pair)
-            builtInFunctions["dict_append"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["dict_append"] = [this](BuiltInArgs args) -> Value {
                 // This would typically be called as dict.append(key, value) in actual implementation
                 return Value(0);
             };
 
             // Delete function for removing elements
-            builtInFunctions["del"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["del"] = [this](BuiltInArgs args) -> Value {
                 // Handle deletion of variables, list elements, dict entries, or pointers
                 if (!args.empty()) {
-                    if (std::holds_alternative<PointerValue>(args[0])) {
+                    if (args[0].is<PointerValue>()) {
                         // Handle pointer deletion
-                        PointerValue ptr = std::get<PointerValue>(args[0]);
+                        PointerValue ptr = args[0].get<PointerValue>();
                         if (!ptr.isNull) {
                             // Remove from managed objects map
                             for (auto it = managedObjects.begin(); it != managedObjects.end(); ++it) {
@@ -834,79 +893,181 @@ namespace steve {
             // Built-in functions for list and dict operations
             
             // Create a new list
-            builtInFunctions["list"] = [this](std::vector<Value> args) -> Value {
-                std::vector<Value> items;
-                // Add all arguments to the list
+            builtInFunctions["list"] = [this](BuiltInArgs args) -> Value {
+                ListValue list;
+                // Add all arguments to the list, typed while they are all ints, doubles or bools
                 for (const Value& arg : args) {
-                    items.push_back(arg);
+                    list.push(arg);
                 }
-                return Value(ListValue(items));
+                return Value(std::move(list));
             };
 
             // Get length of list/dict
-            builtInFunctions["len"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["len"] = [this](BuiltInArgs args) -> Value {
                 if (!args.empty()) {
-                    if (std::holds_alternative<std::string>(args[0])) {
-                        return Value(static_cast<int>(std::get<std::string>(args[0]).length()));
-                    } else if (std::holds_alternative<ListValue>(args[0])) {
-                        const ListValue& list = std::get<ListValue>(args[0]);
-                        return Value(static_cast<int>(list.items.size()));
-                    } else if (std::holds_alternative<DictValue>(args[0])) {
-                        const DictValue& dict = std::get<DictValue>(args[0]);
-                        return Value(static_cast<int>(dict.items.size()));
+                    if (args[0].is<std::string>()) {
+                        return Value(static_cast<int>(args[0].stringLength())); // Does not flatten a rope
+                    } else if (args[0].is<ListValue>()) {
+                        const ListValue& list = args[0].get<ListValue>();
+                        return Value(static_cast<int>(list.size()));
+                    } else if (args[0].is<DictValue>()) {
+                        const DictValue& dict = args[0].get<DictValue>();
+                        return Value(static_cast<int>(dict.size()));
                     }
                 }
                 return Value(0);
             };
             
             // Append to list
-            builtInFunctions["append"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["append"] = [this](BuiltInArgs args) -> Value {
                 if (args.size() >= 2) {
                     // First argument should be the list, second is the item to add
-                    if (std::holds_alternative<ListValue>(args[0])) {
-                        ListValue list = std::get<ListValue>(args[0]);
-                        Value item = args[1];
-                        list.items.push_back(item);
-                        return Value(list); // Return modified list
+                    if (args[0].is<ListValue>()) {
+                        // Copy-on-write: the list is only copied if something else still references it
+                        Value list = std::move(args[0]);
+                        list.mutate<ListValue>().push(args[1]);
+                        return list; // Return modified list
                     }
                 }
                 return args.empty() ? Value(0) : args[0]; // Return first argument if can't append
             };
-            
-            // Type checking function
-            builtInFunctions["type"] = [this](std::vector<Value> args) -> Value {
-                if (!args.empty()) {
-                    if (std::holds_alternative<int>(args[0])) {
-                        return Value(std::string("int"));
-                    } else if (std::holds_alternative<double>(args[0])) {
-                        return Value(std::string("float")); // Or double
-                    } else if (std::holds_alternative<std::string>(args[0])) {
-                        return Value(std::string("string"));
-                    } else if (std::holds_alternative<bool>(args[0])) {
-                        return Value(std::string("bool"));
-                    } else if (std::holds_alternative<std::nullptr_t>(args[0])) {
-                        return Value(std::string("null"));
-                    } else if (std::holds_alternative<int64_t>(args[0])) {
-                        return Value(std::string("long"));
-                    } else if (std::holds_alternative<PointerValue>(args[0])) {
-                        PointerValue ptr = std::get<PointerValue>(args[0]);
-                        return Value(ptr.type);
-                    } else if (std::holds_alternative<ListValue>(args[0])) {
-                        return Value(std::string("list"));
-                    } else if (std::holds_alternative<DictValue>(args[0])) {
-                        return Value(std::string("dict"));
+            builtInFunctions.setInPlace("append");
+
+            // Bulk list built-ins. Lists of ints or doubles run through the kernels in vm_list.h,
+            // other lists element by element with the VM's operators, to the same result.
+            builtInFunctions["list_sum"] = [this](BuiltInArgs args) -> Value {
+                const ListValue& list = listArgument(args, 0, "list_sum");
+                Value result;
+                if (!listSum(list, result)) {
+                    result = Value(0);
+                    for (size_t i = 0; i < list.size(); i++) {
+                        result = performBinaryOperation(result, list.at(i), Operator::ADD, -1);
                     }
                 }
-                return Value(std::string("unknown"));
+                return result;
+            };
+            for (bool largest : { false, true }) {
+                const char* name = largest ? "list_max" : "list_min";
+                builtInFunctions[name] = [this, name, largest](BuiltInArgs args) -> Value {
+                    const ListValue& list = listArgument(args, 0, name);
+                    if (list.empty()) {
+                        throw RuntimeError(std::string(name) + " of an empty list");
+                    }
+                    Value result;
+                    if (!listMinMax(list, largest, result)) {
+                        // First extreme element, later equal ones do not replace it
+                        result = list.at(0);
+                        for (size_t i = 1; i < list.size(); i++) {
+                            Value element = list.at(i);
+                            if (getBoolValue(performBinaryOperation(element, result, largest ? Operator::GT : Operator::LT, -1))) {
+                                result = element;
+                            }
+                        }
+                    }
+                    return result;
+                };
+            }
+            builtInFunctions["list_dot"] = [this](BuiltInArgs args) -> Value {
+                const ListValue& left = listArgument(args, 0, "list_dot");
+                const ListValue& right = listArgument(args, 1, "list_dot");
+                if (left.size() != right.size()) {
+                    throw RuntimeError("list_dot of lists of different lengths");
+                }
+                Value result;
+                if (!listDot(left, right, result)) {
+                    result = Value(0);
+                    for (size_t i = 0; i < left.size(); i++) {
+                        Value product = performBinaryOperation(left.at(i), right.at(i), Operator::MUL, -1);
+                        result = performBinaryOperation(result, product, Operator::ADD, -1);
+                    }
+                }
+                return result;
+            };
+            // Element-wise arithmetic with a list of the same length or a number
+            struct ElementWise {
+                const char* name;
+                ListArithmetic op;
+                Operator binop;
+            };
+            for (const ElementWise& entry : { ElementWise{ "list_add", ListArithmetic::ADD, Operator::ADD },
+                ElementWise{ "list_sub", ListArithmetic::SUB, Operator::SUB }, ElementWise{ "list_mul", ListArithmetic::MUL, Operator::MUL },
+                ElementWise{ "list_div", ListArithmetic::DIV, Operator::DIV } }) {
+                builtInFunctions[entry.name] = [this, entry](BuiltInArgs args) -> Value {
+                    const ListValue& left = listArgument(args, 0, entry.name);
+                    if (args.size() < 2) {
+                        throw TypeError(std::string(entry.name) + " expects a list and a list or number");
+                    }
+                    const Value& right = args[1];
+                    const ListValue* rightList = right.is<ListValue>() ? &right.get<ListValue>() : nullptr;
+                    if (rightList && rightList->size() != left.size()) {
+                        throw RuntimeError(std::string(entry.name) + " of lists of different lengths");
+                    }
+                    Value result;
+                    if (!listArithmetic(left, right, entry.op, result)) {
+                        ListValue values;
+                        for (size_t i = 0; i < left.size(); i++) {
+                            values.push(performBinaryOperation(left.at(i), rightList ? rightList->at(i) : right, entry.binop, -1));
+                        }
+                        result = Value(std::move(values));
+                    }
+                    return result;
+                };
+            }
+            // Set every element to a value, in place like append
+            builtInFunctions["list_fill"] = [this](BuiltInArgs args) -> Value {
+                // Every check before the list is taken (see setInPlace)
+                if (args.size() < 2) {
+                    throw TypeError("list_fill expects a list and a value");
+                }
+                listArgument(args, 0, "list_fill");
+                Value list = std::move(args[0]);
+                list.mutate<ListValue>().fill(args[1]);
+                return list;
+            };
+            builtInFunctions.setInPlace("list_fill");
+            // Index of the first element equal to a value, or -1
+            builtInFunctions["list_find"] = [this](BuiltInArgs args) -> Value {
+                const ListValue& list = listArgument(args, 0, "list_find");
+                if (args.size() < 2) {
+                    throw TypeError("list_find expects a list and a value");
+                }
+                int64_t index;
+                if (!listFind(list, args[1], index)) {
+                    index = -1;
+                    for (size_t i = 0; i < list.size(); i++) {
+                        if (listElementEquals(list.at(i), args[1])) {
+                            index = static_cast<int64_t>(i);
+                            break;
+                        }
+                    }
+                }
+                return Value(static_cast<int>(index));
+            };
+            
+            // Type checking function. Type names are interned once, in Value::index() order,
+            // so the result shares the interned string instead of allocating one per call
+            std::vector<SymbolId> typeNames;
+            for (const char* name : { "int", "float", "bool", "string", "null", "long", "pointer", "list", "dict", "unknown" }) {
+                typeNames.push_back(state.symbols.intern(name));
+            }
+            builtInFunctions["type"] = [this, typeNames](BuiltInArgs args) -> Value {
+                if (args.empty()) {
+                    return state.symbols.value(typeNames[Value::INDEX_COUNT]);
+                }
+                if (args[0].is<PointerValue>()) {
+                    SymbolId type = args[0].get<PointerValue>().type;
+                    return type != NO_SYMBOL ? state.symbols.value(type) : Value(std::string());
+                }
+                return state.symbols.value(typeNames[args[0].index()]);
             };
             
             // New function to create pointer objects
-            builtInFunctions["new"] = [this](std::vector<Value> args) -> Value {
+            builtInFunctions["new"] = [this](BuiltInArgs args) -> Value {
                 if (!args.empty()) {
                     // For now, we'll create a simple managed object based on the type
                     std::string requestedType;
-                    if (std::holds_alternative<std::string>(args[0])) {
-                        requestedType = std::get<std::string>(args[0]);
+                    if (args[0].is<std::string>()) {
+                        requestedType = args[0].get<std::string>();
                     } else {
                         // If not a string, try to get the type of the value
                         std::ostringstream ss;
@@ -935,12 +1096,13 @@ namespace steve {
                         }
                         
                         // Create a managed object
-                        ManagedObject* obj = new ManagedObject(data, requestedType, size);
+                        SymbolId typeName = state.symbols.intern(requestedType);
+                        ManagedObject* obj = new ManagedObject(data, typeName, size);
                         int64_t objId = nextObjectId++;
                         managedObjects[objId] = obj;
                         
                         // Create and return a pointer to the managed object
-                        return Value(PointerValue(obj, requestedType, false, false));
+                        return Value(PointerValue(obj, typeName, false, false));
                     }
                 }
                 // Return null pointer if failed
@@ -948,9 +1110,9 @@ namespace steve {
             };
             
             // Dereference function for pointers
-            builtInFunctions["deref"] = [this](std::vector<Value> args) -> Value {
-                if (!args.empty() && std::holds_alternative<PointerValue>(args[0])) {
-                    PointerValue ptr = std::get<PointerValue>(args[0]);
+            builtInFunctions["deref"] = [this](BuiltInArgs args) -> Value {
+                if (!args.empty() && args[0].is<PointerValue>()) {
+                    PointerValue ptr = args[0].get<PointerValue>();
                     if (!ptr.isNull && ptr.obj && ptr.obj->data) {
                         // Return a representation of the data
                         // In a real implementation, this would return the actual value
@@ -967,9 +1129,10 @@ namespace steve {
 
         bool VirtualMachine::loadProgram(const std::string& filename) {
 
-            std::ifstream file(filename);
+            // Map the file instead of streaming it through a stringstream
+            Bytecode::MappedFile file;
 
-            if (!file) {
+            if (!file.open(filename)) {
 
                 std::cerr << "Error: Cannot open file: " << filename << std::endl;
 
@@ -979,25 +1142,91 @@ namespace steve {
 
 
 
-            std::stringstream buffer;
+            std::vector<Instruction> program;
+
+            if (Bytecode::isBytecode(file.getData(), file.getSize())) {
+
+                // Binary bytecode, decoded straight from the mapping without per-line parsing
+
+                std::string error;
+
+                if (!Bytecode::decode(file.getData(), file.getSize(), program, error)) {
+
+                    std::cerr << "Error: Invalid bytecode file " << filename << ": " << error << std::endl;
+
+                    return false;
+
+                }
+
+            }
+
+            else {
+
+                // Text IR, kept for debugging
+
+                std::string irCode(reinterpret_cast<const char*>(file.getData()), file.getSize());
+
+                program = parseIR(irCode);
+
+            }
+
+
+
+            try {
+
+                prepareProgram(program);
+
+                packProgram(program);
+
+                fuseSuperinstructions();
+
+                registerCode.reset();
+
+                jitCompiler->reset();
+
+                loopHeat.clear();
+
+            }
+
+            catch (const VMException& e) {
+
+                std::cerr << "Error: " << filename;
+
+                if (e.getLine() > 0) {
+
+                    std::cerr << ":" << e.getLine();
+
+                }
+
+                std::cerr << ": " << e.what() << std::endl;
+
+                return false;
 
+            }
 
 
-            buffer << file.rdbuf();
 
+            return !state.code.empty();
 
+        }
 
-            std::string irCode = buffer.str();
+        void VirtualMachine::prepareProgram(std::vector<Instruction>& program) {
 
+            // Load-time passes shared by the bytecode and text IR loaders
 
+            lowerCatches(program);
 
+            resolveLiterals(program);
 
+            resolveOperators(program);
 
+            resolveControlFlow(program);
 
+            resolveLabels(program);
 
-            state.program = parseIR(irCode);
+            resolveSlots(program);
 
-            return !state.program.empty();
+            resolveCalls(program);
 
         }
 
@@ -1042,261 +1271,733 @@ namespace steve {
                 Instruction instr;
                 instr.line = lineNum;
 
-                // Set type based on instruction name
-
-                if (instrName == "DEFVAR") {
-
-                    instr.type = InstructionType::DEFVAR;
+                // Set type based on instruction name, the mnemonics are shared with stevec (vm_bytecode.h)
 
-                }
+                Bytecode::Opcode opcode;
 
-                else if (instrName == "LOAD") {
+                instr.type = Bytecode::opcodeFor(instrName, opcode) ? static_cast<InstructionType>(opcode) : InstructionType::NOP;
 
-                    instr.type = InstructionType::LOAD;
+                // Parse operands
 
-                }
+                std::string operand;
 
-                else if (instrName == "STORE") {
+                while (lineStream >> operand) {
 
-                    instr.type = InstructionType::STORE;
+                    // Handle quoted string operands, LOAD/PUSH keep their quotes until literals are decoded
 
-                }
+                    bool keepQuotes = instr.type == InstructionType::LOAD || instr.type == InstructionType::PUSH;
 
-                else if (instrName == "FUNC") {
+                    if (operand.length() >= 2 && operand.front() == '"' && operand.back() == '"') {
 
-                    instr.type = InstructionType::FUNC;
+                        // Remove quotes
 
-                }
+                        if (!keepQuotes) {
 
-                else if (instrName == "CALL") {
+                            operand = operand.substr(1, operand.length() - 2);
 
-                    instr.type = InstructionType::CALL;
+                        }
 
-                }
+                    }
 
-                else if (instrName == "IF") {
+                    else {
 
-                    instr.type = InstructionType::IF;
+                        // Remove possible comma separators
 
-                }
+                        if (!operand.empty() && operand.back() == ',') {
 
-                else if (instrName == "ELSE") {
+                            operand.pop_back();
 
-                    instr.type = InstructionType::ELSE;
+                        }
 
-                }
+                    }
 
-                else if (instrName == "END") {
+                    
 
-                    instr.type = InstructionType::END;
+                    instr.operands.push_back(operand);
 
                 }
 
-                else if (instrName == "WHILE") {
+                instructions.push_back(instr);
+            }
 
-                    instr.type = InstructionType::WHILE;
+            return instructions;
+        }
 
+        // Stack effect of instructions that may appear in a loop condition.
+        // Returns false for instructions that end an expression (statements, control flow).
+        // arity: parameter count of each user function that is not shadowed by a built-in
+        static bool getStackEffect(const Instruction& instr, const std::unordered_map<std::string, int>& arity, int& pops, int& pushes) {
+            switch (instr.type) {
+            case InstructionType::LOAD:
+            case InstructionType::LOAD_CONST:
+            case InstructionType::LOAD_VAR:
+            case InstructionType::LOAD_SLOT:
+            case InstructionType::PUSH:
+            case InstructionType::INPUT:
+            case InstructionType::GC_RUN:
+                pops = 0; pushes = 1;
+                return true;
+            case InstructionType::BINARY_OP:
+                pops = 2; pushes = 1;
+                return true;
+            case InstructionType::CALL:
+                // CALL name [argc], without argc a user function takes its parameters and a built-in one argument
+                if (instr.operands.size() >= 2) {
+                    pops = std::atoi(instr.operands[1].c_str());
                 }
+                else {
+                    auto it = instr.operands.empty() ? arity.end() : arity.find(instr.operands[0]);
+                    pops = it != arity.end() ? it->second : 1;
+                }
+                pushes = 1;
+                return true;
+            case InstructionType::UNARY_OP:
+            case InstructionType::PTR_NEW:
+            case InstructionType::PTR_DEREF:
+            case InstructionType::GC_NEW:
+            case InstructionType::MEM_MALLOC:
+                pops = 1; pushes = 1;
+                return true;
+            default:
+                return false;
+            }
+        }
 
-                else if (instrName == "DO") {
-
-                    instr.type = InstructionType::DO;
-
+        void VirtualMachine::resolveLabels(std::vector<Instruction>& program) {
+            // Index every LABEL once, then patch each GOTO with its destination
+            std::unordered_map<SymbolId, size_t> labels;
+            for (size_t i = 0; i < program.size(); i++) {
+                const Instruction& instr = program[i];
+                if (instr.type != InstructionType::LABEL) continue;
+                if (instr.operands.empty()) {
+                    throw RuntimeError("LABEL missing name", instr.line);
                 }
-
-                else if (instrName == "RETURN") {
-
-                    instr.type = InstructionType::RETURN;
-
+                if (!labels.emplace(state.symbols.intern(instr.operands[0]), i).second) {
+                    throw RuntimeError("Duplicate label: " + instr.operands[0], instr.line);
                 }
+            }
 
-                else if (instrName == "IMPORT") {
-
-                    instr.type = InstructionType::IMPORT;
-
+            for (auto& instr : program) {
+                if (instr.type != InstructionType::GOTO) continue;
+                if (instr.operands.empty()) {
+                    throw RuntimeError("GOTO missing label", instr.line);
                 }
-
-                else if (instrName == "PRINT") {
-
-                    instr.type = InstructionType::PRINT;
-
+                auto it = labels.find(state.symbols.find(instr.operands[0]));
+                if (it == labels.end()) {
+                    throw RuntimeError("Undefined label: " + instr.operands[0], instr.line);
                 }
+                instr.target = it->second + 1; // LABEL itself is a no-op
+            }
 
-                else if (instrName == "INPUT") {
+            state.labels = std::move(labels);
+        }
 
-                    instr.type = InstructionType::INPUT;
+        // Decode a literal operand, string literals are interned. Returns false when the operand is not a literal.
+        static bool decodeLiteral(const std::string& operand, Value& value, InternTable& symbols) {
+            if (operand.length() >= 2 && operand.front() == '"' && operand.back() == '"') {
+                value = symbols.value(symbols.intern(std::string_view(operand).substr(1, operand.length() - 2)));
+                return true;
+            }
+            if (operand == "true" || operand == "false") {
+                value = Value(operand == "true");
+                return true;
+            }
+            if (operand == "null") {
+                value = Value(nullptr);
+                return true;
+            }
+            if (operand.empty()) {
+                return false;
+            }
 
+            // Numbers must be consumed completely, anything else is a name. Only decimal syntax is a
+            // number, so hex and inf/nan (which strtod would take) stay names.
+            if (operand.find_first_not_of("0123456789+-.eE") != std::string::npos) {
+                return false;
+            }
+            const char* begin = operand.c_str();
+            char* end = nullptr;
+            if (operand.find_first_of(".eE") == std::string::npos) {
+                // int when it fits, int64_t otherwise, double only beyond int64_t
+                errno = 0;
+                long long integer = std::strtoll(begin, &end, 10);
+                if (end != begin && *end == '\0' && errno == 0) {
+                    if (integer >= std::numeric_limits<int>::min() && integer <= std::numeric_limits<int>::max()) {
+                        value = Value(static_cast<int>(integer));
+                    }
+                    else {
+                        value = Value(static_cast<int64_t>(integer));
+                    }
+                    return true;
                 }
+            }
+            errno = 0;
+            double number = std::strtod(begin, &end);
+            if (end != begin && *end == '\0' && errno == 0) {
+                value = Value(number);
+                return true;
+            }
+            return false;
+        }
 
-                else if (instrName == "BINARY_OP") {
-
-                    instr.type = InstructionType::BINARY_OP;
-
+        void VirtualMachine::resolveLiterals(std::vector<Instruction>& program) {
+            // Classify LOAD/PUSH operands once so execution never parses text
+            for (auto& instr : program) {
+                if (instr.type == InstructionType::LOAD) {
+                    if (instr.operands.empty()) {
+                        throw RuntimeError("LOAD missing operand", instr.line);
+                    }
+                    instr.type = decodeLiteral(instr.operands[0], instr.literal, state.symbols) ? InstructionType::LOAD_CONST : InstructionType::LOAD_VAR;
                 }
-
-                else if (instrName == "UNARY_OP") {
-
-                    instr.type = InstructionType::UNARY_OP;
-
+                else if (instr.type == InstructionType::PUSH && !instr.operands.empty()) {
+                    // PUSH treats anything that is not a literal as a bare string
+                    const std::string& operand = instr.operands[0];
+                    if (!decodeLiteral(operand, instr.literal, state.symbols)) {
+                        instr.literal = state.symbols.value(state.symbols.intern(operand));
+                    }
+                    instr.type = InstructionType::LOAD_CONST;
                 }
-
-                else if (instrName == "PUSH") {
-
-                    instr.type = InstructionType::PUSH;
-
+                else {
+                    continue;
                 }
 
-                else if (instrName == "POP") {
-
-                    instr.type = InstructionType::POP;
-
+                // Quotes are only needed for classification
+                std::string& operand = instr.operands[0];
+                if (operand.length() >= 2 && operand.front() == '"' && operand.back() == '"') {
+                    operand = operand.substr(1, operand.length() - 2);
                 }
+            }
+        }
 
-                else if (instrName == "GOTO") {
+        // Operator spellings accepted by BINARY_OP and UNARY_OP
+        static Operator decodeOperator(const std::string& text, bool unary) {
+            static const std::unordered_map<std::string, Operator> binaryOperators = {
+                {"+", Operator::ADD}, {"-", Operator::SUB}, {"*", Operator::MUL}, {"/", Operator::DIV},
+                {"%", Operator::MOD}, {"==", Operator::EQ}, {"!=", Operator::NE}, {"<", Operator::LT},
+                {">", Operator::GT}, {"<=", Operator::LE}, {">=", Operator::GE}, {"and", Operator::AND},
+                {"&&", Operator::AND}, {"or", Operator::OR}, {"||", Operator::OR}, {"=", Operator::ASSIGN}
+            };
+            static const std::unordered_map<std::string, Operator> unaryOperators = {
+                {"-", Operator::NEG}, {"!", Operator::NOT}, {"not", Operator::NOT}
+            };
+            const auto& table = unary ? unaryOperators : binaryOperators;
+            auto it = table.find(text);
+            return it != table.end() ? it->second : Operator::NONE;
+        }
 
-                    instr.type = InstructionType::GOTO;
+        // Text form of an operator for error messages
+        static const char* operatorName(Operator op) {
+            switch (op) {
+            case Operator::ADD: return "+";
+            case Operator::SUB: return "-";
+            case Operator::MUL: return "*";
+            case Operator::DIV: return "/";
+            case Operator::MOD: return "%";
+            case Operator::EQ: return "==";
+            case Operator::NE: return "!=";
+            case Operator::LT: return "<";
+            case Operator::GT: return ">";
+            case Operator::LE: return "<=";
+            case Operator::GE: return ">=";
+            case Operator::AND: return "and";
+            case Operator::OR: return "or";
+            case Operator::ASSIGN: return "=";
+            case Operator::NEG: return "-";
+            case Operator::NOT: return "not";
+            default: return "?";
+            }
+        }
 
+        void VirtualMachine::resolveOperators(std::vector<Instruction>& program) {
+            for (auto& instr : program) {
+                if (instr.type != InstructionType::BINARY_OP && instr.type != InstructionType::UNARY_OP) continue;
+                const char* kind = instr.type == InstructionType::BINARY_OP ? "BINARY_OP" : "UNARY_OP";
+                if (instr.operands.empty()) {
+                    throw AccessError(std::string(kind) + " operation missing operator", instr.line);
                 }
-
-                else if (instrName == "LABEL") {
-
-                    instr.type = InstructionType::LABEL;
-
+                instr.op = decodeOperator(instr.operands[0], instr.type == InstructionType::UNARY_OP);
+                if (instr.op == Operator::NONE) {
+                    throw TypeError(std::string("Unsupported ") + (instr.type == InstructionType::UNARY_OP ? "unary " : "") +
+                        "operator: " + instr.operands[0], instr.line);
                 }
+            }
+        }
 
-                else if (instrName == "TRY") {
-
-                    instr.type = InstructionType::TRY;
-
-                }
+        // Variable name of a DEFVAR operand without its type annotation
+        static std::string stripTypeAnnotation(const std::string& name) {
+            size_t colon = name.find(':');
+            return colon == std::string::npos ? name : name.substr(0, colon);
+        }
 
-                else if (instrName == "CATCH") {
+        void VirtualMachine::resolveSlots(std::vector<Instruction>& program) {
+            std::unordered_map<SymbolId, size_t> globalSlots;
+            std::vector<SymbolId> globalNames;
+            std::vector<FunctionInfo> functionTable;
+            std::unordered_map<SymbolId, size_t> functions;
+
+            auto globalSlot = [&](SymbolId name) -> size_t {
+                auto it = globalSlots.find(name);
+                if (it != globalSlots.end()) return it->second;
+                size_t slot = globalNames.size();
+                globalSlots.emplace(name, slot);
+                globalNames.push_back(name);
+                return slot;
+            };
 
-                    instr.type = InstructionType::CATCH;
+            // Function bodies span from FUNC to the RETURN before FUNC's target (see resolveControlFlow)
+            struct FunctionScope {
+                size_t end;
+                std::unordered_map<SymbolId, size_t> locals;
+            };
+            std::vector<FunctionScope> scopes;
 
+            for (size_t i = 0; i < program.size(); i++) {
+                while (!scopes.empty() && i >= scopes.back().end) {
+                    scopes.pop_back();
                 }
 
-                else if (instrName == "BREAK") {
-
-                    instr.type = InstructionType::BREAK;
+                Instruction& instr = program[i];
 
+                if (instr.type == InstructionType::FUNC) {
+                    // FUNC name [param ...]: parameters take the first local slots, then every
+                    // DEFVAR directly inside the body is a local of this function
+                    FunctionScope scope;
+                    scope.end = instr.target;
+                    FunctionInfo info;
+                    if (!instr.operands.empty() && !instr.operands[0].empty()) {
+                        info.name = state.symbols.intern(instr.operands[0]);
+                    }
+                    info.entry = i + 1;
+                    for (size_t p = 1; p < instr.operands.size(); p++) {
+                        SymbolId name = state.symbols.intern(stripTypeAnnotation(instr.operands[p]));
+                        if (!scope.locals.emplace(name, info.localNames.size()).second) {
+                            throw RuntimeError("Duplicate parameter " + state.symbols.text(name) + " in function " + instr.operands[0], instr.line);
+                        }
+                        info.localNames.push_back(name);
+                    }
+                    info.paramCount = info.localNames.size();
+                    for (size_t j = i + 1; j < scope.end; j++) {
+                        const Instruction& inner = program[j];
+                        if (inner.type == InstructionType::FUNC) {
+                            j = inner.target - 1; // Nested functions own their locals
+                        }
+                        else if (inner.type == InstructionType::DEFVAR && !inner.operands.empty()) {
+                            SymbolId name = state.symbols.intern(stripTypeAnnotation(inner.operands[0]));
+                            if (scope.locals.emplace(name, info.localNames.size()).second) {
+                                info.localNames.push_back(name);
+                            }
+                        }
+                    }
+                    info.localCount = info.localNames.size();
+                    if (info.name != NO_SYMBOL) {
+                        functions[info.name] = functionTable.size(); // A later definition replaces an earlier one
+                    }
+                    functionTable.push_back(std::move(info));
+                    scopes.push_back(std::move(scope));
+                    continue;
                 }
 
-                else if (instrName == "CONTINUE") {
-
-                    instr.type = InstructionType::CONTINUE;
-
+                SymbolId name;
+                if (instr.type == InstructionType::DEFVAR && !instr.operands.empty()) {
+                    name = state.symbols.intern(stripTypeAnnotation(instr.operands[0]));
                 }
-
-                else if (instrName == "PASS") {
-
-                    instr.type = InstructionType::PASS;
-
+                else if (instr.type == InstructionType::LOAD_VAR ||
+                         (instr.type == InstructionType::STORE && !instr.operands.empty())) {
+                    name = state.symbols.intern(instr.operands[0]);
                 }
-
-                else if (instrName == "PACKAGE") {
-
-                    instr.type = InstructionType::PACKAGE;
-
+                else {
+                    continue;
                 }
 
-                else if (instrName == "PTR_new") {
-
-                    instr.type = InstructionType::PTR_NEW;
-
+                // Locals of the enclosing function shadow globals
+                instr.localSlot = false;
+                if (!scopes.empty()) {
+                    auto it = scopes.back().locals.find(name);
+                    if (it != scopes.back().locals.end()) {
+                        instr.slot = static_cast<int>(it->second);
+                        instr.localSlot = true;
+                    }
+                }
+                if (!instr.localSlot) {
+                    instr.slot = static_cast<int>(globalSlot(name));
                 }
 
-                else if (instrName == "PTR_DEREF") {
+                switch (instr.type) {
+                case InstructionType::DEFVAR: instr.type = InstructionType::DEFVAR_SLOT; break;
+                case InstructionType::LOAD_VAR: instr.type = InstructionType::LOAD_SLOT; break;
+                default: instr.type = InstructionType::STORE_SLOT; break;
+                }
+            }
 
-                    instr.type = InstructionType::PTR_DEREF;
+            state.globalSlots = std::move(globalSlots);
+            state.globalNames = std::move(globalNames);
+            state.globals.assign(state.globalNames.size(), Value(0)); // Undefined variables read as 0
+            state.functionTable = std::move(functionTable);
+            state.functions = std::move(functions);
+            state.locals.clear();
+            state.frames.clear();
+            state.localsBase = 0;
+        }
 
+        void VirtualMachine::resolveCalls(std::vector<Instruction>& program) {
+            // CALL name [argc]: built-ins take precedence over user functions, unknown names fail when the CALL runs
+            for (auto& instr : program) {
+                if (instr.type != InstructionType::CALL) continue;
+                if (instr.operands.empty()) {
+                    throw RuntimeError("CALL missing function name", instr.line);
+                }
+                const std::string& name = instr.operands[0];
+
+                uint32_t argc = CALL_ARGC_DEFAULT;
+                if (instr.operands.size() >= 2) {
+                    const std::string& count = instr.operands[1];
+                    if (count.empty() || count.size() > 3 || count.find_first_not_of("0123456789") != std::string::npos ||
+                        std::stoul(count) >= CALL_ARGC_DEFAULT) {
+                        throw RuntimeError("Invalid argument count for " + name + ": " + count, instr.line);
+                    }
+                    argc = static_cast<uint32_t>(std::stoul(count));
                 }
 
-                else if (instrName == "THROW") {
-
+                SymbolId symbol = state.symbols.intern(name);
+                uint32_t builtIn = builtInFunctions.find(symbol);
+                if (builtIn != NO_IMMEDIATE && name == "throw") {
+                    // throw(value) unwinds through THROW, not through a C++ exception out of the built-in
                     instr.type = InstructionType::THROW;
-
+                    instr.target = argc == CALL_ARGC_DEFAULT ? NO_TARGET : argc;
+                    continue;
                 }
-
-                else if (instrName == "GC_new") {
-
-                    instr.type = InstructionType::GC_NEW;
-
+                if (builtIn != NO_IMMEDIATE) {
+                    instr.target = CALL_BUILTIN_FLAG | (argc << CALL_ARGC_SHIFT) | builtIn;
+                    continue;
                 }
 
-                else if (instrName == "GC_delete") {
-
-                    instr.type = InstructionType::GC_DELETE;
-
+                auto it = state.functions.find(symbol);
+                if (it == state.functions.end()) continue;
+                const FunctionInfo& info = state.functionTable[it->second];
+                if (argc == CALL_ARGC_DEFAULT) {
+                    if (info.paramCount >= CALL_ARGC_DEFAULT) {
+                        throw RuntimeError("Too many parameters in function: " + name, instr.line);
+                    }
+                    argc = static_cast<uint32_t>(info.paramCount);
                 }
+                else if (argc != info.paramCount) {
+                    throw TypeError("Function " + name + " expects " + std::to_string(info.paramCount) +
+                        " arguments, got " + std::to_string(argc), instr.line);
+                }
+                if (it->second > CALL_INDEX_MASK) {
+                    throw RuntimeError("Too many functions", instr.line);
+                }
+                instr.target = (argc << CALL_ARGC_SHIFT) | static_cast<uint32_t>(it->second);
+            }
+        }
 
-                else if (instrName == "GC_gc") {
-
-                    instr.type = InstructionType::GC_RUN;
+        size_t VirtualMachine::findConditionStart(const std::vector<Instruction>& program, size_t whileIndex,
+            const std::unordered_map<std::string, int>& arity) {
+            // Walk backwards until the instructions before WHILE produce exactly the one value it pops
+            int needed = 1;
+            size_t current = whileIndex;
+            while (current > 0 && needed > 0) {
+                int pops = 0, pushes = 0;
+                if (!getStackEffect(program[current - 1], arity, pops, pushes)) {
+                    break;
+                }
+                needed += pops - pushes;
+                current--;
+            }
+            return current;
+        }
 
+        void VirtualMachine::lowerCatches(std::vector<Instruction>& program) {
+            // CATCH name: the handler starts right after CATCH with the thrown value on the operand stack
+            if (std::none_of(program.begin(), program.end(),
+                [](const Instruction& instr) { return instr.type == InstructionType::CATCH; })) {
+                return;
+            }
+            std::vector<Instruction> lowered;
+            lowered.reserve(program.size());
+            for (auto& instr : program) {
+                lowered.push_back(std::move(instr));
+                const Instruction& catchInstr = lowered.back();
+                if (catchInstr.type != InstructionType::CATCH) continue;
+
+                Instruction bind;
+                bind.line = catchInstr.line;
+                if (catchInstr.operands.empty()) {
+                    bind.type = InstructionType::POP;
+                    lowered.push_back(std::move(bind));
+                    continue;
                 }
+                std::string name = catchInstr.operands[0];
+                bind.type = InstructionType::DEFVAR;
+                bind.operands.push_back(name);
+                lowered.push_back(bind);
+                bind.type = InstructionType::STORE;
+                bind.operands.assign(1, stripTypeAnnotation(name));
+                lowered.push_back(std::move(bind));
+            }
+            program = std::move(lowered);
+        }
 
-                else if (instrName == "MEM_malloc") {
+        void VirtualMachine::resolveControlFlow(std::vector<Instruction>& program) {
+            struct Block {
+                InstructionType kind;
+                size_t start;                   // IF/WHILE/FUNC/TRY instruction
+                size_t elseIndex;               // ELSE of an IF block, CATCH of a TRY block
+                size_t loopHead;                // First instruction of a WHILE condition
+                uint32_t function;              // Innermost enclosing function (its id for FUNC), NO_IMMEDIATE at top level
+                std::vector<size_t> breaks;
+                std::vector<size_t> continues;
+            };
+            std::vector<Block> blocks;
+            std::vector<ExceptionHandler> handlers;
+            uint32_t functionCount = 0; // FUNCs so far, their ids in resolveSlots follow program order
 
-                    instr.type = InstructionType::MEM_MALLOC;
+            // Parameter counts for delimiting WHILE conditions that call a user function without argc
+            std::unordered_map<std::string, int> arity;
+            for (const auto& instr : program) {
+                if (instr.type == InstructionType::FUNC && !instr.operands.empty() && !instr.operands[0].empty() &&
+                    builtInFunctions.find(state.symbols.intern(instr.operands[0])) == NO_IMMEDIATE) {
+                    arity[instr.operands[0]] = static_cast<int>(instr.operands.size() - 1); // A later definition replaces an earlier one
+                }
+            }
 
+            auto innermostLoop = [&blocks]() -> Block* {
+                for (auto it = blocks.rbegin(); it != blocks.rend(); ++it) {
+                    if (it->kind == InstructionType::WHILE) return &*it;
+                    if (it->kind == InstructionType::FUNC) break; // Loops do not extend into function bodies
                 }
+                return nullptr;
+            };
 
-                else if (instrName == "MEM_free") {
+            for (size_t i = 0; i < program.size(); i++) {
+                Instruction& instr = program[i];
+                instr.target = NO_TARGET;
 
-                    instr.type = InstructionType::MEM_FREE;
+                uint32_t function = blocks.empty() ? NO_IMMEDIATE : blocks.back().function;
+                switch (instr.type) {
+                case InstructionType::IF:
+                case InstructionType::TRY:
+                    blocks.push_back({ instr.type, i, NO_TARGET, NO_TARGET, function, {}, {} });
+                    break;
 
-                }
+                case InstructionType::FUNC:
+                    blocks.push_back({ instr.type, i, NO_TARGET, NO_TARGET, functionCount++, {}, {} });
+                    break;
 
-                else {
+                case InstructionType::WHILE:
+                    blocks.push_back({ instr.type, i, NO_TARGET, findConditionStart(program, i, arity), function, {}, {} });
+                    break;
 
-                    instr.type = InstructionType::NOP;
+                case InstructionType::CATCH:
+                    if (blocks.empty() || blocks.back().kind != InstructionType::TRY || blocks.back().elseIndex != NO_TARGET) {
+                        throw RuntimeError("CATCH without matching TRY", instr.line);
+                    }
+                    blocks.back().elseIndex = i;
+                    break;
+
+                case InstructionType::ELSE:
+                    if (blocks.empty() || blocks.back().kind != InstructionType::IF || blocks.back().elseIndex != NO_TARGET) {
+                        throw RuntimeError("ELSE without matching IF", instr.line);
+                    }
+                    blocks.back().elseIndex = i;
+                    break;
 
+                case InstructionType::BREAK:
+                case InstructionType::CONTINUE: {
+                    Block* loop = innermostLoop();
+                    if (!loop) {
+                        throw RuntimeError(std::string(instr.type == InstructionType::BREAK ? "BREAK" : "CONTINUE") + " outside of a loop", instr.line);
+                    }
+                    (instr.type == InstructionType::BREAK ? loop->breaks : loop->continues).push_back(i);
+                    break;
                 }
 
-                // Parse operands
-
-                std::string operand;
-
-                while (lineStream >> operand) {
+                case InstructionType::END: {
+                    if (blocks.empty()) {
+                        throw RuntimeError("END without matching block", instr.line);
+                    }
+                    Block block = std::move(blocks.back());
+                    blocks.pop_back();
+
+                    if (block.kind == InstructionType::IF) {
+                        // A false condition lands after ELSE (or after END), the then-branch skips the else-branch
+                        if (block.elseIndex != NO_TARGET) {
+                            program[block.start].target = block.elseIndex + 1;
+                            program[block.elseIndex].target = i + 1;
+                        }
+                        else {
+                            program[block.start].target = i + 1;
+                        }
+                    }
+                    else if (block.kind == InstructionType::TRY) {
+                        // Finishing the try body skips the handler. Inner blocks END first, so they come first.
+                        if (block.elseIndex != NO_TARGET) {
+                            program[block.elseIndex].target = i + 1;
+                            handlers.push_back({ static_cast<uint32_t>(block.start), static_cast<uint32_t>(block.elseIndex),
+                                static_cast<uint32_t>(block.elseIndex + 1), block.function });
+                        }
+                    }
+                    else if (block.kind == InstructionType::WHILE) {
+                        // WHILE exits past END, END jumps back to re-evaluate the condition
+                        program[block.start].target = i + 1;
+                        instr.target = block.loopHead;
+                        for (size_t b : block.breaks) program[b].target = i + 1;
+                        for (size_t c : block.continues) program[c].target = block.loopHead;
+                    }
+                    else {
+                        // Straight-line execution skips function bodies; falling off the end returns
+                        program[block.start].target = i + 1;
+                        instr.type = InstructionType::RETURN;
+                    }
+                    break;
+                }
 
-                    // Handle quoted string operands
+                default:
+                    break;
+                }
+            }
 
-                    if (operand.length() >= 2 && operand.front() == '"' && operand.back() == '"') {
+            if (!blocks.empty()) {
+                const Instruction& open = program[blocks.back().start];
+                throw RuntimeError("Block is missing its END", open.line);
+            }
 
-                        // Remove quotes
+            state.handlers = std::move(handlers);
+        }
 
-                        operand = operand.substr(1, operand.length() - 2);
+        void VirtualMachine::packProgram(const std::vector<Instruction>& program) {
+            if (program.size() >= NO_IMMEDIATE) {
+                throw RuntimeError("Program too large", -1);
+            }
 
+            CodeStream code;
+            code.opcodes.reserve(program.size());
+            code.immediates.reserve(program.size());
+            code.operandStart.reserve(program.size() + 1);
+            code.lines.reserve(program.size());
+            code.symbols = &state.symbols;
+
+            // String literals get one constant per distinct string, holding its interned payload
+            std::unordered_map<SymbolId, uint32_t> stringConstants;
+            for (const auto& instr : program) {
+                uint32_t immediate = NO_IMMEDIATE;
+                switch (instr.type) {
+                case InstructionType::LOAD_CONST:
+                    if (instr.literal.is<std::string>()) {
+                        SymbolId symbol = state.symbols.intern(instr.literal.get<std::string>());
+                        auto inserted = stringConstants.emplace(symbol, static_cast<uint32_t>(code.constants.size()));
+                        if (inserted.second) {
+                            code.constants.push_back(state.symbols.value(symbol));
+                        }
+                        immediate = inserted.first->second;
+                        break;
+                    }
+                    immediate = static_cast<uint32_t>(code.constants.size());
+                    code.constants.push_back(instr.literal);
+                    break;
+                case InstructionType::DEFVAR_SLOT:
+                case InstructionType::LOAD_SLOT:
+                case InstructionType::STORE_SLOT:
+                    immediate = static_cast<uint32_t>(instr.slot) | (instr.localSlot ? LOCAL_SLOT_FLAG : 0);
+                    break;
+                case InstructionType::BINARY_OP:
+                case InstructionType::UNARY_OP:
+                    immediate = static_cast<uint32_t>(instr.op);
+                    break;
+                default:
+                    if (instr.target != NO_TARGET) {
+                        immediate = static_cast<uint32_t>(instr.target);
                     }
+                    break;
+                }
 
-                    else {
+                code.opcodes.push_back(instr.type);
+                code.immediates.push_back(immediate);
+                code.lines.push_back(instr.line);
+                code.operandStart.push_back(static_cast<uint32_t>(code.operandNames.size()));
+                for (const auto& operand : instr.operands) {
+                    code.operandNames.push_back(state.symbols.intern(operand));
+                }
+            }
+            code.operandStart.push_back(static_cast<uint32_t>(code.operandNames.size()));
 
-                        // Remove possible comma separators
+            state.code = std::move(code);
+        }
 
-                        if (!operand.empty() && operand.back() == ',') {
+        Instruction CodeStream::unpack(size_t pc) const {
+            Instruction instr;
+            instr.type = superinstructionHead(opcodes[pc]);
+            instr.line = lines[pc];
+            for (size_t i = 0; i < operandCount(pc); i++) {
+                instr.operands.push_back(operand(pc, i));
+            }
 
-                            operand.pop_back();
+            uint32_t immediate = immediates[pc];
+            switch (instr.type) {
+            case InstructionType::LOAD_CONST:
+                instr.literal = constants[immediate];
+                break;
+            case InstructionType::DEFVAR_SLOT:
+            case InstructionType::LOAD_SLOT:
+            case InstructionType::STORE_SLOT:
+                instr.slot = static_cast<int>(immediate & ~LOCAL_SLOT_FLAG);
+                instr.localSlot = (immediate & LOCAL_SLOT_FLAG) != 0;
+                break;
+            case InstructionType::BINARY_OP:
+            case InstructionType::UNARY_OP:
+                instr.op = static_cast<Operator>(immediate);
+                break;
+            default:
+                instr.target = immediate == NO_IMMEDIATE ? NO_TARGET : immediate;
+                break;
+            }
+            return instr;
+        }
 
-                        }
+        void VirtualMachine::fuseSuperinstructions() {
+            if (!useSuperinstructions || STEVE_PROFILE_OPCODES) {
+                return;
+            }
 
+            // Only the head of a sequence is rewritten: the instructions after it keep their opcodes
+            // and immediates, so the superinstruction can read its operands from them and jumps into
+            // the middle of the sequence still run the original instructions
+            CodeStream& code = state.code;
+            for (size_t i = 0; i < code.size(); i++) {
+                for (const SuperinstructionPattern& pattern : SUPERINSTRUCTION_PATTERNS) {
+                    if (pattern.weight == 0 || i + pattern.length > code.size() ||
+                        !std::equal(pattern.sequence, pattern.sequence + pattern.length, code.opcodes.begin() + i)) {
+                        continue;
                     }
-
-                    
-
-                    instr.operands.push_back(operand);
-
+                    InstructionType fused = pattern.fused;
+                    if (fused == InstructionType::VAR_CONST_OP_STORE && code.immediates[i] == code.immediates[i + 3] &&
+                        static_cast<Operator>(code.immediates[i + 2]) == Operator::ADD) {
+                        fused = InstructionType::INC_VAR;
+                    }
+                    code.opcodes[i] = fused;
+                    break;
                 }
+            }
+        }
 
-                instructions.push_back(instr);
+        void CodeStream::unfuse() {
+            for (auto& opcode : opcodes) {
+                opcode = superinstructionHead(opcode);
             }
+        }
 
-            return instructions;
+        void CodeStream::clear() {
+            opcodes.clear();
+            immediates.clear();
+            operandStart.clear();
+            operandNames.clear();
+            lines.clear();
+            constants.clear();
         }
 
         bool VirtualMachine::execute() {
 
-            if (state.program.empty()) {
+            if (state.code.empty()) {
 
                 std::cerr << "Internal Error: No program loaded" << std::endl;
 
@@ -1306,121 +2007,103 @@ namespace steve {
 
 
 
-            // Check if JIT compilation should be used
+            // Execute using the JIT, the register tier or the interpreter
 
-            if (useJIT && canJITCompile()) {
+            state.pc = 0;
 
-                try {
+            state.running = true;
 
-                    // Try to compile and execute
+            if (useOSR) {
 
-                    if (jitCompiler->compile(state.program)) {
+                loopHeat.resize(state.code.size(), 0);
 
-                        int64_t result = jitCompiler->execute();
+            }
 
-                        std::cout << "JIT execution result: " << result << std::endl;
 
-                        return true;
 
-                    }
+            for (;;) {
 
-                }
-
-                catch (const std::exception& e) {
+                try {
 
-                    std::cerr << "JIT compilation failed: " << e.what() << ", falling back to interpreter" << std::endl;
+                    if (useJIT && canJITCompile() && (jitCompiler->isCompiled() || jitCompiler->compile(*this))) {
 
-                }
+                        // Compiled code hands errors back here like dispatch() does
 
-            }
+                        jitCompiler->run(*this);
 
+                    }
 
+                    else if (useRegisterTier) {
 
-            // Execute using interpreter
+                        if (!registerCode) {
 
-            state.pc = 0;
+                            translateRegisters();
 
-            state.running = true;
+                        }
 
+                        if (!dispatchRegisters()) {
 
+                            return false;
 
-            try {
+                        }
 
-                while (state.running && state.pc < state.program.size()) {
+                    }
 
-                    if (!executeInstruction(state.pc)) {
+                    else if (!dispatch(false)) {
 
                         return false;
 
                     }
 
-                    state.pc++;
+                    // The interpreter stopped at a hot loop: run it compiled, then interpret on from its exit
 
-                }
+                    if (osrPending) {
 
-            }
+                        osrPending = false;
 
-            catch (const VMException& e) {
+                        runCompiledLoop();
 
-                std::cerr << "VM Exception, PC " << state.pc << ": " << e.what() << std::endl;
+                        continue;
 
-                if (e.getLine() > 0) {
+                    }
 
-                    std::cerr << "  At line " << e.getLine() << std::endl;
+                    break;
 
                 }
 
-                return false;
+                catch (const VMException& e) {
 
-            }
+                    // Errors raised by the VM are catchable like a THROW of their message
 
-            catch (const std::exception& e) {
+                    if (!dynamic_cast<const UncaughtException*>(&e) && throwValue(Value(std::string(e.what())), state.pc - 1)) {
 
-                std::cerr << "Standard Exception, PC " << state.pc << ": " << e.what() << std::endl;
-
-                return false;
+                        continue;
 
-            }
-
-            catch (...) {
-
-                std::cerr << "Unknown Exception, PC " << state.pc << std::endl;
-
-                return false;
-
-            }
-
-
-
-            return true;
-
-        }
-
-        bool VirtualMachine::canJITCompile() {
-
-            // Simple check to determine if program is suitable for JIT compilation
+                    }
 
-            if (state.program.size() == 0) {
+                    std::cerr << "VM Exception, PC " << state.pc << ": " << e.what() << std::endl;
 
-                return false;
+                    if (e.getLine() > 0) {
 
-            }
+                        std::cerr << "  At line " << e.getLine() << std::endl;
 
+                    }
 
+                    return false;
 
-            // Check if it contains complex instructions
+                }
 
-            for (const auto& instr : state.program) {
+                catch (const std::exception& e) {
 
-                if (instr.type == InstructionType::FUNC ||
+                    std::cerr << "Standard Exception, PC " << state.pc << ": " << e.what() << std::endl;
 
-                    instr.type == InstructionType::IF ||
+                    return false;
 
-                    instr.type == InstructionType::WHILE ||
+                }
 
-                    instr.type == InstructionType::CALL ||
+                catch (...) {
 
-                    instr.type == InstructionType::GOTO) {
+                    std::cerr << "Unknown Exception, PC " << state.pc << std::endl;
 
                     return false;
 
@@ -1434,23 +2117,91 @@ namespace steve {
 
         }
 
-        bool VirtualMachine::executeInstruction(size_t index) {
-            if (index >= state.program.size()) {
-                return false;
+        void VirtualMachine::runCompiledLoop() {
+            size_t end = osrLoop;
+            osrLoop = NO_IMMEDIATE;
+            if (end != NO_IMMEDIATE && !jitCompiler->canEnter(state.pc) &&
+                !jitCompiler->compileLoop(*this, static_cast<uint32_t>(state.pc), static_cast<uint32_t>(end))) {
+                // Unsupported host or no code memory: interpret the loop for another while
+                loopHeat[end] = 0;
+                return;
             }
+            jitCompiler->runLoop(*this);
+        }
 
-            const Instruction& instr = state.program[index];
-            return decodeAndExecute(instr);
+        bool VirtualMachine::canJITCompile() {
+            // The baseline JIT compiles any program, it only needs a supported host
+            return JITCompiler::supported() && !state.code.empty();
         }
 
-        bool VirtualMachine::decodeAndExecute(const Instruction& instr) {
+        // Interpreter core. Each handler ends in VM_NEXT(). With threaded dispatch it leaves the
+        // handler scope with a plain goto (a computed goto would skip the destructors of the
+        // handler's locals) and the shared tail jumps straight to the next handler through the
+        // label table; the compiler replicates that indirect jump into every handler.
+        // With switch dispatch VM_NEXT() returns to the top of the loop.
+        // With singleStep only the instruction at state.pc runs (used by the debugger).
+#define VM_FETCH() \
+            if (!state.running || state.pc >= programSize) return true; \
+            current = state.pc++; \
+            state.instructionCount++; \
+            VM_PROFILE()
+
+#if STEVE_PROFILE_OPCODES
+#define VM_PROFILE() profileOpcode(current, code.opcodes[current])
+#else
+#define VM_PROFILE() ((void)0)
+#endif
+
+#if STEVE_THREADED_DISPATCH
+#define VM_CASE(op) op_##op
+#define VM_DEFAULT op_UNKNOWN
+#define VM_DISPATCH() do { VM_FETCH(); goto *dispatchTable[static_cast<size_t>(code.opcodes[current])]; } while (0)
+#define VM_NEXT() goto next_instruction
+#else
+#define VM_CASE(op) case InstructionType::op
+#define VM_DEFAULT default
+#define VM_NEXT() break
+#endif
+
+        bool VirtualMachine::dispatch(bool singleStep) {
+            const CodeStream& code = state.code;
+            const size_t programSize = code.size();
+            size_t current = state.pc;
+
+#if STEVE_THREADED_DISPATCH
+            // Handler for every InstructionType, in declaration order
+            static void* const dispatchTable[] = {
+                &&op_DEFVAR, &&op_UNKNOWN /* LOAD, lowered at load time */, &&op_STORE, &&op_FUNC,
+                &&op_CALL, &&op_IF, &&op_ELSE, &&op_END, &&op_WHILE, &&op_DO, &&op_RETURN, &&op_IMPORT,
+                &&op_PRINT, &&op_INPUT, &&op_BINARY_OP, &&op_UNARY_OP, &&op_UNKNOWN /* PUSH, lowered */,
+                &&op_POP, &&op_GOTO, &&op_LABEL, &&op_GC_NEW, &&op_GC_DELETE, &&op_GC_RUN,
+                &&op_MEM_MALLOC, &&op_MEM_FREE, &&op_TRY, &&op_CATCH, &&op_BREAK, &&op_CONTINUE,
+                &&op_PASS, &&op_PACKAGE, &&op_PTR_NEW, &&op_PTR_DEREF, &&op_THROW, &&op_NOP,
+                &&op_UNKNOWN /* DEBUG */, &&op_LOAD_CONST, &&op_LOAD_VAR, &&op_DEFVAR_SLOT,
+                &&op_LOAD_SLOT, &&op_STORE_SLOT, &&op_INC_VAR, &&op_VAR_CONST_OP_STORE,
+                &&op_CMP_VAR_CONST_JUMP_IF_FALSE, &&op_CMP_CONST_JUMP_IF_FALSE, &&op_VAR_CONST_OP,
+                &&op_VAR_VAR_OP, &&op_CONST_STORE
+            };
+            static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == static_cast<size_t>(InstructionType::CONST_STORE) + 1,
+                "dispatchTable must cover every InstructionType");
+#endif
+
             try {
-                switch (instr.type) {
-                case InstructionType::DEFVAR: {
 
-                    if (instr.operands.size() >= 1) {
+#if STEVE_THREADED_DISPATCH
+                VM_DISPATCH();
+                {
+#else
+                for (;;) {
+                VM_FETCH();
+                switch (code.opcodes[current]) {
+#endif
+
+                VM_CASE(DEFVAR): {
 
-                        std::string varName = instr.operands[0];
+                    if (code.operandCount(current) >= 1) {
+
+                        std::string varName = code.operand(current, 0);
 
                         // Remove type annotation part (if exists)
 
@@ -1460,113 +2211,85 @@ namespace steve {
 
                         }
 
-                        state.variables[varName] = Value(0); // Default value is 0
+                        setVariable(state.symbols.intern(varName), Value(0)); // Default value is 0
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::LOAD: {
-
-                    if (instr.operands.size() >= 1) {
+                VM_CASE(LOAD_CONST): {
 
-                        std::string operand = instr.operands[0];
+                    // Literal decoded at load time
 
-                        // Check if it's a literal value or variable name
-
-                        if (operand[0] == '"' && operand.back() == '"') {
-
-                            // String literal
-
-                            std::string strValue = operand.substr(1, operand.length() - 2);
-
-                            state.stack.push_back(Value(strValue));
-
-                        }
-
-                        else if (operand == "true" || operand == "false") {
-
-                            // Boolean value
-
-                            state.stack.push_back(Value(operand == "true"));
-
-                        }
+                    state.stack.push_back(code.constants[code.immediates[current]]);
 
-                        else if (operand == "null") {
+                    VM_NEXT();
 
-                            // Null value
-
-                            state.stack.push_back(Value(nullptr));
-
-                        }
-
-                        else {
-
-                            // Try to parse as number
+                }
 
-                            try {
+                VM_CASE(LOAD_VAR): {
 
-                                if (operand.find('.') != std::string::npos) {
+                    // Variable looked up by name (undefined variables default to 0)
 
-                                    // Floating point number
+                    state.stack.push_back(getVariable(code.operandSymbol(current, 0)));
 
-                                    state.stack.push_back(Value(std::stod(operand)));
+                    VM_NEXT();
 
-                                }
+                }
 
-                                else {
+                VM_CASE(DEFVAR_SLOT): {
 
-                                    // Integer
+                    // Define variable by slot, default value is 0
 
-                                    state.stack.push_back(Value(std::stoi(operand)));
+                    Value& slot = slotValue(code.immediates[current]);
 
-                                }
+                    slot = Value(0);
 
-                            }
+                    VM_NEXT();
 
-                            catch (...) {
+                }
 
-                                // Variable name
+                VM_CASE(LOAD_SLOT): {
 
-                                auto it = state.variables.find(operand);
+                    const Value& slot = slotValue(code.immediates[current]);
 
-                                if (it != state.variables.end()) {
+                    state.stack.push_back(slot);
 
-                                    state.stack.push_back(it->second);
+                    VM_NEXT();
 
-                                }
+                }
 
-                                else {
+                VM_CASE(STORE_SLOT): {
 
-                                    // Undefined variable defaults to 0
+                    if (state.stack.empty()) {
 
-                                    state.stack.push_back(Value(0));
+                        throw AccessError("Stack underflow during STORE operation", code.lines[current]);
 
-                                }
+                    }
 
-                            }
+                    Value& slot = slotValue(code.immediates[current]);
 
-                        }
+                    slot = std::move(state.stack.back());
 
-                    }
+                    state.stack.pop_back();
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::STORE: {
+                VM_CASE(STORE): {
 
                     if (state.stack.empty()) {
 
-                        throw AccessError("Stack underflow during STORE operation", instr.line);
+                        throw AccessError("Stack underflow during STORE operation", code.lines[current]);
 
                     }
 
-                    if (instr.operands.size() < 1) {
+                    if (code.operandCount(current) < 1) {
 
-                        throw AccessError("STORE operation missing variable name", instr.line);
+                        throw AccessError("STORE operation missing variable name", code.lines[current]);
 
                     }
 
@@ -1578,251 +2301,177 @@ namespace steve {
 
 
 
-                    std::string varName = instr.operands[0];
-
-                    state.variables[varName] = val;
+                    setVariable(code.operandSymbol(current, 0), val);
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::FUNC: {
-
-                    // Function definition, record function position in program
-
-                    if (instr.operands.size() >= 1) {
-
-                        std::string funcName = instr.operands[0];
-
-                        state.functions[funcName] = state.pc;
-
+                VM_CASE(FUNC): {
 
+                    // Skip over the body, it only runs when called
 
-                        // Create new scope
+                    if (code.immediates[current] != NO_IMMEDIATE) {
 
-                        state.scopes.push_back({});
+                        state.pc = code.immediates[current];
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::CALL: {
-
-                    // Function call
-
-                    if (instr.operands.size() >= 1) {
-
-                        std::string funcName = instr.operands[0];
-
-
+                VM_CASE(CALL): {
 
-                        // Check if it's a built-in function
+                    uint32_t immediate = code.immediates[current];
 
-                        auto builtInIt = builtInFunctions.find(funcName);
+                    if (immediate == NO_IMMEDIATE) {
 
-                        if (builtInIt != builtInFunctions.end()) {
+                        throw RuntimeError("Undefined function: " + code.operand(current, 0), code.lines[current]);
 
-                            // Call built-in function
-
-                            std::vector<Value> args;
-
-                            // Get parameters from stack (if any)
-
-                            if (!state.stack.empty()) {
-
-                                args.push_back(state.stack.back());
-
-                                state.stack.pop_back();
-
-                            }
-
-                            Value result = builtInIt->second(args);
-
-                            state.stack.push_back(result);
-
-                        }
-
-                        else {
-
-                            // Call user-defined function
-
-                            auto funcIt = state.functions.find(funcName);
-
-                            if (funcIt != state.functions.end()) {
-
-                                // Save return address
-
-                                state.stack.push_back(Value(static_cast<int>(state.pc)));
-
-                                // Jump to function
-
-                                state.pc = funcIt->second;
+                    }
 
-                            }
+                    uint32_t index = immediate & CALL_INDEX_MASK;
 
-                            else {
+                    size_t argc = (immediate >> CALL_ARGC_SHIFT) & CALL_ARGC_MASK;
 
-                                throw RuntimeError("Undefined function: " + funcName, instr.line);
+                    if (immediate & CALL_BUILTIN_FLAG) {
 
-                            }
+                        callBuiltIn(immediate, current);
 
-                        }
+                        VM_NEXT();
 
                     }
 
-                    break;
-
-                }
-
-                            case InstructionType::IF: {
-
-                if (state.stack.empty()) {
+                    enterFunction(index, argc, state.pc, code.lines[current]);
 
-                    language::reportError("RuntimeError", "IF: Stack is empty", true);
+                    VM_NEXT();
 
                 }
 
-                Value condition = state.stack.back();
+                VM_CASE(IF): {
 
-                state.stack.pop_back();
-
-                bool condValue = getBoolValue(condition);
-
-                if (!condValue) {
-
-                    jumpToElseOrEnd();
+                    if (state.stack.empty()) {
 
-                }
+                        throw AccessError("Stack is empty during IF operation", code.lines[current]);
 
-                break;
-
-            }
+                    }
 
-                                case InstructionType::WHILE: {
+                    Value condition = state.stack.back();
 
-                    // WHILE loop start
+                    state.stack.pop_back();
 
-                    if (!state.stack.empty()) {
+                    // Condition false: jump straight to the else-branch or past END
 
-                        Value condition = state.stack.back();
+                    if (!getBoolValue(condition)) {
 
-                        state.stack.pop_back();
+                        state.pc = code.immediates[current];
 
+                    }
 
+                    VM_NEXT();
 
-                        bool condValue = getBoolValue(condition);
+                }
 
+                VM_CASE(WHILE): {
 
+                    // WHILE loop condition check, the condition was computed just before
 
-                        if (!condValue) {
+                    if (state.stack.empty()) {
 
-                            // Condition is false, jump to END
+                        throw AccessError("Stack is empty during WHILE operation", code.lines[current]);
 
-                            jumpToEnd();
+                    }
 
-                        }
+                    Value condition = state.stack.back();
 
-                        else {
+                    state.stack.pop_back();
 
-                            // Condition is true, record loop start position for later jump back
+                    // Condition false: leave the loop
 
-                            state.stack.push_back(Value(static_cast<int>(state.pc - 1)));
+                    if (!getBoolValue(condition)) {
 
-                        }
+                        state.pc = code.immediates[current];
 
                     }
 
-                    else {
+                    VM_NEXT();
 
-                        throw AccessError("Stack is empty during WHILE operation", instr.line);
+                }
 
-                    }
+                VM_CASE(ELSE): {
 
-                    break;
+                    // End of the then-branch, skip the else-branch
 
-                }
+                    state.pc = code.immediates[current];
 
-                            case InstructionType::ELSE: {
+                    VM_NEXT();
 
-                jumpToEnd();
+                }
 
-                break;
+                VM_CASE(END): {
 
-            }
+                    // Loop END jumps back to the condition, IF END falls through
 
-                case InstructionType::END: {
+                    if (code.immediates[current] != NO_IMMEDIATE) {
 
-                    // END instruction, check if it's loop end, if so jump back to loop start
+                        state.pc = code.immediates[current];
 
-                    if (!state.stack.empty() && std::holds_alternative<int>(state.stack.back())) {
+                        // A hot loop goes on as compiled code from its condition (on-stack replacement)
 
-                        int loopStart = std::get<int>(state.stack.back());
+                        if (useOSR && !singleStep && ++loopHeat[current] >= JIT_OSR_THRESHOLD) {
 
-                        // Check if it's a reasonable loop start position
+                            osrPending = true;
 
-                        if (loopStart >= 0 && loopStart < static_cast<int>(state.program.size())) {
+                            osrLoop = current;
 
-                            // Jump back to loop start to recheck condition
-
-                            state.pc = loopStart;
+                            return true;
 
                         }
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::DO: {
+                VM_CASE(DO): {
 
                     // DO is the start of WHILE loop body, no special handling needed
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::RETURN: {
-
-                    // RETURN instruction, handle function return
-
-                    // Return to caller
-
-                    if (!state.stack.empty() && std::holds_alternative<int>(state.stack.back())) {
+                VM_CASE(RETURN): {
 
-                        int returnAddr = std::get<int>(state.stack.back());
+                    if (state.frames.empty()) {
 
-                        state.stack.pop_back();
-
-                        state.pc = returnAddr;
+                        // RETURN outside of a function stops execution
 
+                        state.running = false;
 
+                        VM_NEXT();
 
-                        // Restore scope
+                    }
 
-                        if (state.scopes.size() > 1) {
+                    leaveFunction();
 
-                            state.scopes.pop_back();
+                    // Back in a loop that runs compiled code, continue its iteration there
 
-                        }
+                    if (useOSR && !singleStep && jitCompiler->canEnter(state.pc)) {
 
-                    }
+                        osrPending = true;
 
-                    else {
-
-                        // No return address, stop execution
-
-                        state.running = false;
+                        return true;
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::PRINT: {
+                VM_CASE(PRINT): {
 
                     // PRINT instruction
 
@@ -1834,39 +2483,39 @@ namespace steve {
 
 
 
-                        if (std::holds_alternative<std::string>(val)) {
+                        if (val.is<std::string>()) {
 
-                            std::cout << std::get<std::string>(val);
+                            std::cout << val.get<std::string>();
 
                         }
 
-                        else if (std::holds_alternative<int>(val)) {
+                        else if (val.is<int>()) {
 
-                            std::cout << std::get<int>(val);
+                            std::cout << val.get<int>();
 
                         }
 
-                        else if (std::holds_alternative<double>(val)) {
+                        else if (val.is<double>()) {
 
-                            std::cout << std::get<double>(val);
+                            std::cout << val.get<double>();
 
                         }
 
-                        else if (std::holds_alternative<bool>(val)) {
+                        else if (val.is<bool>()) {
 
-                            std::cout << (std::get<bool>(val) ? "true" : "false");
+                            std::cout << (val.get<bool>() ? "true" : "false");
 
                         }
 
-                        else if (std::holds_alternative<std::nullptr_t>(val)) {
+                        else if (val.is<std::nullptr_t>()) {
 
                             std::cout << "null";
 
                         }
 
-                        else if (std::holds_alternative<int64_t>(val)) {
+                        else if (val.is<int64_t>()) {
 
-                            std::cout << std::get<int64_t>(val);
+                            std::cout << val.get<int64_t>();
 
                         }
 
@@ -1874,11 +2523,11 @@ namespace steve {
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::INPUT: {
+                VM_CASE(INPUT): {
 
                     // INPUT instruction
 
@@ -1888,11 +2537,11 @@ namespace steve {
 
                     state.stack.push_back(Value(input));
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::GC_NEW: {
+                VM_CASE(GC_NEW): {
 
                     // Garbage collection new operation - allocate a mock object
 
@@ -1914,11 +2563,11 @@ namespace steve {
 
                     state.stack.push_back(Value(size)); // Return allocated size as reference
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::GC_DELETE: {
+                VM_CASE(GC_DELETE): {
 
                     // Garbage collection delete operation
 
@@ -1934,11 +2583,11 @@ namespace steve {
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::GC_RUN: {
+                VM_CASE(GC_RUN): {
 
                     // Run garbage collection
 
@@ -1946,11 +2595,11 @@ namespace steve {
 
                     state.stack.push_back(Value(0)); // Return number of collected objects
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::MEM_MALLOC: {
+                VM_CASE(MEM_MALLOC): {
 
                     // Memory allocation
 
@@ -1964,15 +2613,15 @@ namespace steve {
 
                         size_t size = 0;
 
-                        if (std::holds_alternative<int>(sizeVal)) {
+                        if (sizeVal.is<int>()) {
 
-                            size = static_cast<size_t>(std::get<int>(sizeVal));
+                            size = static_cast<size_t>(sizeVal.get<int>());
 
                         }
 
-                        else if (std::holds_alternative<int64_t>(sizeVal)) {
+                        else if (sizeVal.is<int64_t>()) {
 
-                            size = static_cast<size_t>(std::get<int64_t>(sizeVal));
+                            size = static_cast<size_t>(sizeVal.get<int64_t>());
 
                         }
 
@@ -1986,11 +2635,11 @@ namespace steve {
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::MEM_FREE: {
+                VM_CASE(MEM_FREE): {
 
                     // Memory deallocation
 
@@ -2004,15 +2653,15 @@ namespace steve {
 
                         void* ptr = nullptr;
 
-                        if (std::holds_alternative<int64_t>(ptrVal)) {
+                        if (ptrVal.is<int64_t>()) {
 
-                            ptr = reinterpret_cast<void*>(std::get<int64_t>(ptrVal));
+                            ptr = reinterpret_cast<void*>(ptrVal.get<int64_t>());
 
                         }
 
-                        else if (std::holds_alternative<int>(ptrVal)) {
+                        else if (ptrVal.is<int>()) {
 
-                            ptr = reinterpret_cast<void*>(static_cast<int64_t>(std::get<int>(ptrVal)));
+                            ptr = reinterpret_cast<void*>(static_cast<int64_t>(ptrVal.get<int>()));
 
                         }
 
@@ -2026,23 +2675,17 @@ namespace steve {
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::BINARY_OP: {
+                VM_CASE(BINARY_OP): {
 
                     // Binary operation
 
                     if (state.stack.size() < 2) {
 
-                        throw AccessError("Stack underflow during BINARY_OP operation", instr.line);
-
-                    }
-
-                    if (instr.operands.size() < 1) {
-
-                        throw AccessError("BINARY_OP operation missing operator", instr.line);
+                        throw AccessError("Stack underflow during BINARY_OP operation", code.lines[current]);
 
                     }
 
@@ -2058,211 +2701,226 @@ namespace steve {
 
 
 
-                    Value result = performBinaryOperation(left, right, instr.operands[0], instr.line);
+                    Value result = performBinaryOperation(left, right, static_cast<Operator>(code.immediates[current]), code.lines[current]);
 
                     state.stack.push_back(result);
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::UNARY_OP: {
+                // Superinstructions: the operands of the fused sequence are the immediates of the
 
-                    // Unary operation
+                // instructions following current, errors report the pc and line of the BINARY_OP
 
-                    if (state.stack.empty()) {
+                VM_CASE(INC_VAR): {
 
-                        throw AccessError("Stack underflow during UNARY_OP operation", instr.line);
+                    Value& slot = slotValue(code.immediates[current]);
 
-                    }
+                    slot = performBinaryOperation(slot, code.constants[code.immediates[current + 1]], Operator::ADD, code.lines[current + 2]);
 
-                    if (instr.operands.size() < 1) {
+                    state.pc = current + 4;
 
-                        throw AccessError("UNARY_OP operation missing operator", instr.line);
+                    VM_NEXT();
 
-                    }
+                }
 
+                VM_CASE(VAR_CONST_OP_STORE): {
 
+                    Value result = performBinaryOperation(slotValue(code.immediates[current]), code.constants[code.immediates[current + 1]],
 
-                    Value operand = state.stack.back();
+                        static_cast<Operator>(code.immediates[current + 2]), code.lines[current + 2]);
 
-                    state.stack.pop_back();
+                    slotValue(code.immediates[current + 3]) = std::move(result);
 
+                    state.pc = current + 4;
 
+                    VM_NEXT();
 
-                    Value result = performUnaryOperation(operand, instr.operands[0], instr.line);
+                }
 
-                    state.stack.push_back(result);
+                VM_CASE(CMP_VAR_CONST_JUMP_IF_FALSE): {
 
-                    break;
+                    Value condition = performBinaryOperation(slotValue(code.immediates[current]), code.constants[code.immediates[current + 1]],
 
-                }
+                        static_cast<Operator>(code.immediates[current + 2]), code.lines[current + 2]);
 
-                case InstructionType::PUSH: {
+                    state.pc = getBoolValue(condition) ? current + 4 : code.immediates[current + 3];
 
-                    // PUSH instruction
+                    VM_NEXT();
 
-                    if (instr.operands.size() >= 1) {
+                }
 
-                        std::string operand = instr.operands[0];
+                VM_CASE(CMP_CONST_JUMP_IF_FALSE): {
 
-                        // Try to parse as number
+                    if (state.stack.empty()) {
 
-                        try {
+                        throw AccessError("Stack underflow during BINARY_OP operation", code.lines[current + 1]);
 
-                            if (operand.find('.') != std::string::npos) {
+                    }
 
-                                state.stack.push_back(Value(std::stod(operand)));
+                    Value condition = performBinaryOperation(state.stack.back(), code.constants[code.immediates[current]],
 
-                            }
+                        static_cast<Operator>(code.immediates[current + 1]), code.lines[current + 1]);
 
-                            else {
+                    state.stack.pop_back();
 
-                                state.stack.push_back(Value(std::stoi(operand)));
+                    state.pc = getBoolValue(condition) ? current + 3 : code.immediates[current + 2];
 
-                            }
+                    VM_NEXT();
 
-                        }
+                }
 
-                        catch (...) {
+                VM_CASE(VAR_CONST_OP): {
 
-                            // If not a number, treat as string
+                    Value result = performBinaryOperation(slotValue(code.immediates[current]), code.constants[code.immediates[current + 1]],
 
-                            state.stack.push_back(Value(operand));
+                        static_cast<Operator>(code.immediates[current + 2]), code.lines[current + 2]);
 
-                        }
+                    state.stack.push_back(std::move(result));
 
-                    }
+                    state.pc = current + 3;
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::POP: {
+                VM_CASE(VAR_VAR_OP): {
 
-                    // POP instruction
+                    Value result = performBinaryOperation(slotValue(code.immediates[current]), slotValue(code.immediates[current + 1]),
 
-                    if (!state.stack.empty()) {
+                        static_cast<Operator>(code.immediates[current + 2]), code.lines[current + 2]);
 
-                        state.stack.pop_back();
+                    state.stack.push_back(std::move(result));
 
-                    }
+                    state.pc = current + 3;
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::GOTO: {
+                VM_CASE(CONST_STORE): {
 
-                    // Jump instruction
+                    slotValue(code.immediates[current + 1]) = code.constants[code.immediates[current]];
 
-                    if (instr.operands.size() >= 1) {
+                    state.pc = current + 2;
 
-                        std::string label = instr.operands[0];
+                    VM_NEXT();
 
-                        // Find label position
+                }
 
-                        for (size_t i = 0; i < state.program.size(); i++) {
+                VM_CASE(UNARY_OP): {
 
-                            if (state.program[i].type == InstructionType::LABEL &&
+                    // Unary operation
 
-                                state.program[i].operands.size() >= 1 &&
+                    if (state.stack.empty()) {
 
-                                state.program[i].operands[0] == label) {
+                        throw AccessError("Stack underflow during UNARY_OP operation", code.lines[current]);
 
-                                state.pc = i; // Jump directly to label position
+                    }
 
-                                return true;
 
-                            }
 
-                        }
+                    Value operand = state.stack.back();
 
-                        throw RuntimeError("Undefined label: " + label, instr.line);
+                    state.stack.pop_back();
 
-                    }
 
-                    break;
 
-                }
+                    Value result = performUnaryOperation(operand, static_cast<Operator>(code.immediates[current]), code.lines[current]);
 
-                case InstructionType::LABEL: {
-
-                    // Label definition, no special handling needed
+                    state.stack.push_back(result);
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::TRY: {
+                VM_CASE(POP): {
+
+                    // POP instruction
+
+                    if (!state.stack.empty()) {
 
-                    // Try statement - implement basic exception handling
+                        state.stack.pop_back();
 
-                    // For now, just continue execution (no exception occurred)
+                    }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::CATCH: {
+                VM_CASE(GOTO): {
 
-                    // Catch statement - handle exceptions
+                    // Jump instruction, label resolved at load time
 
-                    // In a full implementation, this would handle caught exceptions
+                    state.pc = code.immediates[current];
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::BREAK: {
+                VM_CASE(LABEL): {
 
-                    // Break statement - exit current loop
+                    // Label definition, no special handling needed
 
-                    // This would require tracking loop contexts in a more sophisticated implementation
+                    VM_NEXT();
 
-                    // For now, just break out of current context by finding matching END
+                }
 
-                    break;
+                VM_CASE(TRY): {
+
+                    // Protected ranges live in state.handlers, entering one costs nothing
+
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::CONTINUE: {
+                VM_CASE(CATCH): {
 
-                    // Continue statement - skip to loop condition check
+                    // Reached only when the try body finished without a throw: skip the handler
 
-                    // This would require tracking loop contexts in a more sophisticated implementation
+                    state.pc = code.immediates[current];
 
-                    // For now, just continue to next iteration
+                    VM_NEXT();
 
-                    break;
+                }
+
+                VM_CASE(BREAK):
+                VM_CASE(CONTINUE): {
+
+                    // Resolved at load time to the loop exit / condition
+
+                    state.pc = code.immediates[current];
+
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::PASS: {
+                VM_CASE(PASS): {
 
                     // Pass statement - no operation
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::PACKAGE: {
+                VM_CASE(PACKAGE): {
 
                     // Package declaration - no runtime effect
 
-                    if (instr.operands.size() >= 1) {
+                    if (code.operandCount(current) >= 1) {
 
-                        std::string packageName = instr.operands[0];
+                        std::string packageName = code.operand(current, 0);
 
                         // Store package info if needed for module system
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::PTR_NEW: {
+                VM_CASE(PTR_NEW): {
 
                     // Create new pointer - allocate memory for an object and return a pointer to it
 
@@ -2276,7 +2934,7 @@ namespace steve {
 
                         // Create a new pointer value (for now, it's a placeholder)
 
-                        PointerValue newPtr(nullptr, "object", false); // In real implementation, this would allocate memory
+                        PointerValue newPtr(static_cast<ManagedObject*>(nullptr), state.symbols.intern("object"), false); // In real implementation, this would allocate memory
 
                         state.stack.push_back(Value(newPtr));
 
@@ -2284,17 +2942,17 @@ namespace steve {
 
                         // Default: create a null pointer if no size specified
 
-                        PointerValue nullPtr(nullptr, "object", false);
+                        PointerValue nullPtr(static_cast<ManagedObject*>(nullptr), state.symbols.intern("object"), false);
 
                         state.stack.push_back(Value(nullPtr));
 
                     }
 
-                    break;
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::PTR_DEREF: {
+                VM_CASE(PTR_DEREF): {
 
                     // Dereference pointer - get value from pointer address
 
@@ -2304,9 +2962,9 @@ namespace steve {
 
                         state.stack.pop_back();
                         
-                        if (std::holds_alternative<PointerValue>(top)) {
+                        if (top.is<PointerValue>()) {
 
-                            PointerValue ptr = std::get<PointerValue>(top);
+                            PointerValue ptr = top.get<PointerValue>();
 
                             if (!ptr.isNull) {
 
@@ -2318,7 +2976,7 @@ namespace steve {
 
                             } else {
 
-                                throw RuntimeError("Cannot dereference null pointer", instr.line);
+                                throw RuntimeError("Cannot dereference null pointer", code.lines[current]);
 
                             }
 
@@ -2332,164 +2990,336 @@ namespace steve {
 
                     }
 
-                    break;
+                    VM_NEXT();
+
+                }
+
+                VM_CASE(THROW): {
+
+                    // THROW pops the thrown value, THROW n (a lowered throw(...) call) pops n arguments and throws the first
+
+                    uint32_t argc = code.immediates[current];
+
+                    if (argc == NO_IMMEDIATE) {
+
+                        argc = state.stack.empty() ? 0 : 1;
+
+                    }
+
+                    else if (state.stack.size() < argc) {
+
+                        throw AccessError("Not enough arguments for function: throw", code.lines[current]);
+
+                    }
+
+                    Value thrown = argc == 0 ? Value(std::string("Exception thrown")) : std::move(state.stack[state.stack.size() - argc]);
+
+                    state.stack.resize(state.stack.size() - argc);
+
+                    if (!throwValue(thrown, current)) {
+
+                        throw UncaughtException(thrown.is<std::string>() ? thrown.get<std::string>() : "Unknown exception occurred", code.lines[current]);
+
+                    }
+
+                    VM_NEXT();
+
+                }
+
+                VM_CASE(IMPORT): {
+
+                    // Import instruction, simple handling for now
+
+                    if (code.operandCount(current) >= 1) {
+
+                        std::string moduleName = code.operand(current, 0);
+
+                        // In actual implementation, this should load and execute the module
+
+                        // For now just simple logging
+
+                        std::cout << "Importing module: " << moduleName << std::endl;
+
+                    }
+
+                    VM_NEXT();
+
+                }
+
+                VM_CASE(NOP): {
+
+                    // No operation, do nothing
+
+                    VM_NEXT();
 
                 }
 
-                case InstructionType::THROW: {
+                VM_DEFAULT:
 
-                    // Throw exception - get message from stack and throw it
+                    // Unknown instruction type
 
-                    if (!state.stack.empty()) {
+                    std::cerr << "Warning: Unknown instruction type at line " << code.lines[current] << std::endl;
 
-                        Value exceptionValue = state.stack.back();
+                    VM_NEXT();
 
-                        state.stack.pop_back();
+#if STEVE_THREADED_DISPATCH
+                }
+
+            next_instruction:
 
+                if (singleStep) {
 
+                    return true;
 
-                        std::string exceptionMsg;
+                }
 
+                VM_DISPATCH();
+#else
+                }
 
+                if (singleStep) {
 
-                        if (std::holds_alternative<std::string>(exceptionValue)) {
+                    return true;
 
-                            exceptionMsg = std::get<std::string>(exceptionValue);
+                }
 
-                        } else {
+                }
+#endif
 
-                            exceptionMsg = "Unknown exception occurred";
+            }
 
-                        }
+            catch (const VMException& e) {
 
+                // A handler finds the faulting instruction at state.pc - 1, within a superinstruction the one that failed
 
+                state.pc = faultingPc(code, current) + 1;
 
-                        // Throw a RuntimeError exception with the message
+                throw; // Re-throw VM exception
 
-                        throw RuntimeError(exceptionMsg, instr.line);
+            }
 
-                    } else {
+            catch (const std::exception& e) {
 
-                        // If no value on stack, throw a generic exception
+                state.pc = faultingPc(code, current) + 1;
 
-                        throw RuntimeError("Exception thrown", instr.line);
+                throw RuntimeError(std::string("Standard exception: ") + e.what(), current < programSize ? code.lines[state.pc - 1] : -1);
 
-                    }
+            }
 
-                    break;
+        }
 
+#undef VM_FETCH
+#undef VM_CASE
+#undef VM_DEFAULT
+#undef VM_NEXT
+#ifdef VM_DISPATCH
+#undef VM_DISPATCH
+#endif
+
+        void VirtualMachine::enterFunction(uint32_t function, size_t argc, size_t returnPc, int line) {
+            // Move the arguments into the first local slots of a new frame
+            const FunctionInfo& info = state.functionTable[function];
+            if (state.stack.size() < argc) {
+                throw AccessError("Not enough arguments for function: " + state.symbols.text(info.name), line);
+            }
+            if (state.frames.size() >= MAX_CALL_DEPTH) {
+                throw RuntimeError("Call stack overflow in function: " + state.symbols.text(info.name), line);
+            }
+            Frame frame;
+            frame.returnPc = returnPc;
+            frame.function = function;
+            frame.argc = static_cast<uint32_t>(argc);
+            frame.localsBase = state.locals.size();
+            frame.stackBase = state.stack.size() - argc;
+            state.locals.resize(frame.localsBase + info.localCount + info.registerTemps, Value(0));
+            for (size_t i = 0; i < argc; i++) {
+                state.locals[frame.localsBase + i] = std::move(state.stack[frame.stackBase + i]);
+            }
+            state.stack.resize(frame.stackBase);
+            state.frames.push_back(frame);
+            state.localsBase = frame.localsBase;
+            state.pc = info.entry;
+        }
+
+        void VirtualMachine::callBuiltIn(uint32_t immediate, size_t pc) {
+            // Call the built-in on a view of its arguments, then replace them with the result
+            const CodeStream& code = state.code;
+            uint32_t index = immediate & CALL_INDEX_MASK;
+            size_t argc = (immediate >> CALL_ARGC_SHIFT) & CALL_ARGC_MASK;
+            if (argc == CALL_ARGC_DEFAULT) {
+                argc = state.stack.empty() ? 0 : 1;
+            }
+            else if (state.stack.size() < argc) {
+                throw AccessError("Not enough arguments for function: " + code.operand(pc, 0), code.lines[pc]);
+            }
+            size_t base = state.stack.size() - argc;
+            // x = f(x, ...) with an in-place built-in: x is overwritten right after the call,
+            // so drop its reference now and f can update the value without copying it
+            bool released = false;
+            if (argc >= 1 && builtInFunctions.inPlace[index] && pc + 1 < code.size() &&
+                code.opcodes[pc + 1] == InstructionType::STORE_SLOT) {
+                Value& target = slotValue(code.immediates[pc + 1]);
+                if (target.sharesPayload(state.stack[base])) {
+                    target = Value();
+                    released = true;
+                }
+            }
+            Value result;
+            try {
+                result = builtInFunctions.functions[index](BuiltInArgs(state.stack.data() + base, argc));
+            }
+            catch (...) {
+                // In-place built-ins check their arguments before taking the first one, so it still
+                // holds x: give it back, a caught error must not clear the variable
+                if (released) {
+                    slotValue(code.immediates[pc + 1]) = state.stack[base];
                 }
+                throw;
+            }
+            state.stack.resize(base);
+            state.stack.push_back(std::move(result));
+        }
 
-                case InstructionType::IMPORT: {
+        void VirtualMachine::leaveFunction() {
+            // The callee's top of stack is its result (null if it left nothing), the rest is discarded
+            const Frame& frame = state.frames.back();
+            Value result = state.stack.size() > frame.stackBase ? std::move(state.stack.back()) : Value(nullptr);
+            state.stack.resize(frame.stackBase);
+            state.stack.push_back(std::move(result));
+            state.locals.resize(frame.localsBase);
+            state.pc = frame.returnPc;
+            state.frames.pop_back();
+            state.localsBase = state.frames.empty() ? 0 : state.frames.back().localsBase;
+        }
 
-                    // Import instruction, simple handling for now
+        bool VirtualMachine::throwValue(Value thrown, size_t pc) {
 
-                    if (instr.operands.size() >= 1) {
+            // Walk the frames outwards, in each one pc is the faulting instruction or the CALL to the frame above
 
-                        std::string moduleName = instr.operands[0];
+            size_t depth = state.frames.size();
 
-                        // In actual implementation, this should load and execute the module
+            for (;;) {
 
-                        // For now just simple logging
+                uint32_t function = depth == 0 ? NO_IMMEDIATE : state.frames[depth - 1].function;
 
-                        std::cout << "Importing module: " << moduleName << std::endl;
+                for (const ExceptionHandler& handler : state.handlers) {
+
+                    if (handler.function != function || pc < handler.start || pc >= handler.end) {
+
+                        continue;
 
                     }
 
-                    break;
+                    // Drop the frames above the handler's and the operand stack of its own frame
 
-                }
+                    if (depth < state.frames.size()) {
 
-                case InstructionType::NOP: {
+                        state.locals.resize(state.frames[depth].localsBase);
 
-                    // No operation, do nothing
+                        state.frames.resize(depth);
 
-                    break;
+                        state.localsBase = depth == 0 ? 0 : state.frames.back().localsBase;
 
-                }
+                    }
 
-                default:
+                    state.stack.resize(depth == 0 ? 0 : state.frames.back().stackBase);
 
-                    // Unknown instruction type
+                    state.stack.push_back(std::move(thrown));
 
-                    std::cerr << "Warning: Unknown instruction type at line " << instr.line << std::endl;
+                    state.pc = handler.handler;
 
-                    break;
+                    return true;
 
                 }
-            }
 
-            catch (const VMException& e) {
-
-                throw; // Re-throw VM exception
+                if (depth == 0) {
 
-            }
+                    return false;
 
-            catch (const std::exception& e) {
+                }
 
-                throw RuntimeError(std::string("Standard exception: ") + e.what(), instr.line);
+                pc = state.frames[--depth].returnPc - 1;
 
             }
 
+        }
 
+        const char* VirtualMachine::dispatchMode() {
+            return STEVE_THREADED_DISPATCH ? "threaded" : "switch";
+        }
 
-            return true;
+        uint64_t VirtualMachine::getInstructionCount() const {
+            return state.instructionCount;
+        }
 
+        void VirtualMachine::profileOpcode(size_t pc, InstructionType type) {
+            // Sequences only run through straight-line code, a taken jump starts a new one
+            OpcodeProfile& profile = opcodeProfile;
+            if (pc != profile.lastPc + 1) {
+                profile.windowLength = 0;
+            }
+            profile.window = (profile.window << 8) | static_cast<uint8_t>(type);
+            profile.windowLength = std::min<uint32_t>(profile.windowLength + 1, 4);
+            profile.lastPc = pc;
+            for (uint32_t length = 2; length <= profile.windowLength; length++) {
+                uint32_t mask = length == 4 ? 0xFFFFFFFFu : (1u << (8 * length)) - 1;
+                profile.counts[(static_cast<uint64_t>(length) << 32) | (profile.window & mask)]++;
+            }
         }
 
         // Helper function: Get boolean value
 
         bool VirtualMachine::getBoolValue(const Value& value) {
 
-            if (std::holds_alternative<int>(value)) {
+            if (value.is<int>()) {
 
-                return std::get<int>(value) != 0;
+                return value.get<int>() != 0;
 
             }
 
-            else if (std::holds_alternative<int64_t>(value)) {
+            else if (value.is<int64_t>()) {
 
-                return std::get<int64_t>(value) != 0;
+                return value.get<int64_t>() != 0;
 
             }
 
-            else if (std::holds_alternative<double>(value)) {
+            else if (value.is<double>()) {
 
-                return std::get<double>(value) != 0.0;
+                return value.get<double>() != 0.0;
 
             }
 
-            else if (std::holds_alternative<bool>(value)) {
+            else if (value.is<bool>()) {
 
-                return std::get<bool>(value);
+                return value.get<bool>();
 
             }
 
-            else if (std::holds_alternative<std::string>(value)) {
+            else if (value.is<std::string>()) {
 
-                return !std::get<std::string>(value).empty();
+                return !value.get<std::string>().empty();
 
             }
 
-            else if (std::holds_alternative<std::nullptr_t>(value)) {
+            else if (value.is<std::nullptr_t>()) {
 
                 return false;
 
             }
 
-            else if (std::holds_alternative<ListValue>(value)) {
+            else if (value.is<ListValue>()) {
 
-                const ListValue& list = std::get<ListValue>(value);
+                const ListValue& list = value.get<ListValue>();
 
-                return !list.items.empty(); // List is true if not empty
+                return !list.empty(); // List is true if not empty
 
             }
 
-            else if (std::holds_alternative<DictValue>(value)) {
+            else if (value.is<DictValue>()) {
 
-                const DictValue& dict = std::get<DictValue>(value);
+                const DictValue& dict = value.get<DictValue>();
 
-                return !dict.items.empty(); // Dict is true if not empty
+                return !dict.empty(); // Dict is true if not empty
 
             }
 
@@ -2497,577 +3327,517 @@ namespace steve {
 
         }
 
-                // Helper function: Jump to ELSE or END
+        // Numeric conversions shared by the operator handlers
 
-        void VirtualMachine::jumpToElseOrEnd() {
+        static double toDouble(const Value& value) {
 
-            int depth = 1;
+            if (value.is<double>()) {
 
-            size_t current = state.pc + 1;
+                return value.get<double>();
 
-            while (current < state.program.size() && depth > 0) {
-
-                const Instruction& nextInstr = state.program[current];
+            }
 
-                if (nextInstr.type == InstructionType::IF || nextInstr.type == InstructionType::WHILE) {
+            else if (value.is<int>()) {
 
-                    depth++;
+                return static_cast<double>(value.get<int>());
 
-                }
+            }
 
-                else if (nextInstr.type == InstructionType::END) {
+            else if (value.is<int64_t>()) {
 
-                    depth--;
+                return static_cast<double>(value.get<int64_t>());
 
-                }
+            }
 
-                            else {
+            else if (value.is<bool>()) {
 
-                throw TypeError("Unsupported unary operator: " + op, line);
+                return static_cast<double>(value.get<bool>());
 
             }
 
-            // This line should not be reached due to exceptions above, but added for compiler safety
-            return Value(0);
-        }
-
-        // Helper function: Perform binary operation
+            else if (value.is<ListValue>()) {
 
-                    // Found same depth ELSE
+                const ListValue& list = value.get<ListValue>();
 
-                    state.pc = current;
+                return static_cast<double>(list.size()); // Return list length as double
 
-                    return;
+            }
 
-                }
+            else if (value.is<DictValue>()) {
 
-                if (depth == 0) {
+                const DictValue& dict = value.get<DictValue>();
 
-                    // Found matching END
+                return static_cast<double>(dict.size()); // Return dict size as double
 
-                    state.pc = current;
+            }
 
-                    return;
+            return 0.0;
 
-                }
+        }
 
-                current++;
+        static int64_t toInt64(const Value& value) {
 
-            }
+            if (value.is<int64_t>()) {
 
-            // If no matching END is found, jump to end of program
+                return value.get<int64_t>();
 
-            state.pc = state.program.size() - 1;
+            }
 
-        }
+            else if (value.is<int>()) {
 
-        // Helper function: Jump to END
+                return static_cast<int64_t>(value.get<int>());
 
-        void VirtualMachine::jumpToEnd() {
+            }
 
-            int depth = 1;
+            else if (value.is<bool>()) {
 
-            size_t current = state.pc + 1;
+                return static_cast<int64_t>(value.get<bool>());
 
-            while (current < state.program.size() && depth > 0) {
+            }
 
-                const Instruction& nextInstr = state.program[current];
+            else if (value.is<PointerValue>()) {
 
-                if (nextInstr.type == InstructionType::IF || nextInstr.type == InstructionType::WHILE) {
+                // Return some identifier for the pointer, for now just a hash of the pointer address
 
-                    depth++;
+                const PointerValue& ptr = value.get<PointerValue>();
 
-                }
+                return reinterpret_cast<int64_t>(ptr.ptr);
 
-                else if (nextInstr.type == InstructionType::END) {
+            }
 
-                    depth--;
+            else if (value.is<ListValue>()) {
 
-                }
+                const ListValue& list = value.get<ListValue>();
 
-                if (depth == 0) {
+                return static_cast<int64_t>(list.size()); // Return list length as int64_t
 
-                    state.pc = current;
+            }
 
-                    return;
+            else if (value.is<DictValue>()) {
 
-                }
+                const DictValue& dict = value.get<DictValue>();
 
-                current++;
+                return static_cast<int64_t>(dict.size()); // Return dict size as int64_t
 
             }
 
-            // If no matching END is found, jump to end of program
-
-            state.pc = state.program.size() - 1;
+            return 0;
 
         }
 
-                // Helper function: Perform binary operation
+        // Operand type classes used to index the binary operator table
 
-        Value VirtualMachine::performBinaryOperation(const Value& left, const Value& right,
+        enum TypeClass : uint8_t {
 
-            const std::string& op, int line) {
+            TC_INT,     // int, int64_t
 
-            // Determine result type, try to convert to most appropriate type
+            TC_DOUBLE,
 
-            if (std::holds_alternative<double>(left) || std::holds_alternative<double>(right)) {
+            TC_STRING,
 
-                // If either operand is double, convert to double calculation
+            TC_POINTER,
 
-                double leftVal = getDoubleValue(left);
+            TC_LIST,
 
-                double rightVal = getDoubleValue(right);
+            TC_DICT,
 
+            TC_OTHER,   // bool, null
 
+            TC_COUNT
 
-                if (op == "+") return Value(leftVal + rightVal);
+        };
 
-                else if (op == "-") return Value(leftVal - rightVal);
+        static_assert(Value::INDEX_COUNT == 9, "Update typeClassOf when Value gains alternatives");
 
-                else if (op == "*") return Value(leftVal * rightVal);
+        // Type class of each Value alternative, in variant order
 
-                else if (op == "/") {
+        static constexpr TypeClass typeClassOf[] = {
 
-                    if (rightVal == 0.0) {
+            TC_INT, TC_DOUBLE, TC_OTHER, TC_STRING, TC_OTHER, TC_INT, TC_POINTER, TC_LIST, TC_DICT
 
-                        throw RuntimeError("Division by zero error", line);
+        };
 
-                    }
+        [[noreturn]] static void unsupportedOperator(const char* kind, Operator op, int line) {
 
-                    return Value(leftVal / rightVal);
+            throw TypeError(std::string("Unsupported operator for ") + kind + ": " + operatorName(op), line);
 
-                }
+        }
 
-                else if (op == "==") return Value(leftVal == rightVal);
+        static Value binaryDouble(const Value& left, const Value& right, Operator op, int line) {
 
-                else if (op == "!=") return Value(leftVal != rightVal);
+            // If either operand is double, convert to double calculation
 
-                else if (op == "<") return Value(leftVal < rightVal);
+            double leftVal = toDouble(left);
 
-                else if (op == ">") return Value(leftVal > rightVal);
+            double rightVal = toDouble(right);
 
-                else if (op == "<=") return Value(leftVal <= rightVal);
+            switch (op) {
 
-                else if (op == ">=") return Value(leftVal >= rightVal);
+            case Operator::ADD: return Value(leftVal + rightVal);
 
-                else if (op == "and" || op == "&&") return Value(static_cast<bool>(leftVal) && static_cast<bool>(rightVal));
+            case Operator::SUB: return Value(leftVal - rightVal);
 
-                else if (op == "or" || op == "||") return Value(static_cast<bool>(leftVal) || static_cast<bool>(rightVal));
+            case Operator::MUL: return Value(leftVal * rightVal);
 
-                else {
+            case Operator::DIV:
 
-                    throw TypeError("Unsupported operator for floating point: " + op, line);
+                if (rightVal == 0.0) {
 
-                }
+                    throw RuntimeError("Division by zero error", line);
 
-            }
+                }
 
-            else if ((std::holds_alternative<int>(left) || std::holds_alternative<int64_t>(left)) &&
+                return Value(leftVal / rightVal);
 
-                (std::holds_alternative<int>(right) || std::holds_alternative<int64_t>(right))) {
+            case Operator::EQ: return Value(leftVal == rightVal);
 
-                // Integer arithmetic
+            case Operator::NE: return Value(leftVal != rightVal);
 
-                int64_t leftVal = getInt64Value(left);
+            case Operator::LT: return Value(leftVal < rightVal);
 
-                int64_t rightVal = getInt64Value(right);
+            case Operator::GT: return Value(leftVal > rightVal);
 
+            case Operator::LE: return Value(leftVal <= rightVal);
 
+            case Operator::GE: return Value(leftVal >= rightVal);
 
-                if (op == "+") return Value(leftVal + rightVal);
+            case Operator::AND: return Value(static_cast<bool>(leftVal) && static_cast<bool>(rightVal));
 
-                else if (op == "-") return Value(leftVal - rightVal);
+            case Operator::OR: return Value(static_cast<bool>(leftVal) || static_cast<bool>(rightVal));
 
-                else if (op == "*") return Value(leftVal * rightVal);
+            default: unsupportedOperator("floating point", op, line);
 
-                else if (op == "/") {
+            }
 
-                    if (rightVal == 0) {
+        }
 
-                        throw RuntimeError("Division by zero error", line);
+        static Value binaryInt(const Value& left, const Value& right, Operator op, int line) {
 
-                    }
+            // Integer arithmetic
 
-                    return Value(leftVal / rightVal);
+            int64_t leftVal = toInt64(left);
 
-                }
+            int64_t rightVal = toInt64(right);
 
-                else if (op == "%") {
+            switch (op) {
 
-                    if (rightVal == 0) {
+            // Wrapping arithmetic through uint64_t, signed overflow is undefined
 
-                        throw RuntimeError("Modulo by zero error", line);
+            case Operator::ADD: return Value(static_cast<int64_t>(static_cast<uint64_t>(leftVal) + static_cast<uint64_t>(rightVal)));
 
-                    }
+            case Operator::SUB: return Value(static_cast<int64_t>(static_cast<uint64_t>(leftVal) - static_cast<uint64_t>(rightVal)));
 
-                    return Value(leftVal % rightVal);
+            case Operator::MUL: return Value(static_cast<int64_t>(static_cast<uint64_t>(leftVal) * static_cast<uint64_t>(rightVal)));
 
-                }
+            case Operator::DIV:
 
-                else if (op == "==") return Value(leftVal == rightVal);
-                else if (op == "!=") return Value(leftVal != rightVal);
-                else if (op == "<") return Value(leftVal < rightVal);
-                else if (op == ">") return Value(leftVal > rightVal);
-                else if (op == "<=") return Value(leftVal <= rightVal);
-                else if (op == ">=") return Value(leftVal >= rightVal);
-                else if (op == "and" || op == "&&") return Value(leftVal != 0 && rightVal != 0);
-                else if (op == "or" || op == "||") return Value(leftVal != 0 || rightVal != 0);
-                else {
+                if (rightVal == 0) {
 
-                    throw TypeError("Unsupported operator for integer: " + op, line);
+                    throw RuntimeError("Division by zero error", line);
 
                 }
 
-            }
-
-            else if (std::holds_alternative<std::string>(left) && std::holds_alternative<std::string>(right)) {
+                // INT64_MIN / -1 traps, it wraps to INT64_MIN like the negation
 
-                // String arithmetic
+                if (rightVal == -1) {
 
-                if (op == "+") {
-
-                    return Value(std::get<std::string>(left) + std::get<std::string>(right));
+                    return Value(static_cast<int64_t>(0 - static_cast<uint64_t>(leftVal)));
 
                 }
 
-                else if (op == "==") {
-
-                    return Value(std::get<std::string>(left) == std::get<std::string>(right));
+                return Value(leftVal / rightVal);
 
-                }
+            case Operator::MOD:
 
-                else if (op == "!=") {
+                if (rightVal == 0) {
 
-                    return Value(std::get<std::string>(left) != std::get<std::string>(right));
+                    throw RuntimeError("Modulo by zero error", line);
 
                 }
 
-                else {
+                if (rightVal == -1) {
 
-                    throw TypeError("Unsupported operator for string: " + op, line);
+                    return Value(static_cast<int64_t>(0));
 
                 }
 
-            }
-
-            else if (std::holds_alternative<PointerValue>(left) || std::holds_alternative<PointerValue>(right)) {
+                return Value(leftVal % rightVal);
 
-                // Pointer operations
+            case Operator::EQ: return Value(leftVal == rightVal);
 
-                if (op == "==") {
+            case Operator::NE: return Value(leftVal != rightVal);
 
-                    if (std::holds_alternative<PointerValue>(left) && std::holds_alternative<PointerValue>(right)) {
+            case Operator::LT: return Value(leftVal < rightVal);
 
-                        const PointerValue& lptr = std::get<PointerValue>(left);
+            case Operator::GT: return Value(leftVal > rightVal);
 
-                        const PointerValue& rptr = std::get<PointerValue>(right);
+            case Operator::LE: return Value(leftVal <= rightVal);
 
-                        return Value(lptr.ptr == rptr.ptr);
+            case Operator::GE: return Value(leftVal >= rightVal);
 
-                    } else {
-
-                        // Compare pointer to null
+            case Operator::AND: return Value(leftVal != 0 && rightVal != 0);
 
-                        bool leftIsNull = std::holds_alternative<PointerValue>(left) ? std::get<PointerValue>(left).isNull : true;
+            case Operator::OR: return Value(leftVal != 0 || rightVal != 0);
 
-                        bool rightIsNull = std::holds_alternative<PointerValue>(right) ? std::get<PointerValue>(right).isNull : true;
+            default: unsupportedOperator("integer", op, line);
 
-                        return Value(leftIsNull && rightIsNull); // Both are null, so equal
-
-                    }
+            }
 
-                }
+        }
 
-                else if (op == "!=") {
+        static Value binaryString(const Value& left, const Value& right, Operator op, int line) {
 
-                    if (std::holds_alternative<PointerValue>(left) && std::holds_alternative<PointerValue>(right)) {
+            switch (op) {
 
-                        const PointerValue& lptr = std::get<PointerValue>(left);
+            case Operator::ADD: return Value::concat(left, right); // Deferred in a rope when long
 
-                        const PointerValue& rptr = std::get<PointerValue>(right);
+            case Operator::EQ: return Value(left == right); // Interned strings compare by payload
 
-                        return Value(lptr.ptr != rptr.ptr);
+            case Operator::NE: return Value(left != right);
 
-                    } else {
+            default: unsupportedOperator("string", op, line);
 
-                        // Compare pointer to null
+            }
 
-                        bool leftIsNull = std::holds_alternative<PointerValue>(left) ? std::get<PointerValue>(left).isNull : true;
+        }
 
-                        bool rightIsNull = std::holds_alternative<PointerValue>(right) ? std::get<PointerValue>(right).isNull : true;
+        static Value binaryPointer(const Value& left, const Value& right, Operator op, int line) {
 
-                        return Value(leftIsNull != rightIsNull); // Only one is null, so not equal
+            bool bothPointers = left.is<PointerValue>() && right.is<PointerValue>();
 
-                    }
+            // A non-pointer operand compares as null
 
-                }
+            bool leftIsNull = left.is<PointerValue>() ? left.get<PointerValue>().isNull : true;
 
-                else if (op == "=") {
+            bool rightIsNull = right.is<PointerValue>() ? right.get<PointerValue>().isNull : true;
 
-                    // Assignment of pointer to another pointer
+            switch (op) {
 
-                    if (std::holds_alternative<PointerValue>(right)) {
+            case Operator::EQ:
 
-                        return right; // Return the right pointer value
+                if (bothPointers) {
 
-                    }
+                    return Value(left.get<PointerValue>().ptr == right.get<PointerValue>().ptr);
 
                 }
 
-                throw TypeError("Unsupported operator for pointer: " + op, line);
-
-            }
+                return Value(leftIsNull && rightIsNull);
 
-            else if (std::holds_alternative<ListValue>(left) && std::holds_alternative<ListValue>(right) && op == "+") {
+            case Operator::NE:
 
-                // List concatenation
+                if (bothPointers) {
 
-                ListValue leftList = std::get<ListValue>(left);
+                    return Value(left.get<PointerValue>().ptr != right.get<PointerValue>().ptr);
 
-                ListValue rightList = std::get<ListValue>(right);
+                }
 
-                std::vector<Value> resultItems;
+                return Value(leftIsNull != rightIsNull);
 
-                
+            case Operator::ASSIGN:
 
-                // Add items from left list
+                // Assignment of pointer to another pointer
 
-                for (const Value& item : leftList.items) {
+                if (right.is<PointerValue>()) {
 
-                    resultItems.push_back(item);
+                    return right;
 
                 }
 
-                // Add items from right list
-
-                for (const Value& item : rightList.items) {
-
-                    resultItems.push_back(item);
-
-                }
+                break;
 
-                
+            default:
 
-                return Value(ListValue(resultItems));
+                break;
 
             }
 
-            else if (std::holds_alternative<ListValue>(left) && op == "*") {
-
-                // List repetition (list * number)
-
-                if (std::holds_alternative<int>(right) || std::holds_alternative<int64_t>(right)) {
+            unsupportedOperator("pointer", op, line);
 
-                    int64_t repetitions = std::holds_alternative<int>(right) ? std::get<int>(right) : std::get<int64_t>(right);
-
-                    ListValue list = std::get<ListValue>(left);
-
-                    std::vector<Value> resultItems;
-
-                    
+        }
 
-                    for (int64_t i = 0; i < repetitions; ++i) {
+        static Value binaryList(const Value& left, const Value& right, Operator op, int line) {
 
-                        for (const Value& item : list.items) {
+            const ListValue& list = left.get<ListValue>();
 
-                            resultItems.push_back(item);
+            if (op == Operator::ADD && right.is<ListValue>()) {
 
-                        }
+                // List concatenation
 
-                    }
+                const ListValue& rightList = right.get<ListValue>();
 
-                    
+                ListValue result = list;
 
-                    return Value(ListValue(resultItems));
+                result.append(rightList);
 
-                }
+                return Value(std::move(result));
 
             }
 
-            else if (std::holds_alternative<DictValue>(left) && op == "==") {
+            if (op == Operator::MUL && typeClassOf[right.index()] == TC_INT) {
 
-                // Dictionary equality comparison
-
-                if (std::holds_alternative<DictValue>(right)) {
+                // List repetition (list * number)
 
-                    const DictValue& leftDict = std::get<DictValue>(left);
+                int64_t repetitions = toInt64(right);
 
-                    const DictValue& rightDict = std::get<DictValue>(right);
+                ListValue result;
 
-                    
+                for (int64_t i = 0; i < repetitions; ++i) {
 
-                    if (leftDict.items.size() != rightDict.items.size()) {
+                    result.append(list);
 
-                        return Value(false);
+                }
 
-                    }
+                return Value(std::move(result));
 
-                    
+            }
 
-                    for (const auto& pair : leftDict.items) {
+            unsupportedOperator("list", op, line);
 
-                        auto it = rightDict.items.find(pair.first);
+        }
 
-                        if (it == rightDict.items.end() || it->second != pair.second) {
+        static Value binaryDict(const Value& left, const Value& right, Operator op, int line) {
 
-                            return Value(false);
+            if (op != Operator::EQ) {
 
-                        }
+                unsupportedOperator("dict", op, line);
 
-                    }
+            }
 
-                    
+            // Dictionary equality comparison
 
-                    return Value(true);
+            if (!right.is<DictValue>()) {
 
-                }
+                return Value(false);
 
             }
 
-            else {
+            const DictValue& leftDict = left.get<DictValue>();
 
-                throw TypeError("Binary operation type mismatch", line);
+            const DictValue& rightDict = right.get<DictValue>();
 
-            }
+            return Value(leftDict == rightDict);
 
-            // This line should not be reached due to exceptions above, but added for compiler safety
-            return Value(0);
         }
 
-        // Helper function: Perform unary operation
+        static Value binaryMismatch(const Value&, const Value&, Operator, int line) {
 
-        Value VirtualMachine::performUnaryOperation(const Value& operand, const std::string& op, int line) {
+            throw TypeError("Binary operation type mismatch", line);
 
-            if (op == "-") {
+        }
 
-                if (std::holds_alternative<int>(operand)) {
+        using BinaryHandler = Value (*)(const Value&, const Value&, Operator, int);
 
-                    return Value(-std::get<int>(operand));
+        // Handler for each (left, right) type class pair. Earlier rules take precedence:
 
-                }
+        // any double operand, int pairs, string pairs, any pointer operand, list or dict on the left.
 
-                else if (std::holds_alternative<int64_t>(operand)) {
+        static const std::array<std::array<BinaryHandler, TC_COUNT>, TC_COUNT> binaryTable = [] {
 
-                    return Value(-std::get<int64_t>(operand));
+            std::array<std::array<BinaryHandler, TC_COUNT>, TC_COUNT> table;
 
-                }
+            for (auto& row : table) {
 
-                else if (std::holds_alternative<double>(operand)) {
+                row.fill(binaryMismatch);
 
-                    return Value(-std::get<double>(operand));
+            }
 
-                }
+            for (int i = TC_COUNT - 1; i >= 0; i--) {
 
-                else {
+                if (i != TC_DOUBLE && i != TC_POINTER) {
+
+                    table[TC_LIST][i] = binaryList;
 
-                    throw TypeError("Invalid operand type for unary minus", line);
+                    table[TC_DICT][i] = binaryDict;
 
                 }
 
-            }
+                if (i != TC_DOUBLE) {
 
-            else if (op == "!" || op == "not") {
+                    table[TC_POINTER][i] = binaryPointer;
 
-                return Value(!getBoolValue(operand));
+                    table[i][TC_POINTER] = binaryPointer;
 
-            }
+                }
 
-            else {
+                table[TC_DOUBLE][i] = binaryDouble;
 
-                throw TypeError("Unsupported unary operator: " + op, line);
+                table[i][TC_DOUBLE] = binaryDouble;
 
             }
 
-        }
-
-        // Helper function: Get double value
+            table[TC_INT][TC_INT] = binaryInt;
 
-        double VirtualMachine::getDoubleValue(const Value& value) {
+            table[TC_STRING][TC_STRING] = binaryString;
 
-            if (std::holds_alternative<double>(value)) {
+            return table;
 
-                return std::get<double>(value);
+        }();
 
-            }
+        // Helper function: Perform binary operation
 
-            else if (std::holds_alternative<int>(value)) {
+        Value VirtualMachine::performBinaryOperation(const Value& left, const Value& right, Operator op, int line) {
 
-                return static_cast<double>(std::get<int>(value));
+            return binaryTable[typeClassOf[left.index()]][typeClassOf[right.index()]](left, right, op, line);
 
-            }
+        }
 
-            else if (std::holds_alternative<int64_t>(value)) {
+        // Helper function: Perform unary operation
 
-                return static_cast<double>(std::get<int64_t>(value));
+        Value VirtualMachine::performUnaryOperation(const Value& operand, Operator op, int line) {
 
-            }
+            switch (op) {
 
-            else if (std::holds_alternative<bool>(value)) {
+            case Operator::NEG:
 
-                return static_cast<double>(std::get<bool>(value));
+                if (operand.is<int>()) {
 
-            }
+                    // -INT_MIN does not fit in int, it becomes int64_t
 
-            else if (std::holds_alternative<ListValue>(value)) {
+                    int value = operand.get<int>();
 
-                const ListValue& list = std::get<ListValue>(value);
+                    return value == std::numeric_limits<int>::min() ? Value(-static_cast<int64_t>(value)) : Value(-value);
 
-                return static_cast<double>(list.items.size()); // Return list length as double
+                }
 
-            }
+                else if (operand.is<int64_t>()) {
 
-            else if (std::holds_alternative<DictValue>(value)) {
+                    return Value(static_cast<int64_t>(0 - static_cast<uint64_t>(operand.get<int64_t>())));
 
-                const DictValue& dict = std::get<DictValue>(value);
+                }
 
-                return static_cast<double>(dict.items.size()); // Return dict size as double
+                else if (operand.is<double>()) {
 
-            }
+                    return Value(-operand.get<double>());
 
-            return 0.0;
+                }
 
-        }
+                throw TypeError("Invalid operand type for unary minus", line);
 
-                // Helper function: Get int64_t value
+            case Operator::NOT:
 
-        int64_t VirtualMachine::getInt64Value(const Value& value) {
+                return Value(!getBoolValue(operand));
 
-            if (std::holds_alternative<int64_t>(value)) {
+            default:
 
-                return std::get<int64_t>(value);
+                throw TypeError(std::string("Unsupported unary operator: ") + operatorName(op), line);
 
             }
 
-            else if (std::holds_alternative<int>(value)) {
-
-                return static_cast<int64_t>(std::get<int>(value));
-
-            }
+        }
 
-            else if (std::holds_alternative<bool>(value)) {
+        // Helper function: Get double value
 
-                return static_cast<int64_t>(std::get<bool>(value));
+        double VirtualMachine::getDoubleValue(const Value& value) {
 
-            }
+            return toDouble(value);
 
-            else if (std::holds_alternative<PointerValue>(value)) {
-                // Return some identifier for the pointer, for now just a hash of the pointer address
-                const PointerValue& ptr = std::get<PointerValue>(value);
-                return reinterpret_cast<int64_t>(ptr.ptr);
-            }
+        }
 
-            else if (std::holds_alternative<ListValue>(value)) {
-                const ListValue& list = std::get<ListValue>(value);
-                return static_cast<int64_t>(list.items.size()); // Return list length as int64_t
-            }
+        // Helper function: Get int64_t value
 
-            else if (std::holds_alternative<DictValue>(value)) {
-                const DictValue& dict = std::get<DictValue>(value);
-                return static_cast<int64_t>(dict.items.size()); // Return dict size as int64_t
-            }
+        int64_t VirtualMachine::getInt64Value(const Value& value) {
 
-            return 0;
+            return toInt64(value);
 
         }
 
@@ -3097,54 +3867,79 @@ namespace steve {
 
         }
 
-        Value VirtualMachine::getVariable(const std::string& name) {
-            auto it = state.variables.find(name);
-            if (it != state.variables.end()) {
-                return it->second;
+        Value* VirtualMachine::findVariableSlot(SymbolId name) {
+            // Locals of the innermost frame shadow globals
+            if (!state.frames.empty()) {
+                const std::vector<SymbolId>& names = state.functionTable[state.frames.back().function].localNames;
+                for (size_t i = 0; i < names.size(); i++) {
+                    if (names[i] == name) {
+                        return &state.locals[state.localsBase + i];
+                    }
+                }
+            }
+            auto it = state.globalSlots.find(name);
+            if (it != state.globalSlots.end()) {
+                return &state.globals[it->second];
+            }
+            return nullptr;
+        }
+
+        Value VirtualMachine::getVariable(SymbolId name) {
+            Value* slot = findVariableSlot(name);
+            if (slot) {
+                return *slot;
             }
             return Value(0);
         }
 
-        void VirtualMachine::setVariable(const std::string& name, const Value& value) {
-            state.variables[name] = value;
+        void VirtualMachine::setVariable(SymbolId name, const Value& value) {
+            Value* slot = findVariableSlot(name);
+            if (slot) {
+                *slot = value;
+                return;
+            }
+            // New global created at run time
+            state.globalSlots.emplace(name, state.globals.size());
+            state.globalNames.push_back(name);
+            state.globals.push_back(value);
         }
 
         void VirtualMachine::printStack() {
             std::cout << "Stack (" << state.stack.size() << " elements): ";
             for (size_t i = 0; i < state.stack.size(); ++i) {
-                if (std::holds_alternative<int>(state.stack[i])) {
-                    std::cout << std::get<int>(state.stack[i]) << " ";
+                if (state.stack[i].is<int>()) {
+                    std::cout << state.stack[i].get<int>() << " ";
                 }
-                else if (std::holds_alternative<int64_t>(state.stack[i])) {
-                    std::cout << std::get<int64_t>(state.stack[i]) << " ";
+                else if (state.stack[i].is<int64_t>()) {
+                    std::cout << state.stack[i].get<int64_t>() << " ";
                 }
-                else if (std::holds_alternative<double>(state.stack[i])) {
-                    std::cout << std::get<double>(state.stack[i]) << " ";
+                else if (state.stack[i].is<double>()) {
+                    std::cout << state.stack[i].get<double>() << " ";
                 }
-                else if (std::holds_alternative<std::string>(state.stack[i])) {
-                    std::cout << """ << std::get<std::string>(state.stack[i]) << "" ";
+                else if (state.stack[i].is<std::string>()) {
+                    std::cout << """ << state.stack[i].get<std::string>() << "" ";
                 }
-                else if (std::holds_alternative<bool>(state.stack[i])) {
-                    std::cout << (std::get<bool>(state.stack[i]) ? "true" : "false") << " ";
+                else if (state.stack[i].is<bool>()) {
+                    std::cout << (state.stack[i].get<bool>() ? "true" : "false") << " ";
                 }
-                else if (std::holds_alternative<std::nullptr_t>(state.stack[i])) {
+                else if (state.stack[i].is<std::nullptr_t>()) {
                     std::cout << "null ";
                 }
-                else if (std::holds_alternative<PointerValue>(state.stack[i])) {
-                    const PointerValue& ptr = std::get<PointerValue>(state.stack[i]);
+                else if (state.stack[i].is<PointerValue>()) {
+                    const PointerValue& ptr = state.stack[i].get<PointerValue>();
                     if (ptr.isNull) {
                         std::cout << "null_ptr ";
                     } else {
                         std::cout << "ptr(" << ptr.type << ") ";
                     }
                 }
-                else if (std::holds_alternative<ListValue>(state.stack[i])) {
-                    const ListValue& list = std::get<ListValue>(state.stack[i]);
-                    std::cout << "[list:" << list.items.size() << "] ";
+                else if (state.stack[i].is<ListValue>()) {
+                    const ListValue& list = state.stack[i].get<ListValue>();
+                    std::cout << "[list:" << list.size() << "] ";
                 }
-                else if (std::holds_alternative<DictValue>(state.stack[i])) {
-                    const DictValue& dict = std::get<DictValue>(state.stack[i]);
-                    std::cout << "{dict:" << dict.items.size() << "} ";
+                else if (state.stack[i].is<DictValue>()) {
+                    const DictValue& dict = state.stack[i].get<DictValue>();
+                    std::cout << "{dict:" << dict.size() << "} ";
                 }
                 else {
                     std::cout << "unknown ";
@@ -3174,19 +3969,26 @@ namespace steve {
             state.rcx = 0;
             state.rdx = 0;
             
-            // Clear all scopes and create a new one
-            state.scopes.clear();
-            state.scopes.push_back({});
-            
             // Clear the stack
             state.stack.clear();
             
-            // Clear variables and functions maps
-            state.variables.clear();
+            // Clear variable slots, frames, functions and labels maps
+            state.globals.clear();
+            state.locals.clear();
+            state.frames.clear();
+            state.localsBase = 0;
+            state.globalSlots.clear();
+            state.globalNames.clear();
+            state.functionTable.clear();
+            registerCode.reset();
+            jitCompiler->reset();
+            loopHeat.clear();
             state.functions.clear();
+            state.labels.clear();
+            state.instructionCount = 0;
             
             // Clear the program
-            state.program.clear();
+            state.code.clear();
             
             // Re-register built-in functions
             registerBuiltInFunctions();
@@ -3203,48 +4005,21 @@ namespace steve {
         }
 
         int VirtualMachine::findLabel(int start, int targetId) {
-            // Find a label with the given target ID starting from the start position
-            for (size_t i = start; i < state.program.size(); i++) {
-                if (state.program[i].type == InstructionType::LABEL) {
-                    // In our implementation, labels are identified by their operand
-                    if (state.program[i].operands.size() > 0) {
-                        // Try to convert the operand to an integer ID
-                        try {
-                            int labelId = std::stoi(state.program[i].operands[0]);
-                            if (labelId == targetId) {
-                                return static_cast<int>(i);
-                            }
-                        } catch (...) {
-                            // If conversion fails, continue searching
-                            continue;
-                        }
-                    }
-                }
+            // Find a label with the given target ID at or after the start position
+            auto it = state.labels.find(state.symbols.find(std::to_string(targetId)));
+            if (it != state.labels.end() && it->second >= static_cast<size_t>(start)) {
+                return static_cast<int>(it->second);
             }
             return -1; // Not found
         }
 
         bool VirtualMachine::executeWithJIT() {
-            // Execute using JIT compilation
-            if (!useJIT || !jitCompiler) {
-                return false;
-            }
-
-            try {
-                // Try to compile and execute
-                if (jitCompiler->compile(state.program)) {
-                    int64_t result = jitCompiler->execute();
-                    std::cout << "JIT execution result: " << result << std::endl;
-                    return true;
-                }
-            }
-            catch (const std::exception& e) {
-                std::cerr << "JIT execution failed: " << e.what() << std::endl;
-                // Fall back to interpreter
-                return execute();
-            }
-
-            return false;
+            // Execute once on the JIT, whatever setJIT() says
+            bool enabled = useJIT;
+            useJIT = true;
+            bool result = execute();
+            useJIT = enabled;
+            return result;
         }
 
         // Debug control methods implementation
@@ -3374,22 +4149,22 @@ namespace steve {
         }
 
         bool VirtualMachine::executeDebugInstruction(size_t index) {
-            if (index >= state.program.size()) {
+            if (index >= state.code.size()) {
                 return false;
             }
 
-            const Instruction& instr = state.program[index];
+            InstructionType type = state.code.opcodes[index];
             
             // Check if we should pause before executing this instruction
-            if (shouldPauseAt(index, instr.line)) {
+            if (shouldPauseAt(index, state.code.lines[index])) {
                 handleDebugCommand();
             }
 
             // Track function calls for step-into/step-over/step-out functionality
-            if (instr.type == InstructionType::CALL) {
+            if (type == InstructionType::CALL) {
                 debugState.callStack.push_back(index); // Record the call
                 debugState.currentCallDepth++;
-            } else if (instr.type == InstructionType::RETURN) {
+            } else if (type == InstructionType::RETURN) {
                 if (!debugState.callStack.empty()) {
                     debugState.callStack.pop_back(); // Remove the call
                     if (debugState.currentCallDepth > 0) {
@@ -3398,10 +4173,9 @@ namespace steve {
                 }
             }
 
-            // Execute the instruction
-            bool result = decodeAndExecute(instr);
-            state.pc = index + 1;
-            return result;
+            // Execute just this instruction
+            state.pc = index;
+            return dispatch(true);
         }
 
         bool VirtualMachine::executeDebug() {
@@ -3410,8 +4184,11 @@ namespace steve {
                 return execute();
             }
 
+            // Single-stepping must stop at every original instruction
+            state.code.unfuse();
+
             state.running = true;
-            while (state.running && state.pc < state.program.size()) {
+            while (state.running && state.pc < state.code.size()) {
                 if (!executeDebugInstruction(state.pc)) {
                     break;
                 }
@@ -15,87 +15,25 @@
 #include <stack>
 #include <functional>
 #include <cstddef>
+#include <span>
 #include <iostream>
 #include <fstream>  // For FileHandle
 #include <bitset>   // For bs function implementation
+#include "vm_value.h"
+#include "vm_intern.h"
 
 // Forward declaration
 namespace steve {
     namespace VM {
         class VMGarbageCollector;
         class JITCompiler;
+        struct RegisterCode;
     }
 }
 
 namespace steve {
     namespace VM {
 
-        // Forward declarations for Value type
-        struct ListValue;
-        struct DictValue;
-        struct PointerValue;
-        
-        // Value type definition
-        using Value = std::variant<int, double, bool, std::string, std::nullptr_t, int64_t, PointerValue, ListValue, DictValue>;
-        
-        // Memory-managed object structure for pointer system
-        struct ManagedObject {
-            void* data;
-            std::string type;
-            size_t size;
-            bool marked;  // For garbage collection
-            
-            ManagedObject(void* d, const std::string& t, size_t s) 
-                : data(d), type(t), size(s), marked(false) {}
-            
-            ~ManagedObject() {
-                if (data) {
-                    std::free(data);  // Free the data
-                    data = nullptr;
-                }
-            }
-        };
-        
-        // Pointer structure definition
-        struct PointerValue {
-            ManagedObject* obj;  // Pointer to managed object
-            void* ptr;           // Raw pointer value
-            std::string type;    // The type of object being pointed to
-            bool isNull;
-            bool isWeak;         // Whether this is a weak pointer
-            bool isRef;          // Whether this is a reference (cannot be null)
-            
-            PointerValue() : obj(nullptr), ptr(nullptr), type(""), isNull(true), isWeak(false), isRef(false) {}
-            PointerValue(ManagedObject* o, const std::string& t, bool weak = false, bool ref = false) 
-                : obj(o), ptr(o ? o->data : nullptr), type(t), isNull(o == nullptr), isWeak(weak), isRef(ref) {}
-            PointerValue(void* p, const std::string& t, bool weak = false, bool ref = false)
-                : obj(nullptr), ptr(p), type(t), isNull(p == nullptr), isWeak(weak), isRef(ref) {}
-            
-            void* getPointer() const { 
-                return obj ? obj->data : ptr; 
-            }
-            
-            std::string getObjectType() const {
-                return obj ? obj->type : type;
-            }
-        };
-        
-        // List/Array structure definition
-        struct ListValue {
-            std::vector<Value> items;
-            
-            ListValue() {}
-            ListValue(const std::vector<Value>& v) : items(v) {}
-        };
-        
-        // Dictionary structure definition
-        struct DictValue {
-            std::unordered_map<std::string, Value> items;
-            
-            DictValue() {}
-            DictValue(const std::unordered_map<std::string, Value>& m) : items(m) {}
-        };
-
         // Debug command enum
         enum class DebugCommand {
             NONE,       // No debug command
@@ -119,7 +57,7 @@ namespace steve {
             Breakpoint(int l, size_t p, const std::string& cond) : line(l), pc(p), enabled(true), condition(cond), temporary(false) {}
         };
 
-        enum class InstructionType {
+        enum class InstructionType : uint8_t {
             DEFVAR,     // Define variable
             LOAD,       // Load variable
             STORE,      // Store variable
@@ -155,22 +93,155 @@ namespace steve {
             PTR_DEREF,  // Dereference pointer
             THROW,      // Throw exception
             NOP,        // No operation
-            DEBUG       // Debug instruction
+            DEBUG,      // Debug instruction
+
+            // Load-time lowered forms, never serialized in bytecode
+            LOAD_CONST,  // Push a literal decoded at load time
+            LOAD_VAR,    // Load variable by name
+            DEFVAR_SLOT, // Define variable by slot
+            LOAD_SLOT,   // Load variable by slot
+            STORE_SLOT,  // Store variable by slot
+
+            // Superinstructions fused at load time (see vm_superinstructions.h). Each keeps the immediate of
+            // the first instruction it replaced and reads the others from the instructions that follow it
+            INC_VAR,                      // LOAD_SLOT a, LOAD_CONST, BINARY_OP +, STORE_SLOT a
+            VAR_CONST_OP_STORE,           // LOAD_SLOT, LOAD_CONST, BINARY_OP, STORE_SLOT
+            CMP_VAR_CONST_JUMP_IF_FALSE,  // LOAD_SLOT, LOAD_CONST, BINARY_OP, IF/WHILE
+            CMP_CONST_JUMP_IF_FALSE,      // LOAD_CONST, BINARY_OP, IF/WHILE
+            VAR_CONST_OP,                 // LOAD_SLOT, LOAD_CONST, BINARY_OP
+            VAR_VAR_OP,                   // LOAD_SLOT, LOAD_SLOT, BINARY_OP
+            CONST_STORE                   // LOAD_CONST, STORE_SLOT
+        };
+
+        // BINARY_OP/UNARY_OP operators, decoded from their text form at load time
+        enum class Operator : uint8_t {
+            NONE,
+            ADD,        // +
+            SUB,        // - (binary)
+            MUL,        // *
+            DIV,        // /
+            MOD,        // %
+            EQ,         // ==
+            NE,         // !=
+            LT,         // <
+            GT,         // >
+            LE,         // <=
+            GE,         // >=
+            AND,        // and, &&
+            OR,         // or, ||
+            ASSIGN,     // = (pointer assignment)
+            NEG,        // - (unary)
+            NOT         // !, not
         };
 
-        // Instruction structure
+        // Marks an instruction without a resolved jump target
+        constexpr size_t NO_TARGET = static_cast<size_t>(-1);
+
+        // Load-time instruction, rewritten by the load passes and then packed into a CodeStream
         struct Instruction {
             InstructionType type;
-            std::string operand1;
-            std::string operand2;
-            std::string operand3;
-            Value literal;
+            Value literal;  // Decoded operand for LOAD_CONST
             int line;
             std::vector<std::string> operands;
+            size_t target;  // Absolute jump target PC, resolved at load time
+            int slot;       // Variable slot for *_SLOT instructions
+            bool localSlot; // Slot is relative to the current frame instead of global
+            Operator op;    // Decoded operator of BINARY_OP/UNARY_OP
 
-            Instruction() : type(InstructionType::NOP), literal(nullptr), line(-1) {
-                operands = std::vector<std::string>(3);
-            }
+            Instruction() : type(InstructionType::NOP), literal(nullptr), line(-1), target(NO_TARGET), slot(-1), localSlot(false), op(Operator::NONE) {}
+        };
+
+        // Immediate operand without a value (e.g. an END that does not jump)
+        constexpr uint32_t NO_IMMEDIATE = 0xFFFFFFFFu;
+
+        // Set in the immediate of *_SLOT instructions that address a local slot
+        constexpr uint32_t LOCAL_SLOT_FLAG = 0x80000000u;
+
+        // CALL immediates: callee index in the low 24 bits, argument count in the next 7,
+        // and CALL_BUILTIN_FLAG when the callee is a built-in
+        constexpr uint32_t CALL_INDEX_MASK = 0x00FFFFFFu;
+        constexpr uint32_t CALL_ARGC_SHIFT = 24;
+        constexpr uint32_t CALL_ARGC_MASK = 0x7Fu;
+        constexpr uint32_t CALL_ARGC_DEFAULT = 0x7Fu;  // No argc operand: a built-in takes one argument if the stack has one
+        constexpr uint32_t CALL_BUILTIN_FLAG = 0x80000000u;
+
+        // Packed instruction stream executed by the interpreter, stored as parallel arrays.
+        // Each instruction is a 1-byte opcode, one 32-bit immediate and a range of interned
+        // operand names; source lines live in their own table.
+        // The immediate holds, depending on the opcode:
+        //   LOAD_CONST                          index into constants
+        //   DEFVAR_SLOT, LOAD_SLOT, STORE_SLOT  slot, ORed with LOCAL_SLOT_FLAG for locals
+        //   BINARY_OP, UNARY_OP                 Operator
+        //   jumps, FUNC, END                    absolute target pc or NO_IMMEDIATE
+        //   CALL                                callee and argc (see CALL_INDEX_MASK), NO_IMMEDIATE if unknown
+        struct CodeStream {
+            std::vector<InstructionType> opcodes;
+            std::vector<uint32_t> immediates;
+            std::vector<uint32_t> operandStart;  // First operandNames entry per instruction, plus an end marker
+            std::vector<SymbolId> operandNames;  // Operands, interned in symbols
+            std::vector<int> lines;              // Source line per instruction
+            std::vector<Value> constants;        // Distinct literals, strings share their interned payload
+            const InternTable* symbols;          // MachineState::symbols of the VM that packed the stream
+
+            CodeStream() : symbols(nullptr) {}
+
+            size_t size() const { return opcodes.size(); }
+            bool empty() const { return opcodes.empty(); }
+            size_t operandCount(size_t pc) const { return operandStart[pc + 1] - operandStart[pc]; }
+            SymbolId operandSymbol(size_t pc, size_t i) const { return operandNames[operandStart[pc] + i]; }
+            const std::string& operand(size_t pc, size_t i) const { return symbols->text(operandSymbol(pc, i)); }
+
+            // Expand one instruction back into its load-time form (for tooling and the JIT)
+            Instruction unpack(size_t pc) const;
+
+            // Turn superinstructions back into the first instruction they replaced, for single-stepping
+            void unfuse();
+
+            void clear();
+        };
+
+        // Load-time information about a user function
+        struct FunctionInfo {
+            SymbolId name;                        // NO_SYMBOL for an anonymous FUNC
+            size_t entry;                         // First instruction of the body
+            size_t paramCount;                    // Parameters occupy local slots 0..paramCount-1
+            size_t localCount;
+            size_t registerTemps;                 // Register tier temporaries, in the local slots after the locals
+            std::vector<SymbolId> localNames;     // Local slot -> name, for the debugger
+
+            FunctionInfo() : name(NO_SYMBOL), entry(0), paramCount(0), localCount(0), registerTemps(0) {}
+        };
+
+        // Deepest user function recursion before a call fails with a RuntimeError
+        constexpr size_t MAX_CALL_DEPTH = 100000;
+
+        // Activation of a user function
+        struct Frame {
+            size_t returnPc;    // Instruction after the CALL
+            uint32_t function;  // Index into MachineState::functionTable
+            uint32_t argc;      // Arguments moved from the operand stack into the first local slots
+            size_t localsBase;  // First local slot of this activation in MachineState::locals
+            size_t stackBase;   // Operand stack height below the arguments, restored by RETURN
+        };
+
+        // TRY ... CATCH [name] ... END block, built at load time. Entering a protected range costs
+        // nothing at run time, a throw looks up the innermost handler covering the faulting pc.
+        struct ExceptionHandler {
+            uint32_t start;     // TRY instruction
+            uint32_t end;       // CATCH instruction, the protected range is [start, end)
+            uint32_t handler;   // First instruction of the catch body, it pops the thrown value
+            uint32_t function;  // Function owning the block, NO_IMMEDIATE at top level
+        };
+
+        // Straight-line opcode sequences of length 2 to 4 executed by the interpreter,
+        // collected when the VM is built with STEVE_PROFILE_OPCODES=1
+        struct OpcodeProfile {
+            std::unordered_map<uint64_t, uint64_t> counts;  // (length << 32 | opcodes, oldest in the highest byte) -> executions
+            uint32_t window;                                // Last opcodes, one per byte
+            uint32_t windowLength;
+            size_t lastPc;
+
+            OpcodeProfile() : window(0), windowLength(0), lastPc(0) {}
         };
 
         // Machine state structure
@@ -178,13 +249,22 @@ namespace steve {
             size_t pc;
             bool running;
             int rax, rbx, rcx, rdx;
-            std::vector<std::unordered_map<std::string, Value>> scopes;
-            std::vector<Instruction> program;
+            InternTable symbols;            // Names and string literals, kept across loads so ids stay stable
+            CodeStream code;                // Packed program being executed
             std::vector<Value> stack;
-            std::unordered_map<std::string, Value> variables;
-            std::unordered_map<std::string, size_t> functions;
-
-            MachineState() : pc(0), running(false), rax(0), rbx(0), rcx(0), rdx(0) {}
+            std::vector<Value> globals;     // Global variable slots
+            std::vector<Value> locals;      // Local variable slots of every active frame
+            std::vector<Frame> frames;      // Active user function calls
+            size_t localsBase;              // Local slot base of the innermost frame
+            std::unordered_map<SymbolId, size_t> globalSlots;   // Global name -> slot, for the debugger and getVariable
+            std::vector<SymbolId> globalNames;                  // Global slot -> name
+            std::vector<FunctionInfo> functionTable;            // Function id -> entry pc and locals layout
+            std::unordered_map<SymbolId, size_t> functions;     // Function name -> function id
+            std::unordered_map<SymbolId, size_t> labels;        // Label name -> LABEL pc, built at load time
+            std::vector<ExceptionHandler> handlers;             // Innermost blocks first, built at load time
+            uint64_t instructionCount;                        // Instructions dispatched so far
+
+            MachineState() : pc(0), running(false), rax(0), rbx(0), rcx(0), rdx(0), localsBase(0), instructionCount(0) {}
         };
 
         // Debug state structure
@@ -228,15 +308,63 @@ namespace steve {
             }
         };
 
+        // Arguments of a built-in call: a view of the top argc operand stack entries, which the
+        // built-in may move from or update but must not push to or pop from the operand stack
+        using BuiltInArgs = std::span<Value>;
+        using BuiltInFunction = std::function<Value(BuiltInArgs)>;
+
+        // Built-in functions numbered in registration order, CALL sites bind to the number at load time
+        struct BuiltInTable {
+            InternTable& symbols;
+            std::vector<BuiltInFunction> functions;
+            std::vector<bool> inPlace;  // Returns its first argument, updated in place when the call owns it
+            std::unordered_map<SymbolId, uint32_t> index;
+
+            explicit BuiltInTable(InternTable& s) : symbols(s) {}
+
+            // Function registered under name, created on first use
+            BuiltInFunction& operator[](const std::string& name) {
+                auto it = index.emplace(symbols.intern(name), static_cast<uint32_t>(functions.size())).first;
+                if (it->second == functions.size()) {
+                    functions.emplace_back();
+                    inPlace.push_back(false);
+                }
+                return functions[it->second];
+            }
+
+            // Mark a built-in as updating its first argument. A CALL whose result is stored straight
+            // back into the variable the argument was loaded from then releases the variable first,
+            // so x = append(x, v) does not copy x. Such a built-in runs every check that can throw
+            // before it takes its first argument, which the call puts back into x on an error.
+            void setInPlace(const std::string& name) {
+                (*this)[name];
+                inPlace[index[symbols.intern(name)]] = true;
+            }
+
+            // Number of a built-in, or NO_IMMEDIATE
+            uint32_t find(SymbolId name) const {
+                auto it = index.find(name);
+                return it != index.end() ? it->second : NO_IMMEDIATE;
+            }
+        };
+
         // Virtual machine class
         class VirtualMachine {
         private:
             MachineState state;
             DebugState debugState;       // Debug state
-            std::unordered_map<std::string, std::function<Value(std::vector<Value>)>> builtInFunctions;
+            BuiltInTable builtInFunctions;
             std::unique_ptr<VMGarbageCollector> gc;
             std::unique_ptr<JITCompiler> jitCompiler;
             bool useJIT;
+            bool useOSR;
+            std::vector<uint32_t> loopHeat;  // END pc -> iterations the interpreter ran of its WHILE loop
+            bool osrPending;                 // dispatch() stopped where compiled code takes over
+            size_t osrLoop;                  // END of the hot loop to compile first, NO_IMMEDIATE for none
+            bool useSuperinstructions;
+            bool useRegisterTier;
+            std::unique_ptr<RegisterCode> registerCode;  // Register tier translation of state.code, built on first use
+            OpcodeProfile opcodeProfile;
             
             // File operation support
             std::unordered_map<int64_t, FileHandle*> fileHandles; // Global file handle storage
@@ -250,7 +378,7 @@ namespace steve {
             VirtualMachine();
             ~VirtualMachine();
 
-            // Load program
+            // Load program (binary .stb bytecode or text IR, detected by magic)
             bool loadProgram(const std::string& filename);
 
             // Execute program
@@ -278,6 +406,26 @@ namespace steve {
             // Reset virtual machine
             void reset();
 
+            // Interpreter statistics
+            uint64_t getInstructionCount() const;  // Instructions dispatched since the last reset
+            static const char* dispatchMode();     // "threaded" (computed goto) or "switch"
+            const OpcodeProfile& getOpcodeProfile() const { return opcodeProfile; }
+
+            // Fuse frequent instruction sequences into superinstructions when loading (default on)
+            void setSuperinstructions(bool enabled) { useSuperinstructions = enabled; }
+
+            // Run programs on the register tier instead of the stack interpreter (default off)
+            void setRegisterTier(bool enabled) { useRegisterTier = enabled; }
+
+            // Run programs on the JIT where the host supports it (default off)
+            void setJIT(bool enabled) { useJIT = enabled; }
+
+            // Interpret programs but move hot WHILE loops to the JIT mid-run (on-stack replacement, default off)
+            void setOSR(bool enabled) { useOSR = enabled; }
+
+            // JIT tiers, counters and code size
+            JITCompiler& getJITCompiler() { return *jitCompiler; }
+
             // Get machine state
             const MachineState& getState() const { return state; }
 
@@ -288,6 +436,8 @@ namespace steve {
             void runGarbageCollection();
 
         private:
+            friend class JITCompiler;
+
             // Register built-in functions
             void registerBuiltInFunctions();
 
@@ -297,17 +447,79 @@ namespace steve {
             // Parse IR code (implemented in vm.cpp)
             std::vector<Instruction> parseIR(const std::string& irCode);
 
+            // Run the load-time passes over a freshly loaded program
+            void prepareProgram(std::vector<Instruction>& program);
+
+            // Give every CATCH with a name a DEFVAR and STORE of the thrown value, and every other CATCH a POP
+            void lowerCatches(std::vector<Instruction>& program);
+
+            // Decode LOAD/PUSH literals into constants, LOAD of anything else becomes LOAD_VAR
+            void resolveLiterals(std::vector<Instruction>& program);
+
+            // Decode BINARY_OP/UNARY_OP operator text, unknown operators are load errors
+            void resolveOperators(std::vector<Instruction>& program);
+
+            // Resolve IF/ELSE/WHILE/FUNC/TRY/CATCH/END/BREAK/CONTINUE jump targets and build the handler table (load-time pass)
+            void resolveControlFlow(std::vector<Instruction>& program);
+
+            // Index labels and patch GOTO targets, undefined labels are load errors
+            void resolveLabels(std::vector<Instruction>& program);
+
+            // Assign global and function-local variable slots and lower DEFVAR/LOAD/STORE
+            void resolveSlots(std::vector<Instruction>& program);
+
+            // Bind CALL instructions to built-in numbers or user function ids, with their argument count
+            void resolveCalls(std::vector<Instruction>& program);
+
+            // Pack the resolved program into state.code
+            void packProgram(const std::vector<Instruction>& program);
+
+            // Rewrite the heads of SUPERINSTRUCTION_PATTERNS sequences in state.code into superinstructions
+            void fuseSuperinstructions();
+
+            // Translate state.code into three-address register code (vm_register.cpp)
+            void translateRegisters();
+
+            // Register tier interpreter, runs from state.pc and hands anything it cannot run to dispatch()
+            bool dispatchRegisters();
+
+            // Push a frame for a user function, moving argc arguments from the operand stack into its first locals
+            void enterFunction(uint32_t function, size_t argc, size_t returnPc, int line);
+
+            // Call built-in number and argc of a CALL immediate on its arguments, replacing them with the result
+            void callBuiltIn(uint32_t immediate, size_t pc);
+
+            // Pop the innermost frame, leaving the callee's result on the operand stack and state.pc at the return address
+            void leaveFunction();
+
+            // Unwind frames to the innermost handler covering pc and enter it with thrown on the operand
+            // stack. False, leaving the frames alone, when no handler catches it.
+            bool throwValue(Value thrown, size_t pc);
+
+            // Count the opcode sequences ending at pc (STEVE_PROFILE_OPCODES builds)
+            void profileOpcode(size_t pc, InstructionType type);
+
+            // Variable slot addressed by a *_SLOT immediate
+            Value& slotValue(uint32_t immediate) {
+                return (immediate & LOCAL_SLOT_FLAG) ? state.locals[state.localsBase + (immediate & ~LOCAL_SLOT_FLAG)] : state.globals[immediate];
+            }
+
+            // Find the first instruction computing the condition consumed by a WHILE
+            size_t findConditionStart(const std::vector<Instruction>& program, size_t whileIndex,
+                const std::unordered_map<std::string, int>& arity);
+
             // Check if JIT compilation is possible (implemented in vm.cpp)
             bool canJITCompile();
 
-            // Execute single instruction
-            bool executeInstruction(size_t index);
-
             // Execute single instruction with debug support
             bool executeDebugInstruction(size_t index);
 
-            // Decode and execute instruction
-            bool decodeAndExecute(const Instruction& instr);
+            // Interpreter loop, runs from state.pc until the program stops (or one instruction with singleStep).
+            // With useOSR it also stops at hot loops, setting osrPending.
+            bool dispatch(bool singleStep);
+
+            // Continue the loop dispatch() stopped in on compiled code, compiling it first, until it exits
+            void runCompiledLoop();
 
             // Check if execution should pause for debugging
             bool shouldPauseAt(size_t pc, int line = -1);
@@ -326,15 +538,14 @@ namespace steve {
             
             // Helper function declarations
             bool getBoolValue(const Value& value);
-            void jumpToElseOrEnd();
-            void jumpToEnd();
-            Value performBinaryOperation(const Value& left, const Value& right, const std::string& op, int line);
-            Value performUnaryOperation(const Value& operand, const std::string& op, int line);
+            Value performBinaryOperation(const Value& left, const Value& right, Operator op, int line);
+            Value performUnaryOperation(const Value& operand, Operator op, int line);
             double getDoubleValue(const Value& value);
             void* allocateMemory(size_t size);
             void deallocateMemory(void* ptr);
-            Value getVariable(const std::string& name);
-            void setVariable(const std::string& name, const Value& value);
+            Value* findVariableSlot(SymbolId name);
+            Value getVariable(SymbolId name);
+            void setVariable(SymbolId name, const Value& value);
             void printStack();
             size_t getPC() const;
             void setPC(size_t pc);
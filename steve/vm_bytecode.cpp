@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vm_bytecode.h"
+#include "vm.h"
+#include <cstring>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace steve {
+    namespace VM {
+        namespace Bytecode {
+
+            static_assert(static_cast<int>(Opcode::DEBUG) == static_cast<int>(InstructionType::DEBUG),
+                "Bytecode opcodes must match the leading InstructionType values");
+
+            MappedFile::MappedFile() : data(nullptr), size(0) {
+#ifdef _WIN32
+                fileHandle = INVALID_HANDLE_VALUE;
+                mappingHandle = nullptr;
+#else
+                fd = -1;
+#endif
+            }
+
+            MappedFile::~MappedFile() {
+                close();
+            }
+
+            bool MappedFile::open(const std::string& filename) {
+                close();
+#ifdef _WIN32
+                HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (file == INVALID_HANDLE_VALUE) {
+                    return false;
+                }
+                fileHandle = file;
+
+                LARGE_INTEGER fileSize;
+                if (!GetFileSizeEx(file, &fileSize)) {
+                    close();
+                    return false;
+                }
+                size = static_cast<size_t>(fileSize.QuadPart);
+                if (size == 0) {
+                    return true; // Nothing to map, an empty file is still a valid open
+                }
+
+                HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (!mapping) {
+                    close();
+                    return false;
+                }
+                mappingHandle = mapping;
+
+                data = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                if (!data) {
+                    close();
+                    return false;
+                }
+#else
+                fd = ::open(filename.c_str(), O_RDONLY);
+                if (fd < 0) {
+                    return false;
+                }
+
+                struct stat st;
+                if (fstat(fd, &st) != 0) {
+                    close();
+                    return false;
+                }
+                size = static_cast<size_t>(st.st_size);
+                if (size == 0) {
+                    return true; // mmap rejects zero-length mappings
+                }
+
+                void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED) {
+                    close();
+                    return false;
+                }
+                data = static_cast<const uint8_t*>(mapped);
+#endif
+                return true;
+            }
+
+            void MappedFile::close() {
+#ifdef _WIN32
+                if (data) {
+                    UnmapViewOfFile(data);
+                }
+                if (mappingHandle) {
+                    CloseHandle(mappingHandle);
+                    mappingHandle = nullptr;
+                }
+                if (fileHandle != INVALID_HANDLE_VALUE) {
+                    CloseHandle(fileHandle);
+                    fileHandle = INVALID_HANDLE_VALUE;
+                }
+#else
+                if (data) {
+                    munmap(const_cast<uint8_t*>(data), size);
+                }
+                if (fd >= 0) {
+                    ::close(fd);
+                    fd = -1;
+                }
+#endif
+                data = nullptr;
+                size = 0;
+            }
+
+            // Unaligned little-endian read (the container is only produced on little-endian hosts)
+            static uint32_t readU32(const uint8_t* p) {
+                uint32_t value;
+                std::memcpy(&value, p, sizeof(value));
+                return value;
+            }
+
+            bool isBytecode(const uint8_t* data, size_t size) {
+                return data && size >= sizeof(StbHeader) && std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+            }
+
+            bool decode(const uint8_t* data, size_t size, std::vector<Instruction>& program, std::string& error) {
+                if (!isBytecode(data, size)) {
+                    error = "not a steve bytecode file";
+                    return false;
+                }
+
+                StbHeader header;
+                std::memcpy(&header, data, sizeof(header));
+                if (header.version != VERSION) {
+                    error = "unsupported bytecode version " + std::to_string(header.version);
+                    return false;
+                }
+
+                // Validate every section against the mapped size before touching it
+                uint64_t constTableEnd = static_cast<uint64_t>(header.constTableOffset) + uint64_t(header.constCount) * 8;
+                uint64_t codeEnd = static_cast<uint64_t>(header.codeOffset) + header.codeSize;
+                uint64_t lineTableEnd = static_cast<uint64_t>(header.lineTableOffset) + uint64_t(header.instrCount) * 4;
+                if (constTableEnd > size || header.constDataOffset > size || codeEnd > size || lineTableEnd > size) {
+                    error = "truncated bytecode file";
+                    return false;
+                }
+
+                // Constant pool: every distinct operand string is materialized exactly once
+                std::vector<std::string> constants;
+                constants.reserve(header.constCount);
+                const uint8_t* constTable = data + header.constTableOffset;
+                for (uint32_t i = 0; i < header.constCount; i++) {
+                    uint32_t offset = readU32(constTable + i * 8);
+                    uint32_t length = readU32(constTable + i * 8 + 4);
+                    if (static_cast<uint64_t>(header.constDataOffset) + offset + length > size) {
+                        error = "constant " + std::to_string(i) + " out of range";
+                        return false;
+                    }
+                    constants.emplace_back(reinterpret_cast<const char*>(data + header.constDataOffset + offset), length);
+                }
+
+                // Instruction stream
+                program.clear();
+                program.reserve(header.instrCount);
+                const uint8_t* code = data + header.codeOffset;
+                const uint8_t* codeLimit = code + header.codeSize;
+                const uint8_t* lines = data + header.lineTableOffset;
+                for (uint32_t i = 0; i < header.instrCount; i++) {
+                    if (codeLimit - code < 2) {
+                        error = "truncated code section";
+                        return false;
+                    }
+                    uint8_t opcode = code[0];
+                    uint8_t argc = code[1];
+                    code += 2;
+                    if (opcode >= static_cast<uint8_t>(Opcode::OPCODE_COUNT)) {
+                        error = "invalid opcode " + std::to_string(opcode);
+                        return false;
+                    }
+                    if (codeLimit - code < static_cast<ptrdiff_t>(argc) * 4) {
+                        error = "truncated operand list";
+                        return false;
+                    }
+
+                    Instruction instr;
+                    instr.type = static_cast<InstructionType>(opcode);
+                    instr.line = static_cast<int>(readU32(lines + i * 4));
+                    instr.operands.reserve(argc);
+                    for (uint8_t a = 0; a < argc; a++) {
+                        uint32_t index = readU32(code);
+                        code += 4;
+                        if (index >= constants.size()) {
+                            error = "operand references missing constant " + std::to_string(index);
+                            return false;
+                        }
+                        instr.operands.push_back(constants[index]);
+                    }
+                    program.push_back(std::move(instr));
+                }
+
+                return true;
+            }
+
+        } // namespace Bytecode
+    } // namespace VM
+} // namespace steve
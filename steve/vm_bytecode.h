@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STEVE_VM_BYTECODE_H
+#define STEVE_VM_BYTECODE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Forward declaration
+namespace steve {
+    namespace VM {
+        struct Instruction;
+    }
+}
+
+namespace steve {
+    namespace VM {
+        namespace Bytecode {
+
+            // Binary bytecode container (.stb) written by stevec next to the text IR.
+            //
+            // Layout (all integers little-endian):
+            //   StbHeader
+            //   constant table   constCount x { uint32 offset, uint32 length } into the constant data
+            //   constant data    raw bytes of every distinct operand string
+            //                    (LOAD/PUSH operands keep their double quotes to mark string literals)
+            //   code             instrCount x { uint8 opcode, uint8 argc, argc x uint32 constant index }
+            //   line table       instrCount x uint32 source line
+            //
+            // stevec/bytecode.cpp writes the container with these definitions.
+
+            constexpr char MAGIC[4] = { 'S', 'T', 'B', '\0' };
+            constexpr uint16_t VERSION = 2;
+
+            // Wire opcodes. The numbering is part of the file format and matches the
+            // order of the first entries of InstructionType, so never reorder them.
+            enum class Opcode : uint8_t {
+                DEFVAR = 0,
+                LOAD,
+                STORE,
+                FUNC,
+                CALL,
+                IF,
+                ELSE,
+                END,
+                WHILE,
+                DO,
+                RETURN,
+                IMPORT,
+                PRINT,
+                INPUT,
+                BINARY_OP,
+                UNARY_OP,
+                PUSH,
+                POP,
+                GOTO,
+                LABEL,
+                GC_NEW,
+                GC_DELETE,
+                GC_RUN,
+                MEM_MALLOC,
+                MEM_FREE,
+                TRY,
+                CATCH,
+                BREAK,
+                CONTINUE,
+                PASS,
+                PACKAGE,
+                PTR_NEW,
+                PTR_DEREF,
+                THROW,
+                NOP,
+                DEBUG,
+                OPCODE_COUNT
+            };
+
+            // Text IR mnemonic of each opcode, shared by parseIR and the stevec writer.
+            // NOP and DEBUG have none, parseIR reads an unknown mnemonic as NOP.
+            constexpr const char* MNEMONICS[] = {
+                "DEFVAR", "LOAD", "STORE", "FUNC", "CALL", "IF", "ELSE", "END", "WHILE", "DO",
+                "RETURN", "IMPORT", "PRINT", "INPUT", "BINARY_OP", "UNARY_OP", "PUSH", "POP", "GOTO",
+                "LABEL", "GC_new", "GC_delete", "GC_gc", "MEM_malloc", "MEM_free", "TRY", "CATCH",
+                "BREAK", "CONTINUE", "PASS", "PACKAGE", "PTR_new", "PTR_DEREF", "THROW", nullptr, nullptr
+            };
+            static_assert(sizeof(MNEMONICS) / sizeof(MNEMONICS[0]) == static_cast<size_t>(Opcode::OPCODE_COUNT),
+                "Every opcode needs a MNEMONICS entry");
+
+            // Opcode of a text IR mnemonic, returns false if there is none
+            inline bool opcodeFor(const std::string& mnemonic, Opcode& opcode) {
+                for (size_t i = 0; i < static_cast<size_t>(Opcode::OPCODE_COUNT); i++) {
+                    if (MNEMONICS[i] && mnemonic == MNEMONICS[i]) {
+                        opcode = static_cast<Opcode>(i);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            struct StbHeader {
+                char magic[4];
+                uint16_t version;
+                uint16_t flags;
+                uint32_t constCount;
+                uint32_t instrCount;
+                uint32_t constTableOffset;
+                uint32_t constDataOffset;
+                uint32_t codeOffset;
+                uint32_t codeSize;
+                uint32_t lineTableOffset;
+            };
+            static_assert(sizeof(StbHeader) == 36, "StbHeader must stay packed to 36 bytes");
+
+            // Read-only memory mapping of a whole file
+            class MappedFile {
+            private:
+                const uint8_t* data;
+                size_t size;
+#ifdef _WIN32
+                void* fileHandle;
+                void* mappingHandle;
+#else
+                int fd;
+#endif
+
+            public:
+                MappedFile();
+                ~MappedFile();
+
+                MappedFile(const MappedFile&) = delete;
+                MappedFile& operator=(const MappedFile&) = delete;
+
+                // Map the file, returns false if it cannot be opened or mapped
+                bool open(const std::string& filename);
+                void close();
+
+                const uint8_t* getData() const { return data; }
+                size_t getSize() const { return size; }
+            };
+
+            // Check whether a buffer starts with the .stb magic
+            bool isBytecode(const uint8_t* data, size_t size);
+
+            // Decode a mapped .stb image into instructions.
+            // Returns false and fills error if the image is malformed.
+            bool decode(const uint8_t* data, size_t size, std::vector<Instruction>& program, std::string& error);
+
+        } // namespace Bytecode
+    } // namespace VM
+} // namespace steve
+
+#endif // STEVE_VM_BYTECODE_H
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vm_codeheap.h"
+#include <algorithm>
+#include <iterator>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace steve {
+    namespace VM {
+
+        static void* mapPages(size_t size) {
+#ifdef _WIN32
+            return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+            void* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            return pages == MAP_FAILED ? nullptr : pages;
+#endif
+        }
+
+        static void unmapPages(void* pages, size_t size) {
+#ifdef _WIN32
+            (void)size;
+            VirtualFree(pages, 0, MEM_RELEASE);
+#else
+            munmap(pages, size);
+#endif
+        }
+
+        static bool protectPages(void* pages, size_t size, bool executable) {
+#ifdef _WIN32
+            DWORD previous;
+            if (!VirtualProtect(pages, size, executable ? PAGE_EXECUTE_READ : PAGE_READWRITE, &previous)) {
+                return false;
+            }
+            if (executable) {
+                FlushInstructionCache(GetCurrentProcess(), pages, size);
+            }
+            return true;
+#else
+            if (mprotect(pages, size, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) != 0) {
+                return false;
+            }
+            if (executable) {
+                char* begin = static_cast<char*>(pages);
+                __builtin___clear_cache(begin, begin + size); // No-op on x86-64
+            }
+            return true;
+#endif
+        }
+
+        size_t CodeHeap::pageSize() {
+#ifdef _WIN32
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            return static_cast<size_t>(info.dwPageSize);
+#else
+            static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            return size;
+#endif
+        }
+
+        static size_t roundUp(size_t size, size_t alignment) {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+
+        CodeHeap::CodeHeap(size_t chunkSize) : chunkSize(roundUp(std::max<size_t>(chunkSize, 1), pageSize())) {}
+
+        CodeHeap::~CodeHeap() {
+            clear();
+        }
+
+        CodeHeap::Chunk* CodeHeap::chunkOf(const void* address) {
+            auto p = reinterpret_cast<uintptr_t>(address);
+            for (Chunk& chunk : chunks) {
+                auto base = reinterpret_cast<uintptr_t>(chunk.base);
+                if (p >= base && p < base + chunk.size) {
+                    return &chunk;
+                }
+            }
+            return nullptr;
+        }
+
+        bool CodeHeap::protect(Chunk& chunk, bool executable) {
+            if (chunk.executable == executable) {
+                return true;
+            }
+            counters.protectionFlips++;
+            if (!protectPages(chunk.base, chunk.size, executable)) {
+                return false;
+            }
+            chunk.executable = executable;
+            return true;
+        }
+
+        void* CodeHeap::allocate(size_t size) {
+            size = roundUp(std::max<size_t>(size, 1), ALIGNMENT);
+
+            // First fit over the existing chunks, preferring ones already writable
+            Chunk* found = nullptr;
+            std::map<size_t, size_t>::iterator range;
+            for (int pass = 0; pass < 2 && !found; pass++) {
+                for (Chunk& chunk : chunks) {
+                    if (chunk.executable != (pass == 1)) continue;
+                    auto it = std::find_if(chunk.freeList.begin(), chunk.freeList.end(),
+                        [size](const std::pair<const size_t, size_t>& free) { return free.second >= size; });
+                    if (it != chunk.freeList.end()) {
+                        found = &chunk;
+                        range = it;
+                        break;
+                    }
+                }
+            }
+
+            if (!found) {
+                // Oversized blocks get a chunk of their own
+                size_t mapped = std::max(chunkSize, roundUp(size, pageSize()));
+                void* pages = mapPages(mapped);
+                if (!pages) {
+                    return nullptr;
+                }
+                Chunk chunk;
+                chunk.base = static_cast<uint8_t*>(pages);
+                chunk.size = mapped;
+                chunk.executable = false;
+                chunk.liveBlocks = 0;
+                chunk.freeList.emplace(0, mapped);
+                chunks.push_back(std::move(chunk));
+                counters.reserved += mapped;
+                counters.chunks = chunks.size();
+                found = &chunks.back();
+                range = found->freeList.begin();
+            }
+
+            if (!protect(*found, false)) {
+                return nullptr;
+            }
+            size_t offset = range->first;
+            size_t rest = range->second - size;
+            found->freeList.erase(range);
+            if (rest > 0) {
+                found->freeList.emplace(offset + size, rest);
+            }
+            found->liveBlocks++;
+
+            uint8_t* block = found->base + offset;
+            blocks.emplace(reinterpret_cast<uintptr_t>(block), size);
+            counters.used += size;
+            counters.peakUsed = std::max(counters.peakUsed, counters.used);
+            counters.liveBlocks = blocks.size();
+            counters.allocations++;
+            return block;
+        }
+
+        bool CodeHeap::finalize(void* code) {
+            Chunk* chunk = chunkOf(code);
+            return chunk && protect(*chunk, true);
+        }
+
+        bool CodeHeap::unseal(void* code) {
+            Chunk* chunk = chunkOf(code);
+            return chunk && protect(*chunk, false);
+        }
+
+        void CodeHeap::release(void* code) {
+            auto block = blocks.find(reinterpret_cast<uintptr_t>(code));
+            Chunk* chunk = chunkOf(code);
+            if (block == blocks.end() || !chunk) {
+                return;
+            }
+            size_t size = block->second;
+            blocks.erase(block);
+            counters.used -= size;
+            counters.liveBlocks = blocks.size();
+
+            if (--chunk->liveBlocks == 0) {
+                unmapPages(chunk->base, chunk->size);
+                counters.reserved -= chunk->size;
+                chunks.erase(chunks.begin() + (chunk - chunks.data()));
+                counters.chunks = chunks.size();
+                return;
+            }
+
+            // Insert the range and merge it with free neighbours
+            size_t offset = static_cast<uint8_t*>(code) - chunk->base;
+            auto inserted = chunk->freeList.emplace(offset, size).first;
+            auto next = std::next(inserted);
+            if (next != chunk->freeList.end() && inserted->first + inserted->second == next->first) {
+                inserted->second += next->second;
+                chunk->freeList.erase(next);
+            }
+            if (inserted != chunk->freeList.begin()) {
+                auto previous = std::prev(inserted);
+                if (previous->first + previous->second == inserted->first) {
+                    previous->second += inserted->second;
+                    chunk->freeList.erase(inserted);
+                }
+            }
+        }
+
+        void CodeHeap::clear() {
+            for (Chunk& chunk : chunks) {
+                unmapPages(chunk.base, chunk.size);
+            }
+            chunks.clear();
+            blocks.clear();
+            counters.reserved = 0;
+            counters.used = 0;
+            counters.chunks = 0;
+            counters.liveBlocks = 0;
+        }
+
+    } // namespace VM
+} // namespace steve
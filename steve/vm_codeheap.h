@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STEVE_VM_CODEHEAP_H
+#define STEVE_VM_CODEHEAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace steve {
+    namespace VM {
+
+        // Usage counters of a CodeHeap, in bytes unless noted
+        struct CodeHeapStats {
+            size_t reserved;          // Mapped by all chunks
+            size_t used;              // Held by live blocks, including alignment padding
+            size_t peakUsed;
+            size_t chunks;            // Chunk count
+            size_t liveBlocks;        // Block count
+            uint64_t allocations;     // Blocks handed out so far
+            uint64_t protectionFlips; // mprotect/VirtualProtect calls
+
+            CodeHeapStats() : reserved(0), used(0), peakUsed(0), chunks(0), liveBlocks(0), allocations(0), protectionFlips(0) {}
+        };
+
+        // Executable memory for JIT code, following write-xor-execute: a chunk is either writable or
+        // executable, never both. allocate() hands out a block in a writable chunk, the caller emits
+        // into it and calls finalize(), which flips the chunk to read+execute. Writing into a chunk
+        // again flips it back, so code in it must not run until the next finalize().
+        // Chunks are mapped from the OS as needed (mmap on POSIX, VirtualAlloc on Windows), freed
+        // blocks go back to their chunk's free list and a chunk with no live blocks is unmapped.
+        class CodeHeap {
+        private:
+            struct Chunk {
+                uint8_t* base;
+                size_t size;
+                bool executable;
+                size_t liveBlocks;
+                std::map<size_t, size_t> freeList;  // Offset -> size of free ranges, coalesced
+            };
+
+            size_t chunkSize;
+            std::vector<Chunk> chunks;
+            std::map<uintptr_t, size_t> blocks;     // Live block address -> size
+            CodeHeapStats counters;
+
+            Chunk* chunkOf(const void* address);
+            bool protect(Chunk& chunk, bool executable);
+
+        public:
+            // Block alignment, enough for any jump target or constant the JIT emits
+            static constexpr size_t ALIGNMENT = 16;
+
+            explicit CodeHeap(size_t chunkSize = 256 * 1024);
+            ~CodeHeap();
+            CodeHeap(const CodeHeap&) = delete;
+            CodeHeap& operator=(const CodeHeap&) = delete;
+
+            // Writable block of at least size bytes, nullptr if the OS refuses memory
+            void* allocate(size_t size);
+
+            // Make the chunk holding code read+execute (and flush the instruction cache where needed)
+            bool finalize(void* code);
+
+            // Make the chunk holding code writable again, e.g. to patch a jump
+            bool unseal(void* code);
+
+            // Return a block to the heap, the code must not be running or referenced any more
+            void release(void* code);
+
+            // Release every block and unmap every chunk
+            void clear();
+
+            const CodeHeapStats& stats() const { return counters; }
+
+            // Size of the OS pages chunks are made of
+            static size_t pageSize();
+        };
+
+    } // namespace VM
+} // namespace steve
+
+#endif // STEVE_VM_CODEHEAP_H
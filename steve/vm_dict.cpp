@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vm_value.h"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STEVE_DICT_SSE2 1
+#else
+#define STEVE_DICT_SSE2 0
+#endif
+
+namespace steve {
+    namespace VM {
+
+        // Control bytes: a full bucket holds the low 7 bits of its entry's hash,
+        // free buckets have the high bit set
+        constexpr int8_t DICT_EMPTY = -128;
+        constexpr int8_t DICT_DELETED = -2;
+
+        constexpr size_t DICT_GROUP_WIDTH = 16;
+        constexpr size_t DICT_MIN_GROUPS = 1;
+        constexpr size_t NO_BUCKET = SIZE_MAX;
+
+        // Bit i set for every control byte of the group equal to tag
+        static uint32_t matchTag(const int8_t* group, int8_t tag) {
+#if STEVE_DICT_SSE2
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(tag))));
+#else
+            uint32_t mask = 0;
+            for (size_t i = 0; i < DICT_GROUP_WIDTH; i++) {
+                mask |= static_cast<uint32_t>(group[i] == tag) << i;
+            }
+            return mask;
+#endif
+        }
+
+        // Bit i set for every free (empty or deleted) control byte of the group
+        static uint32_t matchFree(const int8_t* group) {
+#if STEVE_DICT_SSE2
+            return static_cast<uint32_t>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+            uint32_t mask = 0;
+            for (size_t i = 0; i < DICT_GROUP_WIDTH; i++) {
+                mask |= static_cast<uint32_t>(group[i] < 0) << i;
+            }
+            return mask;
+#endif
+        }
+
+        static size_t hashInt(int64_t key) {
+            // Multiply-xorshift, the product's high bits are folded into the tag and group bits
+            uint64_t x = static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL;
+            return static_cast<size_t>(x ^ (x >> 32));
+        }
+
+        // Hash of key, false if it is not an int or string. Equal ints hash alike whether they are int or int64_t
+        static bool hashKey(const Value& key, size_t& hash) {
+            switch (key.index()) {
+            case Value::INT_INDEX:
+                hash = hashInt(key.get<int>());
+                return true;
+            case Value::INT64_INDEX:
+                hash = hashInt(key.get<int64_t>());
+                return true;
+            case Value::STRING_INDEX:
+                hash = hashString(key.get<std::string>());
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        static bool sameKey(const Value& a, const Value& b) {
+            switch (a.index()) {
+            case Value::INT_INDEX:
+                return b.is<int>() ? a.get<int>() == b.get<int>() : b.is<int64_t>() && a.get<int>() == b.get<int64_t>();
+            case Value::INT64_INDEX:
+                return b.is<int64_t>() ? a.get<int64_t>() == b.get<int64_t>() : b.is<int>() && a.get<int64_t>() == b.get<int>();
+            default:
+                return b.is<std::string>() && a == b;
+            }
+        }
+
+        bool DictValue::isKey(const Value& key) {
+            size_t hash;
+            return hashKey(key, hash);
+        }
+
+        size_t DictValue::findBucket(const Value& key, size_t hash) const {
+            if (groups.empty()) {
+                return NO_BUCKET;
+            }
+            size_t groupMask = groups.size() - 1;
+            size_t group = (hash >> 7) & groupMask;
+            int8_t tag = static_cast<int8_t>(hash & 0x7F);
+            // Triangular probing visits every group of a power-of-two table, and one always has an empty bucket
+            for (size_t step = 1;; step++) {
+                const Group& candidates = groups[group];
+                for (uint32_t match = matchTag(candidates.control, tag); match != 0; match &= match - 1) {
+                    size_t slot = std::countr_zero(match);
+                    const Entry& entry = entries[candidates.entry[slot]];
+                    if (entry.hash == hash && sameKey(entry.key, key)) {
+                        return group * DICT_GROUP_WIDTH + slot;
+                    }
+                }
+                if (matchTag(candidates.control, DICT_EMPTY) != 0) {
+                    return NO_BUCKET;
+                }
+                group = (group + step) & groupMask;
+            }
+        }
+
+        size_t DictValue::freeBucket(size_t hash) const {
+            size_t groupMask = groups.size() - 1;
+            size_t group = (hash >> 7) & groupMask;
+            for (size_t step = 1;; step++) {
+                uint32_t match = matchFree(groups[group].control);
+                if (match != 0) {
+                    return group * DICT_GROUP_WIDTH + std::countr_zero(match);
+                }
+                group = (group + step) & groupMask;
+            }
+        }
+
+        void DictValue::fill(size_t bucket, size_t hash, size_t entry) {
+            Group& group = groups[bucket / DICT_GROUP_WIDTH];
+            group.control[bucket % DICT_GROUP_WIDTH] = static_cast<int8_t>(hash & 0x7F);
+            group.entry[bucket % DICT_GROUP_WIDTH] = static_cast<uint32_t>(entry);
+        }
+
+        const Value* DictValue::find(const Value& key) const {
+            size_t hash;
+            if (!hashKey(key, hash)) {
+                return nullptr;
+            }
+            size_t bucket = findBucket(key, hash);
+            return bucket != NO_BUCKET ? &entries[entryAt(bucket)].value : nullptr;
+        }
+
+        bool DictValue::set(const Value& key, const Value& value) {
+            size_t hash;
+            if (!hashKey(key, hash)) {
+                return false;
+            }
+            size_t bucket = findBucket(key, hash);
+            if (bucket != NO_BUCKET) {
+                entries[entryAt(bucket)].value = value;
+                return true;
+            }
+            // Erased entries keep their bucket until the next rebuild, so they count towards the 7/8 load limit
+            if ((entries.size() + 1) * 8 > groups.size() * DICT_GROUP_WIDTH * 7) {
+                rebuild(liveCount + 1);
+            }
+            if (entries.size() >= UINT32_MAX) {
+                throw std::length_error("Dictionary too large");
+            }
+            fill(freeBucket(hash), hash, entries.size());
+            entries.push_back(Entry{ key, value, hash });
+            liveCount++;
+            return true;
+        }
+
+        bool DictValue::erase(const Value& key) {
+            size_t hash;
+            if (!hashKey(key, hash)) {
+                return false;
+            }
+            size_t bucket = findBucket(key, hash);
+            if (bucket == NO_BUCKET) {
+                return false;
+            }
+            Entry& entry = entries[entryAt(bucket)];
+            entry.key = Value(nullptr);
+            entry.value = Value();
+            groups[bucket / DICT_GROUP_WIDTH].control[bucket % DICT_GROUP_WIDTH] = DICT_DELETED;
+            liveCount--;
+            return true;
+        }
+
+        void DictValue::rebuild(size_t minEntries) {
+            // Drop erased entries, keeping insertion order
+            if (liveCount != entries.size()) {
+                entries.erase(std::remove_if(entries.begin(), entries.end(),
+                    [](const Entry& entry) { return entry.key.is<std::nullptr_t>(); }), entries.end());
+            }
+            // Rebuilt tables start at most 7/16 full, half the load that triggers the next rebuild
+            size_t groupCount = DICT_MIN_GROUPS;
+            while (groupCount * DICT_GROUP_WIDTH * 7 < minEntries * 16) {
+                groupCount *= 2;
+            }
+            Group empty;
+            std::fill(std::begin(empty.control), std::end(empty.control), DICT_EMPTY);
+            std::fill(std::begin(empty.entry), std::end(empty.entry), 0);
+            groups.assign(groupCount, empty);
+            for (size_t i = 0; i < entries.size(); i++) {
+                fill(freeBucket(entries[i].hash), entries[i].hash, i);
+            }
+        }
+
+        bool DictValue::operator==(const DictValue& other) const {
+            if (liveCount != other.liveCount) {
+                return false;
+            }
+            for (const Entry& entry : entries) {
+                if (entry.key.is<std::nullptr_t>()) {
+                    continue;
+                }
+                size_t bucket = other.findBucket(entry.key, entry.hash);
+                if (bucket == NO_BUCKET || other.entries[other.entryAt(bucket)].value != entry.value) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    } // namespace VM
+} // namespace steve
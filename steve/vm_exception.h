@@ -41,6 +41,14 @@ namespace steve {
             }
         };
 
+        // A steve THROW that no handler caught, the call frames are already unwound
+        class UncaughtException : public RuntimeError {
+        public:
+            UncaughtException(const std::string& msg, int l = -1, int c = -1)
+                : RuntimeError(msg, l, c) {
+            }
+        };
+
         // Type error exception
         class TypeError : public VMException {
         public:
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vm_intern.h"
+#include <stdexcept>
+
+namespace steve {
+    namespace VM {
+
+        SymbolId InternTable::find(std::string_view text) const {
+            if (index.empty()) {
+                return NO_SYMBOL;
+            }
+            size_t hash = hashString(text);
+            for (size_t i = bucket(hash);; i = bucket(i + 1)) {
+                SymbolId id = index[i];
+                if (id == NO_SYMBOL) {
+                    return NO_SYMBOL;
+                }
+                if (symbols[id].hash == hash && this->text(id) == text) {
+                    return id;
+                }
+            }
+        }
+
+        SymbolId InternTable::intern(std::string_view text) {
+            // Keep the load factor at or below 1/2
+            if ((symbols.size() + 1) * 2 > index.size()) {
+                grow();
+            }
+            size_t hash = hashString(text);
+            size_t i = bucket(hash);
+            for (; index[i] != NO_SYMBOL; i = bucket(i + 1)) {
+                SymbolId id = index[i];
+                if (symbols[id].hash == hash && this->text(id) == text) {
+                    return id;
+                }
+            }
+            if (symbols.size() >= NO_SYMBOL) {
+                throw std::length_error("Too many interned strings");
+            }
+            SymbolId id = static_cast<SymbolId>(symbols.size());
+            Value value{std::string(text)};
+            value.markInterned();
+            symbols.push_back(Symbol{std::move(value), hash});
+            index[i] = id;
+            return id;
+        }
+
+        void InternTable::grow() {
+            std::vector<SymbolId> grown(index.empty() ? 64 : index.size() * 2, NO_SYMBOL);
+            index.swap(grown);
+            for (SymbolId id = 0; id < symbols.size(); id++) {
+                size_t i = bucket(symbols[id].hash);
+                while (index[i] != NO_SYMBOL) {
+                    i = bucket(i + 1);
+                }
+                index[i] = id;
+            }
+        }
+
+    } // namespace VM
+} // namespace steve
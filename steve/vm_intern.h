@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STEVE_VM_INTERN_H
+#define STEVE_VM_INTERN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "vm_value.h"
+
+namespace steve {
+    namespace VM {
+
+        // VM-wide table of distinct strings. Variable, function, label and type names and string
+        // literals are interned when a program is loaded, so the VM keys its name maps by SymbolId
+        // and every occurrence of a literal shares one immutable string payload. Ids stay valid for
+        // the lifetime of the table, it only grows.
+        class InternTable {
+        private:
+            struct Symbol {
+                Value value;  // Interned string payload
+                size_t hash;
+            };
+
+            std::vector<Symbol> symbols;   // SymbolId -> string
+            std::vector<SymbolId> index;   // Open-addressing hash index, NO_SYMBOL marks a free bucket
+
+            size_t bucket(size_t hash) const { return hash & (index.size() - 1); }
+            void grow();
+
+        public:
+            InternTable() {}
+            InternTable(const InternTable&) = delete;
+            InternTable& operator=(const InternTable&) = delete;
+
+            // Id of text, adding it to the table on first use
+            SymbolId intern(std::string_view text);
+
+            // Id of text, or NO_SYMBOL if it was never interned
+            SymbolId find(std::string_view text) const;
+
+            const std::string& text(SymbolId id) const { return symbols[id].value.get<std::string>(); }
+            size_t hash(SymbolId id) const { return symbols[id].hash; }
+
+            // Shared string Value of a symbol, copying it only bumps a reference count
+            const Value& value(SymbolId id) const { return symbols[id].value; }
+
+            size_t size() const { return symbols.size(); }
+        };
+
+    } // namespace VM
+} // namespace steve
+
+#endif // STEVE_VM_INTERN_H
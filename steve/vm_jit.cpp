@@ -1,30 +1,27 @@
 /*
  * Copyright (c) 2024 Kekun Su(苏科纶).
- * 
+ *
  * Refer to the LICENSE file for full license information.
  * SPDX-License-Identifier: MIT
  */
 
 #include "vm_jit.h"
+#include "vm_jit_ir.h"
 #include "vm.h" // Include definitions for Instruction and InstructionType
 #include "vm_exception.h"
-#include <iostream>
+#include "vm_superinstructions.h"
+#include <algorithm>
 #include <cstring>
 
-#ifdef _WIN32
-#include <processthreadsapi.h>
-#endif
-
 namespace steve {
     namespace VM {
 
-        // x86-64 register definitions
+        // x86-64 register numbers
         const int RAX = 0;
         const int RCX = 1;
         const int RDX = 2;
         const int RBX = 3;
         const int RSP = 4;
-        const int RBP = 5;
         const int RSI = 6;
         const int RDI = 7;
         const int R8 = 8;
@@ -35,1055 +32,2375 @@ namespace steve {
         const int R13 = 13;
         const int R14 = 14;
         const int R15 = 15;
+        const int NO_REGISTER = -1;
 
-        JITCompiler::JITCompiler(size_t bufferSize) : bufferSize(bufferSize), codeSize(0), nextReg(0) {
-            codeBuffer.resize(bufferSize);
-            executableMemory = nullptr;
-            regUsed.resize(16, false); // x86-64 has 16 general purpose registers
-
-            // Initialize register usage (skip RSP and RBP, as they have special purposes)
-            regUsed[RSP] = true;  // Stack pointer
-            regUsed[RBP] = true;  // Base pointer
-        }
-
-        JITCompiler::~JITCompiler() {
-            if (executableMemory) {
 #ifdef _WIN32
-                // On Windows, use VirtualFree
-                VirtualFree(executableMemory, 0, MEM_RELEASE);
+        const int ARG0 = RCX;
+        const int ARG1 = RDX;
+        const int SHADOW_SPACE = 32;  // Home area for the four register arguments of every call
 #else
-                // On Unix-like systems, use munmap or free
-                // For now, just use free as a placeholder
-                free(executableMemory);
+        const int ARG0 = RDI;
+        const int ARG1 = RSI;
+        const int SHADOW_SPACE = 0;
 #endif
+
+        // Registers the optimizing tier allocates: the callee-saved ones the trampoline preserves
+        // for values live across helper calls, caller-saved ones for the rest. rax, rcx, rdx and
+        // r11 are scratch registers.
+        const int CALLEE_SAVED_REGISTERS[] = { R12, R13, R14, R15 };
+        const int CALLER_SAVED_REGISTERS[] = { R8, R9, R10 };
+
+        // Frame slots of the trampoline for spilled values, above the shadow space
+        const size_t JIT_SPILL_SLOTS = 16;
+        const int32_t FRAME_SIZE = static_cast<int32_t>(SHADOW_SPACE + JIT_SPILL_SLOTS * sizeof(uint64_t));
+
+        // Condition codes of Jcc and SETcc
+        const uint8_t CC_B = 0x2;
+        const uint8_t CC_E = 0x4;
+        const uint8_t CC_NE = 0x5;
+        const uint8_t CC_A = 0x7;
+        const uint8_t CC_L = 0xC;
+        const uint8_t CC_GE = 0xD;
+        const uint8_t CC_LE = 0xE;
+        const uint8_t CC_G = 0xF;
+
+        // Compiled calls nested on the native stack before a call is left to run() instead, so deep
+        // steve recursion cannot overflow the C++ stack
+        const size_t JIT_MAX_NATIVE_DEPTH = 1000;
+
+        // Calls plus loop iterations run on the baseline code before a unit is optimized
+        const uint32_t JIT_HOT_THRESHOLD = 1000;
+
+        // Deoptimizations after which a unit stays on the baseline code
+        const uint32_t JIT_MAX_DEOPTS = 4;
+
+        // Values optimized code keeps off the operand stack before it pushes them
+        const size_t JIT_MAX_VIRTUAL_STACK = 8;
+
+        // Variables of one loop optimized code keeps in registers
+        const size_t JIT_MAX_LOOP_VARIABLES = 12;
+
+        // Machine code buffer with labels resolved when the unit is finished
+        class Assembler {
+        public:
+            std::vector<uint8_t> code;
+
+            size_t newLabel() {
+                labels.push_back(UNBOUND);
+                return labels.size() - 1;
             }
-        }
 
-        bool JITCompiler::compile(const std::vector<Instruction>& program) {
-            // Clear the code buffer
-            codeBuffer.clear();
-            codeSize = 0;
-            nextReg = 0;
-            labelOffsets.clear();
-
-            // Function prologue: save registers and set up stack frame
-            // push rbp
-            emitByte(0x55);
-            // mov rbp, rsp
-            emitByte(0x48);
-            emitByte(0x89);
-            emitByte(0xE5);
-
-            // Reserve space for local variables (1024 bytes for example)
-            emitByte(0x48); // sub rsp, 1024
-            emitByte(0x83);
-            emitByte(0xEC);
-            emitByte(0x00); // Will be updated to 0x04 (1024/8) later
-
-            // Compile each instruction in the program
-            for (size_t i = 0; i < program.size(); i++) {
-                const Instruction& instr = program[i];
-                // Store instruction index for error reporting
-                instructionIndices.push_back(i);
-
-                switch (instr.type) {
-                case InstructionType::DEFVAR: {
-                    // In JIT, variable definition allocates memory space
-                    // We map variables to stack offsets
-                    // Actually, we'll generate machine code that allocates memory
-                    // Create a local variable area at function start
-                    // Here we just record the variable's existence, actual allocation is handled at function start
-                    break;
-                }
+            void bind(size_t label) { labels[label] = code.size(); }
 
-                case InstructionType::LOAD: {
-                    // In JIT, Push operation loads value into register
-                    // We need a runtime stack to simulate the VM stack
-                    int reg = allocateRegister();
-
-                    if (!instr.operands.empty()) {
-                        std::string operand = instr.operands[0];
-
-                        // Simulate stack operation: store register value to stack
-                        // Use RSP as stack pointer
-
-                        // Load value to register
-                        if (operand[0] == '"' && operand.back() == '"') {
-                            // If it's immediate value
-                            std::string strValue = operand.substr(1, operand.length() - 2);
-                            // If it's a number, load to register
-                            try {
-                                if (operand.find('.') != std::string::npos) {
-                                    // Floating point number
-                                    double val = std::stod(strValue);
-                                    // For simplicity, convert to int64_t directly
-                                    emitMovRegImm(reg, *reinterpret_cast<int64_t*>(&val));
-                                } else {
-                                    // Integer
-                                    int64_t val = std::stoll(strValue);
-                                    emitMovRegImm(reg, val);
-                                }
-                            } catch (...) {
-                                // If not a number, it might be a string or special value
-                                // Handle string (if starts and ends with quotes)
-                                // String value, extract content
-                                // Simplification: push string length as value to stack
-                                emitMovRegImm(reg, static_cast<int64_t>(strValue.length()));
-                            }
-                        } else if (operand == "true" || operand == "false") {
-                            // Boolean value
-                            emitMovRegImm(reg, operand == "true" ? 1 : 0);
-                        } else if (operand == "null") {
-                            // Null value
-                            emitMovRegImm(reg, 0);
-                        } else {
-                            // Variable name (like "x"), load from memory
-                            // In our implementation, variables will be stored in the local variable area
-                            // First need to know the variable's stack offset
-                            // Assume variables are stored at fixed offsets below the base pointer
-                            // Actual implementation needs to maintain mapping from variables to offsets
-                            emitMovRegMem(reg, RBP, -8); // Example: load variable x from RBP-8
-                        }
+            size_t offset(size_t label) const { return labels[label]; }
 
-                        // Push value to VM stack (x86-64 stack)
-                        emitPush(reg);
-                    }
+            void byte(uint8_t b) { code.push_back(b); }
 
-                    break;
-                }
+            void imm32(uint32_t value) {
+                for (int i = 0; i < 4; i++) byte(static_cast<uint8_t>(value >> (8 * i)));
+            }
 
-                case InstructionType::STORE: {
-                    // Store top stack value to variable
-                    if (!instr.operands.empty()) {
-                        std::string varName = instr.operands[0];
-                        int valueReg = allocateRegister();
-                        emitPop(valueReg); // Pop value from VM stack
+            void imm64(uint64_t value) {
+                for (int i = 0; i < 8; i++) byte(static_cast<uint8_t>(value >> (8 * i)));
+            }
 
-                        // Store to variable location (simplified)
-                        // In real implementation, we would map variable name to stack offset
-                        emitMovMemReg(RBP, -8, valueReg); // Example: store to RBP-8 (variable x)
-                    }
-                    break;
-                }
+            // REX prefix with reg in ModRM.reg, index in SIB.index and base in ModRM.rm, left out when empty
+            void rex(bool wide, int reg, int index, int base) {
+                uint8_t prefix = static_cast<uint8_t>(0x40 | (wide ? 8 : 0) | ((reg >> 3) << 2) | ((index >> 3) << 1) | (base >> 3));
+                if (prefix != 0x40) byte(prefix);
+            }
 
-                case InstructionType::IF: {
-                    // Pop condition value from stack
-                    int condReg = allocateRegister();
-                    emitPop(condReg); // Pop value from VM stack
+            void modrm(int mod, int reg, int rm) { byte(static_cast<uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7))); }
 
-                    // Compare condition value with 0
-                    emitCmpRegImm(condReg, 0);
+            void push(int reg) {
+                rex(false, 0, 0, reg);
+                byte(0x50 + (reg & 7));
+            }
 
-                    // If condition is false (equals 0), jump to else part
-                    // Generate conditional jump, need to reserve space first
-                    // jne (jump if not equal) to skip else part
-                    emitByte(0x75);
-                    emitInt(0); // Placeholder offset, needs to be fixed later
-                    break;
-                }
+            void pop(int reg) {
+                rex(false, 0, 0, reg);
+                byte(0x58 + (reg & 7));
+            }
 
-                case InstructionType::ELSE: {
-                    // Generate ELSE structure machine code
-                    // Need unconditional jump to skip if part
-                    // Generate unconditional jump, skip if part
-                    emitByte(0xE9);
-                    emitInt(0); // Placeholder offset
-                    break;
-                }
+            void ret() { byte(0xC3); }
 
-                case InstructionType::END: {
-                    // End control flow structure
-                    // Can generate label here but actual label position needs to be determined at compile time
-                    break;
-                }
+            // 64-bit "op dst, src" with the r/m64, r64 form of opcode
+            void alu(uint8_t opcode, int dst, int src) {
+                rex(true, src, 0, dst);
+                byte(opcode);
+                modrm(3, src, dst);
+            }
 
-                case InstructionType::WHILE: {
-                    // WHILE loop start
-                    // Need to generate loop label
-                    break;
-                }
+            void movRegReg(int dst, int src) { alu(0x89, dst, src); }
+            void addRegReg(int dst, int src) { alu(0x01, dst, src); }
+            void subRegReg(int dst, int src) { alu(0x29, dst, src); }
+            void orRegReg(int dst, int src) { alu(0x09, dst, src); }
+            void cmpRegReg(int left, int right) { alu(0x39, left, right); }
+            void testRegReg(int left, int right) { alu(0x85, left, right); }
+
+            void imulRegReg(int dst, int src) {
+                rex(true, dst, 0, src);
+                byte(0x0F);
+                byte(0xAF);
+                modrm(3, dst, src);
+            }
 
-                case InstructionType::DO: {
-                    // DO loop body start
-                    // Loop body part
-                    break;
-                }
+            // dst = sign extension of the low 32 bits of src
+            void movsxd(int dst, int src) {
+                rex(true, dst, 0, src);
+                byte(0x63);
+                modrm(3, dst, src);
+            }
 
-                case InstructionType::RETURN: {
-                    // Return instruction
-                    break;
-                }
+            void shl(int reg, uint8_t count) { shift(4, reg, count); }
+            void shr(int reg, uint8_t count) { shift(5, reg, count); }
+            void sar(int reg, uint8_t count) { shift(7, reg, count); }
 
-                case InstructionType::PRINT: {
-                    // Pop a value from VM stack and print it
-                    // First pop value from stack
-                    int reg = allocateRegister();
-                    emitPop(reg); // Pop value from VM stack
+            // cmp reg32, imm32
+            void cmpReg32Imm(int reg, uint32_t imm) {
+                rex(false, 0, 0, reg);
+                byte(0x81);
+                modrm(3, 7, reg);
+                imm32(imm);
+            }
 
-                    // Call print function
-                    // Save registers
-                    emitPush(RDI); // Save RDI
+            // cmp reg64, imm8 (sign-extended)
+            void cmpRegImm8(int reg, int8_t imm) {
+                rex(true, 0, 0, reg);
+                byte(0x83);
+                modrm(3, 7, reg);
+                byte(static_cast<uint8_t>(imm));
+            }
 
-                    // Set parameters (value in RDI)
-                    emitMovRegReg(RDI, reg); // First parameter (value) to RDI
+            // rdx:rax = sign extension of rax
+            void cqo() {
+                byte(0x48);
+                byte(0x99);
+            }
 
-                    // In actual implementation, we need to generate call to a print function
-                    // For simplicity, we generate code that sets up parameters
-                    // Here we assume there's an address of a print function
-                    // To simplify, we generate some code to set parameters
+            // rax = rdx:rax / reg, rdx = remainder
+            void idiv(int reg) {
+                rex(true, 0, 0, reg);
+                byte(0xF7);
+                modrm(3, 7, reg);
+            }
 
-                    emitByte(0x48); // MOV RAX, 0 (system call number)
-                    emitByte(0xC7);
-                    emitByte(0xC0);
-                    emitByte(0x00);
-                    emitByte(0x00);
-                    emitByte(0x00);
-                    emitByte(0x00);
+            // al or cl = condition
+            void setccAl(uint8_t condition) { setcc(condition, RAX); }
+            void setccCl(uint8_t condition) { setcc(condition, RCX); }
 
-                    // Restore registers
-                    emitPop(RDI); // Restore RDI
+            // eax = al
+            void movzxEaxAl() {
+                byte(0x0F);
+                byte(0xB6);
+                byte(0xC0);
+            }
 
-                    break;
-                }
+            void andAlCl() {
+                byte(0x20);
+                byte(0xC8);
+            }
 
-                case InstructionType::CALL: {
-                    // Function call implementation
-                    // First, pop arguments
-                    int argReg = allocateRegister();
-                    if (!instr.operands.empty()) {
-                        std::string funcName = instr.operands[0];
+            void orAlCl() {
+                byte(0x08);
+                byte(0xC8);
+            }
 
-                        // In actual implementation, we need to generate call to specific function based on name
-                        // For print, we've already implemented it
-                        emitPush(argReg); // Push argument back on stack
+            // mov dst32, imm32 (zero-extends into the 64-bit register)
+            void movRegImm32(int dst, uint32_t imm) {
+                rex(false, 0, 0, dst);
+                byte(0xB8 + (dst & 7));
+                imm32(imm);
+            }
 
-                        // For input, generate special handling
-                        if (funcName == "input") {
-                            emitMovRegImm(reg, 0); // Placeholder value
-                        }
+            // mov dst, imm64
+            void movRegImm64(int dst, uint64_t imm) {
+                rex(true, 0, 0, dst);
+                byte(0xB8 + (dst & 7));
+                imm64(imm);
+            }
 
-                        // For user-defined functions, we need to look up and call
-                        // Simplified handling: generate placeholder call
-                    }
-                    break;
-                }
+            // mov dst, [base + index * 8 + disp], index NO_REGISTER for none
+            void load(int dst, int base, int index, int32_t disp) {
+                rex(true, dst, index == NO_REGISTER ? 0 : index, base);
+                byte(0x8B);
+                memory(dst, base, index, disp);
+            }
 
-                case InstructionType::FUNC: {
-                    // Generate function entry code
-                    // Save base pointer
-                    emitByte(0x55); // push rbp
-                    emitByte(0x48); // mov rbp, rsp
-                    emitByte(0x89);
-                    emitByte(0xE5);
+            // mov [base + index * 8 + disp], src
+            void store(int base, int index, int32_t disp, int src) {
+                rex(true, src, index == NO_REGISTER ? 0 : index, base);
+                byte(0x89);
+                memory(src, base, index, disp);
+            }
 
-                    // Compile all instructions
-                    break;
-                }
+            // 64-bit "op reg, imm" (add, sub, cmp) with the imm8 form when it fits
+            void addRegImm(int reg, int32_t imm) { aluImm(0, reg, imm); }
+            void subRegImm(int reg, int32_t imm) { aluImm(5, reg, imm); }
+            void cmpRegImm(int reg, int32_t imm) { aluImm(7, reg, imm); }
 
-                case InstructionType::BINARY_OP: {
-                    // Pop two operands and perform operation
-                    int rightReg = allocateRegister();
-                    int leftReg = allocateRegister();
-
-                    emitPop(rightReg); // Pop right operand from VM stack
-                    emitPop(leftReg);  // Pop left operand from VM stack
-
-                    if (!instr.operands.empty()) {
-                        std::string op = instr.operands[0];
-
-                        if (op == "+") {
-                            emitAddRegReg(leftReg, rightReg); // leftReg = leftReg + rightReg
-                        } else if (op == "-") {
-                            emitSubRegReg(leftReg, rightReg); // leftReg = leftReg - rightReg
-                        } else if (op == "*") {
-                            emitMulRegReg(leftReg, rightReg); // leftReg = leftReg * rightReg
-                        } else if (op == "/") {
-                            // For division, need to handle division by zero
-                            emitCmpRegImm(rightReg, 0);
-                            // This is simplified - in real code, we'd add error handling
-                            emitDivRegReg(leftReg, rightReg); // leftReg = leftReg / rightReg
-                        } else if (op == "%") {
-                            emitModRegReg(leftReg, rightReg); // leftReg = leftReg % rightReg
-                        } else if (op == "==") {
-                            // Compare and set result
-                            // Set equal flag to destReg
-                            emitCmpRegReg(leftReg, rightReg); // Reverse comparison
-                            emitSetEqual(leftReg); // Set result of comparison to register
-                            // Extend 8-bit result to 64-bit
-                        } else if (op == "!=") {
-                            // Compare and set result
-                            // Set not equal flag to destReg
-                            emitCmpRegReg(leftReg, rightReg); // Reverse comparison
-                            emitSetNotEqual(leftReg); // Set result of comparison to register
-                            // Extend 8-bit result to 64-bit
-                        } else if (op == "<") {
-                            emitCmpRegReg(leftReg, rightReg);
-                            emitSetLess(leftReg); // Set result to 1 if left < right, 0 otherwise
-                        } else if (op == ">") {
-                            emitCmpRegReg(leftReg, rightReg);
-                            emitSetGreater(leftReg); // Set result to 1 if left > right, 0 otherwise
-                        } else if (op == "<=") {
-                            emitCmpRegReg(leftReg, rightReg);
-                            emitSetLessEqual(leftReg); // Set result to 1 if left <= right, 0 otherwise
-                        } else if (op == ">=") {
-                            emitCmpRegReg(leftReg, rightReg);
-                            emitSetGreaterEqual(leftReg); // Set result to 1 if left >= right, 0 otherwise
-                        } else if (op == "and" || op == "&&") {
-                            // Bitwise AND
-                            emitAndRegReg(leftReg, rightReg);
-                        } else if (op == "or" || op == "||") {
-                            // Bitwise OR
-                            emitOrRegReg(leftReg, rightReg);
-                        }
-                    }
+            void addRsp(int32_t imm) {
+                if (imm != 0) addRegImm(RSP, imm);
+            }
 
-                    // Push result back to VM stack
-                    emitPush(leftReg);
-                    break;
-                }
+            void subRsp(int32_t imm) {
+                if (imm != 0) subRegImm(RSP, imm);
+            }
 
-                case InstructionType::UNARY_OP: {
-                    // Pop operand and perform unary operation
-                    int reg = allocateRegister();
-                    emitPop(reg); // Pop operand from VM stack
+            // CF = bit of reg
+            void btRegImm(int reg, uint8_t bit) {
+                rex(true, 0, 0, reg);
+                byte(0x0F);
+                byte(0xBA);
+                modrm(3, 4, reg);
+                byte(bit);
+            }
 
-                    if (!instr.operands.empty()) {
-                        std::string op = instr.operands[0];
+            void callReg(int reg) {
+                rex(false, 0, 0, reg);
+                byte(0xFF);
+                modrm(3, 2, reg);
+            }
 
-                        if (op == "-") {
-                            emitNegReg(reg); // Negate value in register
-                        } else if (op == "!" || op == "not") {
-                            // For logical NOT, first compare with 0, then set result
-                            emitCmpRegImm(reg, 0);
-                            // Set zero flag result
-                            emitSetZero(reg); // Set result of zero comparison to register
-                            // Extend 8-bit result to 64-bit
-                        }
-                    }
+            void jmpReg(int reg) {
+                rex(false, 0, 0, reg);
+                byte(0xFF);
+                modrm(3, 4, reg);
+            }
 
-                    // Push result back to VM stack
-                    emitPush(reg);
-                    break;
-                }
+            void testEaxEax() {
+                byte(0x85);
+                byte(0xC0);
+            }
 
-                case InstructionType::PUSH: {
-                    // If not a number, might be string or identifier
-                    if (!instr.operands.empty()) {
-                        std::string operand = instr.operands[0];
-                        int reg = allocateRegister();
-
-                        // Handle immediate values
-                        try {
-                            if (operand.find('.') != std::string::npos) {
-                                // Floating point number
-                                double val = std::stod(operand);
-                                emitMovRegImm(reg, *reinterpret_cast<int64_t*>(&val));
-                            } else {
-                                // Integer
-                                int64_t val = std::stoll(operand);
-                                emitMovRegImm(reg, val);
-                            }
-                        } catch (...) {
-                            // Variable name or other identifier
-                            // For now just push 0
-                            emitMovRegImm(reg, 0);
-                        }
+            void cmpEaxImm8(int8_t imm) {
+                byte(0x83);
+                byte(0xF8);
+                byte(static_cast<uint8_t>(imm));
+            }
 
-                        // Push value to VM stack
-                        emitPush(reg);
-                    }
-                    break;
-                }
+            void jmp(size_t label) {
+                byte(0xE9);
+                fixup(label);
+            }
 
-                case InstructionType::POP: {
-                    // Pop value from VM stack
-                    int reg = allocateRegister();
-                    emitPop(reg);
-                    // Value is now in register, can be used as needed
-                    break;
+            void jcc(uint8_t condition, size_t label) {
+                byte(0x0F);
+                byte(0x80 | condition);
+                fixup(label);
+            }
+
+            // Patch every rel32 with its label, false if a label was never bound
+            bool resolve() {
+                for (const auto& f : fixups) {
+                    if (labels[f.second] == UNBOUND) return false;
+                    int64_t rel = static_cast<int64_t>(labels[f.second]) - static_cast<int64_t>(f.first + 4);
+                    uint32_t value = static_cast<uint32_t>(static_cast<int32_t>(rel));
+                    std::memcpy(&code[f.first], &value, sizeof(value));
                 }
+                fixups.clear();
+                return true;
+            }
 
-                case InstructionType::GOTO: {
-                    // Jump instruction, using label name instead of number
-                    if (!instr.operands.empty()) {
-                        std::string labelName = instr.operands[0];
+        private:
+            static constexpr size_t UNBOUND = SIZE_MAX;
+            std::vector<size_t> labels;                        // Label -> code offset
+            std::vector<std::pair<size_t, size_t>> fixups;     // rel32 offset -> label
 
-                        // In actual implementation, we need a mapping from label names to addresses
-                        // Here we use a virtual label system
-                        int labelId = std::hash<std::string>{}(labelName); // Simple hash as label ID
-                        // Generate jump to label instruction
-                        emitJmp(0); // Placeholder offset, actual offset needs to be calculated at link time
-                    }
-                    break;
-                }
+            void fixup(size_t label) {
+                fixups.emplace_back(code.size(), label);
+                imm32(0);
+            }
 
-                case InstructionType::TRY: {
-                    // Try statement - exception handling
-                    // For JIT, we'll implement as a no-op for now
-                    break;
+            void aluImm(int kind, int reg, int32_t imm) {
+                rex(true, 0, 0, reg);
+                if (imm >= INT8_MIN && imm <= INT8_MAX) {
+                    byte(0x83);
+                    modrm(3, kind, reg);
+                    byte(static_cast<uint8_t>(imm));
                 }
-
-                case InstructionType::CATCH: {
-                    // Catch statement - exception handling
-                    // For JIT, we'll implement as a no-op for now
-                    break;
+                else {
+                    byte(0x81);
+                    modrm(3, kind, reg);
+                    imm32(static_cast<uint32_t>(imm));
                 }
+            }
 
-                case InstructionType::BREAK: {
-                    // Break statement - exit current loop
-                    // This would require more complex control flow management
-                    break;
-                }
+            // shl (4), shr (5) or sar (7) by an immediate
+            void shift(int kind, int reg, uint8_t count) {
+                rex(true, 0, 0, reg);
+                byte(0xC1);
+                modrm(3, kind, reg);
+                byte(count);
+            }
 
-                case InstructionType::CONTINUE: {
-                    // Continue statement - continue to next iteration
-                    // This would require more complex control flow management
-                    break;
-                }
+            void setcc(uint8_t condition, int reg) {
+                byte(0x0F);
+                byte(0x90 | condition);
+                modrm(3, 0, reg);
+            }
 
-                case InstructionType::PASS: {
-                    // Pass statement - no operation
-                    emitNop();
-                    break;
+            // ModRM (and SIB) of [base + index * 8 + disp32]
+            void memory(int reg, int base, int index, int32_t disp) {
+                if (index == NO_REGISTER && (base & 7) != RSP) {
+                    modrm(2, reg, base);
                 }
-
-                case InstructionType::PACKAGE: {
-                    // Package declaration - no runtime effect
-                    if (!instr.operands.empty()) {
-                        std::string packageName = instr.operands[0];
-                        // Store package info if needed for module system
-                    }
-                    break;
+                else {
+                    int scaled = index == NO_REGISTER ? RSP : index; // SIB index 100 means none
+                    modrm(2, reg, RSP);
+                    byte(static_cast<uint8_t>(((index == NO_REGISTER ? 0 : 3) << 6) | ((scaled & 7) << 3) | (base & 7)));
                 }
-
-                case InstructionType::LABEL: {
-                    // Label definition
-                    if (!instr.operands.empty()) {
-                        std::string labelName = instr.operands[0];
-
-                        // In actual implementation, we need to record label position
-                        int labelId = std::hash<std::string>{}(labelName); // Simple hash as label ID
-                        labelOffsets[labelId] = codeSize; // Record current position as label location
-                    }
-                    break;
+                imm32(static_cast<uint32_t>(disp));
+            }
+        };
+
+        // Emits one unit in either tier. Baseline code calls a helper per instruction. The optimizing
+        // tier translates the unit to IR, tracking the top of the operand stack at compile time as
+        // constants and virtual registers (the virtual stack) and emitting inline code wherever the
+        // feedback only saw integers and booleans, then allocates registers and emits the IR.
+        class JITCompiler::UnitCompiler {
+        public:
+            Assembler as;
+            std::vector<size_t> pcLabel;  // pc -> label, for the pcs of the unit
+            std::vector<bool> published;  // pc -> its code can be entered with an empty virtual stack
+            size_t registerLoops;
+            size_t spilledValues;
+
+            UnitCompiler(JITCompiler& jit, VirtualMachine& vm, const Unit& unit, bool optimize)
+                : registerLoops(0), spilledValues(0), jit(jit), vm(vm), code(vm.state.code), unit(unit), optimize(optimize),
+                  exit(0), current(nullptr), fusedHead(NO_IMMEDIATE), fusedEnd(0) {
+                pcLabel.assign(code.size(), SIZE_MAX);
+                published.assign(code.size(), false);
+                isTarget.assign(code.size(), false);
+                for (uint32_t pc : unit.pcs) {
+                    pcLabel[pc] = as.newLabel();
                 }
+                exit = as.newLabel();
 
-                case InstructionType::GC_NEW:
-                case InstructionType::GC_DELETE:
-                case InstructionType::GC_RUN:
-                case InstructionType::MEM_MALLOC:
-                case InstructionType::MEM_FREE: {
-                    // Garbage collection and memory management instructions
-                    // Need to generate call to corresponding C++ functions
+                // Fields optimized code reads directly, relative to the VM kept in rbx
+                const char* base = reinterpret_cast<const char*>(&vm);
+                globalsOffset = static_cast<int32_t>(reinterpret_cast<const char*>(&vm.state.globals) - base);
+                localsOffset = static_cast<int32_t>(reinterpret_cast<const char*>(&vm.state.locals) - base);
+                localsBaseOffset = static_cast<int32_t>(reinterpret_cast<const char*>(&vm.state.localsBase) - base);
+            }
 
-                    // Save registers
-                    emitPush(RDI); // Save RDI
+            // Optimized code reads a slot through the data pointer a std::vector stores first, as
+            // libstdc++, libc++ and the MSVC STL lay it out
+            static bool canAddressSlots() {
+                std::vector<Value> probe(1);
+                const void* first;
+                std::memcpy(&first, static_cast<const void*>(&probe), sizeof(first));
+                return first == probe.data() && sizeof(size_t) == sizeof(uint64_t);
+            }
 
-                    if (instr.type == InstructionType::MEM_MALLOC ||
-                        instr.type == InstructionType::GC_NEW) {
-                        // Need one parameter (size)
-                        int sizeReg = allocateRegister();
-                        if (!emitPop(sizeReg)) { // Get size parameter from stack
-                            emitMovRegImm(sizeReg, 1); // Default size
+            // False if the optimized code would need more spill slots than the frame has
+            bool emit() {
+                if (optimize) {
+                    if (!emitOptimizedUnit()) {
+                        return false;
+                    }
+                }
+                else {
+                    const std::vector<uint32_t>& pcs = unit.pcs;
+                    for (size_t i = 0; i < pcs.size(); i++) {
+                        uint32_t pc = pcs[i];
+                        as.bind(pcLabel[pc]);
+                        published[pc] = true;
+                        // The next instruction belongs to another unit (or the program ends here)
+                        if (emitBaseline(pc) && (i + 1 == pcs.size() || pcs[i + 1] != pc + 1)) {
+                            resumeAt(pc + 1);
                         }
-
-                        // In actual implementation, need to call corresponding C++ function
-                        // Generate placeholder call
-                    } else if (instr.type == InstructionType::MEM_FREE ||
-                               instr.type == InstructionType::GC_DELETE) {
-                        // Need one parameter (pointer)
-                        int ptrReg = allocateRegister();
-                        emitPop(ptrReg); // Get pointer parameter from stack
-
-                        // Generate placeholder call
-                    } else if (instr.type == InstructionType::GC_RUN ||
-                               instr.type == InstructionType::MEM_MALLOC ||
-                               instr.type == InstructionType::MEM_FREE) {
-                        // Run garbage collection, no parameters
-                        // Generate placeholder call
                     }
-
-                    // Restore registers
-                    emitPop(RDI); // Restore RDI
-                    break;
                 }
 
-                case InstructionType::NOP: {
-                    // No operation
-                    emitNop();
-                    break;
+                for (const auto& stub : foreignJumps) {
+                    as.bind(stub.first);
+                    resumeAt(stub.second);
                 }
-
-                default:
-                    // Unknown instruction, generate no operation
-                    emitNop();
-                    break;
+                as.bind(exit);
+                as.addRsp(FRAME_SIZE);
+                for (int i = 3; i >= 0; i--) {
+                    as.pop(CALLEE_SAVED_REGISTERS[i]);
                 }
-
-                // Update the instruction index mapping
-                instructionIndices.back() = i;
+                as.pop(RBX);
+                as.ret();
+                return true;
             }
 
-            // Function epilogue: restore registers and return
-            // add rsp, 1024 (release local variable space)
-            emitByte(0x48);
-            emitByte(0x83);
-            emitByte(0xC4);
-            emitByte(0x00); // Will be updated to 0x04 (1024/8) later
-
-            // pop rbp
-            emitByte(0x5D);
-            // ret
-            emitByte(0xC3);
-
-            // Generate function exit code
-
-            // Copy generated machine code to executable memory
-            executableMemory = allocateExecutableMemory(codeSize);
-            if (!executableMemory) {
-                return false;
+        private:
+            // Innermost loop [head, end] whose integer variables stay in virtual registers. Entered at
+            // head, which loads them; jumps leaving the loop store the ones it writes back first.
+            struct LoopVariable {
+                uint32_t slot;
+                bool written;
+                uint32_t vreg;
+            };
+
+            struct Loop {
+                uint32_t head;
+                uint32_t end;
+                std::vector<LoopVariable> variables;
+                size_t body;                                     // Label after the variables are loaded
+                std::vector<std::pair<size_t, uint32_t>> exits;  // Stub label -> pc outside the loop
+                size_t failed;                                   // Stub for a failed push, leaving the unit
+            };
+
+            JITCompiler& jit;
+            VirtualMachine& vm;
+            const CodeStream& code;
+            const Unit& unit;
+            bool optimize;
+            size_t exit;
+            std::vector<bool> isTarget;
+            std::vector<std::pair<size_t, uint32_t>> foreignJumps; // Stub label -> pc outside the unit
+            int32_t globalsOffset;
+            int32_t localsOffset;
+            int32_t localsBaseOffset;
+
+            IRUnit ir;
+            std::vector<IROperand> stack;
+            std::vector<bool> viaBaseline;  // pc -> left to its baseline code by the last translation
+            std::vector<Loop> loops;
+            Loop* current;                  // Loop being translated
+
+            // Superinstruction compiled instruction by instruction: its guards restart it at the
+            // head, as the baseline code runs the sequence in one helper
+            uint32_t fusedHead;
+            uint32_t fusedEnd;
+            std::vector<IROperand> fusedEntries;
+
+            std::vector<IRLocation> locations;  // Virtual register -> machine register or frame slot
+            std::vector<size_t> deoptLabels;    // IRUnit::deopts -> label of its exit stub
+
+            static_assert(JIT_MAX_VIRTUAL_STACK + JIT_MAX_LOOP_VARIABLES <= VALUE_BUFFER_SIZE, "valueBuffer too small");
+            static_assert(JIT_MAX_VIRTUAL_STACK <= 8, "rawMask of opPushValues holds 8 bits");
+
+            // High 16 bits of the NaN-boxed kinds optimized code tests
+            static constexpr uint32_t HIGH_INT = static_cast<uint32_t>(Value::box(Value::TAG_INT, 0) >> 48);
+            static constexpr uint32_t HIGH_INT64 = static_cast<uint32_t>(Value::box(Value::TAG_INT64, 0) >> 48);
+            static constexpr uint32_t HIGH_BOOL = static_cast<uint32_t>(Value::box(Value::TAG_BOOL, 0) >> 48);
+            static constexpr uint32_t HIGH_OBJECT = static_cast<uint32_t>(Value::box(Value::TAG_OBJECT, 0) >> 48);
+
+            void callHelper(const void* helper) {
+                as.movRegImm64(RAX, reinterpret_cast<uint64_t>(helper));
+                as.callReg(RAX);
             }
 
-            std::memcpy(executableMemory, codeBuffer.data(), codeSize);
+            void call(int (*helper)(VirtualMachine*, uint32_t) noexcept, uint32_t pc) {
+                as.movRegReg(ARG0, RBX);
+                as.movRegImm32(ARG1, pc);
+                callHelper(reinterpret_cast<const void*>(helper));
+            }
 
-            return true;
-        }
+            // Helper whose non-zero status leaves the unit
+            void callChecked(int (*helper)(VirtualMachine*, uint32_t) noexcept, uint32_t pc) {
+                call(helper, pc);
+                as.testEaxEax();
+                as.jcc(CC_NE, exit);
+            }
 
-        void* JITCompiler::allocateExecutableMemory(size_t size) {
-#ifdef _WIN32
-            // On Windows, use VirtualAlloc with PAGE_EXECUTE_READWRITE
-            return VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-#else
-            // On Unix-like systems, use mmap with PROT_READ, PROT_WRITE, PROT_EXEC
-            // For now, just use malloc as a placeholder (not executable)
-            return malloc(size);
-#endif
-        }
+            void resumeAt(uint32_t pc) {
+                call(opResume, pc);
+                as.jmp(exit);
+            }
 
-        void JITCompiler::emitByte(uint8_t byte) {
-            if (codeSize < codeBuffer.size()) {
-                codeBuffer[codeSize++] = byte;
+            // Label of a jump target: the instruction itself, or a stub resuming there
+            size_t target(uint32_t pc) {
+                if (pc < code.size() && pcLabel[pc] != SIZE_MAX) {
+                    return pcLabel[pc];
+                }
+                size_t stub = as.newLabel();
+                foreignJumps.emplace_back(stub, pc);
+                return stub;
             }
-        }
 
-        void JITCompiler::emitInt(uint32_t value) {
-            for (int i = 0; i < 4; i++) {
-                emitByte((value >> (i * 8)) & 0xFF);
+            // Instructions reached by a jump or a handler. translate() adds the ends of the superinstructions
+            // it leaves to their helpers.
+            void findTargets() {
+                for (uint32_t pc : unit.pcs) {
+                    uint32_t immediate = code.immediates[pc];
+                    if (isJump(code.opcodes[pc]) && immediate < code.size()) {
+                        isTarget[immediate] = true;
+                    }
+                }
+                for (const ExceptionHandler& handler : vm.state.handlers) {
+                    if (handler.handler < code.size()) {
+                        isTarget[handler.handler] = true;
+                    }
+                }
             }
-        }
 
-        void JITCompiler::emitLong(uint64_t value) {
-            for (int i = 0; i < 8; i++) {
-                emitByte((value >> (i * 8)) & 0xFF);
+            static bool isJump(InstructionType type) {
+                switch (type) {
+                case InstructionType::IF:
+                case InstructionType::WHILE:
+                case InstructionType::ELSE:
+                case InstructionType::END:
+                case InstructionType::GOTO:
+                case InstructionType::BREAK:
+                case InstructionType::CONTINUE:
+                case InstructionType::CATCH:
+                case InstructionType::FUNC:
+                    return true;
+                default:
+                    return false;
+                }
             }
-        }
 
-        void JITCompiler::emitMovRegImm(int reg, int64_t imm) {
-            // MOV instruction for 64-bit register with immediate value
-            // REX.W + MOV r64, imm64 (48 B8+rd imm64)
-            emitByte(0x48); // REX.W prefix
-            emitByte(0xB8 + (reg & 0x7)); // MOV reg, imm64
-            emitLong(imm);
-        }
+            // Baseline code of the instruction at pc, false if control never falls through to pc + 1
+            bool emitBaseline(uint32_t pc) {
+                uint32_t immediate = code.immediates[pc];
+
+                // A superinstruction runs its whole sequence in one helper, errors report the pc of the
+                // failing instruction as in the interpreter. The instructions it covers stay compiled for jumps into them.
+                size_t length = superinstructionLength(code.opcodes[pc]);
+                if (length > 1) {
+                    uint32_t next = static_cast<uint32_t>(pc + length);
+                    switch (code.opcodes[pc]) {
+                    case InstructionType::INC_VAR:
+                        callChecked(opIncVar, pc);
+                        break;
+                    case InstructionType::VAR_CONST_OP_STORE:
+                        callChecked(opVarConstOpStore, pc);
+                        break;
+                    case InstructionType::VAR_CONST_OP:
+                        callChecked(opVarConstOp, pc);
+                        break;
+                    case InstructionType::VAR_VAR_OP:
+                        callChecked(opVarVarOp, pc);
+                        break;
+                    case InstructionType::CONST_STORE:
+                        callChecked(opConstStore, pc);
+                        break;
+                    default:
+                        call(code.opcodes[pc] == InstructionType::CMP_VAR_CONST_JUMP_IF_FALSE ? opCmpVarConstJump : opCmpConstJump, pc);
+                        as.cmpEaxImm8(1);
+                        as.jcc(CC_A, exit);
+                        as.jcc(CC_NE, target(code.immediates[next - 1]));
+                        break;
+                    }
+                    as.jmp(target(next));
+                    return false;
+                }
 
-        void JITCompiler::emitMovRegReg(int destReg, int srcReg) {
-            // MOV instruction between registers
-            // REX.R + MOV r64, r64 (48 89 /r)
-            emitByte(0x48); // REX.W prefix
-            emitByte(0x89);
-            // ModR/M byte: 11 (direct addressing) + destReg*8 + srcReg
-            emitByte(0xC0 | ((destReg & 0x7) << 3) | (srcReg & 0x7));
-        }
+                switch (code.opcodes[pc]) {
+                case InstructionType::LOAD_CONST:
+                    callChecked(opLoadConst, pc);
+                    return true;
+                case InstructionType::LOAD_SLOT:
+                    callChecked(opLoadSlot, pc);
+                    return true;
+                case InstructionType::STORE_SLOT:
+                    callChecked(opStoreSlot, pc);
+                    return true;
+                case InstructionType::DEFVAR_SLOT:
+                    callChecked(opDefVarSlot, pc);
+                    return true;
+                case InstructionType::POP:
+                    callChecked(opPop, pc);
+                    return true;
+                case InstructionType::BINARY_OP:
+                    callChecked(opBinary, pc);
+                    return true;
+                case InstructionType::UNARY_OP:
+                    callChecked(opUnary, pc);
+                    return true;
+
+                case InstructionType::IF:
+                case InstructionType::WHILE:
+                    // 1 goes on, 0 takes the branch, anything above is a status
+                    call(opCondition, pc);
+                    as.cmpEaxImm8(1);
+                    as.jcc(CC_A, exit);
+                    as.jcc(CC_NE, target(immediate));
+                    return true;
+
+                case InstructionType::ELSE:
+                case InstructionType::GOTO:
+                case InstructionType::BREAK:
+                case InstructionType::CONTINUE:
+                case InstructionType::CATCH:
+                case InstructionType::FUNC:
+                    if (immediate == NO_IMMEDIATE) {
+                        callChecked(opStep, pc);
+                        return true;
+                    }
+                    backEdge(pc, immediate);
+                    as.jmp(target(immediate));
+                    return false;
 
-        void JITCompiler::emitAddRegReg(int destReg, int srcReg) {
-            // ADD instruction between registers
-            emitByte(0x48); // REX.W prefix
-            emitByte(0x01);
-            emitByte(0xC0 | ((destReg & 0x7) << 3) | (srcReg & 0x7));
-        }
+                case InstructionType::END:
+                    if (immediate == NO_IMMEDIATE) {
+                        return true;
+                    }
+                    backEdge(pc, immediate);
+                    as.jmp(target(immediate));
+                    return false;
 
-        void JITCompiler::emitSubRegReg(int destReg, int srcReg) {
-            // SUB instruction between registers
-            emitByte(0x48); // REX.W prefix
-            emitByte(0x29);
-            emitByte(0xC0 | ((destReg & 0x7) << 3) | (srcReg & 0x7));
-        }
+                case InstructionType::CALL:
+                    if (immediate == NO_IMMEDIATE) {
+                        callChecked(opStep, pc); // Undefined function error
+                    }
+                    else if (immediate & CALL_BUILTIN_FLAG) {
+                        callChecked(opCallBuiltIn, pc);
+                    }
+                    else {
+                        callChecked(opCall, pc);
+                    }
+                    return true;
 
-        void JITCompiler::emitCmpRegReg(int reg1, int reg2) {
-            // CMP instruction between registers
-            emitByte(0x48); // REX.W prefix
-            emitByte(0x39);
-            emitByte(0xC0 | ((reg1 & 0x7) << 3) | (reg2 & 0x7));
-        }
+                case InstructionType::RETURN:
+                    call(opReturn, pc);
+                    as.jmp(exit);
+                    return false;
+
+                case InstructionType::TRY:
+                case InstructionType::LABEL:
+                case InstructionType::NOP:
+                case InstructionType::PASS:
+                case InstructionType::DO:
+                    return true;
 
-        void JITCompiler::emitCmpRegImm(int reg, int64_t imm) {
-            // CMP instruction with immediate value
-            if (imm >= -128 && imm <= 127) {
-                // Use 8-bit immediate
-                emitByte(0x48); // REX.W prefix
-                emitByte(0x83);
-                emitByte(0xF8 | (reg & 0x7));
-                emitByte(imm & 0xFF);
-            } else {
-                // Use 32-bit immediate
-                emitByte(0x48); // REX.W prefix
-                emitByte(0x81);
-                emitByte(0xF8 | (reg & 0x7));
-                emitInt(imm & 0xFFFFFFFF);
+                default:
+                    callChecked(opStep, pc);
+                    return true;
+                }
             }
-        }
 
-        void JITCompiler::emitPush(int reg) {
-            // PUSH register
-            if (reg < 8) {
-                emitByte(0x50 + reg); // PUSH reg
-            } else {
-                emitByte(0x41); // REX.B prefix
-                emitByte(0x50 + (reg & 0x7)); // PUSH reg
+            // Baseline loops count their iterations to find hot units
+            void backEdge(uint32_t pc, uint32_t target) {
+                if (!optimize && target <= pc && code.opcodes[pc] != InstructionType::FUNC) {
+                    callChecked(opBackEdge, target);
+                }
             }
-        }
 
-        bool JITCompiler::emitPop(int reg) {
-            // POP register
-            if (reg < 8) {
-                emitByte(0x58 + reg); // POP reg
-                return true;
-            } else {
-                emitByte(0x41); // REX.B prefix
-                emitByte(0x58 + (reg & 0x7)); // POP reg
+            bool emitOptimizedUnit() {
+                findTargets();
+                // A first translation shows which loops compile inline, the second keeps their variables in registers
+                translate();
+                findLoops();
+                if (!loops.empty()) {
+                    translate();
+                }
+
+                RegisterPools pools;
+                pools.calleeSaved.assign(std::begin(CALLEE_SAVED_REGISTERS), std::end(CALLEE_SAVED_REGISTERS));
+                pools.callerSaved.assign(std::begin(CALLER_SAVED_REGISTERS), std::end(CALLER_SAVED_REGISTERS));
+                AllocationResult allocation;
+                if (!allocateRegisters(ir, pools, JIT_SPILL_SLOTS, allocation)) {
+                    return false;
+                }
+                locations = std::move(allocation.locations);
+                spilledValues = allocation.spilledValues;
+
+                deoptLabels.clear();
+                for (size_t i = 0; i < ir.deopts.size(); i++) {
+                    deoptLabels.push_back(as.newLabel());
+                }
+                for (const IRInstr& instr : ir.code) {
+                    emitInstr(instr);
+                }
+                for (size_t i = 0; i < ir.deopts.size(); i++) {
+                    as.bind(deoptLabels[i]);
+                    emitDeoptStub(ir.deopts[i]);
+                }
                 return true;
             }
-        }
 
-        void JITCompiler::emitNop() {
-            // NOP instruction
-            emitByte(0x90);
-        }
-
-        void JITCompiler::emitJmp(int32_t offset) {
-            // JMP instruction with relative offset
-            emitByte(0xE9);
-            emitInt(offset);
-        }
+            // ---- Translation to IR ----
 
-        void JITCompiler::emitSetEqual(int reg) {
-            // Set byte if equal (for comparison result)
-            emitByte(0x40 | (reg >= 8 ? 0x40 : 0x00)); // REX prefix if needed
-            emitByte(0x0F); // 2-byte opcode prefix
-            emitByte(0x94); // SETE instruction
-            emitByte(0xC0 | (reg & 0x7)); // ModR/M byte
-        }
+            static IROperand constant(IRKind kind, uint64_t bits, int64_t value) {
+                return IROperand{ kind, NO_VREG, bits, value };
+            }
 
-        void JITCompiler::emitSetNotEqual(int reg) {
-            // Set byte if not equal (for comparison result)
-            emitByte(0x40 | (reg >= 8 ? 0x40 : 0x00)); // REX prefix if needed
-            emitByte(0x0F); // 2-byte opcode prefix
-            emitByte(0x95); // SETNE instruction
-            emitByte(0xC0 | (reg & 0x7)); // ModR/M byte
-        }
+            static IROperand inRegister(IRKind kind, uint32_t vreg) {
+                return IROperand{ kind, vreg, 0, 0 };
+            }
 
-        int JITCompiler::allocateRegister() {
-            // Find and return an available register
-            for (size_t i = 0; i < regUsed.size(); i++) {
-                if (!regUsed[i]) {
-                    regUsed[i] = true;
-                    return static_cast<int>(i);
-                }
+            IRInstr& append(IROp op) {
+                ir.code.push_back(IRInstr{ op, IRKind::BOXED, NO_VREG, constant(IRKind::CONST_INT, 0, 0),
+                    constant(IRKind::CONST_INT, 0, 0), NO_IMMEDIATE, SIZE_MAX, -1 });
+                return ir.code.back();
             }
-            // If no registers available, try to reuse (simplified)
-            // In real implementation, use register spilling
-            regUsed[nextReg] = true;
-            int result = nextReg;
-            nextReg = (nextReg + 1) % regUsed.size();
-            return result;
-        }
 
-        void JITCompiler::freeRegister(int reg) {
-            if (reg >= 0 && static_cast<size_t>(reg) < regUsed.size()) {
-                regUsed[reg] = false;
+            void appendLabel(size_t label) {
+                append(IROp::LABEL).label = label;
             }
-        }
 
-        int64_t JITCompiler::execute() {
-            if (!executableMemory) {
-                throw RuntimeError("JIT code not compiled");
+            void appendJump(size_t label) {
+                append(IROp::JUMP).label = label;
             }
 
-            // Cast function pointer and execute
-            int64_t(*func)() = reinterpret_cast<int64_t(*)()>(executableMemory);
-            return func();
-        }
+            void translate() {
+                ir = IRUnit();
+                stack.clear();
+                fusedHead = NO_IMMEDIATE;
+                fusedEnd = 0;
+                fusedEntries.clear();
+                foreignJumps.clear();
+                current = nullptr;
+                registerLoops = 0;
+                published.assign(code.size(), false);
+                viaBaseline.assign(code.size(), false);
+
+                const std::vector<uint32_t>& pcs = unit.pcs;
+                size_t nextLoop = 0;
+                bool reachable = true;
+                for (size_t i = 0; i < pcs.size(); i++) {
+                    uint32_t pc = pcs[i];
+                    // Jumps arrive with every value on the operand stack
+                    if (isTarget[pc] || (i > 0 && pcs[i - 1] + 1 != pc)) {
+                        flush();
+                        reachable = true;
+                    }
+                    if (pc >= fusedEnd) {
+                        fusedHead = NO_IMMEDIATE;
+                    }
+                    if (nextLoop < loops.size() && loops[nextLoop].head == pc) {
+                        enterLoop(loops[nextLoop++]);
+                    }
+                    else {
+                        appendLabel(pcLabel[pc]);
+                        published[pc] = reachable && stack.empty() && !current;
+                    }
 
-        void JITCompiler::emitMulRegReg(int destReg, int srcReg) {
-            // IMUL instruction between registers
-            emitByte(0x48); // REX.W prefix
-            emitByte(0x0F); // 2-byte opcode prefix
-            emitByte(0xAF); // IMUL instruction
-            emitByte(0xC0 | ((destReg & 0x7) << 3) | (srcReg & 0x7));
-        }
+                    // Code after a jump or a deoptimization is only reached through a label
+                    bool fallsThrough = false;
+                    if (reachable) {
+                        fallsThrough = true;
+                        if (!translateInstruction(pc, fallsThrough)) {
+                            flush();
+                            append(IROp::BASELINE).immediate = pc;
+                            viaBaseline[pc] = true;
+                            // A superinstruction's helper jumps past the sequence
+                            size_t length = superinstructionLength(code.opcodes[pc]);
+                            if (length > 1 && pc + length < code.size()) {
+                                isTarget[pc + length] = true;
+                            }
+                            fallsThrough = length == 1;
+                        }
+                        if (!fallsThrough) {
+                            stack.clear();
+                        }
+                    }
+                    reachable = fallsThrough;
 
-        void JITCompiler::emitDivRegReg(int destReg, int srcReg) {
-            // IDIV instruction (divides RAX:RDX by register)
-            // This is a simplified implementation, real division is more complex
-            emitByte(0x48); // REX.W prefix
-            emitByte(0xF7); // DIV/IDIV instruction
-            emitByte(0xF8 | (srcReg & 0x7)); // IDIV srcReg
-        }
+                    if (current && pc == current->end) {
+                        leaveLoop();
+                    }
+                    // The next instruction belongs to another unit (or the program ends here). Baseline
+                    // code that jumps away leaves this unreachable.
+                    if (fallsThrough && (i + 1 == pcs.size() || pcs[i + 1] != pc + 1)) {
+                        flush();
+                        append(IROp::RESUME).immediate = pc + 1;
+                    }
+                }
+            }
 
-        void JITCompiler::emitModRegReg(int destReg, int srcReg) {
-            // For modulo, we perform division and get the remainder from RDX
-            emitDivRegReg(destReg, srcReg); // This performs division, remainder ends up in RDX
-            emitMovRegReg(destReg, RDX); // Move remainder to destination
-        }
+            // IR of the instruction at pc, false to leave it to its baseline code
+            bool translateInstruction(uint32_t pc, bool& fallsThrough) {
+                uint32_t immediate = code.immediates[pc];
+                uint8_t seen = jit.feedback[pc];
+
+                // Code that had not run yet (further down the top level, say) goes back to the baseline
+                // tier to collect its feedback, instead of staying on helper calls
+                uint32_t profiled = profiledPc(pc);
+                if (fusedHead == NO_IMMEDIATE && profiled != NO_IMMEDIATE && !jit.feedback[profiled]) {
+                    flush();
+                    append(IROp::DEOPT).deopt = deoptAt(pc, true);
+                    fallsThrough = false;
+                    return true;
+                }
 
-        void JITCompiler::emitSetLess(int reg) {
-            // Set byte if less (for comparison result)
-            emitByte(0x40 | (reg >= 8 ? 0x40 : 0x00)); // REX prefix if needed
-            emitByte(0x0F); // 2-byte opcode prefix
-            emitByte(0x9C); // SETL instruction
-            emitByte(0xC0 | (reg & 0x7)); // ModR/M byte
-        }
+                // The instructions a superinstruction covers are often heads of shorter ones, compiled as their first instruction
+                if (fusedHead == NO_IMMEDIATE && superinstructionLength(code.opcodes[pc]) > 1) {
+                    if (!canSpecializeFused(pc)) {
+                        return false;
+                    }
+                    // The sequence must not push the virtual stack halfway, or its guards would push it twice
+                    if (stack.size() + 3 > JIT_MAX_VIRTUAL_STACK) {
+                        flush();
+                    }
+                    fusedHead = pc;
+                    fusedEnd = static_cast<uint32_t>(pc + superinstructionLength(code.opcodes[pc]));
+                    fusedEntries = stack;
+                }
 
-        void JITCompiler::emitSetGreater(int reg) {
-            // Set byte if greater (for comparison result)
-            emitByte(0x40 | (reg >= 8 ? 0x40 : 0x00)); // REX prefix if needed
-            emitByte(0x0F); // 2-byte opcode prefix
-            emitByte(0x9F); // SETG instruction
-            emitByte(0xC0 | (reg & 0x7)); // ModR/M byte
-        }
+                switch (superinstructionHead(code.opcodes[pc])) {
+                case InstructionType::LOAD_CONST: {
+                    const Value& value = code.constants[immediate];
+                    uint8_t kind = feedbackOf(value.bits);
+                    if (kind == FEEDBACK_OTHER) {
+                        return false;
+                    }
+                    if (kind == FEEDBACK_INT) {
+                        push(constant(IRKind::CONST_INT, value.bits, value.is<int>() ? value.get<int>() : value.get<int64_t>()));
+                    }
+                    else {
+                        push(constant(IRKind::CONST_BOOL, value.bits, value.get<bool>() ? 1 : 0));
+                    }
+                    return true;
+                }
 
-        void JITCompiler::emitSetLessEqual(int reg) {
-            // Set byte if less or equal (for comparison result)
-            emitByte(0x40 | (reg >= 8 ? 0x40 : 0x00)); // REX prefix if needed
-            emitByte(0x0F); // 2-byte opcode prefix
-            emitByte(0x9E); // SETLE instruction
-            emitByte(0xC0 | (reg & 0x7)); // ModR/M byte
-        }
+                case InstructionType::LOAD_SLOT: {
+                    uint32_t variable = variableOf(immediate);
+                    if (variable != NO_VREG) {
+                        push(inRegister(IRKind::BOXED, variable));
+                        return true;
+                    }
+                    if (seen != FEEDBACK_INT && seen != FEEDBACK_BOOL) {
+                        return false;
+                    }
+                    if (stack.size() >= JIT_MAX_VIRTUAL_STACK) {
+                        flush();
+                    }
+                    int32_t deopt = deoptAt(pc);
+                    IRKind kind = seen == FEEDBACK_INT ? IRKind::BOXED : IRKind::BOOL;
+                    uint32_t vreg = ir.vregCount++;
+                    IRInstr& load = append(IROp::LOAD_SLOT);
+                    load.kind = kind;
+                    load.dst = vreg;
+                    load.immediate = immediate;
+                    load.deopt = deopt;
+                    push(inRegister(kind, vreg));
+                    return true;
+                }
 
-        void JITCompiler::emitSetGreaterEqual(int reg) {
-            // Set byte if greater or equal (for comparison result)
-            emitByte(0x40 | (reg >= 8 ? 0x40 : 0x00)); // REX prefix if needed
-            emitByte(0x0F); // 2-byte opcode prefix
-            emitByte(0x9D); // SETGE instruction
-            emitByte(0xC0 | (reg & 0x7)); // ModR/M byte
-        }
+                case InstructionType::STORE_SLOT: {
+                    if (stack.empty() || !storesScalars(seen)) {
+                        return false;
+                    }
+                    IROperand value = stack.back();
+                    uint32_t variable = variableOf(immediate);
+                    if (variable == NO_VREG) {
+                        IRInstr& store = append(IROp::STORE_SLOT);
+                        store.a = value;
+                        store.immediate = immediate;
+                        store.deopt = deoptAt(pc);
+                        stack.pop_back();
+                        return true;
+                    }
+                    if (!isInt(value)) {
+                        // The variable only ever held integers so far
+                        append(IROp::DEOPT).deopt = deoptAt(pc);
+                        fallsThrough = false;
+                        return true;
+                    }
+                    if (value.vreg != variable) {
+                        int32_t deopt = value.kind == IRKind::INT ? deoptAt(pc) : -1;
+                        stack.pop_back();
+                        detach(variable);
+                        IRInstr& store = append(IROp::STORE_VAR);
+                        store.dst = variable;
+                        store.a = value;
+                        store.deopt = deopt;
+                    }
+                    else {
+                        stack.pop_back();
+                    }
+                    return true;
+                }
 
-        void JITCompiler::emitAndRegReg(int destReg, int srcReg) {
-            // AND instruction between registers
-            emitByte(0x48); // REX.W prefix
-            emitByte(0x21);
-            emitByte(0xC0 | ((destReg & 0x7) << 3) | (srcReg & 0x7));
-        }
+                case InstructionType::POP:
+                    if (stack.empty()) {
+                        return false;
+                    }
+                    stack.pop_back();
+                    return true;
 
-        void JITCompiler::emitOrRegReg(int destReg, int srcReg) {
-            // OR instruction between registers
-            emitByte(0x48); // REX.W prefix
-            emitByte(0x09);
-            emitByte(0xC0 | ((destReg & 0x7) << 3) | (srcReg & 0x7));
-        }
+                case InstructionType::BINARY_OP:
+                    return translateIntBinary(pc, static_cast<Operator>(immediate), seen);
 
-        void JITCompiler::emitNegReg(int reg) {
-            // NEG instruction (negate value in register)
-            emitByte(0xF7); // NEG instruction
-            emitByte(0xD8 | (reg & 0x7)); // ModR/M byte for NEG reg
-        }
+                case InstructionType::IF:
+                case InstructionType::WHILE: {
+                    if (stack.empty()) {
+                        return false;
+                    }
+                    // Both successors start with an empty virtual stack, except for the condition
+                    IROperand condition = stack.back();
+                    stack.pop_back();
+                    flush();
+                    size_t label = jumpLabel(immediate);
+                    if (condition.vreg == NO_VREG) {
+                        if (condition.value == 0) {
+                            appendJump(label);
+                            fallsThrough = false;
+                        }
+                        return true;
+                    }
+                    // A comparison right before the branch sets the flags it tests
+                    IRInstr& last = ir.code.back();
+                    if (last.op == IROp::BINARY && last.dst == condition.vreg && isComparison(static_cast<Operator>(last.immediate))) {
+                        last.op = IROp::BRANCH_FALSE;
+                        last.dst = NO_VREG;
+                        last.label = label;
+                        return true;
+                    }
+                    IRInstr& branch = append(IROp::BRANCH_FALSE);
+                    branch.a = condition;
+                    branch.label = label;
+                    return true;
+                }
 
-        void JITCompiler::emitSetZero(int reg) {
-            // Set byte if zero (for logical NOT result)
-            emitByte(0x40 | (reg >= 8 ? 0x40 : 0x00)); // REX prefix if needed
-            emitByte(0x0F); // 2-byte opcode prefix
-            emitByte(0x94); // SETZ instruction
-            emitByte(0xC0 | (reg & 0x7)); // ModR/M byte
-        }
+                case InstructionType::ELSE:
+                case InstructionType::GOTO:
+                case InstructionType::BREAK:
+                case InstructionType::CONTINUE:
+                case InstructionType::CATCH:
+                case InstructionType::FUNC:
+                case InstructionType::END:
+                    if (immediate == NO_IMMEDIATE) {
+                        return code.opcodes[pc] == InstructionType::END;
+                    }
+                    flush();
+                    appendJump(jumpLabel(immediate));
+                    fallsThrough = false;
+                    return true;
+
+                case InstructionType::TRY:
+                case InstructionType::LABEL:
+                case InstructionType::NOP:
+                case InstructionType::PASS:
+                case InstructionType::DO:
+                    return true;
 
-        void JITCompiler::emitMovRegMem(int destReg, int baseReg, int offset) {
-            // MOV register, [baseReg + offset]
-            emitByte(0x48); // REX.W prefix (for 64-bit operation)
-            emitByte(0x8B); // MOV r32, r/m32 (but with REX.W becomes MOV r64, r/m64)
-
-            if (offset == 0 && baseReg != RBP && baseReg != R13) {
-                // If offset is 0 and not using RBP/R13 as base (which would need SIB byte), use simple encoding
-                emitByte(0x04 | ((destReg & 0x7) << 3) | (baseReg & 0x7));
-            } else if (offset >= -128 && offset <= 127) {
-                // Use 8-bit displacement
-                emitByte(0x40 | ((destReg & 0x7) << 3) | (baseReg & 0x7)); // ModR/M
-                emitByte(offset & 0xFF); // 8-bit displacement
-            } else {
-                // Use 32-bit displacement
-                emitByte(0x80 | ((destReg & 0x7) << 3) | (baseReg & 0x7)); // ModR/M
-                emitInt(offset & 0xFFFFFFFF); // 32-bit displacement
+                default:
+                    return false;
+                }
             }
-        }
 
-        void JITCompiler::emitMovMemReg(int baseReg, int offset, int srcReg) {
-            // MOV [baseReg + offset], srcReg
-            emitByte(0x48); // REX.W prefix (for 64-bit operation)
-            emitByte(0x89); // MOV r/m32, r32 (but with REX.W becomes MOV r/m64, r64)
-
-            if (offset == 0 && baseReg != RBP && baseReg != R13) {
-                // If offset is 0 and not using RBP/R13 as base (which would need SIB byte), use simple encoding
-                emitByte(0x04 | ((srcReg & 0x7) << 3) | (baseReg & 0x7));
-            } else if (offset >= -128 && offset <= 127) {
-                // Use 8-bit displacement
-                emitByte(0x40 | ((srcReg & 0x7) << 3) | (baseReg & 0x7)); // ModR/M
-                emitByte(offset & 0xFF); // 8-bit displacement
-            } else {
-                // Use 32-bit displacement
-                emitByte(0x80 | ((srcReg & 0x7) << 3) | (baseReg & 0x7)); // ModR/M
-                emitInt(offset & 0xFFFFFFFF); // 32-bit displacement
+            // Instruction whose feedback shows whether pc has run: the head of most superinstructions,
+            // pc itself for instructions that do not collect any
+            uint32_t profiledPc(uint32_t pc) const {
+                switch (code.opcodes[pc]) {
+                case InstructionType::CONST_STORE:
+                case InstructionType::CMP_CONST_JUMP_IF_FALSE:
+                    return pc + 1;
+                default:
+                    break;
+                }
+                switch (superinstructionHead(code.opcodes[pc])) {
+                case InstructionType::LOAD_SLOT:
+                case InstructionType::STORE_SLOT:
+                case InstructionType::BINARY_OP:
+                    return pc;
+                default:
+                    return NO_IMMEDIATE;
+                }
             }
-        }
-
-        // Additional methods that were declared in header but not implemented
 
-        void JITCompiler::emitBytes(const std::vector<uint8_t>& bytes) {
-            for (uint8_t byte : bytes) {
-                emitByte(byte);
+            static bool storesScalars(uint8_t seen) {
+                return seen != 0 && (seen & ~(FEEDBACK_INT | FEEDBACK_BOOL)) == 0;
             }
-        }
-
-        void JITCompiler::emitJmpIf(int condition, int offset) {
-            // Conditional jump implementation
-            // This would emit the appropriate conditional jump instruction based on the condition
-            // For now, using a simple placeholder approach
-            emitByte(0x0F);  // 2-byte jump opcode prefix
-            emitByte(0x80 + condition);  // conditional jump opcode
-            emitInt(offset);  // offset
-        }
 
-        void JITCompiler::emitReturn() {
-            emitByte(0xC3);  // RET instruction
-        }
+            static bool isIntOperator(Operator op) {
+                switch (op) {
+                case Operator::ADD:
+                case Operator::SUB:
+                case Operator::MUL:
+                case Operator::DIV:
+                case Operator::MOD:
+                case Operator::AND:
+                case Operator::OR:
+                    return true;
+                default:
+                    return isComparison(op);
+                }
+            }
 
-        void JITCompiler::emitCall(int funcAddr) {
-            emitByte(0xE8);  // CALL instruction
-            emitInt(funcAddr);  // function address
-        }
+            static bool isComparison(Operator op) {
+                switch (op) {
+                case Operator::EQ:
+                case Operator::NE:
+                case Operator::LT:
+                case Operator::GT:
+                case Operator::LE:
+                case Operator::GE:
+                    return true;
+                default:
+                    return false;
+                }
+            }
 
-        void JITCompiler::emitNeg(int reg) {
-            emitByte(0xF7);  // NEG instruction
-            emitByte(0xD8 + (reg & 0x7));  // ModR/M byte for NEG reg
-        }
+            static bool isInt(const IROperand& operand) {
+                return operand.kind == IRKind::CONST_INT || operand.kind == IRKind::BOXED || operand.kind == IRKind::INT;
+            }
 
-        void JITCompiler::emitNot(int reg) {
-            emitByte(0xF7);  // NOT instruction
-            emitByte(0xD0 + (reg & 0x7));  // ModR/M byte for NOT reg
-        }
+            // Whether every instruction of the superinstruction at pc gets optimized code, so none
+            // of them reports an error from a pc the interpreter would not
+            bool canSpecializeFused(uint32_t pc) {
+                size_t end = pc + superinstructionLength(code.opcodes[pc]);
+                std::vector<int> ints; // Simulated operands: 1 integer, 0 boolean, -1 unknown
+                if (!stack.empty()) {
+                    ints.push_back(isInt(stack.back()) ? 1 : 0);
+                }
+                for (size_t at = pc; at < end; at++) {
+                    if (at > pc && isTarget[at]) {
+                        return false;
+                    }
+                    uint8_t seen = jit.feedback[at];
+                    switch (superinstructionHead(code.opcodes[at])) {
+                    case InstructionType::LOAD_SLOT:
+                        if (seen != FEEDBACK_INT && seen != FEEDBACK_BOOL) {
+                            return false;
+                        }
+                        ints.push_back(seen == FEEDBACK_INT ? 1 : 0);
+                        break;
+                    case InstructionType::LOAD_CONST: {
+                        uint8_t kind = feedbackOf(code.constants[code.immediates[at]].bits);
+                        if (kind == FEEDBACK_OTHER) {
+                            return false;
+                        }
+                        ints.push_back(kind == FEEDBACK_INT ? 1 : 0);
+                        break;
+                    }
+                    case InstructionType::BINARY_OP:
+                        if (seen != FEEDBACK_INT || !isIntOperator(static_cast<Operator>(code.immediates[at])) ||
+                            ints.size() < 2 || ints[ints.size() - 1] != 1 || ints[ints.size() - 2] != 1) {
+                            return false;
+                        }
+                        ints.pop_back();
+                        break;
+                    case InstructionType::STORE_SLOT:
+                        if (!storesScalars(seen)) {
+                            return false;
+                        }
+                        ints.pop_back();
+                        break;
+                    case InstructionType::IF:
+                    case InstructionType::WHILE:
+                        ints.pop_back();
+                        break;
+                    default:
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Inline integer arithmetic and comparisons, computed as binaryInt does
+            bool translateIntBinary(uint32_t pc, Operator op, uint8_t seen) {
+                if (seen != FEEDBACK_INT || stack.size() < 2 || !isIntOperator(op)) {
+                    return false;
+                }
+                IROperand left = stack[stack.size() - 2];
+                IROperand right = stack.back();
+                if (!isInt(left) || !isInt(right)) {
+                    return false;
+                }
+                // A divisor of 0 or -1 deopts to binaryInt, which raises division by zero and wraps INT64_MIN / -1 where idiv traps
+                int32_t deopt = op == Operator::DIV || op == Operator::MOD ? deoptAt(pc) : -1;
+                IRKind kind = op == Operator::ADD || op == Operator::SUB || op == Operator::MUL || deopt >= 0 ? IRKind::INT : IRKind::BOOL;
+                uint32_t vreg = ir.vregCount++;
+                IRInstr& binary = append(IROp::BINARY);
+                binary.kind = kind;
+                binary.dst = vreg;
+                binary.a = left;
+                binary.b = right;
+                binary.immediate = static_cast<uint32_t>(op);
+                binary.deopt = deopt;
+                stack.resize(stack.size() - 2);
+                stack.push_back(inRegister(kind, vreg));
+                return true;
+            }
+
+            void push(const IROperand& operand) {
+                if (stack.size() >= JIT_MAX_VIRTUAL_STACK) {
+                    flush();
+                }
+                stack.push_back(operand);
+            }
+
+            // Push the virtual stack, as baseline code and jump targets expect every value on the operand stack
+            void flush() {
+                if (stack.empty()) {
+                    return;
+                }
+                ir.pushes.push_back(stack);
+                IRInstr& push = append(IROp::PUSH);
+                push.immediate = static_cast<uint32_t>(ir.pushes.size() - 1);
+                push.label = current ? current->failed : exit;
+                stack.clear();
+            }
+
+            // Exit for a failed guard of the instruction at pc
+            int32_t deoptAt(uint32_t pc, bool unreached = false) {
+                IRDeopt deopt;
+                if (fusedHead != NO_IMMEDIATE && pc < fusedEnd) {
+                    deopt.pc = fusedHead;
+                    deopt.stack = fusedEntries;
+                }
+                else {
+                    deopt.pc = pc;
+                    deopt.stack = stack;
+                }
+                if (current) {
+                    for (const LoopVariable& variable : current->variables) {
+                        if (variable.written) {
+                            deopt.vars.emplace_back(variable.slot, variable.vreg);
+                        }
+                    }
+                }
+                deopt.unreached = unreached;
+                ir.deopts.push_back(std::move(deopt));
+                return static_cast<int32_t>(ir.deopts.size() - 1);
+            }
+
+            // ---- Loop variables ----
+
+            // Innermost loops compiled inline by the last translation, whose integer variables can
+            // move to registers: entered only at their head, no handler inside
+            void findLoops() {
+                std::vector<Loop> found;
+                for (uint32_t pc : unit.pcs) {
+                    uint32_t head = code.immediates[pc];
+                    if (!isJump(code.opcodes[pc]) || code.opcodes[pc] == InstructionType::FUNC || head > pc) {
+                        continue;
+                    }
+                    // Back-edges to one head (END and CONTINUE) make one loop
+                    auto same = std::find_if(found.begin(), found.end(), [head](const Loop& loop) { return loop.head == head; });
+                    if (same != found.end()) {
+                        same->end = std::max(same->end, pc);
+                    }
+                    else {
+                        found.push_back(Loop{ head, pc, {}, 0, {}, 0 });
+                    }
+                }
+
+                loops.clear();
+                for (const Loop& loop : found) {
+                    bool innermost = std::none_of(found.begin(), found.end(), [&loop](const Loop& other) {
+                        return &other != &loop && other.head >= loop.head && other.end <= loop.end;
+                    });
+                    if (innermost && canKeepVariables(loop)) {
+                        loops.push_back(loop);
+                        findVariables(loops.back());
+                        if (loops.back().variables.empty()) {
+                            loops.pop_back();
+                        }
+                    }
+                }
+                std::sort(loops.begin(), loops.end(), [](const Loop& a, const Loop& b) { return a.head < b.head; });
+                // Loops crossed by GOTOs may overlap, keep the first
+                for (size_t i = 1; i < loops.size();) {
+                    if (loops[i].head <= loops[i - 1].end) {
+                        loops.erase(loops.begin() + i);
+                    }
+                    else {
+                        i++;
+                    }
+                }
+            }
+
+            bool canKeepVariables(const Loop& loop) const {
+                uint32_t index = unitOf(loop.head);
+                for (uint32_t pc = loop.head; pc <= loop.end; pc++) {
+                    if (unitOf(pc) != index || viaBaseline[pc]) {
+                        return false;
+                    }
+                }
+                for (uint32_t pc : unit.pcs) {
+                    if (pc >= loop.head && pc <= loop.end) {
+                        continue;
+                    }
+                    uint32_t immediate = code.immediates[pc];
+                    size_t length = superinstructionLength(code.opcodes[pc]);
+                    if ((isJump(code.opcodes[pc]) && immediate > loop.head && immediate <= loop.end) ||
+                        (length > 1 && pc + length > loop.head && pc + length <= loop.end)) {
+                        return false;
+                    }
+                }
+                for (const ExceptionHandler& handler : vm.state.handlers) {
+                    if (handler.handler > loop.head && handler.handler <= loop.end) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            uint32_t unitOf(uint32_t pc) const {
+                return jit.unitOf[pc];
+            }
+
+            // Slots the loop only ever accessed with integers, the most used first
+            void findVariables(Loop& loop) const {
+                std::vector<std::pair<uint32_t, size_t>> uses;  // Slot -> accesses, or SIZE_MAX if not an integer
+                std::vector<uint32_t> written;
+                for (uint32_t pc = loop.head; pc <= loop.end; pc++) {
+                    InstructionType type = superinstructionHead(code.opcodes[pc]);
+                    if (type != InstructionType::LOAD_SLOT && type != InstructionType::STORE_SLOT) {
+                        continue;
+                    }
+                    uint32_t slot = code.immediates[pc];
+                    auto use = std::find_if(uses.begin(), uses.end(), [slot](const std::pair<uint32_t, size_t>& u) { return u.first == slot; });
+                    if (use == uses.end()) {
+                        uses.emplace_back(slot, 0);
+                        use = uses.end() - 1;
+                    }
+                    if (jit.feedback[pc] != FEEDBACK_INT) {
+                        use->second = SIZE_MAX;
+                    }
+                    else if (use->second != SIZE_MAX) {
+                        use->second++;
+                    }
+                    if (type == InstructionType::STORE_SLOT) {
+                        written.push_back(slot);
+                    }
+                }
+                uses.erase(std::remove_if(uses.begin(), uses.end(), [](const std::pair<uint32_t, size_t>& u) { return u.second == SIZE_MAX; }), uses.end());
+                std::stable_sort(uses.begin(), uses.end(), [](const std::pair<uint32_t, size_t>& a, const std::pair<uint32_t, size_t>& b) {
+                    return a.second > b.second;
+                });
+                if (uses.size() > JIT_MAX_LOOP_VARIABLES) {
+                    uses.resize(JIT_MAX_LOOP_VARIABLES);
+                }
+                for (const auto& use : uses) {
+                    bool stored = std::find(written.begin(), written.end(), use.first) != written.end();
+                    loop.variables.push_back(LoopVariable{ use.first, stored, NO_VREG });
+                }
+            }
+
+            // Virtual register of the loop variable in slot, NO_VREG if the slot is read from memory
+            uint32_t variableOf(uint32_t slot) const {
+                if (current) {
+                    for (const LoopVariable& variable : current->variables) {
+                        if (variable.slot == slot) {
+                            return variable.vreg;
+                        }
+                    }
+                }
+                return NO_VREG;
+            }
+
+            void enterLoop(Loop& loop) {
+                appendLabel(pcLabel[loop.head]);
+                published[loop.head] = true;
+                int32_t deopt = deoptAt(loop.head);
+                for (LoopVariable& variable : loop.variables) {
+                    variable.vreg = ir.vregCount++;
+                    IRInstr& enter = append(IROp::ENTER_VAR);
+                    enter.dst = variable.vreg;
+                    enter.immediate = variable.slot;
+                    enter.deopt = deopt;
+                }
+                loop.body = as.newLabel();
+                loop.failed = as.newLabel();
+                loop.exits.clear();
+                appendLabel(loop.body);
+                current = &loop;
+                registerLoops++;
+            }
+
+            // Stubs storing the written variables back for each jump out of the loop
+            void leaveLoop() {
+                Loop& loop = *current;
+                current = nullptr;
+                for (const auto& stub : loop.exits) {
+                    appendLabel(stub.first);
+                    storeVariables(loop);
+                    appendJump(target(stub.second));
+                }
+                appendLabel(loop.failed);
+                storeVariables(loop);
+                appendJump(exit);
+            }
+
+            void storeVariables(const Loop& loop) {
+                for (const LoopVariable& variable : loop.variables) {
+                    if (variable.written) {
+                        IRInstr& sync = append(IROp::SYNC_VAR);
+                        sync.a = inRegister(IRKind::BOXED, variable.vreg);
+                        sync.immediate = variable.slot;
+                    }
+                }
+            }
+
+            // Label a jump to pc takes: inside the current loop the instruction itself (the loop body
+            // for its head), out of it a stub storing the variables
+            size_t jumpLabel(uint32_t pc) {
+                if (!current) {
+                    return target(pc);
+                }
+                if (pc == current->head) {
+                    return current->body;
+                }
+                if (pc > current->head && pc <= current->end) {
+                    return pcLabel[pc];
+                }
+                size_t stub = as.newLabel();
+                current->exits.emplace_back(stub, pc);
+                return stub;
+            }
+
+            // Before a store to a loop variable, give the entries still holding its old value their own copy
+            void detach(uint32_t variable) {
+                uint32_t copy = NO_VREG;
+                for (std::vector<IROperand>* entries : { &stack, &fusedEntries }) {
+                    for (IROperand& entry : *entries) {
+                        if (entry.vreg != variable) {
+                            continue;
+                        }
+                        if (copy == NO_VREG) {
+                            copy = ir.vregCount++;
+                            IRInstr& move = append(IROp::MOVE);
+                            move.dst = copy;
+                            move.a = entry;
+                        }
+                        entry.vreg = copy;
+                    }
+                }
+            }
+
+            // ---- Machine code ----
 
-        // Generate code for specific operations
-
-        void JITCompiler::compileBinaryOp(const std::string& op, int destReg, int srcReg) {
-            if (op == "+") {
-                emitAddRegReg(destReg, srcReg);
-            } else if (op == "-") {
-                emitSubRegReg(destReg, srcReg);
-            } else if (op == "*") {
-                emitMulRegReg(destReg, srcReg);
-            } else if (op == "/") {
-                emitDivRegReg(destReg, srcReg);
-            } else if (op == "%") {
-                emitModRegReg(destReg, srcReg);
-            } else if (op == "==") {
-                emitCmpRegReg(destReg, srcReg);
-                emitSetEqual(destReg);
-            } else if (op == "!=") {
-                emitCmpRegReg(destReg, srcReg);
-                emitSetNotEqual(destReg);
-            } else if (op == "<") {
-                emitCmpRegReg(destReg, srcReg);
-                emitSetLess(destReg);
-            } else if (op == ">") {
-                emitCmpRegReg(destReg, srcReg);
-                emitSetGreater(destReg);
-            } else if (op == "<=") {
-                emitCmpRegReg(destReg, srcReg);
-                emitSetLessEqual(destReg);
-            } else if (op == ">=") {
-                emitCmpRegReg(destReg, srcReg);
-                emitSetGreaterEqual(destReg);
-            } else if (op == "and" || op == "&&") {
-                emitAndRegReg(destReg, srcReg);
-            } else if (op == "or" || op == "||") {
-                emitOrRegReg(destReg, srcReg);
+            static int32_t spillDisplacement(int slot) {
+                return static_cast<int32_t>(SHADOW_SPACE + slot * sizeof(uint64_t));
+            }
+
+            // Register holding vreg, loaded into scratch when it lives in the frame
+            int use(uint32_t vreg, int scratch) {
+                const IRLocation& location = locations[vreg];
+                if (location.reg != NO_REGISTER) {
+                    return location.reg;
+                }
+                as.load(scratch, RSP, NO_REGISTER, spillDisplacement(location.spillSlot));
+                return scratch;
+            }
+
+            // Register to compute vreg in: its own, or scratch for define() to store
+            int destination(uint32_t vreg, int scratch) const {
+                return locations[vreg].reg != NO_REGISTER ? locations[vreg].reg : scratch;
+            }
+
+            void define(uint32_t vreg, int src) {
+                const IRLocation& location = locations[vreg];
+                if (location.reg == NO_REGISTER) {
+                    as.store(RSP, NO_REGISTER, spillDisplacement(location.spillSlot), src);
+                }
+                else if (location.reg != src) {
+                    as.movRegReg(location.reg, src);
+                }
+            }
+
+            void emitInstr(const IRInstr& instr) {
+                switch (instr.op) {
+                case IROp::LABEL:
+                    as.bind(instr.label);
+                    break;
+                case IROp::JUMP:
+                    as.jmp(instr.label);
+                    break;
+                case IROp::BRANCH_FALSE:
+                    emitBranch(instr);
+                    break;
+                case IROp::LOAD_SLOT:
+                case IROp::ENTER_VAR: {
+                    size_t guardFailed = deoptLabels[instr.deopt];
+                    loadSlot(instr.immediate, RDX);
+                    as.movRegReg(R11, RDX);
+                    as.shr(R11, 48);
+                    if (instr.kind == IRKind::BOOL) {
+                        as.cmpReg32Imm(R11, HIGH_BOOL);
+                        as.jcc(CC_NE, guardFailed);
+                        as.shl(RDX, 63);
+                        as.shr(RDX, 63);
+                    }
+                    else {
+                        size_t isInt = as.newLabel();
+                        as.cmpReg32Imm(R11, HIGH_INT);
+                        as.jcc(CC_E, isInt);
+                        as.cmpReg32Imm(R11, HIGH_INT64);
+                        as.jcc(CC_NE, guardFailed);
+                        as.bind(isInt);
+                    }
+                    define(instr.dst, RDX);
+                    break;
+                }
+                case IROp::STORE_SLOT: {
+                    size_t guardFailed = deoptLabels[instr.deopt];
+                    boxOperand(instr.a, RDX, guardFailed);
+                    // A plain store is only right if the old value holds no reference
+                    int index = slotAddress(instr.immediate);
+                    int32_t disp = slotDisplacement(instr.immediate);
+                    as.load(R11, RAX, index, disp);
+                    as.shr(R11, 48);
+                    as.cmpReg32Imm(R11, HIGH_OBJECT);
+                    as.jcc(CC_E, guardFailed);
+                    as.store(RAX, index, disp, RDX);
+                    break;
+                }
+                case IROp::STORE_VAR:
+                    // A guard must fail before the variable changes, its exit stores it back
+                    if (instr.a.kind == IRKind::INT) {
+                        boxOperand(instr.a, RDX, deoptLabels[instr.deopt]);
+                        define(instr.dst, RDX);
+                    }
+                    else if (instr.a.kind == IRKind::CONST_INT) {
+                        int reg = destination(instr.dst, RDX);
+                        as.movRegImm64(reg, instr.a.bits);
+                        define(instr.dst, reg);
+                    }
+                    else {
+                        define(instr.dst, use(instr.a.vreg, RDX));
+                    }
+                    break;
+                case IROp::MOVE:
+                    define(instr.dst, use(instr.a.vreg, RDX));
+                    break;
+                case IROp::SYNC_VAR: {
+                    int src = use(instr.a.vreg, RDX);
+                    int index = slotAddress(instr.immediate);
+                    as.store(RAX, index, slotDisplacement(instr.immediate), src);
+                    break;
+                }
+                case IROp::BINARY:
+                    emitBinary(instr);
+                    break;
+                case IROp::PUSH: {
+                    const std::vector<IROperand>& values = ir.pushes[instr.immediate];
+                    uint32_t rawMask = storeValues(values, {});
+                    as.movRegReg(ARG0, RBX);
+                    as.movRegImm32(ARG1, static_cast<uint32_t>(values.size()) | rawMask << 8);
+                    callHelper(reinterpret_cast<const void*>(opPushValues));
+                    as.testEaxEax();
+                    as.jcc(CC_NE, instr.label);
+                    break;
+                }
+                case IROp::BASELINE:
+                    emitBaseline(instr.immediate);
+                    break;
+                case IROp::RESUME:
+                    resumeAt(instr.immediate);
+                    break;
+                case IROp::DEOPT:
+                    as.jmp(deoptLabels[instr.deopt]);
+                    break;
+                }
+            }
+
+            // Store values, then the loop variables, to valueBuffer, returning the DeoptPoint::rawMask
+            uint32_t storeValues(const std::vector<IROperand>& values, const std::vector<std::pair<uint32_t, uint32_t>>& vars) {
+                as.movRegImm64(RAX, reinterpret_cast<uint64_t>(&jit.valueBuffer[0]));
+                uint32_t rawMask = 0;
+                int32_t disp = 0;
+                for (size_t i = 0; i < values.size(); i++, disp += 8) {
+                    const IROperand& value = values[i];
+                    int reg = R11;
+                    switch (value.kind) {
+                    case IRKind::CONST_INT:
+                    case IRKind::CONST_BOOL:
+                        as.movRegImm64(R11, value.bits);
+                        break;
+                    case IRKind::BOXED:
+                    case IRKind::INT:
+                        reg = use(value.vreg, R11);
+                        break;
+                    case IRKind::BOOL:
+                        as.movRegImm64(R11, static_cast<uint64_t>(HIGH_BOOL) << 48);
+                        as.orRegReg(R11, use(value.vreg, RDX));
+                        break;
+                    }
+                    if (value.kind == IRKind::INT) {
+                        rawMask |= 1u << i;
+                    }
+                    as.store(RAX, NO_REGISTER, disp, reg);
+                }
+                for (size_t i = 0; i < vars.size(); i++, disp += 8) {
+                    as.store(RAX, NO_REGISTER, disp, use(vars[i].second, R11));
+                }
+                return rawMask;
+            }
+
+            void emitDeoptStub(const IRDeopt& deopt) {
+                DeoptPoint point;
+                point.pc = deopt.pc;
+                point.count = static_cast<uint32_t>(deopt.stack.size());
+                point.rawMask = storeValues(deopt.stack, deopt.vars);
+                for (const auto& var : deopt.vars) {
+                    point.slots.push_back(var.first);
+                }
+                point.unreached = deopt.unreached;
+                jit.deoptPoints.push_back(std::move(point));
+                call(opDeopt, static_cast<uint32_t>(jit.deoptPoints.size() - 1));
+                as.jmp(exit);
+            }
+
+            // Condition code of a comparison operator
+            static uint8_t conditionOf(Operator op) {
+                return op == Operator::EQ ? CC_E : op == Operator::NE ? CC_NE : op == Operator::LT ? CC_L :
+                    op == Operator::GT ? CC_G : op == Operator::LE ? CC_LE : CC_GE;
+            }
+
+            static bool fitsImm32(const IROperand& operand) {
+                return operand.vreg == NO_VREG && operand.value >= INT32_MIN && operand.value <= INT32_MAX;
+            }
+
+            // Compare a with b, leaving the flags of a - b
+            void emitCompare(const IROperand& a, const IROperand& b) {
+                int left = intRegister(a, RAX);
+                if (fitsImm32(b)) {
+                    as.cmpRegImm(left, static_cast<int32_t>(b.value));
+                }
+                else {
+                    as.cmpRegReg(left, intRegister(b, RCX));
+                }
+            }
+
+            void emitBranch(const IRInstr& instr) {
+                if (instr.immediate != NO_IMMEDIATE) {
+                    emitCompare(instr.a, instr.b);
+                    as.jcc(conditionOf(static_cast<Operator>(instr.immediate)) ^ 1, instr.label); // Inverted condition
+                    return;
+                }
+                if (instr.a.vreg == NO_VREG) {
+                    if (instr.a.value == 0) {
+                        as.jmp(instr.label);
+                    }
+                    return;
+                }
+                int reg = intRegister(instr.a, RAX);
+                as.testRegReg(reg, reg);
+                as.jcc(CC_E, instr.label);
+            }
+
+            void emitBinary(const IRInstr& instr) {
+                Operator op = static_cast<Operator>(instr.immediate);
+                switch (op) {
+                case Operator::ADD:
+                case Operator::SUB:
+                case Operator::MUL: {
+                    int result = destination(instr.dst, RAX);
+                    loadInt(instr.a, result);
+                    if (op != Operator::MUL && fitsImm32(instr.b)) {
+                        if (op == Operator::ADD) {
+                            as.addRegImm(result, static_cast<int32_t>(instr.b.value));
+                        }
+                        else {
+                            as.subRegImm(result, static_cast<int32_t>(instr.b.value));
+                        }
+                    }
+                    else {
+                        int right = intRegister(instr.b, RCX);
+                        if (op == Operator::ADD) {
+                            as.addRegReg(result, right);
+                        }
+                        else if (op == Operator::SUB) {
+                            as.subRegReg(result, right);
+                        }
+                        else {
+                            as.imulRegReg(result, right);
+                        }
+                    }
+                    define(instr.dst, result);
+                    return;
+                }
+                case Operator::DIV:
+                case Operator::MOD: {
+                    size_t guardFailed = deoptLabels[instr.deopt];
+                    loadInt(instr.a, RAX);
+                    loadInt(instr.b, RCX);
+                    as.testRegReg(RCX, RCX);
+                    as.jcc(CC_E, guardFailed);
+                    as.cmpRegImm8(RCX, -1);
+                    as.jcc(CC_E, guardFailed);
+                    as.cqo();
+                    as.idiv(RCX);
+                    define(instr.dst, op == Operator::MOD ? RDX : RAX);
+                    return;
+                }
+                case Operator::AND:
+                case Operator::OR:
+                    loadInt(instr.a, RAX);
+                    loadInt(instr.b, RCX);
+                    as.testRegReg(RAX, RAX);
+                    as.setccAl(CC_NE);
+                    as.testRegReg(RCX, RCX);
+                    as.setccCl(CC_NE);
+                    if (op == Operator::AND) {
+                        as.andAlCl();
+                    }
+                    else {
+                        as.orAlCl();
+                    }
+                    as.movzxEaxAl();
+                    define(instr.dst, RAX);
+                    return;
+                default:
+                    emitCompare(instr.a, instr.b);
+                    as.setccAl(conditionOf(op));
+                    as.movzxEaxAl();
+                    define(instr.dst, RAX);
+                    return;
+                }
+            }
+
+            // Register with the int64_t value of an operand: its own for INT and BOOL values, else dst
+            int intRegister(const IROperand& operand, int dst) {
+                if (operand.kind == IRKind::INT || operand.kind == IRKind::BOOL) {
+                    return use(operand.vreg, dst);
+                }
+                loadInt(operand, dst);
+                return dst;
+            }
+
+            // The int64_t value of an operand in dst
+            void loadInt(const IROperand& operand, int dst) {
+                switch (operand.kind) {
+                case IRKind::CONST_INT:
+                case IRKind::CONST_BOOL:
+                    as.movRegImm64(dst, static_cast<uint64_t>(operand.value));
+                    break;
+                case IRKind::BOXED: {
+                    // An int is the low 32 bits, an inline int64_t the low 48, both sign-extended.
+                    // Bit 48 tells the tags apart.
+                    size_t done = as.newLabel();
+                    int src = use(operand.vreg, R11);
+                    as.movsxd(dst, src);
+                    as.btRegImm(src, 48);
+                    as.jcc(CC_B, done);
+                    as.movRegReg(dst, src);
+                    as.shl(dst, 16);
+                    as.sar(dst, 16);
+                    as.bind(done);
+                    break;
+                }
+                case IRKind::INT:
+                case IRKind::BOOL: {
+                    int src = use(operand.vreg, dst);
+                    if (src != dst) {
+                        as.movRegReg(dst, src);
+                    }
+                    break;
+                }
+                }
+            }
+
+            // The NaN-boxed bits of an operand in dst. An int64_t too wide to store inline fails the guard.
+            void boxOperand(const IROperand& operand, int dst, size_t guardFailed) {
+                if (operand.vreg == NO_VREG) {
+                    as.movRegImm64(dst, operand.bits);
+                    return;
+                }
+                int src = use(operand.vreg, dst);
+                if (src != dst) {
+                    as.movRegReg(dst, src);
+                }
+                switch (operand.kind) {
+                case IRKind::BOOL:
+                    as.movRegImm64(R11, static_cast<uint64_t>(HIGH_BOOL) << 48);
+                    as.orRegReg(dst, R11);
+                    break;
+                case IRKind::INT:
+                    as.movRegReg(R11, dst);
+                    as.shl(dst, 16);
+                    as.sar(dst, 16);
+                    as.cmpRegReg(dst, R11);
+                    as.jcc(CC_NE, guardFailed);
+                    as.shl(dst, 16);
+                    as.shr(dst, 16);
+                    as.movRegImm64(R11, static_cast<uint64_t>(HIGH_INT64) << 48);
+                    as.orRegReg(dst, R11);
+                    break;
+                default:
+                    break;
+                }
             }
+
+            // Load the base of a slot's vector into rax, returning the index register (NO_REGISTER for globals)
+            int slotAddress(uint32_t immediate) {
+                if (immediate & LOCAL_SLOT_FLAG) {
+                    as.load(RAX, RBX, NO_REGISTER, localsOffset);
+                    as.load(RCX, RBX, NO_REGISTER, localsBaseOffset);
+                    return RCX;
+                }
+                as.load(RAX, RBX, NO_REGISTER, globalsOffset);
+                return NO_REGISTER;
+            }
+
+            static int32_t slotDisplacement(uint32_t immediate) {
+                return static_cast<int32_t>((immediate & ~LOCAL_SLOT_FLAG) * sizeof(Value));
+            }
+
+            void loadSlot(uint32_t immediate, int dst) {
+                int index = slotAddress(immediate);
+                as.load(dst, RAX, index, slotDisplacement(immediate));
+            }
+        };
+
+        JITCompiler::JITCompiler() : enter(nullptr), nativeDepth(0), optimizing(true), loopsOnly(false) {}
+
+        JITCompiler::~JITCompiler() {
+            // codeHeap unmaps the compiled code
+        }
+
+        bool JITCompiler::supported() {
+            return STEVE_JIT_X64 != 0;
         }
 
-        void JITCompiler::compileUnaryOp(const std::string& op, int reg) {
-            if (op == "-") {
-                emitNegReg(reg);
-            } else if (op == "!" || op == "not") {
-                emitCmpRegImm(reg, 0);
-                emitSetZero(reg);
-            } else if (op == "~") {
-                emitNot(reg);
+        void JITCompiler::reset() {
+            for (const Unit& unit : units) {
+                if (unit.baseline) {
+                    codeHeap.release(unit.baseline);
+                }
+                if (unit.optimized) {
+                    codeHeap.release(unit.optimized);
+                }
             }
+            for (void* block : retired) {
+                codeHeap.release(block);
+            }
+            units.clear();
+            retired.clear();
+            unitOf.clear();
+            nativeAt.clear();
+            baselineAt.clear();
+            feedback.clear();
+            deoptPoints.clear();
+            pendingError = nullptr;
+            nativeDepth = 0;
+            loopsOnly = false;
+            stats = JITStats();
+        }
+
+        bool JITCompiler::emitTrampoline() {
+            // enter(vm, code): keep vm in rbx for the helper calls and jump to the instruction.
+            // Every unit shares this frame, so its exits pop it and return the status in eax.
+            Assembler as;
+            as.push(RBX);
+            for (int reg : CALLEE_SAVED_REGISTERS) {
+                as.push(reg);
+            }
+            as.subRsp(FRAME_SIZE);
+            as.movRegReg(RBX, ARG0);
+            as.jmpReg(ARG1);
+            void* block = codeHeap.allocate(as.code.size());
+            if (!block) {
+                return false;
+            }
+            std::memcpy(block, as.code.data(), as.code.size());
+            if (!codeHeap.finalize(block)) {
+                codeHeap.release(block);
+                return false;
+            }
+            enter = reinterpret_cast<EnterFunction>(block);
+            return true;
         }
 
-        // Compile various instructions
-        void JITCompiler::compileDefVar(const std::string& varName) {
-            // In JIT, variable definition allocates memory space
-            // We map variables to stack offsets
+        uint8_t JITCompiler::feedbackOf(uint64_t valueBits) {
+            Value::Tag tag = static_cast<Value::Tag>(valueBits < Value::BOX_LIMIT ? Value::TAG_DOUBLE : (valueBits >> 48) & 0x7);
+            if (tag == Value::TAG_INT || tag == Value::TAG_INT64) {
+                return FEEDBACK_INT;
+            }
+            return tag == Value::TAG_BOOL ? FEEDBACK_BOOL : FEEDBACK_OTHER;
         }
 
-        void JITCompiler::compileLoad(const std::string& operand) {
-            int reg = allocateRegister();
-            // Try to parse as number
-            try {
-                if (operand.find('.') != std::string::npos) {
-                    // Floating point number
-                    double val = std::stod(operand);
-                    emitMovRegImm(reg, *reinterpret_cast<int64_t*>(&val));
-                } else {
-                    // Integer
-                    int64_t val = std::stoll(operand);
-                    emitMovRegImm(reg, val);
-                }
-            } catch (...) {
-                // If not a number, treat as variable name or other identifier
-                emitMovRegImm(reg, 0);
-            }
-
-            // Push value to VM stack
-            emitPush(reg);
+        bool JITCompiler::compile(VirtualMachine& vm) {
+            if (!prepare(vm)) {
+                return false;
+            }
+            for (size_t unit = 0; unit < units.size(); unit++) {
+                if (!units[unit].pcs.empty() && !compileUnit(vm, unit, false)) {
+                    reset();
+                    return false;
+                }
+            }
+            baselineAt = nativeAt;
+            return true;
         }
 
-        void JITCompiler::compileStore(const std::string& varName) {
-            // Store top stack value to variable
-            int valueReg = allocateRegister();
-            if (emitPop(valueReg)) {
-                // Store to variable location (simplified)
+        bool JITCompiler::prepare(VirtualMachine& vm) {
+            reset();
+            if (!supported()) {
+                return false;
+            }
+            if (!enter && !emitTrampoline()) {
+                return false;
+            }
+
+            // Unit owning each instruction: the innermost function whose body holds it, or the top level
+            const CodeStream& code = vm.state.code;
+            const size_t size = code.size();
+            const auto& functions = vm.state.functionTable;
+            unitOf.assign(size, 0);
+            for (size_t id = 0; id < functions.size(); id++) {
+                size_t entry = functions[id].entry;
+                size_t end = entry > 0 ? code.immediates[entry - 1] : NO_IMMEDIATE;
+                end = std::min(end, size);
+                for (size_t pc = entry; pc < end; pc++) {
+                    unitOf[pc] = static_cast<uint32_t>(id + 1); // Nested functions come later and take over their bodies
+                }
             }
+
+            units.assign(functions.size() + 1, Unit{ NO_IMMEDIATE, {}, nullptr, nullptr, false, 0, 0 });
+            for (size_t unit = 1; unit < units.size(); unit++) {
+                units[unit].function = static_cast<uint32_t>(unit - 1);
+            }
+            for (size_t pc = 0; pc < size; pc++) {
+                units[unitOf[pc]].pcs.push_back(static_cast<uint32_t>(pc));
+            }
+
+            nativeAt.assign(size + 1, nullptr);
+            baselineAt = nativeAt;
+            feedback.assign(size, 0);
+            return true;
         }
 
-        void JITCompiler::compilePush(int64_t value) {
-            int reg = allocateRegister();
-            emitMovRegImm(reg, value);
-            emitPush(reg);
+        bool JITCompiler::compileLoop(VirtualMachine& vm, uint32_t head, uint32_t end) {
+            if (nativeAt.empty()) {
+                if (!prepare(vm)) {
+                    return false;
+                }
+                loopsOnly = true;
+            }
+            if (canEnter(head)) {
+                return true;
+            }
+
+            // The instructions of the loop's function: the bodies of functions defined inside the loop
+            // stay on the interpreter, loops compiled inside it join this unit
+            uint32_t function = units[unitOf[head]].function;
+            Unit loop{ function, {}, nullptr, nullptr, false, 0, 0 };
+            for (uint32_t pc = head; pc <= end && pc < unitOf.size(); pc++) {
+                if (units[unitOf[pc]].function == function) {
+                    loop.pcs.push_back(pc);
+                }
+            }
+            size_t index = units.size();
+            units.push_back(std::move(loop));
+            if (!compileUnit(vm, index, false)) {
+                units.pop_back();
+                return false;
+            }
+            for (uint32_t pc : units[index].pcs) {
+                Unit& inner = units[unitOf[pc]];
+                if (inner.baseline) {
+                    retired.push_back(inner.baseline);
+                    if (inner.optimized) {
+                        retired.push_back(inner.optimized);
+                    }
+                    inner = Unit{ function, {}, nullptr, nullptr, false, 0, 0 };
+                }
+                unitOf[pc] = static_cast<uint32_t>(index);
+                baselineAt[pc] = nativeAt[pc];
+            }
+            stats.osrLoops++;
+            return true;
         }
 
-        void JITCompiler::compilePop() {
-            int reg = allocateRegister();
-            emitPop(reg);
+        bool JITCompiler::compileUnit(VirtualMachine& vm, size_t index, bool optimize) {
+            if (optimize && !UnitCompiler::canAddressSlots()) {
+                return false;
+            }
+            Unit& unit = units[index];
+            UnitCompiler compiler(*this, vm, unit, optimize);
+            Assembler& as = compiler.as;
+            if (!compiler.emit() || !as.resolve()) {
+                return false;
+            }
+            void* block = codeHeap.allocate(as.code.size());
+            if (!block) {
+                return false;
+            }
+            std::memcpy(block, as.code.data(), as.code.size());
+            if (!codeHeap.finalize(block)) {
+                codeHeap.release(block);
+                return false;
+            }
+
+            // Optimized code is entered where it holds no values in registers, elsewhere the baseline
+            // code runs until the next back-edge or call
+            for (uint32_t pc : unit.pcs) {
+                const uint8_t* native = static_cast<const uint8_t*>(block) + as.offset(compiler.pcLabel[pc]);
+                nativeAt[pc] = !optimize || compiler.published[pc] ? native : baselineAt[pc];
+            }
+            if (optimize) {
+                if (unit.optimized) {
+                    retired.push_back(unit.optimized);
+                }
+                unit.optimized = block;
+                unit.active = true;
+                stats.optimizedCodeSize += as.code.size();
+                stats.tierUps++;
+                stats.registerLoops += compiler.registerLoops;
+                stats.spilledValues += compiler.spilledValues;
+            }
+            else {
+                unit.baseline = block;
+                stats.baselineCodeSize += as.code.size();
+            }
+            return true;
         }
 
-        void JITCompiler::compileIf(int& endLabel, int& elseLabel) {
-            // Pop condition value from stack
-            int condReg = allocateRegister();
-            emitPop(condReg); // Pop value from VM stack
+        bool JITCompiler::heat(VirtualMachine& vm, size_t index) {
+            Unit& unit = units[index];
+            if (unit.active) {
+                return true;
+            }
+            // Units the interpreter runs (on-stack replacement only compiles loops) have no code to replace
+            if (!optimizing || !unit.baseline || unit.deopts >= JIT_MAX_DEOPTS || ++unit.hotness < JIT_HOT_THRESHOLD) {
+                return false;
+            }
+            unit.hotness = 0;
+            if (!compileUnit(vm, index, true)) {
+                unit.deopts = JIT_MAX_DEOPTS; // Stay on the baseline code
+                return false;
+            }
+            return true;
+        }
 
-            // Compare condition value with 0
-            emitCmpRegImm(condReg, 0);
+        // Runtime helpers. They mirror the handlers of VirtualMachine::dispatch, errors included, and
+        // never let an exception into compiled code: fail() parks it for run() to rethrow.
 
-            // If condition is false (equals 0), jump to else part
-            emitByte(0x75);  // JNE (jump if not equal)
-            elseLabel = codeSize;  // Placeholder offset
-            emitInt(0);  // Placeholder offset, needs to be fixed later
+        int JITCompiler::fail(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            JITCompiler& jit = *vm->jitCompiler;
+            // A handler finds the faulting instruction at state.pc - 1, within a superinstruction the one that failed
+            pc = static_cast<uint32_t>(faultingPc(state.code, pc));
+            state.pc = pc + 1;
+            try {
+                throw;
+            }
+            catch (const VMException&) {
+                jit.pendingError = std::current_exception();
+            }
+            catch (const std::exception& e) {
+                jit.pendingError = std::make_exception_ptr(RuntimeError(std::string("Standard exception: ") + e.what(), state.code.lines[pc]));
+            }
+            catch (...) {
+                jit.pendingError = std::current_exception();
+            }
+            return JIT_STOP;
         }
 
-        void JITCompiler::compileElse(int& endLabel) {
-            // Generate unconditional jump to skip if part
-            emitByte(0xE9);  // JMP
-            endLabel = codeSize;  // Placeholder offset
-            emitInt(0);  // Placeholder offset
+        int JITCompiler::opLoadConst(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            try {
+                state.stack.push_back(state.code.constants[state.code.immediates[pc]]);
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compileEnd() {
-            // End control flow structure - no operation needed
+        int JITCompiler::opLoadSlot(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            try {
+                const Value& slot = vm->slotValue(state.code.immediates[pc]);
+                vm->jitCompiler->observe(pc, slot.bits);
+                state.stack.push_back(slot);
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compileWhile() {
-            // WHILE loop start - no operation needed
+        int JITCompiler::opStoreSlot(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            try {
+                if (state.stack.empty()) {
+                    throw AccessError("Stack underflow during STORE operation", state.code.lines[pc]);
+                }
+                Value& slot = vm->slotValue(state.code.immediates[pc]);
+                vm->jitCompiler->observe(pc, slot.bits);
+                vm->jitCompiler->observe(pc, state.stack.back().bits);
+                slot = std::move(state.stack.back());
+                state.stack.pop_back();
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compileDo() {
-            // DO loop body start - no operation needed
+        int JITCompiler::opDefVarSlot(VirtualMachine* vm, uint32_t pc) noexcept {
+            try {
+                vm->slotValue(vm->state.code.immediates[pc]) = Value(0);
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compileReturn() {
-            // Return instruction
-            emitReturn();
+        int JITCompiler::opPop(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            try {
+                if (!state.stack.empty()) {
+                    state.stack.pop_back();
+                }
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compilePrint() {
-            // Pop a value from VM stack and print it
-            int reg = allocateRegister();
-            emitPop(reg); // Pop value from VM stack
+        int JITCompiler::opBinary(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            try {
+                if (state.stack.size() < 2) {
+                    throw AccessError("Stack underflow during BINARY_OP operation", state.code.lines[pc]);
+                }
+                Value right = std::move(state.stack.back());
+                state.stack.pop_back();
+                Value left = std::move(state.stack.back());
+                state.stack.pop_back();
+                vm->jitCompiler->observe(pc, left.bits);
+                vm->jitCompiler->observe(pc, right.bits);
+                state.stack.push_back(vm->performBinaryOperation(left, right, static_cast<Operator>(state.code.immediates[pc]), state.code.lines[pc]));
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compileCall(const std::string& funcName) {
-            // Function call implementation
+        int JITCompiler::opUnary(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            try {
+                if (state.stack.empty()) {
+                    throw AccessError("Stack underflow during UNARY_OP operation", state.code.lines[pc]);
+                }
+                Value operand = std::move(state.stack.back());
+                state.stack.pop_back();
+                state.stack.push_back(vm->performUnaryOperation(operand, static_cast<Operator>(state.code.immediates[pc]), state.code.lines[pc]));
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compileTry() {
-            // Try statement - exception handling
+        int JITCompiler::opCondition(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            try {
+                if (state.stack.empty()) {
+                    bool isIf = state.code.opcodes[pc] == InstructionType::IF;
+                    throw AccessError(isIf ? "Stack is empty during IF operation" : "Stack is empty during WHILE operation", state.code.lines[pc]);
+                }
+                Value condition = std::move(state.stack.back());
+                state.stack.pop_back();
+                return vm->getBoolValue(condition) ? 1 : 0;
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
         }
 
-        void JITCompiler::compileCatch() {
-            // Catch statement - exception handling
+        int JITCompiler::opCall(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            JITCompiler& jit = *vm->jitCompiler;
+            try {
+                uint32_t immediate = state.code.immediates[pc];
+                size_t argc = (immediate >> CALL_ARGC_SHIFT) & CALL_ARGC_MASK;
+                uint32_t function = immediate & CALL_INDEX_MASK;
+                vm->enterFunction(function, argc, pc + 1, state.code.lines[pc]);
+                jit.heat(*vm, function + 1);
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+
+            // Run the callee on the native stack, it comes back with JIT_NEXT once it returned to pc + 1
+            const uint8_t* callee = state.pc < jit.nativeAt.size() ? jit.nativeAt[state.pc] : nullptr;
+            if (!callee || jit.nativeDepth >= JIT_MAX_NATIVE_DEPTH) {
+                return JIT_RESUME;
+            }
+            jit.nativeDepth++;
+            int status = jit.enter(vm, callee);
+            jit.nativeDepth--;
+            if (status == JIT_NEXT && state.pc != pc + 1) {
+                return JIT_RESUME;
+            }
+            return status;
         }
 
-        void JITCompiler::compileBreak() {
-            // Break statement - exit current loop
+        int JITCompiler::opCallBuiltIn(VirtualMachine* vm, uint32_t pc) noexcept {
+            try {
+                vm->callBuiltIn(vm->state.code.immediates[pc], pc);
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compileContinue() {
-            // Continue statement - continue to next iteration
+        int JITCompiler::opReturn(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            if (state.frames.empty()) {
+                // RETURN outside of a function stops execution
+                state.pc = pc + 1;
+                state.running = false;
+                return JIT_STOP;
+            }
+            try {
+                vm->leaveFunction();
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compilePass() {
-            // Pass statement - no operation
-            emitNop();
+        // Superinstructions: the operands of the fused sequence are the immediates of the
+        // instructions following pc, errors report the pc and line of the BINARY_OP. The feedback goes to
+        // the instructions of the sequence, which optimized code compiles one by one.
+
+        int JITCompiler::opIncVar(VirtualMachine* vm, uint32_t pc) noexcept {
+            const CodeStream& code = vm->state.code;
+            JITCompiler& jit = *vm->jitCompiler;
+            try {
+                Value& slot = vm->slotValue(code.immediates[pc]);
+                jit.observe(pc, slot.bits);
+                jit.observe(pc + 2, slot.bits);
+                jit.observe(pc + 3, slot.bits);
+                slot = vm->performBinaryOperation(slot, code.constants[code.immediates[pc + 1]], Operator::ADD, code.lines[pc + 2]);
+                jit.observe(pc + 3, slot.bits);
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::compilePackage() {
-            // Package declaration - no runtime effect
+        int JITCompiler::opVarConstOpStore(VirtualMachine* vm, uint32_t pc) noexcept {
+            const CodeStream& code = vm->state.code;
+            JITCompiler& jit = *vm->jitCompiler;
+            try {
+                const Value& operand = vm->slotValue(code.immediates[pc]);
+                jit.observe(pc, operand.bits);
+                jit.observe(pc + 2, operand.bits);
+                Value result = vm->performBinaryOperation(operand, code.constants[code.immediates[pc + 1]],
+                    static_cast<Operator>(code.immediates[pc + 2]), code.lines[pc + 2]);
+                Value& slot = vm->slotValue(code.immediates[pc + 3]);
+                jit.observe(pc + 3, slot.bits);
+                jit.observe(pc + 3, result.bits);
+                slot = std::move(result);
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        // Register management
-        int JITCompiler::allocReg() {
-            return allocateRegister();
+        int JITCompiler::opVarConstOp(VirtualMachine* vm, uint32_t pc) noexcept {
+            const CodeStream& code = vm->state.code;
+            JITCompiler& jit = *vm->jitCompiler;
+            try {
+                const Value& operand = vm->slotValue(code.immediates[pc]);
+                jit.observe(pc, operand.bits);
+                jit.observe(pc + 2, operand.bits);
+                vm->state.stack.push_back(vm->performBinaryOperation(operand, code.constants[code.immediates[pc + 1]],
+                    static_cast<Operator>(code.immediates[pc + 2]), code.lines[pc + 2]));
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        void JITCompiler::freeReg(int reg) {
-            if (reg >= 0 && static_cast<size_t>(reg) < regUsed.size()) {
-                regUsed[reg] = false;
+        int JITCompiler::opVarVarOp(VirtualMachine* vm, uint32_t pc) noexcept {
+            const CodeStream& code = vm->state.code;
+            JITCompiler& jit = *vm->jitCompiler;
+            try {
+                const Value& left = vm->slotValue(code.immediates[pc]);
+                const Value& right = vm->slotValue(code.immediates[pc + 1]);
+                jit.observe(pc, left.bits);
+                jit.observe(pc + 1, right.bits);
+                jit.observe(pc + 2, left.bits);
+                jit.observe(pc + 2, right.bits);
+                vm->state.stack.push_back(vm->performBinaryOperation(left, right,
+                    static_cast<Operator>(code.immediates[pc + 2]), code.lines[pc + 2]));
             }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        // Reset compiler
-        void JITCompiler::reset() {
-            codeSize = 0;
-            nextReg = 0;
-            for (size_t i = 0; i < regUsed.size(); i++) {
-                regUsed[i] = false;
-            }
-            // Initialize register usage (skip RSP and RBP, as they have special purposes)
-            regUsed[RSP] = true;  // Stack pointer
-            regUsed[RBP] = true;  // Base pointer
+        int JITCompiler::opConstStore(VirtualMachine* vm, uint32_t pc) noexcept {
+            const CodeStream& code = vm->state.code;
+            JITCompiler& jit = *vm->jitCompiler;
+            try {
+                Value& slot = vm->slotValue(code.immediates[pc + 1]);
+                jit.observe(pc + 1, slot.bits);
+                jit.observe(pc + 1, code.constants[code.immediates[pc]].bits);
+                slot = code.constants[code.immediates[pc]];
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
         }
 
-        // Get code size
-        size_t JITCompiler::getCodeSize() const {
-            return codeSize;
+        int JITCompiler::opCmpVarConstJump(VirtualMachine* vm, uint32_t pc) noexcept {
+            const CodeStream& code = vm->state.code;
+            JITCompiler& jit = *vm->jitCompiler;
+            try {
+                const Value& operand = vm->slotValue(code.immediates[pc]);
+                jit.observe(pc, operand.bits);
+                jit.observe(pc + 2, operand.bits);
+                Value condition = vm->performBinaryOperation(operand, code.constants[code.immediates[pc + 1]],
+                    static_cast<Operator>(code.immediates[pc + 2]), code.lines[pc + 2]);
+                return vm->getBoolValue(condition) ? 1 : 0;
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
         }
 
-        // Generate labels and jumps
-        int JITCompiler::newLabel() {
-            int labelId = labelCounter++;
-            labelPositions[labelId] = 0; // initially unknown position
-            return labelId;
+        int JITCompiler::opCmpConstJump(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            const CodeStream& code = state.code;
+            try {
+                if (state.stack.empty()) {
+                    throw AccessError("Stack underflow during BINARY_OP operation", code.lines[pc + 1]);
+                }
+                vm->jitCompiler->observe(pc + 1, state.stack.back().bits);
+                Value condition = vm->performBinaryOperation(state.stack.back(), code.constants[code.immediates[pc]],
+                    static_cast<Operator>(code.immediates[pc + 1]), code.lines[pc + 1]);
+                state.stack.pop_back();
+                return vm->getBoolValue(condition) ? 1 : 0;
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
         }
 
-        void JITCompiler::placeLabel(int label) {
-            labelPositions[label] = codeSize;
+        int JITCompiler::opStep(VirtualMachine* vm, uint32_t pc) noexcept {
+            MachineState& state = vm->state;
+            size_t depth = state.frames.size();
+            state.pc = pc;
+            try {
+                vm->dispatch(true);
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            if (!state.running) {
+                return JIT_STOP;
+            }
+            return state.pc == pc + 1 && state.frames.size() == depth ? JIT_NEXT : JIT_RESUME;
         }
 
-        int JITCompiler::getJumpOffset(int label) {
-            if (labelPositions.find(label) != labelPositions.end()) {
-                return static_cast<int>(labelPositions[label] - codeSize);
+        int JITCompiler::opResume(VirtualMachine* vm, uint32_t pc) noexcept {
+            vm->state.pc = pc;
+            return JIT_RESUME;
+        }
+
+        int JITCompiler::opBackEdge(VirtualMachine* vm, uint32_t pc) noexcept {
+            JITCompiler& jit = *vm->jitCompiler;
+            try {
+                // Continue in the optimized code once the loop head can be entered there
+                if (jit.heat(*vm, jit.unitOf[pc]) && jit.nativeAt[pc] != jit.baselineAt[pc]) {
+                    vm->state.pc = pc;
+                    return JIT_RESUME;
+                }
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            return JIT_NEXT;
+        }
+
+        void JITCompiler::pushValues(VirtualMachine* vm, size_t count, uint32_t rawMask) {
+            JITCompiler& jit = *vm->jitCompiler;
+            std::vector<Value>& stack = vm->state.stack;
+            for (size_t i = 0; i < count; i++) {
+                if (rawMask & (1u << i)) {
+                    stack.push_back(Value(static_cast<int64_t>(jit.valueBuffer[i])));
+                }
+                else {
+                    // Registers only hold ints, inline int64_t values and booleans, none owns a heap object
+                    Value value;
+                    value.bits = jit.valueBuffer[i];
+                    stack.push_back(std::move(value));
+                }
+            }
+        }
+
+        int JITCompiler::opPushValues(VirtualMachine* vm, uint32_t packed) noexcept {
+            try {
+                pushValues(vm, packed & 0xFF, packed >> 8);
+            }
+            catch (...) {
+                return fail(vm, static_cast<uint32_t>(vm->state.pc));
+            }
+            return JIT_NEXT;
+        }
+
+        int JITCompiler::opDeopt(VirtualMachine* vm, uint32_t index) noexcept {
+            JITCompiler& jit = *vm->jitCompiler;
+            const DeoptPoint& point = jit.deoptPoints[index];
+            uint32_t pc = point.pc;
+            Unit& unit = jit.units[jit.unitOf[pc]];
+            // Frames still running the optimized code further down the native stack keep it, its
+            // guards stay valid. An unreached instruction is not counted as a deoptimization, the
+            // unit gets optimized again once hot with the new feedback.
+            if (unit.active) {
+                unit.active = false;
+                if (point.unreached) {
+                    unit.hotness = 0;
+                }
+                else {
+                    unit.deopts++;
+                }
+                for (uint32_t unitPc : unit.pcs) {
+                    jit.nativeAt[unitPc] = jit.baselineAt[unitPc];
+                }
+            }
+            if (!point.unreached) {
+                jit.feedback[pc] |= FEEDBACK_DEOPT;
+                jit.stats.deopts++;
+            }
+            try {
+                // Loop variables held integers, storing them back releases nothing
+                for (size_t i = 0; i < point.slots.size(); i++) {
+                    Value value;
+                    value.bits = jit.valueBuffer[point.count + i];
+                    vm->slotValue(point.slots[i]) = std::move(value);
+                }
+                pushValues(vm, point.count, point.rawMask);
+            }
+            catch (...) {
+                return fail(vm, pc);
+            }
+            vm->state.pc = pc;
+            return JIT_RESUME;
+        }
+
+        bool JITCompiler::run(VirtualMachine& vm) {
+            MachineState& state = vm.state;
+            while (state.running && state.pc < state.code.size()) {
+                const uint8_t* code = nativeAt[state.pc];
+                if (!code) {
+                    vm.dispatch(true);
+                    continue;
+                }
+                int status = enter(&vm, code);
+                if (status == JIT_STOP && pendingError) {
+                    std::exception_ptr error = pendingError;
+                    pendingError = nullptr;
+                    std::rethrow_exception(error);
+                }
+            }
+            return true;
+        }
+
+        void JITCompiler::runLoop(VirtualMachine& vm) {
+            MachineState& state = vm.state;
+            stats.osrEntries++;
+            while (state.running && canEnter(state.pc)) {
+                int status = enter(&vm, nativeAt[state.pc]);
+                if (status == JIT_STOP && pendingError) {
+                    std::exception_ptr error = pendingError;
+                    pendingError = nullptr;
+                    std::rethrow_exception(error);
+                }
             }
-            return 0; // default to 0 if label not found
         }
 
     } // namespace VM
-} // namespace steve
\ No newline at end of file
+} // namespace steve
@@ -1,6 +1,6 @@
 /*
  * Copyright (c) 2024 Kekun Su(苏科纶).
- * 
+ *
  * Refer to the LICENSE file for full license information.
  * SPDX-License-Identifier: MIT
  */
@@ -9,180 +9,215 @@
 #define STEVE_VM_JIT_H
 
 #include <vector>
-#include <string>
-#include <unordered_map>
-#include <memory>
-#include <functional>
-#include <stack>
 #include <cstddef> // for size_t
-#ifdef _WIN32
-#define NOMINMAX
-#include <windows.h>
+#include <cstdint>
+#include <exception>
+#include "vm_codeheap.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define STEVE_JIT_X64 1
+#else
+#define STEVE_JIT_X64 0
 #endif
 
 // Forward declaration
 namespace steve {
     namespace VM {
-        struct Instruction;
-        enum class InstructionType;
+        class VirtualMachine;
     }
 }
 
 namespace steve {
     namespace VM {
 
-        // Simplified JIT compiler
-        class JITCompiler {
-
-        private:
-            std::vector<uint8_t> codeBuffer;  // buffer for machine code
-            size_t codeSize;                  // current code size
-            size_t bufferSize;                // buffer size
-            void* executableMemory;           // executable memory area
-
-            // Virtual machine stack simulation
-            std::stack<int64_t> vmStack;
+        // Status returned in eax by compiled code and by the runtime helpers it calls
+        enum JITStatus : int {
+            JIT_NEXT = 0,    // Go on with the next instruction; from a compiled function: it executed RETURN
+            JIT_RESUME = 1,  // Control moved to state.pc (a throw was caught, a deep call, a jump out of the unit)
+            JIT_STOP = 2     // The program stopped or failed, the error waits in the compiler
+        };
 
-            // Variable storage (simulation)
-            std::unordered_map<std::string, int64_t> variables;
+        // Iterations the interpreter runs a WHILE loop before on-stack replacement compiles it
+        const uint32_t JIT_OSR_THRESHOLD = 1000;
 
-            // Register allocation (simulation)
-            std::unordered_map<std::string, int> variableToReg;
+        // Operand types seen by an instruction, collected by the baseline tier
+        enum JITFeedback : uint8_t {
+            FEEDBACK_INT = 1,    // int or int64_t stored inline
+            FEEDBACK_BOOL = 2,
+            FEEDBACK_OTHER = 4,  // double, null, strings and other heap values
+            FEEDBACK_DEOPT = 8   // A guard of optimized code failed here, do not speculate again
+        };
 
-            // Register usage
-            std::vector<bool> regUsed;
-            int nextReg;
+        // Counters of the two tiers
+        struct JITStats {
+            size_t baselineCodeSize;   // Bytes of baseline code
+            size_t optimizedCodeSize;  // Bytes of optimized code, including units since deoptimized
+            uint64_t tierUps;          // Units compiled by the optimizing tier
+            uint64_t deopts;           // Guard failures that sent a unit back to the baseline tier
+            uint64_t registerLoops;    // Loops whose variables optimized code keeps in registers
+            uint64_t spilledValues;    // Optimized code values the register allocator left in the frame
+            uint64_t osrLoops;         // WHILE loops compiled by on-stack replacement
+            uint64_t osrEntries;       // Times the interpreter moved to the compiled code of such a loop
+
+            JITStats() : baselineCodeSize(0), optimizedCodeSize(0), tierUps(0), deopts(0), registerLoops(0), spilledValues(0),
+                osrLoops(0), osrEntries(0) {}
+        };
 
+        // Two-tier JIT for x86-64 (System V and Windows ABIs).
+        //
+        // The baseline tier compiles the top level and every user function to separate units, each
+        // instruction becoming a call to a runtime helper with its pc, or a native jump for branches
+        // and loops. Its helpers record the operand types of the instructions (JITFeedback).
+        // All machine state stays in MachineState, so compiled code can be entered at any
+        // instruction, leaves it at any instruction, and the interpreter can take over wherever the
+        // compiled code stops.
+        //
+        // A unit called or looped in often enough is recompiled by the optimizing tier. Where the
+        // feedback only saw integers and booleans it translates the instructions to a small IR
+        // (vm_jit_ir.h) that keeps operand stack values unboxed in virtual registers, with the
+        // arithmetic, comparisons, branches and slot accesses inline, guarded by tag checks. The
+        // integer variables of an innermost loop live in virtual registers for the whole loop.
+        // A linear-scan allocator maps virtual registers to machine registers and frame slots.
+        // A failed guard deoptimizes: the values are pushed to the operand stack, loop variables
+        // stored back, the unit falls back to its baseline code at the guarded instruction and the
+        // instruction is marked so the next optimization does not speculate on it.
+        //
+        // Without compile() the interpreter runs the program and only hands over its hot WHILE loops
+        // (on-stack replacement): compileLoop() makes a unit of the loop's instructions and runLoop()
+        // continues there on the operand stack and variables the interpreter left. Jumps out of the
+        // loop leave the unit, and runLoop() returns to the interpreter at the first instruction
+        // that has no compiled code. The loop tiers up and deoptimizes like any other unit.
+        class JITCompiler {
         public:
-            JITCompiler(size_t bufferSize = 1024 * 1024); // default 1MB
+            JITCompiler();
             ~JITCompiler();
+            JITCompiler(const JITCompiler&) = delete;
+            JITCompiler& operator=(const JITCompiler&) = delete;
 
-            // Compile IR instructions to machine code
-            bool compile(const std::vector<Instruction>& instructions);
-
-            // Execute compiled code
-            int64_t execute();
-
-            // Add a machine instruction
-            void emitByte(uint8_t byte);
-            void emitInt(int32_t value);
-            void emitLong(int64_t value);
-            void emitBytes(const std::vector<uint8_t>& bytes);
-
-            void emitMovRegReg(int dest, int src);      // MOV register to register
-            void emitMovRegImm(int dest, int64_t imm);  // MOV immediate to register
-            void emitMovRegMem(int dest, int baseReg, int offset); // MOV [base+offset], reg
-            void emitMovMemReg(int baseReg, int offset, int src); // MOV reg, [base+offset]
-            void emitAddRegReg(int dest, int src);      // ADD register addition
-            void emitSubRegReg(int dest, int src);      // SUB register subtraction
-            void emitMulRegReg(int dest, int src);      // MUL register multiplication
-            void emitDivRegReg(int dest, int src);      // DIV register division
-            void emitCmpRegReg(int reg1, int reg2);     // CMP compare registers
-            void emitJmp(int offset);                   // JMP unconditional jump
-            void emitJmpIf(int condition, int offset);  // conditional jump
-            void emitPush(int reg);                     // PUSH register
-            void emitPop(int reg);                      // POP register
-
-            void emitReturn();                          // return instruction
-
-            void emitCall(int funcAddr);                // call function
-
-            void emitNeg(int reg);                      // NEG negate
-
-            void emitNot(int reg);                      // NOT bitwise NOT
-
-            void emitNegReg(int reg);                   // NEG register
-
-            // Additional emit functions used in implementation
-
-            void emitSetEqual(int reg);
-
-            void emitSetNotEqual(int reg);
-
-            void emitSetLess(int reg);
-
-            void emitSetGreater(int reg);
-
-            void emitSetLessEqual(int reg);
+            // Whether this build can generate code for the host
+            static bool supported();
 
-            void emitSetGreaterEqual(int reg);
+            // Compile the program loaded into vm with the baseline tier, false if the host is not supported
+            bool compile(VirtualMachine& vm);
 
-            void emitAndRegReg(int destReg, int srcReg);
+            bool isCompiled() const { return !nativeAt.empty() && !loopsOnly; }
 
-            void emitOrRegReg(int destReg, int srcReg);
+            // On-stack replacement: compile the WHILE loop from head to its END with the baseline tier,
+            // taking over the loops compiled inside it. False if the host is not supported.
+            bool compileLoop(VirtualMachine& vm, uint32_t head, uint32_t end);
 
-            void emitModRegReg(int destReg, int srcReg);
+            // Whether compiled code can take over at pc
+            bool canEnter(size_t pc) const { return pc < nativeAt.size() && nativeAt[pc]; }
 
-            void emitSetZero(int reg);
+            // Run compiled code from vm's state.pc until control reaches an instruction without any,
+            // where the interpreter goes on. VM errors are rethrown like run() does.
+            void runLoop(VirtualMachine& vm);
 
-            // Generate code for specific operations
+            // Run from vm's state.pc until the program stops. VM errors are rethrown with state.pc
+            // after the faulting instruction, as dispatch() does.
+            bool run(VirtualMachine& vm);
 
-            void compileBinaryOp(const std::string& op, int destReg, int srcReg);
-
-            void compileUnaryOp(const std::string& op, int reg);
-
-            // Compile various instructions
-            void compileDefVar(const std::string& varName);
-            void compileLoad(const std::string& operand);
-            void compileStore(const std::string& varName);
-            void compilePush(int64_t value);
-            void compilePop();
-            void compileIf(int& endLabel, int& elseLabel);
-            void compileElse(int& endLabel);
-            void compileEnd();
-            void compileWhile();
-
-            void compileDo();
-
-            void compileReturn();
-
-            void compilePrint();
-
-            void compileCall(const std::string& funcName);
-
-            void compileTry();
-
-            void compileCatch();
-
-            void compileBreak();
-
-            void compileContinue();
-
-            void compilePass();
-
-            void compilePackage();
-
-            // Register management
-
-            int allocReg();
-
-            void freeReg(int reg);
-
-            int allocateRegister();  // Added to fix compilation error
-
-            // Reset compiler
+            // Reset compiler, releasing the compiled program
             void reset();
 
-            // Get code size
-            size_t getCodeSize() const;
-
-            // Generate labels and jumps
-            int newLabel();
-            void placeLabel(int label);
-            int getJumpOffset(int label);
+            // Enable the optimizing tier (default on)
+            void setOptimizing(bool enabled) { optimizing = enabled; }
 
-        private:
+            // Bytes of machine code in the compiled units
+            size_t getCodeSize() const { return stats.baselineCodeSize + stats.optimizedCodeSize; }
 
-            std::unordered_map<int, size_t> labelPositions;
+            const JITStats& getStats() const { return stats; }
 
-            int labelCounter;
+            // Executable memory usage of the compiled code
+            const CodeHeapStats& codeHeapStats() const { return codeHeap.stats(); }
 
-            std::unordered_map<int, size_t> labelOffsets;  // Added to fix compilation error
-
-            std::vector<size_t> instructionIndices;        // Added to fix compilation error
+        private:
+            class UnitCompiler;
+            using EnterFunction = int (*)(VirtualMachine* vm, const uint8_t* code);
+
+            // Compiled top level (NO_IMMEDIATE), user function, or WHILE loop of one of them
+            struct Unit {
+                uint32_t function;
+                std::vector<uint32_t> pcs;  // Instructions of the unit, in program order
+                void* baseline;
+                void* optimized;            // nullptr until the unit gets hot
+                bool active;                // nativeAt points into the optimized code
+                uint32_t hotness;           // Calls and loop iterations run on the baseline code
+                uint32_t deopts;
+            };
+
+            // Exit of optimized code, whose values it leaves in valueBuffer: count operand stack
+            // values, then the loop variables to store back into slots
+            struct DeoptPoint {
+                uint32_t pc;                 // Where the baseline code takes over
+                uint32_t count;
+                uint32_t rawMask;            // Bit i set: value i is an int64_t, not NaN-boxed bits
+                std::vector<uint32_t> slots;
+                bool unreached;              // Not a guard: pc had not run when the unit was optimized
+            };
+
+            static constexpr size_t VALUE_BUFFER_SIZE = 32;
+
+            CodeHeap codeHeap;                      // W^X executable memory
+            EnterFunction enter;                    // Trampoline into compiled code, shared by every unit
+            std::vector<Unit> units;
+            std::vector<void*> retired;             // Optimized code replaced after a deoptimization, may still be running
+            std::vector<uint32_t> unitOf;           // pc -> unit
+            std::vector<const uint8_t*> nativeAt;   // pc -> machine code of the instruction in the active tier
+            std::vector<const uint8_t*> baselineAt; // pc -> baseline code of the instruction
+            std::vector<uint8_t> feedback;          // pc -> JITFeedback bits
+            std::vector<DeoptPoint> deoptPoints;    // Exits of the optimized code compiled so far
+            uint64_t valueBuffer[VALUE_BUFFER_SIZE]; // Values optimized code hands to opPushValues and opDeopt
+            std::exception_ptr pendingError;        // Error raised by a helper, rethrown by run()
+            size_t nativeDepth;                     // Compiled calls nested on the native stack
+            bool optimizing;
+            bool loopsOnly;                         // Only the units of compileLoop() have code
+            JITStats stats;
+
+            bool emitTrampoline();
+            // Assign the instructions to the top level and function units, compiling none
+            bool prepare(VirtualMachine& vm);
+            bool compileUnit(VirtualMachine& vm, size_t unit, bool optimize);
+
+            // Count a call or loop iteration of unit and optimize it once hot, true if it now runs optimized code
+            bool heat(VirtualMachine& vm, size_t unit);
+
+            // Record the type of a value (its NaN-boxed bits) as an operand of the instruction at pc
+            void observe(uint32_t pc, uint64_t valueBits) { feedback[pc] |= feedbackOf(valueBits); }
+            static uint8_t feedbackOf(uint64_t valueBits);
+
+            // Runtime helpers called from compiled code, with the VM and the pc of the instruction
+            static int fail(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opLoadConst(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opLoadSlot(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opStoreSlot(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opDefVarSlot(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opPop(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opBinary(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opUnary(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opCondition(VirtualMachine* vm, uint32_t pc) noexcept;  // 0 false, 1 true, else JIT_STOP
+            static int opIncVar(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opVarConstOpStore(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opVarConstOp(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opVarVarOp(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opConstStore(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opCmpVarConstJump(VirtualMachine* vm, uint32_t pc) noexcept;  // Like opCondition
+            static int opCmpConstJump(VirtualMachine* vm, uint32_t pc) noexcept;     // Like opCondition
+            static int opCall(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opCallBuiltIn(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opReturn(VirtualMachine* vm, uint32_t pc) noexcept;
+            static int opStep(VirtualMachine* vm, uint32_t pc) noexcept;       // Any other instruction, on the interpreter
+            static int opResume(VirtualMachine* vm, uint32_t pc) noexcept;     // Continue at pc outside this unit
+            static int opBackEdge(VirtualMachine* vm, uint32_t pc) noexcept;   // Loop jump to pc, JIT_RESUME once optimized
+
+            // Optimized code: push the first (packed & 0xFF) values of valueBuffer to the operand stack,
+            // packed >> 8 being their DeoptPoint::rawMask; leave through deoptPoints[index]
+            static int opPushValues(VirtualMachine* vm, uint32_t packed) noexcept;
+            static int opDeopt(VirtualMachine* vm, uint32_t index) noexcept;
+            static void pushValues(VirtualMachine* vm, size_t count, uint32_t rawMask);
         };
 
     } // namespace VM
 } // namespace steve
 
-#endif // STEVE_VM_JIT_H
\ No newline at end of file
+#endif // STEVE_VM_JIT_H
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vm_jit_ir.h"
+#include <algorithm>
+
+namespace steve {
+    namespace VM {
+
+        bool isCallInstruction(IROp op) {
+            return op == IROp::PUSH || op == IROp::BASELINE || op == IROp::RESUME;
+        }
+
+        namespace {
+
+            void extend(std::vector<LiveInterval>& intervals, uint32_t vreg, size_t position) {
+                if (vreg == NO_VREG) {
+                    return;
+                }
+                LiveInterval& interval = intervals[vreg];
+                if (interval.vreg == NO_VREG) {
+                    interval.vreg = vreg;
+                    interval.start = position;
+                    interval.end = position;
+                    return;
+                }
+                interval.start = std::min(interval.start, position);
+                interval.end = std::max(interval.end, position);
+            }
+
+            void extendDeopt(std::vector<LiveInterval>& intervals, const IRDeopt& deopt, size_t position) {
+                for (const IROperand& operand : deopt.stack) {
+                    extend(intervals, operand.vreg, position);
+                }
+                for (const auto& var : deopt.vars) {
+                    extend(intervals, var.second, position);
+                }
+            }
+
+        } // namespace
+
+        std::vector<LiveInterval> computeLiveIntervals(const IRUnit& ir) {
+            std::vector<LiveInterval> intervals(ir.vregCount, LiveInterval{ NO_VREG, 0, 0, false });
+            std::vector<size_t> labelAt;
+            std::vector<size_t> calls;
+            for (size_t i = 0; i < ir.code.size(); i++) {
+                const IRInstr& instr = ir.code[i];
+                extend(intervals, instr.dst, i);
+                extend(intervals, instr.a.vreg, i);
+                extend(intervals, instr.b.vreg, i);
+                if (instr.op == IROp::PUSH) {
+                    for (const IROperand& operand : ir.pushes[instr.immediate]) {
+                        extend(intervals, operand.vreg, i);
+                    }
+                }
+                if (instr.deopt >= 0) {
+                    extendDeopt(intervals, ir.deopts[instr.deopt], i);
+                }
+                if (instr.op == IROp::LABEL) {
+                    if (labelAt.size() <= instr.label) {
+                        labelAt.resize(instr.label + 1, SIZE_MAX);
+                    }
+                    labelAt[instr.label] = i;
+                }
+                if (isCallInstruction(instr.op)) {
+                    calls.push_back(i);
+                }
+            }
+
+            // Back-edges, as (jump, loop head) positions
+            std::vector<std::pair<size_t, size_t>> loops;
+            for (size_t i = 0; i < ir.code.size(); i++) {
+                const IRInstr& instr = ir.code[i];
+                if ((instr.op == IROp::JUMP || instr.op == IROp::BRANCH_FALSE) && instr.label < labelAt.size() &&
+                    labelAt[instr.label] <= i) {
+                    loops.emplace_back(i, labelAt[instr.label]);
+                }
+            }
+            // A value live at a loop head is needed again after the back-edge; nested loops may
+            // extend it further, so repeat until nothing changes
+            bool changed = !loops.empty();
+            while (changed) {
+                changed = false;
+                for (LiveInterval& interval : intervals) {
+                    for (const auto& loop : loops) {
+                        if (interval.vreg != NO_VREG && interval.start < loop.second && interval.end >= loop.second &&
+                            interval.end < loop.first) {
+                            interval.end = loop.first;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+
+            std::vector<LiveInterval> result;
+            for (LiveInterval& interval : intervals) {
+                if (interval.vreg == NO_VREG) {
+                    continue;
+                }
+                auto call = std::upper_bound(calls.begin(), calls.end(), interval.start);
+                interval.crossesCall = call != calls.end() && *call < interval.end;
+                result.push_back(interval);
+            }
+            std::stable_sort(result.begin(), result.end(), [](const LiveInterval& a, const LiveInterval& b) {
+                return a.start < b.start;
+            });
+            return result;
+        }
+
+        bool allocateRegisters(const IRUnit& ir, const RegisterPools& pools, size_t maxSpillSlots, AllocationResult& result) {
+            result.locations.assign(ir.vregCount, IRLocation{ -1, -1 });
+            result.spillSlots = 0;
+            result.spilledValues = 0;
+
+            std::vector<LiveInterval> intervals = computeLiveIntervals(ir);
+            std::vector<int> freeCallee(pools.calleeSaved.rbegin(), pools.calleeSaved.rend());
+            std::vector<int> freeCaller(pools.callerSaved.rbegin(), pools.callerSaved.rend());
+            std::vector<int> freeSlots;
+            std::vector<const LiveInterval*> active;   // Holding a register
+            std::vector<const LiveInterval*> spilled;  // Holding a frame slot
+            auto isCalleeSaved = [&](int reg) {
+                return std::find(pools.calleeSaved.begin(), pools.calleeSaved.end(), reg) != pools.calleeSaved.end();
+            };
+
+            auto spill = [&](const LiveInterval* interval) {
+                int slot;
+                if (!freeSlots.empty()) {
+                    slot = freeSlots.back();
+                    freeSlots.pop_back();
+                }
+                else {
+                    slot = static_cast<int>(result.spillSlots++);
+                }
+                result.locations[interval->vreg] = IRLocation{ -1, slot };
+                result.spilledValues++;
+                spilled.push_back(interval);
+            };
+
+            for (const LiveInterval& current : intervals) {
+                // Expire the intervals that ended before this one starts
+                for (size_t i = 0; i < active.size();) {
+                    if (active[i]->end < current.start) {
+                        int reg = result.locations[active[i]->vreg].reg;
+                        (isCalleeSaved(reg) ? freeCallee : freeCaller).push_back(reg);
+                        active.erase(active.begin() + i);
+                    }
+                    else {
+                        i++;
+                    }
+                }
+                for (size_t i = 0; i < spilled.size();) {
+                    if (spilled[i]->end < current.start) {
+                        freeSlots.push_back(result.locations[spilled[i]->vreg].spillSlot);
+                        spilled.erase(spilled.begin() + i);
+                    }
+                    else {
+                        i++;
+                    }
+                }
+
+                // Caller-saved registers first, keeping the callee-saved ones for values live across calls
+                int reg = -1;
+                if (!current.crossesCall && !freeCaller.empty()) {
+                    reg = freeCaller.back();
+                    freeCaller.pop_back();
+                }
+                else if (!freeCallee.empty()) {
+                    reg = freeCallee.back();
+                    freeCallee.pop_back();
+                }
+                if (reg >= 0) {
+                    result.locations[current.vreg] = IRLocation{ reg, -1 };
+                    active.push_back(&current);
+                    continue;
+                }
+
+                // Spill the interval ending last, taking its register if it suits this one
+                size_t victim = active.size();
+                for (size_t i = 0; i < active.size(); i++) {
+                    if ((!current.crossesCall || isCalleeSaved(result.locations[active[i]->vreg].reg)) &&
+                        (victim == active.size() || active[i]->end > active[victim]->end)) {
+                        victim = i;
+                    }
+                }
+                if (victim < active.size() && active[victim]->end > current.end) {
+                    const LiveInterval* evicted = active[victim];
+                    result.locations[current.vreg] = IRLocation{ result.locations[evicted->vreg].reg, -1 };
+                    active[victim] = &current;
+                    spill(evicted);
+                }
+                else {
+                    spill(&current);
+                }
+                if (result.spillSlots > maxSpillSlots) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+    } // namespace VM
+} // namespace steve
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STEVE_VM_JIT_IR_H
+#define STEVE_VM_JIT_IR_H
+
+#include <vector>
+#include <cstddef> // for size_t
+#include <cstdint>
+#include <utility>
+
+namespace steve {
+    namespace VM {
+
+        // Virtual register of an operand that is a constant
+        const uint32_t NO_VREG = UINT32_MAX;
+
+        // Operand stack value held by optimized code
+        enum class IRKind : uint8_t {
+            CONST_INT,   // Integer constant
+            CONST_BOOL,  // Boolean constant
+            BOXED,       // NaN-boxed bits of an int or an inline int64_t
+            INT,         // int64_t computed by the optimized code, an int64_t Value once pushed
+            BOOL         // 0 or 1
+        };
+
+        struct IROperand {
+            IRKind kind;
+            uint32_t vreg;  // NO_VREG for constants
+            uint64_t bits;  // NaN-boxed constant
+            int64_t value;  // Constant value
+        };
+
+        // Instructions of the optimizing tier's IR, in the order their machine code is emitted.
+        // Loop variables kept in registers are virtual registers assigned more than once.
+        enum class IROp : uint8_t {
+            LABEL,         // Bind label
+            JUMP,          // Jump to label
+            BRANCH_FALSE,  // Jump to label unless a is non-zero, or a operator(immediate) b holds if immediate is set
+            LOAD_SLOT,     // dst = slot immediate, BOXED or BOOL as kind says, deopt for any other value
+            STORE_SLOT,    // slot immediate = a, deopt if a does not fit inline or the slot holds a heap object
+            ENTER_VAR,     // dst = slot immediate, a loop variable, deopt unless it holds an integer
+            STORE_VAR,     // dst = a NaN-boxed, deopt if it does not fit inline
+            MOVE,          // dst = a
+            SYNC_VAR,      // slot immediate = a, a loop variable leaving its register
+            BINARY,        // dst = a operator(immediate) b, deopt on a divisor of 0 or -1
+            PUSH,          // Push pushes[immediate] to the operand stack, label on failure
+            BASELINE,      // Baseline code of the instruction at pc immediate
+            RESUME,        // Leave the unit for pc immediate
+            DEOPT          // Leave through deopt
+        };
+
+        struct IRInstr {
+            IROp op;
+            IRKind kind;         // Of dst
+            uint32_t dst;        // NO_VREG for none
+            IROperand a;
+            IROperand b;
+            uint32_t immediate;
+            size_t label;
+            int32_t deopt;       // Index in IRUnit::deopts taken by a failed guard, -1 for none
+        };
+
+        // Interpreter state rebuilt when a guard fails
+        struct IRDeopt {
+            uint32_t pc;                                      // Where the baseline code takes over
+            std::vector<IROperand> stack;                     // Values to push to the operand stack
+            std::vector<std::pair<uint32_t, uint32_t>> vars;  // Slot -> virtual register of the loop variables to store back
+            bool unreached;                                   // Not a guard: the instruction had not run when the unit was optimized
+        };
+
+        // A unit translated by the optimizing tier
+        struct IRUnit {
+            std::vector<IRInstr> code;
+            std::vector<IRDeopt> deopts;
+            std::vector<std::vector<IROperand>> pushes;
+            uint32_t vregCount;
+
+            IRUnit() : vregCount(0) {}
+        };
+
+        // Positions of a virtual register, as indices in IRUnit::code
+        struct LiveInterval {
+            uint32_t vreg;
+            size_t start;      // First definition
+            size_t end;        // Last use, or the last back-edge of a loop it is live across
+            bool crossesCall;  // A helper call (PUSH, BASELINE, RESUME) lies strictly inside
+        };
+
+        // Where a virtual register lives
+        struct IRLocation {
+            int reg;        // Machine register, -1 when spilled
+            int spillSlot;  // Frame slot when spilled, -1 otherwise
+        };
+
+        // Registers the allocator hands out. Values live across a helper call only get callee-saved ones.
+        struct RegisterPools {
+            std::vector<int> calleeSaved;
+            std::vector<int> callerSaved;
+        };
+
+        struct AllocationResult {
+            std::vector<IRLocation> locations;  // Virtual register -> location
+            size_t spillSlots;                  // Frame slots used
+            size_t spilledValues;               // Virtual registers that got no register
+        };
+
+        bool isCallInstruction(IROp op);
+
+        // Live intervals of the virtual registers defined in ir, ordered by start. A value live into
+        // a loop (used after the loop head but defined before it) stays live up to the loop's back-edge.
+        std::vector<LiveInterval> computeLiveIntervals(const IRUnit& ir);
+
+        // Linear-scan allocation (Poletto and Sarkar): walk the intervals by start, free the registers
+        // of the ones that ended, and when none is left spill whichever active interval ends last.
+        // False if more than maxSpillSlots frame slots would be needed.
+        bool allocateRegisters(const IRUnit& ir, const RegisterPools& pools, size_t maxSpillSlots, AllocationResult& result);
+
+    } // namespace VM
+} // namespace steve
+
+#endif // STEVE_VM_JIT_IR_H
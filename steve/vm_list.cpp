@@ -0,0 +1,680 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vm_list.h"
+#include "vm_exception.h"
+#include <algorithm>
+#include <bit>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STEVE_LIST_SSE2 1
+#else
+#define STEVE_LIST_SSE2 0
+#endif
+
+namespace steve {
+    namespace VM {
+
+        // Mask of the used bits in the last word of a bit store of n elements
+        static uint64_t lastWordMask(size_t n) {
+            return n % 64 != 0 ? (static_cast<uint64_t>(1) << (n % 64)) - 1 : ~static_cast<uint64_t>(0);
+        }
+
+        // n bits all set or all clear
+        static std::vector<uint64_t> uniformBits(size_t n, bool set) {
+            std::vector<uint64_t> bits((n + 63) / 64, set ? ~static_cast<uint64_t>(0) : 0);
+            if (!bits.empty()) {
+                bits.back() &= lastWordMask(n);
+            }
+            return bits;
+        }
+
+        static ListValue::Storage storageFor(const Value& value) {
+            if (value.is<int>() || value.is<int64_t>()) {
+                return ListValue::Storage::INT;
+            }
+            if (value.is<double>()) {
+                return ListValue::Storage::DOUBLE;
+            }
+            if (value.is<bool>()) {
+                return ListValue::Storage::BOOL;
+            }
+            return ListValue::Storage::GENERIC;
+        }
+
+        ListValue::ListValue(const std::vector<Value>& v) : ListValue() {
+            for (const Value& value : v) {
+                push(value);
+            }
+        }
+
+        ListValue ListValue::fromInts(std::vector<int64_t>&& values, bool wide) {
+            ListValue list;
+            if (!values.empty()) {
+                list.storage = Storage::INT;
+                list.count = values.size();
+                list.bits = uniformBits(values.size(), wide);
+                list.ints = std::move(values);
+            }
+            return list;
+        }
+
+        ListValue ListValue::fromDoubles(std::vector<double>&& values) {
+            ListValue list;
+            if (!values.empty()) {
+                list.storage = Storage::DOUBLE;
+                list.count = values.size();
+                list.doubles = std::move(values);
+            }
+            return list;
+        }
+
+        Value ListValue::at(size_t i) const {
+            switch (storage) {
+            case Storage::INT: return bit(i) ? Value(ints[i]) : Value(static_cast<int>(ints[i]));
+            case Storage::DOUBLE: return Value(doubles[i]);
+            case Storage::BOOL: return Value(bit(i));
+            default: return items[i];
+            }
+        }
+
+        void ListValue::pushBit(bool set) {
+            if (count % 64 == 0) {
+                bits.push_back(0);
+            }
+            bits.back() |= static_cast<uint64_t>(set) << (count % 64);
+        }
+
+        void ListValue::push(const Value& value) {
+            if (storage == Storage::EMPTY) {
+                storage = storageFor(value);
+            }
+            switch (storage) {
+            case Storage::INT:
+                if (value.is<int>() || value.is<int64_t>()) {
+                    bool wide = value.is<int64_t>();
+                    ints.push_back(wide ? value.get<int64_t>() : value.get<int>());
+                    pushBit(wide);
+                    count++;
+                    return;
+                }
+                break;
+            case Storage::DOUBLE:
+                if (value.is<double>()) {
+                    doubles.push_back(value.get<double>());
+                    count++;
+                    return;
+                }
+                break;
+            case Storage::BOOL:
+                if (value.is<bool>()) {
+                    pushBit(value.get<bool>());
+                    count++;
+                    return;
+                }
+                break;
+            default:
+                items.push_back(value);
+                count++;
+                return;
+            }
+            // First element of another kind
+            toGeneric();
+            items.push_back(value);
+            count++;
+        }
+
+        void ListValue::append(const ListValue& other) {
+            if (&other == this) {
+                ListValue copy = other;
+                append(copy);
+                return;
+            }
+            if (other.count == 0) {
+                return;
+            }
+            if (storage == Storage::EMPTY) {
+                *this = other;
+                return;
+            }
+            if (storage != other.storage) {
+                for (size_t i = 0; i < other.count; i++) {
+                    push(other.at(i));
+                }
+                return;
+            }
+            ints.insert(ints.end(), other.ints.begin(), other.ints.end());
+            doubles.insert(doubles.end(), other.doubles.begin(), other.doubles.end());
+            items.insert(items.end(), other.items.begin(), other.items.end());
+            if (!other.bits.empty()) {
+                size_t shift = count % 64;
+                if (shift == 0) {
+                    bits.insert(bits.end(), other.bits.begin(), other.bits.end());
+                }
+                else {
+                    for (uint64_t word : other.bits) {
+                        bits.back() |= word << shift;
+                        bits.push_back(word >> (64 - shift));
+                    }
+                    bits.resize((count + other.count + 63) / 64);
+                }
+            }
+            count += other.count;
+        }
+
+        void ListValue::fill(const Value& value) {
+            size_t n = count;
+            Storage target = n != 0 ? storageFor(value) : Storage::EMPTY;
+            if (target != storage) {
+                *this = ListValue();
+            }
+            storage = target;
+            count = n;
+            switch (storage) {
+            case Storage::INT:
+                ints.assign(n, value.is<int64_t>() ? value.get<int64_t>() : value.get<int>());
+                bits = uniformBits(n, value.is<int64_t>());
+                break;
+            case Storage::DOUBLE:
+                doubles.assign(n, value.get<double>());
+                break;
+            case Storage::BOOL:
+                bits = uniformBits(n, value.get<bool>());
+                break;
+            case Storage::GENERIC:
+                items.assign(n, value);
+                break;
+            default:
+                break;
+            }
+        }
+
+        void ListValue::toGeneric() {
+            std::vector<Value> values;
+            values.reserve(count + 1);
+            for (size_t i = 0; i < count; i++) {
+                values.push_back(at(i));
+            }
+            items = std::move(values);
+            std::vector<int64_t>().swap(ints);
+            std::vector<double>().swap(doubles);
+            std::vector<uint64_t>().swap(bits);
+            storage = Storage::GENERIC;
+        }
+
+        bool ListValue::operator==(const ListValue& other) const {
+            if (count != other.count) {
+                return false;
+            }
+            if (storage == other.storage) {
+                switch (storage) {
+                case Storage::INT: return ints == other.ints && bits == other.bits;
+                case Storage::DOUBLE: return doubles == other.doubles;   // Element-wise, NaN != NaN
+                case Storage::BOOL: return bits == other.bits;
+                default: return items == other.items;
+                }
+            }
+            for (size_t i = 0; i < count; i++) {
+                if (at(i) != other.at(i)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Kernels. Integer arithmetic wraps like the VM's int64_t operators do in practice, but
+        // through uint64_t so it is defined. Double reductions keep four lanes, the SSE2 registers
+        // hold lanes 0-1 and 2-3, so both builds round identically.
+
+        static double sumLanes(const double* data, size_t n) {
+            size_t i = 0;
+            double total = 0.0;
+#if STEVE_LIST_SSE2
+            __m128d low = _mm_setzero_pd();
+            __m128d high = _mm_setzero_pd();
+            for (; i + 4 <= n; i += 4) {
+                low = _mm_add_pd(low, _mm_loadu_pd(data + i));
+                high = _mm_add_pd(high, _mm_loadu_pd(data + i + 2));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_add_pd(low, high));
+            total = lanes[0] + lanes[1];
+#else
+            double lanes[4] = { 0.0, 0.0, 0.0, 0.0 };
+            for (; i + 4 <= n; i += 4) {
+                for (size_t k = 0; k < 4; k++) {
+                    lanes[k] += data[i + k];
+                }
+            }
+            total = (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+#endif
+            for (; i < n; i++) {
+                total += data[i];
+            }
+            return total;
+        }
+
+        static uint64_t sumInts(const int64_t* data, size_t n) {
+            size_t i = 0;
+            uint64_t total = 0;
+#if STEVE_LIST_SSE2
+            __m128i low = _mm_setzero_si128();
+            __m128i high = _mm_setzero_si128();
+            for (; i + 4 <= n; i += 4) {
+                low = _mm_add_epi64(low, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)));
+                high = _mm_add_epi64(high, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 2)));
+            }
+            uint64_t lanes[2];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_add_epi64(low, high));
+            total = lanes[0] + lanes[1];
+#endif
+            for (; i < n; i++) {
+                total += static_cast<uint64_t>(data[i]);
+            }
+            return total;
+        }
+
+        bool listSum(const ListValue& list, Value& result) {
+            switch (list.kind()) {
+            case ListValue::Storage::INT:
+                result = Value(static_cast<int64_t>(sumInts(list.intStore().data(), list.size())));
+                return true;
+            case ListValue::Storage::DOUBLE:
+                result = Value(sumLanes(list.doubleStore().data(), list.size()));
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        template <bool Largest>
+        static int64_t extremeInt(const int64_t* data, size_t n) {
+            // SSE2 has no 64-bit compare, four independent lanes still break the dependency chain
+            int64_t lanes[4] = { data[0], data[0], data[0], data[0] };
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                for (size_t k = 0; k < 4; k++) {
+                    lanes[k] = Largest ? std::max(lanes[k], data[i + k]) : std::min(lanes[k], data[i + k]);
+                }
+            }
+            int64_t best = Largest ? std::max({ lanes[0], lanes[1], lanes[2], lanes[3] }) : std::min({ lanes[0], lanes[1], lanes[2], lanes[3] });
+            for (; i < n; i++) {
+                best = Largest ? std::max(best, data[i]) : std::min(best, data[i]);
+            }
+            return best;
+        }
+
+        // NaN elements are skipped, the caller handles a NaN first element
+        template <bool Largest>
+        static double extremeDouble(const double* data, size_t n) {
+            double best = data[0];
+            size_t i = 0;
+#if STEVE_LIST_SSE2
+            // minpd/maxpd return the second operand when either is NaN, so the accumulator goes second
+            __m128d lanes = _mm_set1_pd(best);
+            for (; i + 2 <= n; i += 2) {
+                __m128d x = _mm_loadu_pd(data + i);
+                lanes = Largest ? _mm_max_pd(x, lanes) : _mm_min_pd(x, lanes);
+            }
+            double pair[2];
+            _mm_storeu_pd(pair, lanes);
+            best = Largest ? std::max(pair[0], pair[1]) : std::min(pair[0], pair[1]);
+#endif
+            for (; i < n; i++) {
+                if (Largest ? data[i] > best : data[i] < best) {
+                    best = data[i];
+                }
+            }
+            return best;
+        }
+
+        bool listMinMax(const ListValue& list, bool largest, Value& result) {
+            size_t n = list.size();
+            if (n == 0) {
+                return false;
+            }
+            // The extreme value is found first, then its first occurrence, which keeps int and int64_t apart
+            size_t index = 0;
+            if (list.kind() == ListValue::Storage::INT) {
+                const int64_t* data = list.intStore().data();
+                int64_t best = largest ? extremeInt<true>(data, n) : extremeInt<false>(data, n);
+                index = std::find(data, data + n, best) - data;
+            }
+            else if (list.kind() == ListValue::Storage::DOUBLE) {
+                const double* data = list.doubleStore().data();
+                // A NaN first element is never replaced, no comparison with it holds
+                if (data[0] == data[0]) {
+                    double best = largest ? extremeDouble<true>(data, n) : extremeDouble<false>(data, n);
+                    index = std::find(data, data + n, best) - data;
+                }
+            }
+            else {
+                return false;
+            }
+            result = list.at(index);
+            return true;
+        }
+
+        template <typename L, typename R>
+        static double dotLanes(const L* left, const R* right, size_t n) {
+            double lanes[4] = { 0.0, 0.0, 0.0, 0.0 };
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                for (size_t k = 0; k < 4; k++) {
+                    lanes[k] += static_cast<double>(left[i + k]) * static_cast<double>(right[i + k]);
+                }
+            }
+            double total = (lanes[0] + lanes[2]) + (lanes[1] + lanes[3]);
+            for (; i < n; i++) {
+                total += static_cast<double>(left[i]) * static_cast<double>(right[i]);
+            }
+            return total;
+        }
+
+        static double dotDoubles(const double* left, const double* right, size_t n) {
+#if STEVE_LIST_SSE2
+            __m128d low = _mm_setzero_pd();
+            __m128d high = _mm_setzero_pd();
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                low = _mm_add_pd(low, _mm_mul_pd(_mm_loadu_pd(left + i), _mm_loadu_pd(right + i)));
+                high = _mm_add_pd(high, _mm_mul_pd(_mm_loadu_pd(left + i + 2), _mm_loadu_pd(right + i + 2)));
+            }
+            double lanes[2];
+            _mm_storeu_pd(lanes, _mm_add_pd(low, high));
+            double total = lanes[0] + lanes[1];
+            for (; i < n; i++) {
+                total += left[i] * right[i];
+            }
+            return total;
+#else
+            return dotLanes(left, right, n);
+#endif
+        }
+
+        bool listDot(const ListValue& left, const ListValue& right, Value& result) {
+            size_t n = left.size();
+            if (n == 0 || right.size() != n) {
+                return false;
+            }
+            ListValue::Storage l = left.kind();
+            ListValue::Storage r = right.kind();
+            if (l == ListValue::Storage::INT && r == ListValue::Storage::INT) {
+                const int64_t* a = left.intStore().data();
+                const int64_t* b = right.intStore().data();
+                uint64_t lanes[4] = { 0, 0, 0, 0 };
+                size_t i = 0;
+                for (; i + 4 <= n; i += 4) {
+                    for (size_t k = 0; k < 4; k++) {
+                        lanes[k] += static_cast<uint64_t>(a[i + k]) * static_cast<uint64_t>(b[i + k]);
+                    }
+                }
+                uint64_t total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                for (; i < n; i++) {
+                    total += static_cast<uint64_t>(a[i]) * static_cast<uint64_t>(b[i]);
+                }
+                result = Value(static_cast<int64_t>(total));
+                return true;
+            }
+            if (l == ListValue::Storage::DOUBLE && r == ListValue::Storage::DOUBLE) {
+                result = Value(dotDoubles(left.doubleStore().data(), right.doubleStore().data(), n));
+                return true;
+            }
+            if (l == ListValue::Storage::INT && r == ListValue::Storage::DOUBLE) {
+                result = Value(dotLanes(left.intStore().data(), right.doubleStore().data(), n));
+                return true;
+            }
+            if (l == ListValue::Storage::DOUBLE && r == ListValue::Storage::INT) {
+                result = Value(dotLanes(left.doubleStore().data(), right.intStore().data(), n));
+                return true;
+            }
+            return false;
+        }
+
+        template <ListArithmetic Op>
+        static int64_t applyInt(int64_t a, int64_t b) {
+            uint64_t x = static_cast<uint64_t>(a);
+            uint64_t y = static_cast<uint64_t>(b);
+            if constexpr (Op == ListArithmetic::ADD) return static_cast<int64_t>(x + y);
+            else if constexpr (Op == ListArithmetic::SUB) return static_cast<int64_t>(x - y);
+            else if constexpr (Op == ListArithmetic::MUL) return static_cast<int64_t>(x * y);
+            else return b == -1 ? static_cast<int64_t>(0 - x) : a / b; // INT64_MIN / -1 wraps as binaryInt does
+        }
+
+        template <ListArithmetic Op>
+        static double applyDouble(double a, double b) {
+            if constexpr (Op == ListArithmetic::ADD) return a + b;
+            else if constexpr (Op == ListArithmetic::SUB) return a - b;
+            else if constexpr (Op == ListArithmetic::MUL) return a * b;
+            else return a / b;
+        }
+
+        // out[i] = a[i] op b[i * step], step 0 broadcasts b[0]
+        template <ListArithmetic Op>
+        static void intArithmetic(const int64_t* a, const int64_t* b, size_t step, int64_t* out, size_t n) {
+            size_t i = 0;
+#if STEVE_LIST_SSE2
+            // SSE2 adds and subtracts 64-bit lanes, it has no 64-bit multiply or divide
+            if constexpr (Op == ListArithmetic::ADD || Op == ListArithmetic::SUB) {
+                __m128i broadcast = _mm_set1_epi64x(b[0]);
+                for (; i + 2 <= n; i += 2) {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+                    __m128i y = step != 0 ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)) : broadcast;
+                    __m128i r = Op == ListArithmetic::ADD ? _mm_add_epi64(x, y) : _mm_sub_epi64(x, y);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), r);
+                }
+            }
+#endif
+            for (; i < n; i++) {
+                out[i] = applyInt<Op>(a[i], b[i * step]);
+            }
+        }
+
+        template <ListArithmetic Op>
+        static void doubleArithmetic(const double* a, const double* b, size_t step, double* out, size_t n) {
+            size_t i = 0;
+#if STEVE_LIST_SSE2
+            __m128d broadcast = _mm_set1_pd(b[0]);
+            for (; i + 2 <= n; i += 2) {
+                __m128d x = _mm_loadu_pd(a + i);
+                __m128d y = step != 0 ? _mm_loadu_pd(b + i) : broadcast;
+                __m128d r;
+                if constexpr (Op == ListArithmetic::ADD) r = _mm_add_pd(x, y);
+                else if constexpr (Op == ListArithmetic::SUB) r = _mm_sub_pd(x, y);
+                else if constexpr (Op == ListArithmetic::MUL) r = _mm_mul_pd(x, y);
+                else r = _mm_div_pd(x, y);
+                _mm_storeu_pd(out + i, r);
+            }
+#endif
+            for (; i < n; i++) {
+                out[i] = applyDouble<Op>(a[i], b[i * step]);
+            }
+        }
+
+        static void runArithmetic(ListArithmetic op, const int64_t* a, const int64_t* b, size_t step, int64_t* out, size_t n) {
+            switch (op) {
+            case ListArithmetic::ADD: intArithmetic<ListArithmetic::ADD>(a, b, step, out, n); break;
+            case ListArithmetic::SUB: intArithmetic<ListArithmetic::SUB>(a, b, step, out, n); break;
+            case ListArithmetic::MUL: intArithmetic<ListArithmetic::MUL>(a, b, step, out, n); break;
+            case ListArithmetic::DIV: intArithmetic<ListArithmetic::DIV>(a, b, step, out, n); break;
+            }
+        }
+
+        static void runArithmetic(ListArithmetic op, const double* a, const double* b, size_t step, double* out, size_t n) {
+            switch (op) {
+            case ListArithmetic::ADD: doubleArithmetic<ListArithmetic::ADD>(a, b, step, out, n); break;
+            case ListArithmetic::SUB: doubleArithmetic<ListArithmetic::SUB>(a, b, step, out, n); break;
+            case ListArithmetic::MUL: doubleArithmetic<ListArithmetic::MUL>(a, b, step, out, n); break;
+            case ListArithmetic::DIV: doubleArithmetic<ListArithmetic::DIV>(a, b, step, out, n); break;
+            }
+        }
+
+        bool listArithmetic(const ListValue& left, const Value& right, ListArithmetic op, Value& result) {
+            size_t n = left.size();
+            ListValue::Storage l = left.kind();
+            if (n == 0 || (l != ListValue::Storage::INT && l != ListValue::Storage::DOUBLE)) {
+                return false;
+            }
+
+            // Right operand as a typed array, step 0 for a number broadcast to every element
+            ListValue::Storage r;
+            size_t step = 1;
+            int64_t intScalar = 0;
+            double doubleScalar = 0.0;
+            const int64_t* rightInts = &intScalar;
+            const double* rightDoubles = &doubleScalar;
+            if (right.is<ListValue>()) {
+                const ListValue& list = right.get<ListValue>();
+                r = list.kind();
+                if (list.size() != n || (r != ListValue::Storage::INT && r != ListValue::Storage::DOUBLE)) {
+                    return false;
+                }
+                rightInts = list.intStore().data();
+                rightDoubles = list.doubleStore().data();
+            }
+            else if (right.is<int>() || right.is<int64_t>()) {
+                r = ListValue::Storage::INT;
+                intScalar = right.is<int>() ? right.get<int>() : right.get<int64_t>();
+                step = 0;
+            }
+            else if (right.is<double>()) {
+                r = ListValue::Storage::DOUBLE;
+                doubleScalar = right.get<double>();
+                step = 0;
+            }
+            else {
+                return false;
+            }
+
+            // Division by zero throws before any work, as the first zero divisor would
+            size_t rightCount = step != 0 ? n : 1;
+            if (op == ListArithmetic::DIV) {
+                bool zero = r == ListValue::Storage::INT
+                    ? std::find(rightInts, rightInts + rightCount, 0) != rightInts + rightCount
+                    : std::find(rightDoubles, rightDoubles + rightCount, 0.0) != rightDoubles + rightCount;
+                if (zero) {
+                    throw RuntimeError("Division by zero error");
+                }
+            }
+
+            if (l == ListValue::Storage::INT && r == ListValue::Storage::INT) {
+                // Int operators produce int64_t
+                std::vector<int64_t> values(n);
+                runArithmetic(op, left.intStore().data(), rightInts, step, values.data(), n);
+                result = Value(ListValue::fromInts(std::move(values), true));
+                return true;
+            }
+
+            // Any double operand makes the operation double, the int side is widened first
+            std::vector<double> widened;
+            const double* a = left.doubleStore().data();
+            const double* b = rightDoubles;
+            if (l == ListValue::Storage::INT) {
+                widened.assign(left.intStore().begin(), left.intStore().end());
+                a = widened.data();
+            }
+            else if (r == ListValue::Storage::INT) {
+                widened.assign(rightInts, rightInts + rightCount);
+                b = widened.data();
+            }
+            std::vector<double> values(n);
+            runArithmetic(op, a, b, step, values.data(), n);
+            result = Value(ListValue::fromDoubles(std::move(values)));
+            return true;
+        }
+
+        static size_t findInt(const int64_t* data, size_t n, int64_t target, size_t from) {
+            size_t i = from;
+#if STEVE_LIST_SSE2
+            // 64-bit lanes are equal when both of their 32-bit halves are
+            __m128i wanted = _mm_set1_epi64x(target);
+            for (; i + 2 <= n; i += 2) {
+                __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), wanted);
+                eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+                int mask = _mm_movemask_pd(_mm_castsi128_pd(eq));
+                if (mask != 0) {
+                    return i + std::countr_zero(static_cast<unsigned>(mask));
+                }
+            }
+#endif
+            for (; i < n; i++) {
+                if (data[i] == target) {
+                    return i;
+                }
+            }
+            return n;
+        }
+
+        static size_t findDouble(const double* data, size_t n, double target) {
+            size_t i = 0;
+#if STEVE_LIST_SSE2
+            __m128d wanted = _mm_set1_pd(target);
+            for (; i + 2 <= n; i += 2) {
+                int mask = _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(data + i), wanted));
+                if (mask != 0) {
+                    return i + std::countr_zero(static_cast<unsigned>(mask));
+                }
+            }
+#endif
+            for (; i < n; i++) {
+                if (data[i] == target) {
+                    return i;
+                }
+            }
+            return n;
+        }
+
+        bool listFind(const ListValue& list, const Value& needle, int64_t& index) {
+            size_t n = list.size();
+            size_t found = n;
+            bool numeric = needle.is<int>() || needle.is<int64_t>() || needle.is<double>();
+            switch (list.kind()) {
+            case ListValue::Storage::EMPTY:
+                break;
+            case ListValue::Storage::INT:
+                if (needle.is<double>()) {
+                    // Compared as doubles, like == with a double operand
+                    const int64_t* data = list.intStore().data();
+                    double target = needle.get<double>();
+                    found = std::find_if(data, data + n, [target](int64_t x) { return static_cast<double>(x) == target; }) - data;
+                }
+                else if (numeric) {
+                    found = findInt(list.intStore().data(), n, needle.is<int>() ? needle.get<int>() : needle.get<int64_t>(), 0);
+                }
+                break;
+            case ListValue::Storage::DOUBLE:
+                if (numeric) {
+                    double target = needle.is<double>() ? needle.get<double>()
+                        : static_cast<double>(needle.is<int>() ? needle.get<int>() : needle.get<int64_t>());
+                    found = findDouble(list.doubleStore().data(), n, target);
+                }
+                break;
+            case ListValue::Storage::BOOL:
+                if (needle.is<bool>()) {
+                    const std::vector<uint64_t>& bits = list.bitStore();
+                    for (size_t w = 0; w < bits.size(); w++) {
+                        uint64_t word = needle.get<bool>() ? bits[w] : ~bits[w];
+                        if (w + 1 == bits.size()) {
+                            word &= lastWordMask(n);
+                        }
+                        if (word != 0) {
+                            found = w * 64 + std::countr_zero(word);
+                            break;
+                        }
+                    }
+                }
+                break;
+            default:
+                return false;
+            }
+            index = found < n ? static_cast<int64_t>(found) : -1;
+            return true;
+        }
+
+    } // namespace VM
+} // namespace steve
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STEVE_VM_LIST_H
+#define STEVE_VM_LIST_H
+
+#include <cstdint>
+#include "vm_value.h"
+
+namespace steve {
+    namespace VM {
+
+        // Bulk kernels behind the list_* built-ins, run over the typed stores of ListValue with
+        // SSE2 where available. Each returns false when an operand has no store it handles
+        // (generic or bool lists, non-numeric operands), the built-in then works element by element
+        // with the VM's own operators and gets the same result, only slower. The one exception is
+        // rounding: doubles are summed in independent lanes, not strictly left to right.
+
+        enum class ListArithmetic : uint8_t {
+            ADD,
+            SUB,
+            MUL,
+            DIV
+        };
+
+        // Sum of the elements, as 0 + e0 + e1 + ...
+        bool listSum(const ListValue& list, Value& result);
+
+        // First smallest (or largest) element of a non-empty list, as found with < (or >)
+        bool listMinMax(const ListValue& list, bool largest, Value& result);
+
+        // Sum of the products of two lists of equal length
+        bool listDot(const ListValue& left, const ListValue& right, Value& result);
+
+        // New list of left[i] op right[i], right is a list of equal length or a number.
+        // Throws RuntimeError on a division by zero, like the DIV operator.
+        bool listArithmetic(const ListValue& left, const Value& right, ListArithmetic op, Value& result);
+
+        // Index of the first element equal to needle, or -1. Numbers compare by value as with ==,
+        // so 1, 1.0 and a long 1 all match; other values only match an equal Value of their own type.
+        bool listFind(const ListValue& list, const Value& needle, int64_t& index);
+
+    } // namespace VM
+} // namespace steve
+
+#endif // STEVE_VM_LIST_H
@@ -0,0 +1,419 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vm_register.h"
+#include "vm_exception.h"
+#include "vm_superinstructions.h"
+#include <algorithm>
+
+namespace steve {
+    namespace VM {
+
+        // Instructions the translator turns into register code without leaving the block
+        static bool isStraightLine(InstructionType type, uint32_t immediate) {
+            switch (type) {
+            case InstructionType::LOAD_SLOT:
+            case InstructionType::LOAD_CONST:
+            case InstructionType::STORE_SLOT:
+            case InstructionType::DEFVAR_SLOT:
+            case InstructionType::BINARY_OP:
+            case InstructionType::UNARY_OP:
+            case InstructionType::POP:
+            case InstructionType::DO:
+            case InstructionType::NOP:
+            case InstructionType::PASS:
+            case InstructionType::LABEL:
+            case InstructionType::TRY:
+                return true;
+            case InstructionType::END:
+                return immediate == NO_IMMEDIATE; // IF END falls through, loop END jumps
+            default:
+                return false;
+            }
+        }
+
+        static bool isJump(InstructionType type) {
+            switch (type) {
+            case InstructionType::IF:
+            case InstructionType::WHILE:
+            case InstructionType::ELSE:
+            case InstructionType::END:
+            case InstructionType::GOTO:
+            case InstructionType::BREAK:
+            case InstructionType::CONTINUE:
+            case InstructionType::FUNC:
+            case InstructionType::CATCH:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        void VirtualMachine::translateRegisters() {
+            const CodeStream& code = state.code;
+            const size_t size = code.size();
+            auto result = std::make_unique<RegisterCode>();
+            RegisterCode& rc = *result;
+
+            rc.constants = code.constants;
+            const uint32_t zero = REGISTER_CONST_FLAG | static_cast<uint32_t>(rc.constants.size());
+            rc.constants.push_back(Value(0));
+            if (rc.constants.size() >= REGISTER_CONST_FLAG || state.globals.size() >= REGISTER_CONST_FLAG) {
+                throw RuntimeError("Program too large for the register tier", -1);
+            }
+
+            // Function owning each instruction (NO_IMMEDIATE at top level), and the block starts:
+            // jump targets, function entries and whatever follows a jump, call or STACK instruction
+            std::vector<uint32_t> owner(size, NO_IMMEDIATE);
+            std::vector<bool> blockStart(size + 1, false);
+            blockStart[0] = true;
+            std::unordered_map<size_t, uint32_t> functionAt;
+            for (size_t id = 0; id < state.functionTable.size(); id++) {
+                functionAt[state.functionTable[id].entry] = static_cast<uint32_t>(id);
+            }
+            std::vector<std::pair<uint32_t, size_t>> openFunctions; // Function id, end pc
+            for (size_t pc = 0; pc < size; pc++) {
+                while (!openFunctions.empty() && pc >= openFunctions.back().second) {
+                    openFunctions.pop_back();
+                }
+                owner[pc] = openFunctions.empty() ? NO_IMMEDIATE : openFunctions.back().first;
+
+                InstructionType type = superinstructionHead(code.opcodes[pc]);
+                uint32_t immediate = code.immediates[pc];
+                if (!isStraightLine(type, immediate)) {
+                    blockStart[pc + 1] = true;
+                }
+                if (isJump(type) && immediate != NO_IMMEDIATE) {
+                    blockStart[std::min<size_t>(immediate, size)] = true;
+                }
+                if (type == InstructionType::FUNC && immediate != NO_IMMEDIATE) {
+                    auto it = functionAt.find(pc + 1);
+                    if (it != functionAt.end()) {
+                        openFunctions.emplace_back(it->second, immediate);
+                    }
+                }
+            }
+
+            // Abstract operand stack: LOAD_SLOT/LOAD_CONST only push their operand, computed values live
+            // in the temporary of their stack depth, so the temporaries of a frame are bounded by its
+            // deepest expression
+            struct StackEntry {
+                uint32_t operand;
+                bool temp;
+                size_t producer;  // Instruction that computed a temporary
+            };
+            std::vector<StackEntry> stack;
+            std::vector<size_t> functionTemps(state.functionTable.size(), 0);
+            size_t pc = 0;
+
+            auto temp = [&](size_t depth) -> uint32_t {
+                uint32_t function = owner[pc];
+                size_t& count = function == NO_IMMEDIATE ? rc.topLevelTemps : functionTemps[function];
+                count = std::max(count, depth + 1);
+                size_t base = function == NO_IMMEDIATE ? 0 : state.functionTable[function].localCount;
+                return LOCAL_SLOT_FLAG | static_cast<uint32_t>(base + depth);
+            };
+            auto emit = [&](RegisterOp op, uint32_t dst, uint32_t a, uint32_t b) -> size_t {
+                RegisterInstruction instr;
+                instr.op = op;
+                instr.binop = Operator::NONE;
+                instr.dst = dst;
+                instr.a = a;
+                instr.b = b;
+                instr.target = NO_IMMEDIATE;
+                instr.pc = static_cast<uint32_t>(pc);
+                rc.code.push_back(instr);
+                return rc.code.size() - 1;
+            };
+            // Move the abstract stack onto the operand stack
+            auto flush = [&]() {
+                for (const StackEntry& entry : stack) {
+                    emit(RegisterOp::PUSH, 0, entry.operand, 0);
+                }
+                stack.clear();
+            };
+            // Make sure the top count values are on the abstract stack
+            auto require = [&](size_t count) {
+                if (stack.size() >= count) return;
+                flush();
+                std::vector<size_t> pops(count);
+                for (size_t depth = count; depth-- > 0;) {
+                    pops[depth] = emit(RegisterOp::POP, temp(depth), 0, 0);
+                }
+                for (size_t depth = 0; depth < count; depth++) {
+                    stack.push_back({ temp(depth), true, pops[depth] });
+                }
+            };
+            // Copy pending loads of slot into temporaries before the slot is overwritten
+            auto detach = [&](uint32_t slot) -> bool {
+                bool detached = false;
+                for (size_t depth = 0; depth < stack.size(); depth++) {
+                    if (!stack[depth].temp && stack[depth].operand == slot) {
+                        stack[depth] = { temp(depth), true, emit(RegisterOp::MOVE, temp(depth), slot, 0) };
+                        detached = true;
+                    }
+                }
+                return detached;
+            };
+            auto computed = [&](RegisterOp op, Operator binop, uint32_t a, uint32_t b) {
+                uint32_t dst = temp(stack.size());
+                size_t index = emit(op, dst, a, b);
+                rc.code[index].binop = binop;
+                stack.push_back({ dst, true, index });
+            };
+            auto jump = [&](RegisterOp op, uint32_t a, uint32_t target) {
+                size_t index = emit(op, 0, a, 0);
+                rc.code[index].target = target; // Stack pc, patched below
+            };
+
+            rc.entry.assign(size + 1, NO_IMMEDIATE);
+            for (pc = 0; pc < size; pc++) {
+                if (blockStart[pc]) {
+                    flush();
+                    rc.entry[pc] = static_cast<uint32_t>(rc.code.size());
+                }
+
+                InstructionType type = superinstructionHead(code.opcodes[pc]);
+                uint32_t immediate = code.immediates[pc];
+                switch (type) {
+                case InstructionType::LOAD_SLOT:
+                    stack.push_back({ immediate, false, 0 });
+                    break;
+
+                case InstructionType::LOAD_CONST:
+                    stack.push_back({ REGISTER_CONST_FLAG | immediate, false, 0 });
+                    break;
+
+                case InstructionType::STORE_SLOT: {
+                    require(1);
+                    StackEntry value = stack.back();
+                    stack.pop_back();
+                    bool detached = detach(immediate);
+                    if (value.temp && !detached && value.producer + 1 == rc.code.size() && rc.code.back().dst == value.operand) {
+                        rc.code.back().dst = immediate; // Compute straight into the variable
+                    }
+                    else {
+                        emit(RegisterOp::MOVE, immediate, value.operand, 0);
+                    }
+                    break;
+                }
+
+                case InstructionType::DEFVAR_SLOT:
+                    detach(immediate);
+                    emit(RegisterOp::MOVE, immediate, zero, 0);
+                    break;
+
+                case InstructionType::BINARY_OP: {
+                    require(2);
+                    uint32_t right = stack.back().operand;
+                    stack.pop_back();
+                    uint32_t left = stack.back().operand;
+                    stack.pop_back();
+                    computed(RegisterOp::BINARY, static_cast<Operator>(immediate), left, right);
+                    break;
+                }
+
+                case InstructionType::UNARY_OP: {
+                    require(1);
+                    uint32_t operand = stack.back().operand;
+                    stack.pop_back();
+                    computed(RegisterOp::UNARY, static_cast<Operator>(immediate), operand, 0);
+                    break;
+                }
+
+                case InstructionType::POP:
+                    if (!stack.empty()) {
+                        stack.pop_back();
+                    }
+                    else {
+                        emit(RegisterOp::DROP, 0, 0, 0);
+                    }
+                    break;
+
+                case InstructionType::DO:
+                case InstructionType::NOP:
+                case InstructionType::PASS:
+                case InstructionType::LABEL:
+                case InstructionType::TRY:
+                    break;
+
+                case InstructionType::IF:
+                case InstructionType::WHILE: {
+                    require(1);
+                    uint32_t condition = stack.back().operand;
+                    stack.pop_back();
+                    flush();
+                    jump(RegisterOp::JUMP_IF_FALSE, condition, immediate);
+                    break;
+                }
+
+                case InstructionType::END:
+                case InstructionType::ELSE:
+                case InstructionType::GOTO:
+                case InstructionType::BREAK:
+                case InstructionType::CONTINUE:
+                case InstructionType::FUNC:
+                case InstructionType::CATCH:
+                    flush();
+                    if (immediate != NO_IMMEDIATE) {
+                        jump(RegisterOp::JUMP, 0, immediate);
+                    }
+                    break;
+
+                case InstructionType::CALL:
+                    flush();
+                    if (immediate != NO_IMMEDIATE && !(immediate & CALL_BUILTIN_FLAG)) {
+                        emit(RegisterOp::CALL, 0, immediate & CALL_INDEX_MASK, (immediate >> CALL_ARGC_SHIFT) & CALL_ARGC_MASK);
+                    }
+                    else {
+                        emit(RegisterOp::STACK, 0, 0, 0);
+                    }
+                    break;
+
+                case InstructionType::RETURN:
+                    flush();
+                    emit(RegisterOp::RETURN, 0, 0, 0);
+                    break;
+
+                default:
+                    flush();
+                    emit(RegisterOp::STACK, 0, 0, 0);
+                    break;
+                }
+            }
+            flush();
+            rc.entry[size] = static_cast<uint32_t>(rc.code.size());
+            emit(RegisterOp::HALT, 0, 0, 0);
+
+            for (auto& instr : rc.code) {
+                if (instr.op == RegisterOp::JUMP || instr.op == RegisterOp::JUMP_IF_FALSE) {
+                    instr.target = rc.entry[std::min<size_t>(instr.target, size)];
+                }
+            }
+            for (size_t id = 0; id < functionTemps.size(); id++) {
+                state.functionTable[id].registerTemps = functionTemps[id];
+            }
+            registerCode = std::move(result);
+        }
+
+        bool VirtualMachine::dispatchRegisters() {
+            const RegisterCode& rc = *registerCode;
+            const std::vector<Value>& constants = rc.constants;
+            auto operand = [&](uint32_t x) -> const Value& {
+                return (x & REGISTER_CONST_FLAG) ? constants[x & ~REGISTER_CONST_FLAG] : slotValue(x);
+            };
+
+            if (state.frames.empty() && state.locals.size() < rc.topLevelTemps) {
+                state.locals.resize(rc.topLevelTemps, Value(0));
+            }
+            if (state.pc >= rc.entry.size() || rc.entry[state.pc] == NO_IMMEDIATE) {
+                return dispatch(false);
+            }
+
+            size_t rpc = rc.entry[state.pc];
+            size_t current = rpc;
+            try {
+                for (;;) {
+                    current = rpc++;
+                    const RegisterInstruction& instr = rc.code[current];
+                    if (instr.op != RegisterOp::STACK) {
+                        state.instructionCount++;
+                    }
+                    switch (instr.op) {
+                    case RegisterOp::MOVE:
+                        slotValue(instr.dst) = operand(instr.a);
+                        break;
+
+                    case RegisterOp::BINARY: {
+                        Value result = performBinaryOperation(operand(instr.a), operand(instr.b), instr.binop, state.code.lines[instr.pc]);
+                        slotValue(instr.dst) = std::move(result);
+                        break;
+                    }
+
+                    case RegisterOp::UNARY: {
+                        Value result = performUnaryOperation(operand(instr.a), instr.binop, state.code.lines[instr.pc]);
+                        slotValue(instr.dst) = std::move(result);
+                        break;
+                    }
+
+                    case RegisterOp::JUMP:
+                        rpc = instr.target;
+                        break;
+
+                    case RegisterOp::JUMP_IF_FALSE:
+                        if (!getBoolValue(operand(instr.a))) {
+                            rpc = instr.target;
+                        }
+                        break;
+
+                    case RegisterOp::PUSH:
+                        state.stack.push_back(operand(instr.a));
+                        break;
+
+                    case RegisterOp::POP:
+                        if (state.stack.empty()) {
+                            throw AccessError("Stack underflow", state.code.lines[instr.pc]);
+                        }
+                        slotValue(instr.dst) = std::move(state.stack.back());
+                        state.stack.pop_back();
+                        break;
+
+                    case RegisterOp::DROP:
+                        if (!state.stack.empty()) {
+                            state.stack.pop_back();
+                        }
+                        break;
+
+                    case RegisterOp::CALL:
+                    case RegisterOp::RETURN:
+                    case RegisterOp::STACK:
+                        // Control leaves the block: continue at the register block of the new pc, or
+                        // stay on the stack interpreter when there is none
+                        if (instr.op == RegisterOp::CALL) {
+                            enterFunction(instr.a, instr.b, instr.pc + 1, state.code.lines[instr.pc]);
+                        }
+                        else if (instr.op == RegisterOp::RETURN) {
+                            if (state.frames.empty()) {
+                                state.pc = instr.pc + 1;
+                                state.running = false;
+                                return true;
+                            }
+                            leaveFunction();
+                        }
+                        else {
+                            state.pc = instr.pc;
+                            if (!dispatch(true)) {
+                                return false;
+                            }
+                            if (!state.running) {
+                                return true;
+                            }
+                        }
+                        if (state.pc >= rc.entry.size() || rc.entry[state.pc] == NO_IMMEDIATE) {
+                            return dispatch(false);
+                        }
+                        rpc = rc.entry[state.pc];
+                        break;
+
+                    case RegisterOp::HALT:
+                        state.pc = state.code.size();
+                        return true;
+                    }
+                }
+            }
+            catch (const VMException& e) {
+                state.pc = rc.code[current].pc + 1;
+                throw;
+            }
+            catch (const std::exception& e) {
+                state.pc = rc.code[current].pc + 1;
+                throw RuntimeError(std::string("Standard exception: ") + e.what(), state.code.lines[rc.code[current].pc]);
+            }
+        }
+
+    } // namespace VM
+} // namespace steve
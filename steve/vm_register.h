@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STEVE_VM_REGISTER_H
+#define STEVE_VM_REGISTER_H
+#include "vm.h"
+
+namespace steve {
+    namespace VM {
+
+        // Register tier opcodes. Operands are encoded like *_SLOT immediates (a global slot, or a
+        // local slot with LOCAL_SLOT_FLAG), or name a constant with REGISTER_CONST_FLAG. The
+        // register file of a frame is its locals followed by FunctionInfo::registerTemps temporaries.
+        enum class RegisterOp : uint8_t {
+            MOVE,           // dst = a
+            BINARY,         // dst = a op b
+            UNARY,          // dst = op a
+            JUMP,           // continue at target
+            JUMP_IF_FALSE,  // continue at target unless a is true
+            PUSH,           // push a onto the operand stack
+            POP,            // pop the operand stack into dst
+            DROP,           // discard the top of the operand stack, if any
+            CALL,           // call user function a with b arguments from the operand stack
+            RETURN,         // return the top of the operand stack to the caller
+            STACK,          // run the stack instruction at pc on the stack interpreter
+            HALT            // end of the program
+        };
+
+        // Operand flag selecting RegisterCode::constants
+        constexpr uint32_t REGISTER_CONST_FLAG = 0x40000000u;
+
+        // Three-address instruction
+        struct RegisterInstruction {
+            RegisterOp op;
+            Operator binop;   // BINARY, UNARY
+            uint32_t dst;
+            uint32_t a;
+            uint32_t b;
+            uint32_t target;  // Register pc of a jump
+            uint32_t pc;      // Stack instruction it was translated from, for errors and STACK
+        };
+
+        // Register tier translation of a CodeStream. Values that are live across a block boundary,
+        // a call or a STACK instruction stay on the operand stack, so both tiers share MachineState
+        // and execution can leave the register tier at any block start.
+        struct RegisterCode {
+            std::vector<RegisterInstruction> code;
+            std::vector<uint32_t> entry;   // Stack pc -> register pc of the block starting there, NO_IMMEDIATE elsewhere
+            std::vector<Value> constants;  // CodeStream constants followed by the translator's own
+            size_t topLevelTemps;          // Temporaries of code outside functions, in locals[0..topLevelTemps)
+
+            RegisterCode() : topLevelTemps(0) {}
+        };
+
+    } // namespace VM
+} // namespace steve
+
+#endif // STEVE_VM_REGISTER_H
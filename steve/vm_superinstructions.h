@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STEVE_VM_SUPERINSTRUCTIONS_H
+#define STEVE_VM_SUPERINSTRUCTIONS_H
+#include "vm.h"
+
+namespace steve {
+    namespace VM {
+
+        // Instruction sequence replaced by one superinstruction at load time
+        struct SuperinstructionPattern {
+            InstructionType fused;
+            size_t length;
+            InstructionType sequence[4];
+            uint64_t weight;  // Dispatches the pattern saved in the profile, executions * (length - 1)
+        };
+
+        // Patterns tried by VirtualMachine::fuseSuperinstructions. The first match wins, so longer
+        // patterns come first and patterns of equal length are ordered by weight; a pattern with
+        // weight 0 is never fused. INC_VAR is not listed, it is the same-slot ADD case of
+        // VAR_CONST_OP_STORE.
+        //
+        // Weights are regenerated from a profiling build of the dispatch benchmark:
+        //   g++ -O2 -std=c++20 -DSTEVE_PROFILE_OPCODES=1 bench_dispatch.cpp <VM sources> -o bench_profile
+        //   ./bench_profile --profile [program.sir ...]
+        // which prints the most frequent straight-line sequences in this format. A new pattern also
+        // needs an InstructionType, a handler in VirtualMachine::dispatch, a superinstructionHead case,
+        // a superinstructionLength case and, if it can fail, a faultingPc case.
+        inline constexpr SuperinstructionPattern SUPERINSTRUCTION_PATTERNS[] = {
+            { InstructionType::VAR_CONST_OP_STORE, 4,
+              { InstructionType::LOAD_SLOT, InstructionType::LOAD_CONST, InstructionType::BINARY_OP, InstructionType::STORE_SLOT }, 18003000 },
+            { InstructionType::CMP_VAR_CONST_JUMP_IF_FALSE, 4,
+              { InstructionType::LOAD_SLOT, InstructionType::LOAD_CONST, InstructionType::BINARY_OP, InstructionType::WHILE }, 9006006 },
+            { InstructionType::CMP_VAR_CONST_JUMP_IF_FALSE, 4,
+              { InstructionType::LOAD_SLOT, InstructionType::LOAD_CONST, InstructionType::BINARY_OP, InstructionType::IF }, 8994879 },
+            { InstructionType::VAR_CONST_OP, 3,
+              { InstructionType::LOAD_SLOT, InstructionType::LOAD_CONST, InstructionType::BINARY_OP }, 27998170 },
+            { InstructionType::CMP_CONST_JUMP_IF_FALSE, 3,
+              { InstructionType::LOAD_CONST, InstructionType::BINARY_OP, InstructionType::IF }, 7996586 },
+            { InstructionType::CMP_CONST_JUMP_IF_FALSE, 3,
+              { InstructionType::LOAD_CONST, InstructionType::BINARY_OP, InstructionType::WHILE }, 6004004 },
+            { InstructionType::VAR_VAR_OP, 3,
+              { InstructionType::LOAD_SLOT, InstructionType::LOAD_SLOT, InstructionType::BINARY_OP }, 4000000 },
+            { InstructionType::CONST_STORE, 2,
+              { InstructionType::LOAD_CONST, InstructionType::STORE_SLOT }, 1004 },
+        };
+
+        // First instruction of the sequence a superinstruction replaced, any other type is returned as is
+        inline InstructionType superinstructionHead(InstructionType type) {
+            switch (type) {
+            case InstructionType::INC_VAR:
+            case InstructionType::VAR_CONST_OP_STORE:
+            case InstructionType::CMP_VAR_CONST_JUMP_IF_FALSE:
+            case InstructionType::VAR_CONST_OP:
+            case InstructionType::VAR_VAR_OP:
+                return InstructionType::LOAD_SLOT;
+            case InstructionType::CMP_CONST_JUMP_IF_FALSE:
+            case InstructionType::CONST_STORE:
+                return InstructionType::LOAD_CONST;
+            default:
+                return type;
+            }
+        }
+
+        // Instructions a superinstruction covers, 1 for any other type
+        inline size_t superinstructionLength(InstructionType type) {
+            switch (type) {
+            case InstructionType::INC_VAR:
+            case InstructionType::VAR_CONST_OP_STORE:
+            case InstructionType::CMP_VAR_CONST_JUMP_IF_FALSE:
+                return 4;
+            case InstructionType::CMP_CONST_JUMP_IF_FALSE:
+            case InstructionType::VAR_CONST_OP:
+            case InstructionType::VAR_VAR_OP:
+                return 3;
+            case InstructionType::CONST_STORE:
+                return 2;
+            default:
+                return 1;
+            }
+        }
+
+        // Instruction whose runtime errors the superinstruction at pc raises (its BINARY_OP), reported
+        // as the faulting pc like without fusion; pc itself for any other instruction
+        inline size_t faultingPc(const CodeStream& code, size_t pc) {
+            if (pc >= code.size()) {
+                return pc;
+            }
+            switch (code.opcodes[pc]) {
+            case InstructionType::INC_VAR:
+            case InstructionType::VAR_CONST_OP_STORE:
+            case InstructionType::CMP_VAR_CONST_JUMP_IF_FALSE:
+            case InstructionType::VAR_CONST_OP:
+            case InstructionType::VAR_VAR_OP:
+                return pc + 2;
+            case InstructionType::CMP_CONST_JUMP_IF_FALSE:
+                return pc + 1;
+            default:
+                return pc; // CONST_STORE cannot fail
+            }
+        }
+
+        // Mnemonic of an instruction type, for profiles and diagnostics
+        inline const char* instructionTypeName(InstructionType type) {
+            static const char* const names[] = {
+                "DEFVAR", "LOAD", "STORE", "FUNC", "CALL", "IF", "ELSE", "END", "WHILE", "DO", "RETURN",
+                "IMPORT", "PRINT", "INPUT", "BINARY_OP", "UNARY_OP", "PUSH", "POP", "GOTO", "LABEL",
+                "GC_NEW", "GC_DELETE", "GC_RUN", "MEM_MALLOC", "MEM_FREE", "TRY", "CATCH", "BREAK",
+                "CONTINUE", "PASS", "PACKAGE", "PTR_NEW", "PTR_DEREF", "THROW", "NOP", "DEBUG",
+                "LOAD_CONST", "LOAD_VAR", "DEFVAR_SLOT", "LOAD_SLOT", "STORE_SLOT",
+                "INC_VAR", "VAR_CONST_OP_STORE", "CMP_VAR_CONST_JUMP_IF_FALSE", "CMP_CONST_JUMP_IF_FALSE",
+                "VAR_CONST_OP", "VAR_VAR_OP", "CONST_STORE"
+            };
+            static_assert(sizeof(names) / sizeof(names[0]) == static_cast<size_t>(InstructionType::CONST_STORE) + 1,
+                "instructionTypeName must cover every InstructionType");
+            size_t index = static_cast<size_t>(type);
+            return index < sizeof(names) / sizeof(names[0]) ? names[index] : "UNKNOWN";
+        }
+
+    } // namespace VM
+} // namespace steve
+
+#endif // STEVE_VM_SUPERINSTRUCTIONS_H
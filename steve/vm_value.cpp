@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "vm_value.h"
+
+namespace steve {
+    namespace VM {
+
+        // Concatenations shorter than this are copied right away
+        constexpr size_t ROPE_MIN_LENGTH = 64;
+
+        // A rope whose right leaf is shorter than this is extended by copying the leaf instead of
+        // adding a node, so appending small pieces in a loop leaves one node per ROPE_LEAF_LENGTH bytes
+        constexpr size_t ROPE_LEAF_LENGTH = 256;
+
+        Value Value::concat(const Value& left, const Value& right) {
+            size_t leftLength = left.stringLength();
+            size_t rightLength = right.stringLength();
+            if (rightLength == 0) {
+                return left;
+            }
+            if (leftLength == 0) {
+                return right;
+            }
+            if (leftLength + rightLength < ROPE_MIN_LENGTH) {
+                return Value(left.get<std::string>() + right.get<std::string>());
+            }
+            if (left.isObject(ObjectKind::ROPE)) {
+                const RopeValue& rope = left.rope();
+                if (!rope.flattened && rope.right.stringLength() + rightLength <= ROPE_LEAF_LENGTH) {
+                    return Value(RopeValue(rope.left, Value(rope.right.get<std::string>() + right.get<std::string>())));
+                }
+            }
+            return Value(RopeValue(left, right));
+        }
+
+        const std::string& Value::flatten() const {
+            // Flattening caches the text without changing it, so the payload is updated in place
+            RopeValue& rope = static_cast<BoxedObject<RopeValue>*>(object())->value;
+            if (!rope.flattened) {
+                std::string text;
+                text.reserve(rope.length);
+                // Left to right with an explicit stack, a rope built by appending in a loop is as deep as it is long
+                std::vector<const Value*> pending = { &rope.right, &rope.left };
+                while (!pending.empty()) {
+                    const Value* piece = pending.back();
+                    pending.pop_back();
+                    if (piece->isObject(ObjectKind::ROPE) && !piece->rope().flattened) {
+                        pending.push_back(&piece->rope().right);
+                        pending.push_back(&piece->rope().left);
+                    }
+                    else {
+                        text += piece->get<std::string>();
+                    }
+                }
+                rope.flat = std::move(text);
+                rope.flattened = true;
+                rope.left = Value();
+                rope.right = Value();
+            }
+            return rope.flat;
+        }
+
+        void Value::destroyRope(HeapObject* object) {
+            // Iterative for the same reason as flatten(), only rope children are unlinked here
+            std::vector<HeapObject*> pending = { object };
+            while (!pending.empty()) {
+                auto* rope = static_cast<BoxedObject<RopeValue>*>(pending.back());
+                pending.pop_back();
+                for (Value* child : { &rope->value.left, &rope->value.right }) {
+                    if (child->isObject(ObjectKind::ROPE)) {
+                        HeapObject* node = child->object();
+                        child->bits = box(TAG_INT, 0);
+                        if (--node->refCount == 0) {
+                            pending.push_back(node);
+                        }
+                    }
+                }
+                delete rope;
+            }
+        }
+
+    } // namespace VM
+} // namespace steve
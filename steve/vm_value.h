@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STEVE_VM_VALUE_H
+#define STEVE_VM_VALUE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace steve {
+    namespace VM {
+
+        struct PointerValue;
+        class ListValue;
+        struct DictValue;
+        struct RopeValue;
+        class InternTable;
+
+        // Id of a string in the VM's InternTable (vm_intern.h)
+        using SymbolId = uint32_t;
+        constexpr SymbolId NO_SYMBOL = 0xFFFFFFFFu;
+
+        // Kind of a heap-allocated Value payload
+        enum class ObjectKind : uint8_t {
+            STRING,
+            POINTER,
+            LIST,
+            DICT,
+            INT64,      // int64_t too wide for the inline 48-bit payload
+            ROPE        // String concatenation deferred until the text is read, see RopeValue
+        };
+
+        // Header shared by every heap payload, reference counted by Value
+        struct HeapObject {
+            uint32_t refCount;
+            ObjectKind kind;
+            bool interned;  // String owned by an InternTable, equal interned strings share one payload
+
+            explicit HeapObject(ObjectKind k) : refCount(1), kind(k), interned(false) {}
+        };
+
+        template <typename T>
+        struct BoxedObject : HeapObject {
+            T value;
+
+            template <typename... Args>
+            explicit BoxedObject(ObjectKind k, Args&&... args) : HeapObject(k), value(std::forward<Args>(args)...) {}
+        };
+
+        // 8-byte NaN-boxed value.
+        //
+        // Doubles are stored as their IEEE-754 bits. Every other kind lives in the negative
+        // quiet-NaN space, with a 3-bit tag in bits 48..50 and a 48-bit payload:
+        //   INT     int in the low 32 bits
+        //   INT64   int64_t that fits in 48 bits, sign-extended on read (wider ones are boxed)
+        //   BOOL    0 or 1
+        //   NUL     no payload
+        //   OBJECT  HeapObject* of a string, rope, pointer, list, dict or wide int64_t
+        // NaN doubles are canonicalized to 0x7FF8... so they never collide with a tag.
+        //
+        // Heap payloads are shared between copies and released with the last reference.
+        // Lists and dicts are copy-on-write: mutate<T>() copies a shared payload before handing
+        // out a mutable reference, nothing else is mutated through a Value, so copies keep value
+        // semantics. Two interned strings are equal exactly when they share a payload. A rope is
+        // a string to everything but concat() and stringLength(), get<std::string>() flattens it
+        // on first use.
+        class Value {
+        public:
+            // Alternative indices, in the order of the std::variant this type replaced
+            enum Index : uint8_t {
+                INT_INDEX,
+                DOUBLE_INDEX,
+                BOOL_INDEX,
+                STRING_INDEX,
+                NULL_INDEX,
+                INT64_INDEX,
+                POINTER_INDEX,
+                LIST_INDEX,
+                DICT_INDEX,
+                INDEX_COUNT
+            };
+
+            Value() : bits(box(TAG_INT, 0)) {}
+            Value(int v) : bits(box(TAG_INT, static_cast<uint32_t>(v))) {}
+            Value(double v) : bits(doubleBits(v)) {}
+            Value(bool v) : bits(box(TAG_BOOL, v ? 1 : 0)) {}
+            Value(std::nullptr_t) : bits(box(TAG_NULL, 0)) {}
+            Value(int64_t v) : bits(int64Bits(v)) {}
+
+            // Remaining integer types follow the old variant conversions:
+            // narrower than or as wide as int becomes int, anything wider becomes int64_t
+            template <typename T, typename std::enable_if<std::is_integral<T>::value &&
+                !std::is_same<T, bool>::value && !std::is_same<T, int>::value && !std::is_same<T, int64_t>::value, int>::type = 0>
+            Value(T v) : bits(sizeof(T) < sizeof(int) || (sizeof(T) == sizeof(int) && std::is_signed<T>::value)
+                ? box(TAG_INT, static_cast<uint32_t>(static_cast<int>(v))) : int64Bits(static_cast<int64_t>(v))) {}
+
+            Value(const char* v);
+            Value(const std::string& v);
+            Value(std::string&& v);
+            Value(const PointerValue& v);
+            Value(const ListValue& v);
+            Value(ListValue&& v);
+            Value(const DictValue& v);
+            Value(DictValue&& v);
+
+            // String concatenation. Long results are ropes, so appending in a loop copies each
+            // piece about once instead of the whole string every time (vm_value.cpp)
+            static Value concat(const Value& left, const Value& right);
+
+            // Length of a string or rope, without flattening the rope
+            size_t stringLength() const;
+
+            Value(const Value& other) : bits(other.bits) { retain(); }
+            Value(Value&& other) noexcept : bits(other.bits) { other.bits = box(TAG_INT, 0); }
+            ~Value() { release(); }
+
+            Value& operator=(const Value& other) {
+                other.retain();
+                release();
+                bits = other.bits;
+                return *this;
+            }
+
+            Value& operator=(Value&& other) noexcept {
+                if (this != &other) {
+                    release();
+                    bits = other.bits;
+                    other.bits = box(TAG_INT, 0);
+                }
+                return *this;
+            }
+
+            // Variant-style type test, e.g. value.is<int>()
+            template <typename T>
+            bool is() const {
+                if constexpr (std::is_same<T, int>::value) return tag() == TAG_INT;
+                else if constexpr (std::is_same<T, double>::value) return bits < BOX_LIMIT;
+                else if constexpr (std::is_same<T, bool>::value) return tag() == TAG_BOOL;
+                else if constexpr (std::is_same<T, std::nullptr_t>::value) return tag() == TAG_NULL;
+                else if constexpr (std::is_same<T, int64_t>::value) return tag() == TAG_INT64 || isObject(ObjectKind::INT64);
+                else if constexpr (std::is_same<T, std::string>::value) {
+                    return isObject() && (object()->kind == ObjectKind::STRING || object()->kind == ObjectKind::ROPE);
+                }
+                else return isObject(objectKindOf<T>());
+            }
+
+            // Variant-style access, e.g. value.get<int>(). Scalars are returned by value,
+            // heap payloads by const reference. Throws std::runtime_error on a type mismatch.
+            template <typename T>
+            decltype(auto) get() const {
+                if (!is<T>()) {
+                    typeMismatch();
+                }
+                if constexpr (std::is_same<T, int>::value) {
+                    return static_cast<int>(static_cast<uint32_t>(bits));
+                }
+                else if constexpr (std::is_same<T, double>::value) {
+                    double v;
+                    std::memcpy(&v, &bits, sizeof(v));
+                    return v;
+                }
+                else if constexpr (std::is_same<T, bool>::value) {
+                    return (bits & 1) != 0;
+                }
+                else if constexpr (std::is_same<T, std::nullptr_t>::value) {
+                    return nullptr;
+                }
+                else if constexpr (std::is_same<T, int64_t>::value) {
+                    if (tag() == TAG_INT64) {
+                        // Sign-extend the 48-bit payload
+                        return static_cast<int64_t>(bits << 16) >> 16;
+                    }
+                    return static_cast<const BoxedObject<int64_t>*>(object())->value;
+                }
+                else if constexpr (std::is_same<T, std::string>::value) {
+                    if (object()->kind == ObjectKind::ROPE) {
+                        return flatten();
+                    }
+                    return (static_cast<const BoxedObject<std::string>*>(object())->value);
+                }
+                else {
+                    return (static_cast<const BoxedObject<T>*>(object())->value);
+                }
+            }
+
+            // Mutable list or dict payload, copied first unless this Value is its only owner
+            template <typename T>
+            T& mutate() {
+                static_assert(std::is_same<T, ListValue>::value || std::is_same<T, DictValue>::value,
+                    "Only lists and dicts are copy-on-write");
+                if (!is<T>()) {
+                    typeMismatch();
+                }
+                if (object()->refCount > 1) {
+                    *this = Value(get<T>());
+                }
+                return static_cast<BoxedObject<T>*>(object())->value;
+            }
+
+            // Both Values hold the same heap payload
+            bool sharesPayload(const Value& other) const { return bits == other.bits && isObject(); }
+
+            // Alternative index, compatible with the old std::variant::index()
+            size_t index() const;
+
+            bool operator==(const Value& other) const;
+            bool operator!=(const Value& other) const { return !(*this == other); }
+
+        private:
+            static constexpr uint64_t BOX_BASE = 0xFFF8000000000000ULL;
+            static constexpr uint64_t BOX_LIMIT = 0xFFF9000000000000ULL;   // Bits below this are doubles
+            static constexpr uint64_t PAYLOAD_MASK = 0x0000FFFFFFFFFFFFULL;
+            static constexpr uint64_t CANONICAL_NAN = 0x7FF8000000000000ULL;
+            static constexpr int64_t INLINE_INT64_MIN = -(static_cast<int64_t>(1) << 47);
+            static constexpr int64_t INLINE_INT64_MAX = (static_cast<int64_t>(1) << 47) - 1;
+
+            enum Tag : uint64_t {
+                TAG_DOUBLE = 0,
+                TAG_INT,
+                TAG_INT64,
+                TAG_BOOL,
+                TAG_NULL,
+                TAG_OBJECT
+            };
+
+            uint64_t bits;
+
+            static constexpr uint64_t box(uint64_t tag, uint64_t payload) {
+                return BOX_BASE | (tag << 48) | (payload & PAYLOAD_MASK);
+            }
+
+            static uint64_t doubleBits(double v) {
+                if (v != v) {
+                    return CANONICAL_NAN;
+                }
+                uint64_t b;
+                std::memcpy(&b, &v, sizeof(b));
+                return b;
+            }
+
+            static uint64_t int64Bits(int64_t v) {
+                if (v >= INLINE_INT64_MIN && v <= INLINE_INT64_MAX) {
+                    return box(TAG_INT64, static_cast<uint64_t>(v));
+                }
+                return objectBits(new BoxedObject<int64_t>(ObjectKind::INT64, v));
+            }
+
+            static uint64_t objectBits(HeapObject* object) {
+                return box(TAG_OBJECT, reinterpret_cast<uintptr_t>(object));
+            }
+
+            template <typename T>
+            static constexpr ObjectKind objectKindOf() {
+                if constexpr (std::is_same<T, std::string>::value) return ObjectKind::STRING;
+                else if constexpr (std::is_same<T, PointerValue>::value) return ObjectKind::POINTER;
+                else if constexpr (std::is_same<T, ListValue>::value) return ObjectKind::LIST;
+                else {
+                    static_assert(std::is_same<T, DictValue>::value, "Unsupported Value alternative");
+                    return ObjectKind::DICT;
+                }
+            }
+
+            uint64_t tag() const { return bits < BOX_LIMIT ? TAG_DOUBLE : (bits >> 48) & 0x7; }
+            HeapObject* object() const { return reinterpret_cast<HeapObject*>(static_cast<uintptr_t>(bits & PAYLOAD_MASK)); }
+            bool isObject() const { return bits >= BOX_LIMIT && ((bits >> 48) & 0x7) == TAG_OBJECT; }
+            bool isObject(ObjectKind kind) const { return isObject() && object()->kind == kind; }
+
+            void retain() const {
+                if (isObject()) {
+                    object()->refCount++;
+                }
+            }
+
+            void release() {
+                if (isObject() && --object()->refCount == 0) {
+                    destroy(object());
+                }
+            }
+
+            // Flag a fresh string payload as owned by an InternTable
+            void markInterned() { object()->interned = true; }
+            friend class InternTable;
+
+            // Optimized JIT code tests and builds the encoding above inline
+            friend class JITCompiler;
+
+            explicit Value(RopeValue&& rope);
+            const RopeValue& rope() const;
+            const std::string& flatten() const;
+
+            static void destroy(HeapObject* object);
+            static void destroyRope(HeapObject* object);
+            [[noreturn]] static void typeMismatch() { throw std::runtime_error("Value type mismatch"); }
+        };
+
+        static_assert(sizeof(Value) == 8, "Value must stay 8 bytes");
+
+        // Memory-managed object structure for pointer system
+        struct ManagedObject {
+            void* data;
+            SymbolId type;  // Interned type name
+            size_t size;
+            bool marked;  // For garbage collection
+
+            ManagedObject(void* d, SymbolId t, size_t s)
+                : data(d), type(t), size(s), marked(false) {}
+
+            ~ManagedObject() {
+                if (data) {
+                    std::free(data);  // Free the data
+                    data = nullptr;
+                }
+            }
+        };
+
+        // Pointer structure definition
+        struct PointerValue {
+            ManagedObject* obj;  // Pointer to managed object
+            void* ptr;           // Raw pointer value
+            SymbolId type;       // Interned name of the type of object being pointed to, NO_SYMBOL if untyped
+            bool isNull;
+            bool isWeak;         // Whether this is a weak pointer
+            bool isRef;          // Whether this is a reference (cannot be null)
+
+            PointerValue() : obj(nullptr), ptr(nullptr), type(NO_SYMBOL), isNull(true), isWeak(false), isRef(false) {}
+            PointerValue(ManagedObject* o, SymbolId t, bool weak = false, bool ref = false)
+                : obj(o), ptr(o ? o->data : nullptr), type(t), isNull(o == nullptr), isWeak(weak), isRef(ref) {}
+            PointerValue(void* p, SymbolId t, bool weak = false, bool ref = false)
+                : obj(nullptr), ptr(p), type(t), isNull(p == nullptr), isWeak(weak), isRef(ref) {}
+
+            void* getPointer() const {
+                return obj ? obj->data : ptr;
+            }
+
+            SymbolId getObjectType() const {
+                return obj ? obj->type : type;
+            }
+
+            bool operator==(const PointerValue& other) const { return getPointer() == other.getPointer(); }
+        };
+
+        // List/Array structure definition (vm_list.cpp).
+        //
+        // A list whose elements are all ints, all doubles or all bools keeps them unboxed in a
+        // typed store, so the bulk list built-ins run over plain arrays (vm_list.h). Storing an
+        // element of another kind converts the list to generic Values for good. Elements read back
+        // as the Values that were stored: the int store is int64_t and remembers which elements
+        // were int64_t rather than int.
+        class ListValue {
+        public:
+            enum class Storage : uint8_t {
+                EMPTY,      // No elements yet, the first one picks the store
+                INT,        // ints, bits marks the int64_t elements
+                DOUBLE,     // doubles
+                BOOL,       // bits, one per element
+                GENERIC     // items
+            };
+
+            ListValue() : storage(Storage::EMPTY), count(0) {}
+            ListValue(const std::vector<Value>& v);
+
+            Storage kind() const { return storage; }
+            size_t size() const { return count; }
+            bool empty() const { return count == 0; }
+
+            Value at(size_t i) const;
+            void push(const Value& value);
+            void append(const ListValue& other);
+
+            // Replace every element with value, keeping the length
+            void fill(const Value& value);
+
+            // Typed stores, valid for the matching kind(). Unused bits of the last word are zero.
+            const std::vector<int64_t>& intStore() const { return ints; }
+            const std::vector<double>& doubleStore() const { return doubles; }
+            const std::vector<uint64_t>& bitStore() const { return bits; }
+            bool bit(size_t i) const { return (bits[i / 64] >> (i % 64)) & 1; }
+
+            // Lists built by the kernels, every int element is int64_t when wide is set and int otherwise
+            static ListValue fromInts(std::vector<int64_t>&& values, bool wide);
+            static ListValue fromDoubles(std::vector<double>&& values);
+
+            bool operator==(const ListValue& other) const;
+
+        private:
+            Storage storage;
+            size_t count;
+            std::vector<int64_t> ints;
+            std::vector<double> doubles;
+            std::vector<uint64_t> bits;
+            std::vector<Value> items;
+
+            void pushBit(bool set);
+            void toGeneric();
+        };
+
+        // FNV-1a string hash, shared by InternTable and DictValue
+        inline size_t hashString(std::string_view text) {
+            uint64_t hash = 0xCBF29CE484222325ULL;
+            for (unsigned char c : text) {
+                hash ^= c;
+                hash *= 0x100000001B3ULL;
+            }
+            return static_cast<size_t>(hash);
+        }
+
+        // Insertion-ordered dictionary with int and string keys (vm_dict.cpp).
+        //
+        // Entries live in a dense array in insertion order, so iteration is deterministic and never
+        // touches the index. The index is an open-addressing table in the SwissTable layout: a control
+        // byte per bucket (empty, deleted, or the low 7 bits of the entry's hash) next to the entry
+        // number, probed a group of 16 control bytes at a time (with SSE2 where available). Hashes
+        // are cached in the entries, so growing the index never rehashes a key.
+        struct DictValue {
+            struct Entry {
+                Value key;    // int or string, null once erased
+                Value value;
+                size_t hash;
+            };
+
+            DictValue() : liveCount(0) {}
+
+            // Keys are ints (int or int64_t, equal numbers are the same key) and strings
+            static bool isKey(const Value& key);
+
+            size_t size() const { return liveCount; }
+            bool empty() const { return liveCount == 0; }
+
+            // Value stored under key, or nullptr
+            const Value* find(const Value& key) const;
+            Value* find(const Value& key) { return const_cast<Value*>(static_cast<const DictValue*>(this)->find(key)); }
+
+            // Insert or replace. Returns false, leaving the dictionary unchanged, if key is not an int or string
+            bool set(const Value& key, const Value& value);
+
+            // Remove key, returns false if it was not present
+            bool erase(const Value& key);
+
+            // Call f(key, value) for every entry in insertion order
+            template <typename F>
+            void forEach(F f) const {
+                for (const Entry& entry : entries) {
+                    if (!entry.key.is<std::nullptr_t>()) {
+                        f(entry.key, entry.value);
+                    }
+                }
+            }
+
+            // Same keys mapped to equal values, in any order
+            bool operator==(const DictValue& other) const;
+
+        private:
+            // 16 buckets probed together, control bytes next to entry numbers so a probe touches one place
+            struct Group {
+                int8_t control[16];    // DICT_EMPTY, DICT_DELETED or the hash tag
+                uint32_t entry[16];    // Index into entries
+            };
+
+            std::vector<Entry> entries;    // Insertion order, erased entries stay until the next rebuild
+            std::vector<Group> groups;     // Power-of-two count, bucket b is groups[b / 16] slot b % 16
+            size_t liveCount;
+
+            size_t findBucket(const Value& key, size_t hash) const;  // Bucket holding key, or SIZE_MAX
+            size_t freeBucket(size_t hash) const;                    // First empty or deleted bucket on the probe path
+            size_t entryAt(size_t bucket) const { return groups[bucket / 16].entry[bucket % 16]; }
+            void fill(size_t bucket, size_t hash, size_t entry);
+            void rebuild(size_t minEntries);
+        };
+
+        // Deferred concatenation of two strings, built by Value::concat. The first read of the text
+        // flattens the rope: the text is cached in flat and the children are released, so later
+        // reads cost the same as a plain string. The text itself never changes.
+        struct RopeValue {
+            Value left;    // String or rope, released once flattened
+            Value right;
+            size_t length;
+            std::string flat;
+            bool flattened;
+
+            RopeValue(const Value& l, const Value& r) : left(l), right(r), length(l.stringLength() + r.stringLength()), flattened(false) {}
+        };
+
+        inline Value::Value(const char* v) : bits(objectBits(new BoxedObject<std::string>(ObjectKind::STRING, v))) {}
+        inline Value::Value(const std::string& v) : bits(objectBits(new BoxedObject<std::string>(ObjectKind::STRING, v))) {}
+        inline Value::Value(std::string&& v) : bits(objectBits(new BoxedObject<std::string>(ObjectKind::STRING, std::move(v)))) {}
+        inline Value::Value(const PointerValue& v) : bits(objectBits(new BoxedObject<PointerValue>(ObjectKind::POINTER, v))) {}
+        inline Value::Value(const ListValue& v) : bits(objectBits(new BoxedObject<ListValue>(ObjectKind::LIST, v))) {}
+        inline Value::Value(ListValue&& v) : bits(objectBits(new BoxedObject<ListValue>(ObjectKind::LIST, std::move(v)))) {}
+        inline Value::Value(const DictValue& v) : bits(objectBits(new BoxedObject<DictValue>(ObjectKind::DICT, v))) {}
+        inline Value::Value(DictValue&& v) : bits(objectBits(new BoxedObject<DictValue>(ObjectKind::DICT, std::move(v)))) {}
+        inline Value::Value(RopeValue&& v) : bits(objectBits(new BoxedObject<RopeValue>(ObjectKind::ROPE, std::move(v)))) {}
+
+        inline const RopeValue& Value::rope() const {
+            return static_cast<const BoxedObject<RopeValue>*>(object())->value;
+        }
+
+        inline size_t Value::stringLength() const {
+            if (isObject(ObjectKind::ROPE)) {
+                return rope().length;
+            }
+            return get<std::string>().size();
+        }
+
+        inline void Value::destroy(HeapObject* object) {
+            switch (object->kind) {
+            case ObjectKind::STRING: delete static_cast<BoxedObject<std::string>*>(object); break;
+            case ObjectKind::POINTER: delete static_cast<BoxedObject<PointerValue>*>(object); break;
+            case ObjectKind::LIST: delete static_cast<BoxedObject<ListValue>*>(object); break;
+            case ObjectKind::DICT: delete static_cast<BoxedObject<DictValue>*>(object); break;
+            case ObjectKind::INT64: delete static_cast<BoxedObject<int64_t>*>(object); break;
+            case ObjectKind::ROPE: destroyRope(object); break;
+            }
+        }
+
+        inline size_t Value::index() const {
+            switch (tag()) {
+            case TAG_DOUBLE: return DOUBLE_INDEX;
+            case TAG_INT: return INT_INDEX;
+            case TAG_INT64: return INT64_INDEX;
+            case TAG_BOOL: return BOOL_INDEX;
+            case TAG_NULL: return NULL_INDEX;
+            default:
+                switch (object()->kind) {
+                case ObjectKind::STRING:
+                case ObjectKind::ROPE: return STRING_INDEX;
+                case ObjectKind::POINTER: return POINTER_INDEX;
+                case ObjectKind::LIST: return LIST_INDEX;
+                case ObjectKind::DICT: return DICT_INDEX;
+                default: return INT64_INDEX;
+                }
+            }
+        }
+
+        inline bool Value::operator==(const Value& other) const {
+            if (bits == other.bits) {
+                return !is<double>() || get<double>() == get<double>(); // NaN != NaN
+            }
+            size_t kind = index();
+            if (kind != other.index()) {
+                return false;
+            }
+            switch (kind) {
+            case DOUBLE_INDEX: return get<double>() == other.get<double>(); // 0.0 == -0.0
+            case INT64_INDEX: return get<int64_t>() == other.get<int64_t>();
+            case STRING_INDEX:
+                if (object()->interned && other.object()->interned) {
+                    return false; // Distinct interned payloads hold distinct strings
+                }
+                if (stringLength() != other.stringLength()) {
+                    return false; // Checked before a rope is flattened
+                }
+                return get<std::string>() == other.get<std::string>();
+            case POINTER_INDEX: return get<PointerValue>() == other.get<PointerValue>();
+            case LIST_INDEX: return get<ListValue>() == other.get<ListValue>();
+            case DICT_INDEX: return get<DictValue>() == other.get<DictValue>();
+            default: return false; // Inline scalars compare by bits
+            }
+        }
+
+    } // namespace VM
+} // namespace steve
+
+#endif // STEVE_VM_VALUE_H
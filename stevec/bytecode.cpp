@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "bytecode.h"
+#include "../steve/vm_bytecode.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+using namespace steve;
+
+namespace {
+
+namespace Bytecode = steve::VM::Bytecode;
+using Bytecode::Opcode;
+
+void writeU16(std::string& buf, uint16_t v) {
+    buf.push_back(static_cast<char>(v & 0xFF));
+    buf.push_back(static_cast<char>((v >> 8) & 0xFF));
+}
+
+void writeU32(std::string& buf, uint32_t v) {
+    for (int i = 0; i < 4; i++) buf.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+}
+
+} // namespace
+
+BytecodeWriter::BytecodeWriter() {}
+
+uint32_t BytecodeWriter::internConstant(const std::string& s) {
+    auto it = constantIndex.find(s);
+    if (it != constantIndex.end()) return it->second;
+    uint32_t index = static_cast<uint32_t>(constants.size());
+    constants.push_back(s);
+    constantIndex[s] = index;
+    return index;
+}
+
+void BytecodeWriter::emitInstruction(uint8_t opcode, const std::vector<std::string>& operands, int line) {
+    size_t argc = operands.size() > 255 ? 255 : operands.size();
+    code.push_back(opcode);
+    code.push_back(static_cast<uint8_t>(argc));
+    for (size_t i = 0; i < argc; i++) {
+        uint32_t index = internConstant(operands[i]);
+        for (int b = 0; b < 4; b++) code.push_back(static_cast<uint8_t>((index >> (b * 8)) & 0xFF));
+    }
+    lines.push_back(static_cast<uint32_t>(line));
+}
+
+bool BytecodeWriter::encode(const std::string& irCode, std::string& error) {
+    // Tokenization mirrors VirtualMachine::parseIR so both loaders see the same program
+    std::istringstream stream(irCode);
+    std::string line;
+    int lineNum = 0;
+    while (std::getline(stream, line)) {
+        lineNum++;
+        if (line.empty() || line[0] == ';') continue;
+        if (line.find("# IR BEGIN") != std::string::npos || line.find("IR END") != std::string::npos) continue;
+
+        size_t commentPos = line.find(';');
+        if (commentPos != std::string::npos) line = line.substr(0, commentPos);
+        line.erase(0, line.find_first_not_of(" \t\r\n"));
+        line.erase(line.find_last_not_of(" \t\r\n") + 1);
+        if (line.empty()) continue;
+
+        std::istringstream lineStream(line);
+        std::string instrName;
+        lineStream >> instrName;
+        if (instrName.empty()) continue;
+
+        // The VM would run an unknown mnemonic as a no-op, so the program cannot be encoded
+        Opcode opcode;
+        if (!Bytecode::opcodeFor(instrName, opcode)) {
+            error = "Unknown IR instruction '" + instrName + "' at line " + std::to_string(lineNum);
+            return false;
+        }
+
+        // LOAD/PUSH keep their quotes so the VM can tell string literals from names
+        bool keepQuotes = opcode == Opcode::LOAD || opcode == Opcode::PUSH;
+        std::vector<std::string> operands;
+        std::string operand;
+        while (lineStream >> operand) {
+            if (operand.length() >= 2 && operand.front() == '"' && operand.back() == '"') {
+                if (!keepQuotes) operand = operand.substr(1, operand.length() - 2);
+            } else if (!operand.empty() && operand.back() == ',') {
+                operand.pop_back();
+            }
+            operands.push_back(operand);
+        }
+        emitInstruction(static_cast<uint8_t>(opcode), operands, lineNum);
+    }
+    return true;
+}
+
+bool BytecodeWriter::write(const std::string& outputFile) const {
+    uint32_t constCount = static_cast<uint32_t>(constants.size());
+    uint32_t instrCount = static_cast<uint32_t>(lines.size());
+
+    std::string constData;
+    std::string constTable;
+    for (auto &c : constants) {
+        writeU32(constTable, static_cast<uint32_t>(constData.size()));
+        writeU32(constTable, static_cast<uint32_t>(c.size()));
+        constData += c;
+    }
+
+    uint32_t constTableOffset = static_cast<uint32_t>(sizeof(Bytecode::StbHeader));
+    uint32_t constDataOffset = constTableOffset + static_cast<uint32_t>(constTable.size());
+    uint32_t codeOffset = constDataOffset + static_cast<uint32_t>(constData.size());
+    uint32_t codeSize = static_cast<uint32_t>(code.size());
+    uint32_t lineTableOffset = codeOffset + codeSize;
+
+    std::string image;
+    image.append(Bytecode::MAGIC, sizeof(Bytecode::MAGIC));
+    writeU16(image, Bytecode::VERSION);
+    writeU16(image, 0); // flags
+    writeU32(image, constCount);
+    writeU32(image, instrCount);
+    writeU32(image, constTableOffset);
+    writeU32(image, constDataOffset);
+    writeU32(image, codeOffset);
+    writeU32(image, codeSize);
+    writeU32(image, lineTableOffset);
+    image += constTable;
+    image += constData;
+    image.append(reinterpret_cast<const char*>(code.data()), code.size());
+    for (uint32_t l : lines) writeU32(image, l);
+
+    std::ofstream out(outputFile, std::ios::binary);
+    if (!out) return false;
+    out.write(image.data(), static_cast<std::streamsize>(image.size()));
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2024 Kekun Su(苏科纶).
+ *
+ * Refer to the LICENSE file for full license information.
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef STEVE_BYTECODE_H
+#define STEVE_BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace steve {
+
+// Binary bytecode container (.stb) consumed by the steve VM.
+// The layout, opcodes and mnemonics come from steve/vm_bytecode.h:
+//   header, constant table { offset, length }, constant data,
+//   code { uint8 opcode, uint8 argc, argc x uint32 constant index }, line table (uint32 per instruction)
+class BytecodeWriter {
+public:
+    BytecodeWriter();
+
+    // Encode text IR (as produced by CodeGen) into the binary container.
+    // Returns false and fills error at the first line the VM has no instruction for.
+    bool encode(const std::string& irCode, std::string& error);
+
+    // Write the encoded container, returns false if the file cannot be written
+    bool write(const std::string& outputFile) const;
+
+    size_t instructionCount() const { return lines.size(); }
+
+private:
+    std::vector<std::string> constants;
+    std::unordered_map<std::string, uint32_t> constantIndex;
+    std::vector<uint8_t> code;
+    std::vector<uint32_t> lines;
+
+    uint32_t internConstant(const std::string& s);
+    void emitInstruction(uint8_t opcode, const std::vector<std::string>& operands, int line);
+};
+
+} // namespace steve
+
+#endif // STEVE_BYTECODE_H
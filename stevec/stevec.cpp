@@ -14,6 +14,7 @@
 #include "sema.h"
 #include "codegen.h"
 #include "backend.h"  // Include backend code generator
+#include "bytecode.h"  // Binary bytecode for the VM
 #include "language.h"
 #include "gc.h"  // Include garbage collector
 using namespace std;
@@ -64,6 +65,28 @@ int main(int argc, char** argv) {
     // Use backend code generator to generate assembly code and save to .ste file
     steve::Backend::CodeGenerator backend;
     backend.generate(prog.get(), outputFileName);
+
+    // Emit the VM program: text IR (.sir) for debugging and binary bytecode (.stb) for fast loading
+    std::string baseName = inputFileName.substr(0, inputFileName.find_last_of('.'));
+    std::ostringstream ir;
+    steve::CodeGen codegen(ir);
+    codegen.generate(prog.get());
+
+    std::ofstream irOut(baseName + ".sir", ios::binary);
+    if (irOut) irOut << ir.str();
+    else cerr << "Error: Could not open output file: " << baseName << ".sir" << endl;
+
+    steve::BytecodeWriter bytecode;
+    std::string bytecodeError;
+    if (!bytecode.encode(ir.str(), bytecodeError)) {
+        cerr << "Error: Cannot encode " << baseName << ".stb: " << bytecodeError << endl;
+        steve::cleanupGC();
+        return 1;
+    }
+    if (!bytecode.write(baseName + ".stb")) {
+        cerr << "Error: Could not open output file: " << baseName << ".stb" << endl;
+    }
+
     steve::cleanupGC();  // Cleanup garbage collector
     return 0;
 